@@ -0,0 +1,105 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Server driven by `make bench`, built from the release objects:
+ * -      GET /        a short text body.
+ * -      GET /large   1 MB.
+ * -      POST /upload the body is streamed and discarded.
+ * Usage: bench_server [port], the backend comes from LIGHTNING_BACKEND.
+ */
+
+#include <lightning.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_LARGE_SIZE (1024 * 1024)
+
+static const char hello[] = "Hello, World!";
+static char *large;
+
+static void get_root(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data);
+static void get_large(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data);
+static int upload_body(struct lightning_http_request *request, const void *data, size_t length, void *user_data);
+static void upload_done(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data);
+
+int main(int argc, char **argv)
+{
+  unsigned short port = argc > 1 ? (unsigned short)atoi(argv[1]) : 8080;
+
+  large = malloc(BENCH_LARGE_SIZE);
+  if(large == NULL)
+  {
+    fprintf(stderr, "Error: can't allocate memory for the large body\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(large, 'x', BENCH_LARGE_SIZE);
+
+  struct lightning_application *app = lightning_new_application(port);
+  if(app == NULL)
+  {
+    fprintf(stderr, "Error: can't create the application\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if(lightning_route(app, HTTP_GET, "/", get_root, NULL) != 0 ||
+     lightning_route(app, HTTP_GET, "/large", get_large, NULL) != 0 ||
+     lightning_route_stream(app, HTTP_POST, "/upload", upload_body, upload_done, NULL) != 0 ||
+     lightning_set_body_limits(app, 1024 * 1024 * 1024, 64 * 1024) != 0)
+  {
+    fprintf(stderr, "Error: can't register the routes\n");
+    exit(EXIT_FAILURE);
+  }
+
+  lightning_ride(app);
+  lightning_destroy(app);
+  free(large);
+  return 0;
+}
+
+static void get_root(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data)
+{
+  (void)request;
+  (void)user_data;
+  lightning_response_body(response, "text/plain", hello, sizeof(hello) - 1);
+}
+
+static void get_large(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data)
+{
+  (void)request;
+  (void)user_data;
+  lightning_response_body(response, "application/octet-stream", large, BENCH_LARGE_SIZE);
+}
+
+static int upload_body(struct lightning_http_request *request, const void *data, size_t length, void *user_data)
+{
+  (void)request;
+  (void)data;
+  (void)length;
+  (void)user_data;
+  return 0;
+}
+
+static void upload_done(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data)
+{
+  (void)request;
+  (void)user_data;
+  lightning_response_status(response, 201);
+  lightning_response_body(response, "text/plain", "stored", 6);
+}
@@ -0,0 +1,687 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * HTTP/1.1 load generator for `make bench`: one epoll loop per thread, each
+ * driving its share of the connections. Latency is measured from the moment
+ * a request is queued on its connection until its response is complete, so
+ * with pipelining it includes the wait behind the requests before it. The
+ * result is one JSON object on stdout.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "internal/metrics.h"
+
+#define BENCH_MAX_PIPELINE 256
+#define BENCH_HEADER_SIZE 8192
+#define BENCH_READ_SIZE (256 * 1024)
+#define BENCH_MAX_EVENTS 256
+// A slow client sends one byte of its request per interval.
+#define BENCH_SLOW_INTERVAL_MS 10
+
+struct bench_options
+{
+  const char *name;
+  const char *host;
+  unsigned short port;
+  int threads;
+  int connections;
+  int slow_connections;
+  int pipeline;
+  double duration;
+  const char *method;
+  const char *path;
+  size_t body_size;
+  // Connection: close on every request, a new connection for the next one.
+  bool churn;
+};
+
+struct bench_connection
+{
+  int fd;
+  bool slow;
+  bool connecting;
+  // Requests queued and not written yet, and how much of the first one is.
+  int unsent;
+  size_t offset;
+  // Queue times of the requests in flight, oldest at `first`.
+  uint64_t queued_ns[BENCH_MAX_PIPELINE];
+  int first;
+  int in_flight;
+  uint64_t next_byte_ns;
+  // Response being read.
+  char header[BENCH_HEADER_SIZE];
+  size_t header_length;
+  size_t body_remaining;
+  bool in_body;
+  int status;
+};
+
+struct bench_thread
+{
+  const struct bench_options *options;
+  pthread_t id;
+  int connections;
+  int slow_connections;
+  uint64_t end_ns;
+  uint64_t requests;
+  uint64_t slow_requests;
+  uint64_t errors;
+  uint64_t connects;
+  uint64_t bytes;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[LIGHTNING_HISTOGRAM_BUCKETS];
+};
+
+static struct sockaddr_storage bench_address;
+static socklen_t bench_address_length;
+static char *bench_request;
+static size_t bench_request_length;
+
+static void *run_thread(void *data);
+static int open_connection(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn);
+static void close_connection(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn, bool failed);
+static int send_requests(struct bench_connection *conn, uint64_t now_ns);
+static int read_responses(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn, char *buffer);
+static int consume(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn, const char *data, size_t length);
+static void queue_request(struct bench_connection *conn, uint64_t now_ns);
+static int build_request(const struct bench_options *options);
+static uint64_t percentile(const uint64_t *buckets, uint64_t count, uint64_t max, double fraction);
+static void usage(const char *program);
+
+static uint64_t clock_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+  struct bench_options options = {
+    .name = "default",
+    .host = "127.0.0.1",
+    .port = 8080,
+    .threads = 2,
+    .connections = 64,
+    .pipeline = 1,
+    .duration = 5.0,
+    .method = "GET",
+    .path = "/",
+  };
+
+  static const struct option long_options[] = {
+    {"name", required_argument, NULL, 'n'},
+    {"host", required_argument, NULL, 'H'},
+    {"port", required_argument, NULL, 'p'},
+    {"threads", required_argument, NULL, 't'},
+    {"connections", required_argument, NULL, 'c'},
+    {"slow", required_argument, NULL, 's'},
+    {"pipeline", required_argument, NULL, 'P'},
+    {"duration", required_argument, NULL, 'd'},
+    {"method", required_argument, NULL, 'm'},
+    {"path", required_argument, NULL, 'u'},
+    {"body", required_argument, NULL, 'b'},
+    {"churn", no_argument, NULL, 'C'},
+    {NULL, 0, NULL, 0},
+  };
+
+  int option;
+  while((option = getopt_long(argc, argv, "n:H:p:t:c:s:P:d:m:u:b:C", long_options, NULL)) != -1)
+  {
+    switch(option)
+    {
+      case 'n': options.name = optarg; break;
+      case 'H': options.host = optarg; break;
+      case 'p': options.port = (unsigned short)atoi(optarg); break;
+      case 't': options.threads = atoi(optarg); break;
+      case 'c': options.connections = atoi(optarg); break;
+      case 's': options.slow_connections = atoi(optarg); break;
+      case 'P': options.pipeline = atoi(optarg); break;
+      case 'd': options.duration = atof(optarg); break;
+      case 'm': options.method = optarg; break;
+      case 'u': options.path = optarg; break;
+      case 'b': options.body_size = strtoul(optarg, NULL, 10); break;
+      case 'C': options.churn = true; break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+
+  if(options.threads < 1 || options.connections < options.threads || options.slow_connections < 0 ||
+     options.pipeline < 1 || options.pipeline > BENCH_MAX_PIPELINE || options.duration <= 0 ||
+     (options.churn && options.pipeline > 1))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct sockaddr_in *ipv4 = (struct sockaddr_in *)&bench_address;
+  struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *)&bench_address;
+  memset(&bench_address, 0, sizeof(bench_address));
+
+  if(inet_pton(AF_INET, options.host, &ipv4->sin_addr) == 1)
+  {
+    ipv4->sin_family = AF_INET;
+    ipv4->sin_port = htons(options.port);
+    bench_address_length = sizeof(struct sockaddr_in);
+  }
+  else if(inet_pton(AF_INET6, options.host, &ipv6->sin6_addr) == 1)
+  {
+    ipv6->sin6_family = AF_INET6;
+    ipv6->sin6_port = htons(options.port);
+    bench_address_length = sizeof(struct sockaddr_in6);
+  }
+  else
+  {
+    fprintf(stderr, "loadgen: %s is not a numeric address\n", options.host);
+    return 1;
+  }
+
+  if(build_request(&options) == -1)
+  {
+    fprintf(stderr, "loadgen: out of memory\n");
+    return 1;
+  }
+
+  struct bench_thread *threads = calloc(options.threads, sizeof(struct bench_thread));
+  if(threads == NULL)
+  {
+    fprintf(stderr, "loadgen: out of memory\n");
+    return 1;
+  }
+
+  uint64_t start_ns = clock_ns();
+  uint64_t end_ns = start_ns + (uint64_t)(options.duration * 1e9);
+
+  for(int i = 0; i < options.threads; i++)
+  {
+    threads[i].options = &options;
+    threads[i].end_ns = end_ns;
+    threads[i].connections = options.connections / options.threads + (i < options.connections % options.threads);
+    threads[i].slow_connections = options.slow_connections / options.threads + (i < options.slow_connections % options.threads);
+
+    if(pthread_create(&threads[i].id, NULL, run_thread, &threads[i]) != 0)
+    {
+      fprintf(stderr, "loadgen: can not create thread %d\n", i);
+      return 1;
+    }
+  }
+
+  struct bench_thread total;
+  memset(&total, 0, sizeof(total));
+
+  for(int i = 0; i < options.threads; i++)
+  {
+    pthread_join(threads[i].id, NULL);
+    total.requests += threads[i].requests;
+    total.slow_requests += threads[i].slow_requests;
+    total.errors += threads[i].errors;
+    total.connects += threads[i].connects;
+    total.bytes += threads[i].bytes;
+    total.sum_ns += threads[i].sum_ns;
+    total.max_ns = threads[i].max_ns > total.max_ns ? threads[i].max_ns : total.max_ns;
+    for(size_t bucket = 0; bucket < LIGHTNING_HISTOGRAM_BUCKETS; bucket++)
+    {
+      total.buckets[bucket] += threads[i].buckets[bucket];
+    }
+  }
+
+  double elapsed = (double)(clock_ns() - start_ns) / 1e9;
+  uint64_t count = total.requests;
+
+  printf("{\"name\":\"%s\",\"threads\":%d,\"connections\":%d,\"slow_connections\":%d,\"pipeline\":%d,"
+         "\"churn\":%s,\"method\":\"%s\",\"path\":\"%s\",\"body_bytes\":%zu,\"duration_s\":%.3f,"
+         "\"requests\":%lu,\"slow_requests\":%lu,\"errors\":%lu,\"connects\":%lu,"
+         "\"requests_per_s\":%.1f,\"received_bytes_per_s\":%.1f,"
+         "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+         options.name, options.threads, options.connections, options.slow_connections, options.pipeline,
+         options.churn ? "true" : "false", options.method, options.path, options.body_size, elapsed,
+         (unsigned long)count, (unsigned long)total.slow_requests, (unsigned long)total.errors,
+         (unsigned long)total.connects, (double)count / elapsed, (double)total.bytes / elapsed,
+         count > 0 ? (double)total.sum_ns / (double)count / 1e3 : 0.0,
+         (double)percentile(total.buckets, count, total.max_ns, 0.50) / 1e3, (double)percentile(total.buckets, count, total.max_ns, 0.90) / 1e3,
+         (double)percentile(total.buckets, count, total.max_ns, 0.99) / 1e3, (double)percentile(total.buckets, count, total.max_ns, 0.999) / 1e3,
+         (double)total.max_ns / 1e3);
+
+  free(threads);
+  free(bench_request);
+  return total.errors > 0 && count == 0 ? 1 : 0;
+}
+
+static void *run_thread(void *data)
+{
+  struct bench_thread *thread = data;
+  int count = thread->connections + thread->slow_connections;
+  struct bench_connection *connections = calloc(count, sizeof(struct bench_connection));
+  char *buffer = malloc(BENCH_READ_SIZE);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if(connections == NULL || buffer == NULL || epoll_fd == -1)
+  {
+    fprintf(stderr, "loadgen: can not set up a thread\n");
+    thread->errors++;
+    free(connections);
+    free(buffer);
+    return NULL;
+  }
+
+  for(int i = 0; i < count; i++)
+  {
+    connections[i].fd = -1;
+    connections[i].slow = i >= thread->connections;
+    if(open_connection(thread, epoll_fd, &connections[i]) == -1)
+    {
+      thread->errors++;
+    }
+  }
+
+  struct epoll_event events[BENCH_MAX_EVENTS];
+  uint64_t now_ns = clock_ns();
+
+  while(now_ns < thread->end_ns)
+  {
+    int timeout = (int)((thread->end_ns - now_ns) / 1000000) + 1;
+    if(thread->slow_connections > 0 && timeout > BENCH_SLOW_INTERVAL_MS)
+    {
+      timeout = BENCH_SLOW_INTERVAL_MS;
+    }
+
+    int ready = epoll_wait(epoll_fd, events, BENCH_MAX_EVENTS, timeout);
+    now_ns = clock_ns();
+
+    for(int i = 0; i < ready; i++)
+    {
+      struct bench_connection *conn = events[i].data.ptr;
+
+      if(conn->fd == -1)
+      {
+        continue;
+      }
+
+      if(conn->connecting && (events[i].events & EPOLLOUT))
+      {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if(error != 0)
+        {
+          close_connection(thread, epoll_fd, conn, true);
+          continue;
+        }
+        conn->connecting = false;
+      }
+
+      if((events[i].events & EPOLLIN) && read_responses(thread, epoll_fd, conn, buffer) == -1)
+      {
+        close_connection(thread, epoll_fd, conn, true);
+        continue;
+      }
+
+      if(conn->fd != -1 && !conn->connecting && send_requests(conn, now_ns) == -1)
+      {
+        close_connection(thread, epoll_fd, conn, true);
+      }
+    }
+
+    // Slow clients trickle on a timer, not on socket readiness.
+    for(int i = thread->connections; i < count; i++)
+    {
+      struct bench_connection *conn = &connections[i];
+      if(conn->fd != -1 && !conn->connecting && conn->next_byte_ns <= now_ns && send_requests(conn, now_ns) == -1)
+      {
+        close_connection(thread, epoll_fd, conn, true);
+      }
+    }
+
+    // Connections lost to errors are replaced.
+    for(int i = 0; i < count; i++)
+    {
+      if(connections[i].fd == -1 && open_connection(thread, epoll_fd, &connections[i]) == -1)
+      {
+        thread->errors++;
+      }
+    }
+  }
+
+  for(int i = 0; i < count; i++)
+  {
+    if(connections[i].fd != -1)
+    {
+      close(connections[i].fd);
+    }
+  }
+
+  close(epoll_fd);
+  free(connections);
+  free(buffer);
+  return NULL;
+}
+
+static int open_connection(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn)
+{
+  int fd = socket(bench_address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+  if(connect(fd, (struct sockaddr *)&bench_address, bench_address_length) == -1 && errno != EINPROGRESS)
+  {
+    close(fd);
+    return -1;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+  event.data.ptr = conn;
+
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+
+  uint64_t now_ns = clock_ns();
+  bool slow = conn->slow;
+  // The header buffer is not cleared, header_length is.
+  memset(conn, 0, offsetof(struct bench_connection, header));
+  conn->header_length = 0;
+  conn->body_remaining = 0;
+  conn->in_body = false;
+  conn->fd = fd;
+  conn->slow = slow;
+  conn->connecting = true;
+  thread->connects++;
+
+  int depth = slow ? 1 : thread->options->pipeline;
+  for(int i = 0; i < depth; i++)
+  {
+    queue_request(conn, now_ns);
+  }
+  return 0;
+}
+
+/*
+ * Requests still in flight on a failed connection count as errors.
+ */
+static void close_connection(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn, bool failed)
+{
+  if(failed)
+  {
+    thread->errors += conn->in_flight > 0 ? (uint64_t)conn->in_flight : 1;
+  }
+
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+  conn->fd = -1;
+}
+
+static void queue_request(struct bench_connection *conn, uint64_t now_ns)
+{
+  conn->queued_ns[(conn->first + conn->in_flight) % BENCH_MAX_PIPELINE] = now_ns;
+  conn->in_flight++;
+  conn->unsent++;
+}
+
+static int send_requests(struct bench_connection *conn, uint64_t now_ns)
+{
+  while(conn->unsent > 0)
+  {
+    size_t length = bench_request_length - conn->offset;
+
+    if(conn->slow)
+    {
+      if(conn->next_byte_ns > now_ns)
+      {
+        return 0;
+      }
+      length = 1;
+      conn->next_byte_ns = now_ns + (uint64_t)BENCH_SLOW_INTERVAL_MS * 1000000;
+    }
+
+    ssize_t written = send(conn->fd, bench_request + conn->offset, length, MSG_NOSIGNAL);
+    if(written == -1)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+
+    conn->offset += (size_t)written;
+    if(conn->offset == bench_request_length)
+    {
+      conn->offset = 0;
+      conn->unsent--;
+    }
+
+    if(conn->slow)
+    {
+      return 0;
+    }
+  }
+
+  return 0;
+}
+
+static int read_responses(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn, char *buffer)
+{
+  while(conn->fd != -1)
+  {
+    ssize_t received = recv(conn->fd, buffer, BENCH_READ_SIZE, 0);
+
+    if(received == 0)
+    {
+      // Expected once the response to Connection: close is complete.
+      return conn->in_flight > 0 ? -1 : 0;
+    }
+
+    if(received == -1)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+
+    thread->bytes += (uint64_t)received;
+    if(consume(thread, epoll_fd, conn, buffer, (size_t)received) == -1)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Splits the bytes into responses. Only Content-Length framing is expected
+ * from the benchmark server.
+ */
+static int consume(struct bench_thread *thread, int epoll_fd, struct bench_connection *conn, const char *data, size_t length)
+{
+  while(length > 0 && conn->fd != -1)
+  {
+    if(!conn->in_body)
+    {
+      size_t previous = conn->header_length;
+      size_t copied = length < BENCH_HEADER_SIZE - 1 - previous ? length : BENCH_HEADER_SIZE - 1 - previous;
+
+      memcpy(conn->header + previous, data, copied);
+      conn->header_length += copied;
+      conn->header[conn->header_length] = '\0';
+
+      char *end = strstr(conn->header + (previous > 3 ? previous - 3 : 0), "\r\n\r\n");
+      if(end == NULL)
+      {
+        if(conn->header_length == BENCH_HEADER_SIZE - 1)
+        {
+          return -1;
+        }
+        return 0;
+      }
+
+      size_t used = (size_t)(end + 4 - conn->header) - previous;
+      data += used;
+      length -= used;
+
+      if(conn->header_length < 12 || strncmp(conn->header, "HTTP/1.", 7) != 0)
+      {
+        return -1;
+      }
+
+      *end = '\0';
+      conn->status = atoi(conn->header + 9);
+      conn->body_remaining = 0;
+
+      for(char *line = strstr(conn->header, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n"))
+      {
+        if(strncasecmp(line + 2, "Content-Length:", 15) == 0)
+        {
+          conn->body_remaining = strtoul(line + 17, NULL, 10);
+        }
+      }
+
+      conn->header_length = 0;
+      conn->in_body = true;
+    }
+
+    size_t taken = length < conn->body_remaining ? length : conn->body_remaining;
+    conn->body_remaining -= taken;
+    data += taken;
+    length -= taken;
+
+    if(conn->body_remaining > 0)
+    {
+      return 0;
+    }
+
+    // One response complete.
+    uint64_t now_ns = clock_ns();
+    uint64_t latency = now_ns - conn->queued_ns[conn->first];
+
+    conn->in_body = false;
+    conn->first = (conn->first + 1) % BENCH_MAX_PIPELINE;
+    conn->in_flight--;
+
+    if(conn->status < 200 || conn->status > 299)
+    {
+      thread->errors++;
+    }
+    else if(conn->slow)
+    {
+      thread->slow_requests++;
+    }
+    else
+    {
+      thread->requests++;
+      thread->sum_ns += latency;
+      thread->max_ns = latency > thread->max_ns ? latency : thread->max_ns;
+      thread->buckets[lightning_histogram_index(latency)]++;
+    }
+
+    if(thread->options->churn)
+    {
+      close_connection(thread, epoll_fd, conn, false);
+      return 0;
+    }
+
+    queue_request(conn, now_ns);
+  }
+
+  return 0;
+}
+
+static int build_request(const struct bench_options *options)
+{
+  char head[1024];
+  int head_length = snprintf(head, sizeof(head),
+                             "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: lightning-loadgen\r\n%s%s",
+                             options->method, options->path, options->host,
+                             options->churn ? "Connection: close\r\n" : "",
+                             options->body_size > 0 ? "Content-Type: application/octet-stream\r\n" : "");
+
+  if(options->body_size > 0)
+  {
+    head_length += snprintf(head + head_length, sizeof(head) - head_length, "Content-Length: %zu\r\n", options->body_size);
+  }
+  head_length += snprintf(head + head_length, sizeof(head) - head_length, "\r\n");
+
+  bench_request_length = (size_t)head_length + options->body_size;
+  bench_request = malloc(bench_request_length);
+  if(bench_request == NULL)
+  {
+    return -1;
+  }
+
+  memcpy(bench_request, head, head_length);
+  memset(bench_request + head_length, 'x', options->body_size);
+  return 0;
+}
+
+// Upper bound of the bucket holding the value at `fraction` of `count`,
+// never above the largest value seen.
+static uint64_t percentile(const uint64_t *buckets, uint64_t count, uint64_t max, double fraction)
+{
+  uint64_t rank = (uint64_t)((double)count * fraction);
+  uint64_t seen = 0;
+
+  if(count == 0)
+  {
+    return 0;
+  }
+
+  for(size_t bucket = 0; bucket < LIGHTNING_HISTOGRAM_BUCKETS; bucket++)
+  {
+    seen += buckets[bucket];
+    if(seen > rank)
+    {
+      uint64_t bound = lightning_histogram_bucket_max(bucket);
+      return bound < max ? bound : max;
+    }
+  }
+
+  return max;
+}
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [--name N] [--host ADDRESS] [--port P] [--threads T] [--connections C]\n"
+          "          [--pipeline DEPTH] [--churn] [--slow S] [--duration SECONDS]\n"
+          "          [--method M] [--path PATH] [--body BYTES]\n"
+          "  --pipeline: requests in flight per connection (1-%d)\n"
+          "  --churn: one request per connection (Connection: close), not with --pipeline\n"
+          "  --slow: extra connections sending their requests one byte every %d ms\n",
+          program, BENCH_MAX_PIPELINE, BENCH_SLOW_INTERVAL_MS);
+}
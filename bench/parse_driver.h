@@ -0,0 +1,145 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file parse_driver.h
+ * @brief Runs the request parser over a buffer the way a connection does
+ * -      shared by the parser microbenchmark, the fuzz harness and
+ * -      test_parser: the buffer is revealed `step` bytes at a time, as recv
+ * -      would, pipelined requests follow each other and bodies that do not
+ * -      fit in `capacity` stream through lightning_http_body_read.
+ */
+
+#ifndef LIGHTNING_PARSE_DRIVER_H
+#define LIGHTNING_PARSE_DRIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "internal/parser.h"
+
+/**
+ * Called for every complete request. `end` is where the next one starts;
+ * `body_length` counts the streamed payload for streamed bodies.
+ */
+typedef void (*parse_driver_callback)(const struct lightning_http_request *request,
+                                      const char *buffer,
+                                      size_t start,
+                                      size_t end,
+                                      uint64_t body_length,
+                                      void *user_data);
+
+/*
+ * Returns ERROR at the first malformed request, COMPLETE when the buffer
+ * ends with a complete request and INCOMPLETE otherwise. `requests` is set
+ * to the number of complete requests.
+ */
+static inline enum lightning_parse_result parse_driver_run(const char *buffer,
+                                                           size_t length,
+                                                           size_t step,
+                                                           size_t capacity,
+                                                           parse_driver_callback callback,
+                                                           void *user_data,
+                                                           size_t *requests)
+{
+  struct lightning_http_parser parser;
+  struct lightning_http_body_reader reader;
+  struct lightning_http_request request;
+  size_t visible = step < length ? step : length;
+  size_t position = 0;
+  uint64_t body_length = 0;
+  bool streaming = false;
+
+  *requests = 0;
+  lightning_http_parser_init(&parser, 0);
+
+  for(;;)
+  {
+    enum lightning_parse_result result = LIGHTNING_PARSE_INCOMPLETE;
+
+    if(!streaming)
+    {
+      result = lightning_http_parse(&parser, &request, buffer, visible);
+      body_length = request.body.length;
+
+      if(result == LIGHTNING_PARSE_INCOMPLETE && lightning_http_parser_body_streams(&parser, &request, capacity))
+      {
+        lightning_http_body_reader_init(&reader, &request);
+        position = request.body.offset;
+        streaming = true;
+      }
+    }
+
+    if(streaming)
+    {
+      while(result == LIGHTNING_PARSE_INCOMPLETE && position < visible)
+      {
+        const char *payload;
+        size_t payload_length;
+        size_t consumed;
+
+        result = lightning_http_body_read(&reader, buffer + position, visible - position, &consumed, &payload, &payload_length);
+        position += consumed;
+
+        if(consumed == 0)
+        {
+          break;
+        }
+      }
+
+      if(result == LIGHTNING_PARSE_COMPLETE)
+      {
+        parser.end = position;
+        body_length = reader.total;
+        streaming = false;
+      }
+    }
+
+    if(result == LIGHTNING_PARSE_ERROR)
+    {
+      return LIGHTNING_PARSE_ERROR;
+    }
+
+    if(result == LIGHTNING_PARSE_COMPLETE)
+    {
+      if(callback != NULL)
+      {
+        callback(&request, buffer, parser.start, parser.end, body_length, user_data);
+      }
+
+      (*requests)++;
+      if(parser.end == length)
+      {
+        return LIGHTNING_PARSE_COMPLETE;
+      }
+
+      lightning_http_parser_init(&parser, parser.end);
+      continue;
+    }
+
+    if(visible == length)
+    {
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+    visible = length - visible < step ? length : visible + step;
+  }
+}
+
+//      LIGHTNING_PARSE_DRIVER_H
+#endif
@@ -0,0 +1,207 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Request parser microbenchmark, run by `make parser-bench` on the files of
+ * bench/corpus: raw request bytes, one or more pipelined requests each.
+ * Every file is parsed whole and again revealed one byte at a time, the
+ * worst case of a fragmented client. Timing uses the time stamp counter;
+ * the fastest of the rounds is reported, as one JSON object per line.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "internal/scan.h"
+#include "parse_driver.h"
+
+#define PARSER_BENCH_ROUNDS 10
+// Read buffer of a connection with the default settings.
+#define PARSER_BENCH_CAPACITY 8192
+
+struct corpus
+{
+  const char *name;
+  char *data;
+  size_t length;
+  size_t requests;
+};
+
+// Keeps the compiler from dropping passes whose result is unused.
+static volatile size_t parsed_requests;
+
+static int load_corpus(const char *path, struct corpus *corpus);
+static void run_case(const struct corpus *corpus, const char *mode, size_t step, double seconds);
+static uint64_t clock_ns(void);
+static uint64_t cycles(void);
+
+int main(int argc, char **argv)
+{
+  double seconds = 1.0;
+  int first = 1;
+
+  if(argc > 2 && strcmp(argv[1], "--seconds") == 0)
+  {
+    seconds = atof(argv[2]);
+    first = 3;
+  }
+
+  if(first >= argc || seconds <= 0)
+  {
+    fprintf(stderr, "usage: %s [--seconds S] FILE...\n", argv[0]);
+    return 1;
+  }
+
+  fprintf(stderr, "scan backend: %s\n", lightning_scan_backend());
+
+  for(int i = first; i < argc; i++)
+  {
+    struct corpus corpus;
+
+    if(load_corpus(argv[i], &corpus) == -1)
+    {
+      return 1;
+    }
+
+    run_case(&corpus, "whole", corpus.length, seconds / 2);
+    run_case(&corpus, "bytes", 1, seconds / 2);
+    free(corpus.data);
+  }
+
+  return 0;
+}
+
+/*
+ * The file must hold complete requests only: a partial or malformed one
+ * would measure the error path.
+ */
+static int load_corpus(const char *path, struct corpus *corpus)
+{
+  FILE *file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  corpus->data = malloc(size > 0 ? (size_t)size : 1);
+  if(corpus->data == NULL || size <= 0 || fread(corpus->data, 1, (size_t)size, file) != (size_t)size)
+  {
+    fprintf(stderr, "Error: can not read %s\n", path);
+    free(corpus->data);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+
+  const char *slash = strrchr(path, '/');
+  corpus->name = slash != NULL ? slash + 1 : path;
+  corpus->length = (size_t)size;
+
+  if(parse_driver_run(corpus->data, corpus->length, corpus->length, PARSER_BENCH_CAPACITY, NULL, NULL, &corpus->requests) !=
+     LIGHTNING_PARSE_COMPLETE)
+  {
+    fprintf(stderr, "Error: %s does not end with a complete request\n", path);
+    free(corpus->data);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void run_case(const struct corpus *corpus, const char *mode, size_t step, double seconds)
+{
+  size_t requests;
+  uint64_t passes = 1;
+
+  // Passes per round, so that the rounds fill `seconds`.
+  for(;;)
+  {
+    uint64_t started = clock_ns();
+    for(uint64_t i = 0; i < passes; i++)
+    {
+      parse_driver_run(corpus->data, corpus->length, step, PARSER_BENCH_CAPACITY, NULL, NULL, &requests);
+      parsed_requests += requests;
+    }
+
+    uint64_t elapsed = clock_ns() - started;
+    if(elapsed * PARSER_BENCH_ROUNDS >= (uint64_t)(seconds * 1e9) || passes >= (UINT64_C(1) << 40))
+    {
+      break;
+    }
+    passes = elapsed < 1000000 ? passes * 10 : (uint64_t)((double)passes * seconds * 1e9 / PARSER_BENCH_ROUNDS / (double)elapsed) + 1;
+  }
+
+  uint64_t best_cycles = UINT64_MAX;
+  uint64_t best_ns = UINT64_MAX;
+
+  for(int round = 0; round < PARSER_BENCH_ROUNDS; round++)
+  {
+    uint64_t started_ns = clock_ns();
+    uint64_t started = cycles();
+
+    for(uint64_t i = 0; i < passes; i++)
+    {
+      parse_driver_run(corpus->data, corpus->length, step, PARSER_BENCH_CAPACITY, NULL, NULL, &requests);
+      parsed_requests += requests;
+    }
+
+    uint64_t spent = cycles() - started;
+    uint64_t spent_ns = clock_ns() - started_ns;
+    best_cycles = spent < best_cycles ? spent : best_cycles;
+    best_ns = spent_ns < best_ns ? spent_ns : best_ns;
+  }
+
+  double bytes = (double)corpus->length * (double)passes;
+  double total_requests = (double)corpus->requests * (double)passes;
+
+  printf("{\"corpus\":\"%s\",\"mode\":\"%s\",\"bytes\":%zu,\"requests\":%zu,\"passes\":%lu,"
+         "\"cycles_per_byte\":%.2f,\"cycles_per_request\":%.1f,\"ns_per_request\":%.1f,\"mb_per_s\":%.1f}\n",
+         corpus->name, mode, corpus->length, corpus->requests, (unsigned long)passes,
+         (double)best_cycles / bytes, (double)best_cycles / total_requests, (double)best_ns / total_requests,
+         bytes / ((double)best_ns / 1e9) / 1e6);
+}
+
+static uint64_t clock_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// Time stamp counter ticks; nanoseconds where there is none.
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return clock_ns();
+#endif
+}
@@ -0,0 +1,218 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fuzz target for the request parser and the body reader, built with the
+ * debug sanitizers by `make fuzz` (libFuzzer, clang) or `make fuzz-standalone`
+ * (any compiler, afl-gcc included: it reads the files given, or stdin).
+ *
+ * Every input is parsed whole from a buffer of its exact size, so reads
+ * past the end trip ASan, and again revealed one byte at a time. Both runs
+ * must see the same requests: a difference is a resumption bug, reported
+ * by abort().
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_driver.h"
+
+// Small, so the fuzzer reaches the streamed body paths quickly.
+#define FUZZ_CAPACITY 256
+
+struct fuzz_trace
+{
+  size_t start;
+  uint64_t hash;
+};
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void check_slice(const struct lightning_http_slice *slice, size_t start, size_t end, const char *field);
+static void trace_request(const struct lightning_http_request *request,
+                          const char *buffer,
+                          size_t start,
+                          size_t end,
+                          uint64_t body_length,
+                          void *user_data);
+static uint64_t mix(uint64_t hash, uint64_t value);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  char *buffer = malloc(size > 0 ? size : 1);
+  if(buffer == NULL)
+  {
+    return 0;
+  }
+  memcpy(buffer, data, size);
+
+  struct fuzz_trace whole = {0, 0};
+  struct fuzz_trace bytes = {0, 0};
+  size_t whole_requests;
+  size_t bytes_requests;
+
+  enum lightning_parse_result whole_result = parse_driver_run(buffer, size, size, FUZZ_CAPACITY, trace_request, &whole, &whole_requests);
+  enum lightning_parse_result bytes_result = parse_driver_run(buffer, size, 1, FUZZ_CAPACITY, trace_request, &bytes, &bytes_requests);
+
+  if(whole_result != bytes_result || whole_requests != bytes_requests || whole.hash != bytes.hash)
+  {
+    fprintf(stderr, "parser_fuzz: whole input: result %d, %zu requests; one byte at a time: result %d, %zu requests\n",
+            whole_result, whole_requests, bytes_result, bytes_requests);
+    abort();
+  }
+
+  free(buffer);
+  return 0;
+}
+
+static void check_slice(const struct lightning_http_slice *slice, size_t start, size_t end, const char *field)
+{
+  if(slice->length > 0 && (slice->offset < start || (size_t)slice->offset + slice->length > end))
+  {
+    fprintf(stderr, "parser_fuzz: %s [%u, +%u) outside the request [%zu, %zu)\n", field, slice->offset, slice->length, start, end);
+    abort();
+  }
+}
+
+static void trace_request(const struct lightning_http_request *request,
+                          const char *buffer,
+                          size_t start,
+                          size_t end,
+                          uint64_t body_length,
+                          void *user_data)
+{
+  struct fuzz_trace *trace = user_data;
+  (void)buffer;
+
+  if(start < trace->start || end <= start)
+  {
+    fprintf(stderr, "parser_fuzz: request [%zu, %zu) after %zu\n", start, end, trace->start);
+    abort();
+  }
+  trace->start = end;
+
+  check_slice(&request->uri, start, end, "uri");
+  check_slice(&request->path, start, end, "path");
+  check_slice(&request->query_string, start, end, "query string");
+  check_slice(&request->version, start, end, "version");
+  check_slice(&request->host, start, end, "host");
+  check_slice(&request->content_type, start, end, "content type");
+  check_slice(&request->user_agent, start, end, "user agent");
+  check_slice(&request->body, start, end, "body");
+
+  if(request->headers_count > LIGHTNING_MAX_HEADERS)
+  {
+    fprintf(stderr, "parser_fuzz: %zu headers\n", request->headers_count);
+    abort();
+  }
+
+  for(size_t i = 0; i < request->headers_count; i++)
+  {
+    check_slice(&request->headers[i].name, start, end, "header name");
+    check_slice(&request->headers[i].value, start, end, "header value");
+  }
+
+  trace->hash = mix(trace->hash, start);
+  trace->hash = mix(trace->hash, end);
+  trace->hash = mix(trace->hash, (uint64_t)request->method);
+  trace->hash = mix(trace->hash, request->headers_count);
+  trace->hash = mix(trace->hash, request->content_length);
+  trace->hash = mix(trace->hash, body_length);
+  trace->hash = mix(trace->hash, (uint64_t)request->keep_alive << 1 | (uint64_t)request->chunked);
+}
+
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+  hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+#ifndef LIGHTNING_FUZZ_LIBFUZZER
+
+static int run_file(FILE *file, const char *name);
+
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+  {
+    return run_file(stdin, "stdin");
+  }
+
+  for(int i = 1; i < argc; i++)
+  {
+    FILE *file = fopen(argv[i], "rb");
+    if(file == NULL)
+    {
+      fprintf(stderr, "Error: %s: %s\n", argv[i], strerror(errno));
+      return 1;
+    }
+
+    int result = run_file(file, argv[i]);
+    fclose(file);
+    if(result != 0)
+    {
+      return result;
+    }
+  }
+
+  fprintf(stderr, "parser_fuzz: %d inputs passed\n", argc - 1);
+  return 0;
+}
+
+static int run_file(FILE *file, const char *name)
+{
+  size_t capacity = 4096;
+  size_t size = 0;
+  uint8_t *data = malloc(capacity);
+
+  while(data != NULL)
+  {
+    size += fread(data + size, 1, capacity - size, file);
+    if(size < capacity)
+    {
+      break;
+    }
+
+    uint8_t *larger = realloc(data, capacity * 2);
+    if(larger == NULL)
+    {
+      free(data);
+      data = NULL;
+      break;
+    }
+    data = larger;
+    capacity *= 2;
+  }
+
+  if(data == NULL || ferror(file))
+  {
+    fprintf(stderr, "Error: can not read %s\n", name);
+    free(data);
+    return 1;
+  }
+
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+  return 0;
+}
+
+//      LIGHTNING_FUZZ_LIBFUZZER
+#endif
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Runs the benchmark scenarios against bench_server on loopback and prints
+# one JSON object per scenario. Invoked by `make bench`, which builds both
+# binaries into build/bench.
+#
+# Environment: BENCH_DURATION (seconds per scenario), BENCH_THREADS,
+# BENCH_CONNECTIONS, BENCH_PORT, LIGHTNING_BACKEND (epoll or io_uring).
+
+set -eu
+
+BIN=${BIN:-build/bench}
+DURATION=${BENCH_DURATION:-5}
+THREADS=${BENCH_THREADS:-2}
+CONNECTIONS=${BENCH_CONNECTIONS:-64}
+PORT=${BENCH_PORT:-8089}
+
+"$BIN/bench_server" "$PORT" > "$BIN/server.log" 2>&1 &
+SERVER=$!
+trap 'kill -TERM $SERVER 2>/dev/null; wait $SERVER 2>/dev/null || true' EXIT INT TERM
+
+# The server is up once a short probe gets its requests answered.
+tries=0
+until "$BIN/loadgen" --port "$PORT" --threads 1 --connections 1 --duration 0.1 > /dev/null 2>&1
+do
+  tries=$((tries + 1))
+  if [ $tries -ge 50 ] || ! kill -0 $SERVER 2>/dev/null
+  then
+    echo "bench: the server did not start, see $BIN/server.log" >&2
+    exit 1
+  fi
+  sleep 0.1
+done
+
+run()
+{
+  "$BIN/loadgen" --port "$PORT" --threads "$THREADS" --duration "$DURATION" "$@"
+}
+
+run --name keepalive --connections "$CONNECTIONS"
+run --name pipeline --connections 16 --pipeline 16
+run --name churn --connections 16 --churn
+run --name slow_clients --connections "$CONNECTIONS" --slow 200
+run --name large_body --connections 16 --path /large
+run --name upload --connections 16 --method POST --path /upload --body 262144
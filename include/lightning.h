@@ -30,6 +30,7 @@
 #define LIGHTNING_H
 
 #include <lightning/application.h>
+#include <lightning/http.h>
 
 //      LIGHTNING_H
 #endif
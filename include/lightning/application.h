@@ -25,14 +25,333 @@
 #ifndef LIGHTNING_APPLICATION_H
 #define LIGHTNING_APPLICATION_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 
+#include <lightning/http.h>
+
 struct lightning_application;
 
+#define LIGHTNING_MAX_LISTENERS 8
+#define LIGHTNING_CACHE_VARY_MAX 4
+
+enum lightning_backend
+{
+  LIGHTNING_BACKEND_EPOLL = 0,
+  LIGHTNING_BACKEND_IO_URING
+};
+
+enum lightning_access_log_format
+{
+  // One JSON object per line.
+  LIGHTNING_ACCESS_LOG_JSON = 0,
+  // Fixed 128 byte records in host byte order, see lightning_access_log.
+  LIGHTNING_ACCESS_LOG_BINARY
+};
+
+enum lightning_access_log_overflow
+{
+  // Requests that find their worker's log buffer full are counted and lost.
+  LIGHTNING_ACCESS_LOG_DROP = 0,
+  // Past half full, one request in 16 is logged, with the number of
+  // requests it stands for as its weight.
+  LIGHTNING_ACCESS_LOG_SAMPLE
+};
+
+enum lightning_shed_mode
+{
+  // Connections over the admission limits are accepted only to be answered
+  // 503 Service Unavailable and closed.
+  LIGHTNING_SHED_REJECT = 0,
+  // The worker stops accepting: new connections wait in the listen backlog
+  // until it is back under its limits, or until the backlog is full.
+  LIGHTNING_SHED_BACKLOG
+};
+
+/**
+ * An address to listen on. Every worker gets its own socket for it, in one
+ * SO_REUSEPORT group per listener. The socket options are set on the
+ * listening sockets, the connections they accept inherit them.
+ */
+struct lightning_listener
+{
+  // Numeric address. NULL: every IPv4 address. "::": every IPv6 address,
+  // and IPv4 too unless ipv6_only.
+  const char *address;
+  unsigned short port;
+  bool ipv6_only;
+  // listen() backlog, default SOMAXCONN.
+  int backlog;
+  // SO_SNDBUF and SO_RCVBUF in bytes, 0 leaves them to the kernel's
+  // autotuning. Default 1 MB.
+  int send_buffer;
+  int receive_buffer;
+  // TCP_DEFER_ACCEPT: seconds a connection may stay silent before it is
+  // accepted anyway. 0: accept at once.
+  int defer_accept;
+  // TCP_FASTOPEN: Fast Open requests waiting for accept at most. 0: off.
+  int fast_open;
+  // SO_BUSY_POLL: microseconds a read spins on the NIC queue before it
+  // sleeps. 0: off.
+  int busy_poll;
+};
+
+/**
+ * Deployment settings, filled with defaults by lightning_config_init.
+ */
+struct lightning_config
+{
+  // 0: one per CPU in `cpus`. More workers than CPUs share them.
+  int workers;
+  // "0-3,8", in the sysfs CPU list format. NULL: the CPUs the process may
+  // run on.
+  const char *cpus;
+  // Each worker runs on its own CPU only. Default true.
+  bool pin_workers;
+  // Per worker, and the highest file descriptor it can serve. 0: the
+  // RLIMIT_NOFILE soft limit.
+  int max_connections;
+  // Request head plus whatever fits of the body, per connection reading a
+  // request. Default 8 KB, from 1 KB to 1 MB.
+  size_t read_buffer_size;
+  // Events per epoll_wait. Default 64.
+  int epoll_max_events;
+  // Connections accepted from one listener per event loop round, so that an
+  // accept storm can not starve the connections already open. Default 32.
+  int accept_batch;
+  // Admission control, per worker. Past either limit new connections are
+  // shed as `shed` says, until the worker is back under 3/4 of both. The
+  // loop delay is the time a round of the event loop takes, averaged: how
+  // long an event waits before it is handled. 0: no limit, the default.
+  int max_active_connections;
+  int max_loop_delay_us;
+  enum lightning_shed_mode shed;
+  // Bytes of responses cached by lightning_route_cached, per worker and in
+  // the table the workers share. Default 4 MB each.
+  size_t response_cache_size;
+  size_t shared_response_cache_size;
+  struct lightning_listener listeners[LIGHTNING_MAX_LISTENERS];
+  int listeners_count;
+};
+
+/**
+ * Route handler. `user_data` is the pointer given to lightning_route.
+ * Handlers run concurrently on every worker thread.
+ */
+typedef void (*lightning_handler)(struct lightning_http_request *request,
+                                  struct lightning_http_response *response,
+                                  void *user_data);
+
+/**
+ * Receives the body of a streaming route piece by piece, before the route
+ * handler runs. Return -1 to reject the request and close the connection.
+ * Called once with `data` NULL when the request is abandoned before the
+ * handler could run, so per-request state can be released.
+ */
+typedef int (*lightning_body_handler)(struct lightning_http_request *request,
+                                      const void *data,
+                                      size_t length,
+                                      void *user_data);
+
+/**
+ * How lightning_route_cached keeps the responses of a route.
+ */
+struct lightning_cache_policy
+{
+  // Milliseconds a response is served without calling the handler.
+  unsigned ttl_ms;
+  // Request headers whose values tell responses apart besides the path and
+  // query, e.g. {"Accept-Encoding", NULL}; at most LIGHTNING_CACHE_VARY_MAX.
+  // NULL: none. The handler still sends its own Vary header.
+  const char *const *vary;
+  // One copy for all the workers instead of one each: the handler runs
+  // once per TTL instead of once per worker and TTL, hits read memory
+  // other CPUs wrote.
+  bool shared;
+};
+
+/**
+ * Usage of the per-request arenas (lightning_request_alloc), summed over
+ * the workers. A cycle is everything allocated for the responses written in
+ * one go on a connection; high_water is the largest cycle seen, in bytes.
+ * Overflows are cycles that needed more than one block of block_size.
+ */
+struct lightning_arena_stats
+{
+  size_t block_size;
+  size_t high_water;
+  unsigned long cycles;
+  unsigned long overflows;
+  unsigned long large_allocations;
+};
+
+/**
+ * Creates the workers and their listening sockets. Hot restart, through
+ * environment variables:
+ * -      LIGHTNING_HANDOFF_SOCKET=<path>: if a running generation serves
+ * -      that unix socket, its listening sockets are taken over; once this
+ * -      process is accepting (lightning_ride) the old one drains, and this
+ * -      one serves the path for the next upgrade.
+ * -      LIGHTNING_LISTEN_FDS=3,4,...: listening sockets inherited from
+ * -      whoever started us.
+ * Taken over sockets keep their accept queues: no connection is refused or
+ * reset while generations change.
+ */
 struct lightning_application *lightning_new_application(const unsigned short port);
+
+/**
+ * Default settings, without listeners.
+ */
+void lightning_config_init(struct lightning_config *config);
+
+/**
+ * Adds a listener with the default options, which can be changed through
+ * the returned pointer. NULL when there are LIGHTNING_MAX_LISTENERS already.
+ */
+struct lightning_listener *lightning_config_listen(struct lightning_config *config, const char *address, unsigned short port);
+
+/**
+ * Same as lightning_new_application with the settings of `config`, which
+ * is not used any more once it returns. NULL when a setting is invalid or
+ * a listener can not be bound.
+ */
+struct lightning_application *lightning_new_application_config(const struct lightning_config *config);
+
+/**
+ * Registers `handler` for `method` requests whose path matches `pattern`.
+ * -      "/users/:id" captures one path segment as the parameter "id".
+ * -      "/assets/\*path" captures the rest of the path as "path".
+ * A static segment is tried before a parameter and a parameter before a
+ * wildcard; the next one is tried when a match has no route for `method`.
+ * Routes must be registered before lightning_ride. Returns 0 on success and
+ * -1 when the pattern is invalid or the route is already registered.
+ */
+int lightning_route(struct lightning_application *application,
+                    enum http_methods method,
+                    const char *pattern,
+                    lightning_handler handler,
+                    void *user_data);
+
+/**
+ * Like lightning_route, but the request body is handed to `body_handler` as
+ * it arrives instead of being collected, so its size is only bounded by
+ * lightning_set_body_limits. `handler` runs once the body is complete.
+ */
+int lightning_route_stream(struct lightning_application *application,
+                           enum http_methods method,
+                           const char *pattern,
+                           lightning_body_handler body_handler,
+                           lightning_handler handler,
+                           void *user_data);
+
+/**
+ * Like lightning_route for GET (and HEAD), with the responses kept fully
+ * serialized and sent again as they are until `policy->ttl_ms` is over.
+ * For handlers that answer the same request the same way: the body is
+ * copied, nothing the handler reads is looked at again. Only responses
+ * with a status of 200, 203, 204, 300, 301, 404 or 410, no Set-Cookie and
+ * up to 8 KB serialized are kept. Requests with a body always reach the
+ * handler. A kept 200 carries an ETag, the handler's or a hash of the body,
+ * and answers If-None-Match with 304 and a single byte range with 206.
+ */
+int lightning_route_cached(struct lightning_application *application,
+                           const char *pattern,
+                           lightning_handler handler,
+                           void *user_data,
+                           const struct lightning_cache_policy *policy);
+
+/**
+ * Bodies that do not fit in the read buffer (read_buffer_size with the
+ * headers) or are chunked are collected before the handler runs: in memory
+ * up to `spill_threshold` bytes, then in an unlinked file under $TMPDIR.
+ * Larger than `max_body_size` and the connection is closed. Defaults: 16 MB
+ * and 64 KB.
+ */
+int lightning_set_body_limits(struct lightning_application *application, size_t max_body_size, size_t spill_threshold);
+
+/**
+ * Serves the files under `directory` for GET and HEAD requests below
+ * `prefix`: with prefix "/assets", "/assets/app.js" is read from
+ * "<directory>/app.js" and "/assets/" from "<directory>/index.html".
+ * Hidden files and ".." segments are refused, and symbolic links are only
+ * followed while they stay below `directory`. Files carry ETag and
+ * Last-Modified validators for conditional requests (304) and are served
+ * in byte ranges (206, multipart/byteranges for several). Returns -1 when
+ * the directory can not be opened or the route is already registered.
+ */
+int lightning_static(struct lightning_application *application, const char *prefix, const char *directory);
+
+/**
+ * Selects the event loop used by the workers. The default is epoll, or the
+ * value of the LIGHTNING_BACKEND environment variable ("epoll" or
+ * "io_uring"). io_uring falls back to epoll when the kernel lacks support.
+ */
+int lightning_set_backend(struct lightning_application *application, enum lightning_backend backend);
+
+/**
+ * Opt-in: each connection is accepted by the worker pinned to the CPU that
+ * received its packets (the one handling the NIC queue), so it is served
+ * where its data is already in cache. Worth it when the NIC spreads its
+ * queues over the CPUs the workers run on. Also enabled by
+ * LIGHTNING_CPU_STEERING=1. Takes effect in lightning_ride.
+ */
+int lightning_set_cpu_steering(struct lightning_application *application, int enabled);
+
+/**
+ * Pre-renders the status line, Content-Type and fixed headers of a response
+ * so handlers can send them as one block with lightning_response_use_prefix.
+ * `headers` holds name, value pairs and ends with NULL; it may be NULL.
+ * The prefix belongs to the application and is freed by lightning_destroy.
+ * Returns NULL when a header is invalid or memory runs out.
+ */
+const struct lightning_response_prefix *lightning_response_prefix(struct lightning_application *application,
+                                                                  int status_code,
+                                                                  const char *content_type,
+                                                                  const char *const headers[]);
+
+void lightning_arena_usage(const struct lightning_application *application, struct lightning_arena_stats *stats);
+
+/**
+ * Serves the workers' counters and latency histograms (parse, handle,
+ * write), summed, in the Prometheus text format on GET `path`, e.g.
+ * "/metrics". The workers are never stopped to read them. Same return
+ * values as lightning_route.
+ */
+int lightning_serve_metrics(struct lightning_application *application, const char *path);
+
+/**
+ * Logs every request to `path`, appended, or to the standard output with
+ * "-". The workers only copy a record into a buffer of their own; a
+ * logger thread formats and writes them. Lost and sampled requests are
+ * counted in the metrics. Binary records are, in order: time_ns (u64, wall
+ * clock), duration_ns (u64, parse and handle), bytes (u64, body), address
+ * (16 bytes, IPv6 or IPv4-mapped) and port (u16) in network byte order,
+ * status (u16), weight (u16), worker (u16), method (u8, enum
+ * http_methods), path_length (u8) and the first 78 bytes of the path.
+ * Call before lightning_ride, at most once.
+ */
+int lightning_access_log(struct lightning_application *application,
+                         const char *path,
+                         enum lightning_access_log_format format,
+                         enum lightning_access_log_overflow overflow);
+
+/**
+ * Runs the workers until they are stopped. SIGTERM and SIGINT, unless the
+ * program already handles or ignores them, call lightning_stop; a second
+ * one stops at once.
+ */
 void lightning_ride(struct lightning_application *application);
+
+/**
+ * Graceful stop: the listening sockets are closed, idle keep-alive
+ * connections too, and the others get Connection: close on their next
+ * response. lightning_ride returns once every connection is gone or after
+ * a 10 second drain deadline. Safe to call from any thread and from a
+ * signal handler.
+ */
+void lightning_stop(struct lightning_application *application);
 void lightning_destroy(struct lightning_application *application);
 
 //      LIGHTNING_APPLICATION_H
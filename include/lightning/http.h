@@ -0,0 +1,118 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file http.h
+ * @brief Request and response as seen by route handlers.
+ * -      strings returned by the request accessors are NOT null terminated:
+ * -      they point into the connection buffer and are only valid while the
+ * -      handler runs.
+ */
+
+#ifndef LIGHTNING_HTTP_H
+#define LIGHTNING_HTTP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+enum http_methods
+{
+  HTTP_GET,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_DELETE,
+  HTTP_HEAD,
+  HTTP_OPTIONS,
+  HTTP_PATCH,
+  HTTP_UNKNOWN
+};
+
+struct lightning_http_request;
+struct lightning_http_response;
+struct lightning_response_prefix;
+
+enum http_methods lightning_request_method(const struct lightning_http_request *request);
+const char *lightning_request_path(const struct lightning_http_request *request, size_t *length);
+const char *lightning_request_query(const struct lightning_http_request *request, size_t *length);
+const char *lightning_request_header(const struct lightning_http_request *request, const char *name, size_t *length);
+const char *lightning_request_param(const struct lightning_http_request *request, const char *name, size_t *length);
+const void *lightning_request_body(const struct lightning_http_request *request, size_t *length);
+
+/**
+ * One pointer of per-request state, NULL when the request starts. Meant for
+ * streaming routes that build something up across body callbacks.
+ */
+void lightning_request_set_context(struct lightning_http_request *request, void *context);
+void *lightning_request_context(const struct lightning_http_request *request);
+
+/**
+ * Memory for the handler that is released all at once after the response
+ * has been written, so it can back the response body and headers. Returns
+ * NULL when memory runs out. Never free() it.
+ */
+void *lightning_request_alloc(struct lightning_http_request *request, size_t size);
+
+void lightning_response_status(struct lightning_http_response *response, int status_code);
+
+/**
+ * `body` is not copied: it must stay valid after the handler returns, until
+ * the response has been written (static data or memory owned by the caller).
+ */
+void lightning_response_body(struct lightning_http_response *response, const char *content_type, const void *body, size_t length);
+
+/**
+ * Adds a response header, both strings are copied. Content-Type,
+ * Content-Length, Transfer-Encoding and Connection are written by Lightning
+ * itself: the last three are refused. Returns -1 when the name or value is
+ * invalid or the response is out of header space.
+ */
+int lightning_response_header(struct lightning_http_response *response, const char *name, const char *value);
+
+/**
+ * Same without the copy or the validation of the characters, for string
+ * literals and other strings that outlive the response.
+ */
+int lightning_response_header_static(struct lightning_http_response *response, const char *name, const char *value);
+
+/**
+ * Produces the body of a chunked response, one chunk per call: write at
+ * most `capacity` bytes to `buffer` and return how many, 0 once the body is
+ * complete or -1 to abort the connection. Called with `buffer` NULL when the
+ * response is abandoned (HEAD request, closed connection) so `user_data` can
+ * be released.
+ */
+typedef ssize_t (*lightning_chunk_producer)(char *buffer, size_t capacity, void *user_data);
+
+/**
+ * Sends the body with Transfer-Encoding: chunked, asking `producer` for
+ * chunks whenever the previous ones have been written. An HTTP/1.0 client
+ * gets the chunks unframed and the connection closes after the last one.
+ */
+void lightning_response_chunked(struct lightning_http_response *response,
+                                const char *content_type,
+                                lightning_chunk_producer producer,
+                                void *user_data);
+
+/**
+ * Starts the response from a prefix made by lightning_response_prefix. The
+ * status code and Content-Type come from the prefix: do not set them again.
+ */
+void lightning_response_use_prefix(struct lightning_http_response *response, const struct lightning_response_prefix *prefix);
+
+//      LIGHTNING_HTTP_H
+#endif
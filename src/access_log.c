@@ -0,0 +1,372 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+
+#include "internal/access_log.h"
+#include "internal/request.h"
+
+// Formatted JSON lines are written out in blocks of this size.
+#define ACCESS_LOG_BUFFER_SIZE (256 * 1024)
+// Longest JSON line: every path byte escaped as \u00XX, plus the fields.
+#define ACCESS_LOG_LINE_MAX (LIGHTNING_ACCESS_LOG_PATH_SIZE * 6 + 256)
+// Rings gathered in one writev of binary records, two segments each.
+#define ACCESS_LOG_BATCH_RINGS 32
+
+static void *run_logger(void *data);
+static size_t collect_json(struct lightning_access_log *log);
+static size_t collect_binary(struct lightning_access_log *log);
+static size_t format_json(struct lightning_access_log *log, const struct lightning_access_record *record, char *output);
+static void write_all(struct lightning_access_log *log, struct iovec *iov, int count);
+
+struct lightning_access_log *lightning_access_log_create(const char *path,
+                                                         enum lightning_access_log_format format,
+                                                         enum lightning_access_log_overflow overflow,
+                                                         int workers)
+{
+  struct lightning_access_log *log = calloc(1, sizeof(struct lightning_access_log));
+
+  if(log == NULL)
+  {
+    return NULL;
+  }
+
+  log->format = format;
+  log->count = workers;
+  log->second = -1;
+  log->fd = STDOUT_FILENO;
+
+  if(strcmp(path, "-") != 0)
+  {
+    log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    log->close_fd = true;
+  }
+
+  log->rings = calloc(workers, sizeof(struct lightning_access_ring *));
+
+  if(log->fd == -1 || log->rings == NULL)
+  {
+    lightning_access_log_destroy(log);
+    return NULL;
+  }
+
+  if(format == LIGHTNING_ACCESS_LOG_JSON && (log->buffer = malloc(ACCESS_LOG_BUFFER_SIZE)) == NULL)
+  {
+    lightning_access_log_destroy(log);
+    return NULL;
+  }
+
+  for(int i = 0; i < workers; i++)
+  {
+    log->rings[i] = aligned_alloc(LIGHTNING_CACHE_LINE, sizeof(struct lightning_access_ring));
+
+    if(log->rings[i] == NULL)
+    {
+      lightning_access_log_destroy(log);
+      return NULL;
+    }
+
+    memset(log->rings[i], 0, offsetof(struct lightning_access_ring, records));
+    log->rings[i]->sample = overflow == LIGHTNING_ACCESS_LOG_SAMPLE;
+    log->rings[i]->worker = (uint16_t)i;
+  }
+
+  return log;
+}
+
+int lightning_access_log_start(struct lightning_access_log *log)
+{
+  __atomic_store_n(&log->running, true, __ATOMIC_RELEASE);
+
+  if(pthread_create(&log->thread, NULL, run_logger, log) != 0)
+  {
+    log->running = false;
+    return -1;
+  }
+
+  log->started = true;
+  return 0;
+}
+
+void lightning_access_log_stop(struct lightning_access_log *log)
+{
+  if(log == NULL || !log->started)
+  {
+    return;
+  }
+
+  __atomic_store_n(&log->running, false, __ATOMIC_RELEASE);
+  pthread_join(log->thread, NULL);
+  log->started = false;
+}
+
+void lightning_access_log_destroy(struct lightning_access_log *log)
+{
+  if(log == NULL)
+  {
+    return;
+  }
+
+  lightning_access_log_stop(log);
+
+  if(log->rings != NULL)
+  {
+    for(int i = 0; i < log->count; i++)
+    {
+      free(log->rings[i]);
+    }
+    free(log->rings);
+  }
+
+  if(log->close_fd && log->fd >= 0)
+  {
+    close(log->fd);
+  }
+
+  free(log->buffer);
+  free(log);
+}
+
+/*
+ * Polls the rings rather than being woken: a worker never makes a system
+ * call to log. Once stopped, whatever is left is written before returning.
+ */
+static void *run_logger(void *data)
+{
+  struct lightning_access_log *log = data;
+  const struct timespec interval = {0, LIGHTNING_ACCESS_LOG_INTERVAL_MS * 1000000L};
+
+  while(__atomic_load_n(&log->running, __ATOMIC_ACQUIRE))
+  {
+    size_t collected = log->format == LIGHTNING_ACCESS_LOG_BINARY ? collect_binary(log) : collect_json(log);
+
+    if(collected == 0)
+    {
+      nanosleep(&interval, NULL);
+    }
+  }
+
+  while((log->format == LIGHTNING_ACCESS_LOG_BINARY ? collect_binary(log) : collect_json(log)) > 0)
+  {
+  }
+
+  return NULL;
+}
+
+/*
+ * A ring's records are released as soon as they are formatted, before the
+ * buffer is written.
+ */
+static size_t collect_json(struct lightning_access_log *log)
+{
+  size_t collected = 0;
+  size_t length = 0;
+
+  for(int i = 0; i < log->count; i++)
+  {
+    struct lightning_access_ring *ring = log->rings[i];
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = ring->tail;
+
+    for(; tail != head; tail++)
+    {
+      if(ACCESS_LOG_BUFFER_SIZE - length < ACCESS_LOG_LINE_MAX)
+      {
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        struct iovec iov = {log->buffer, length};
+        write_all(log, &iov, 1);
+        length = 0;
+      }
+
+      length += format_json(log, &ring->records[tail & (LIGHTNING_ACCESS_LOG_RECORDS - 1)], log->buffer + length);
+      collected++;
+    }
+
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+  }
+
+  if(length > 0)
+  {
+    struct iovec iov = {log->buffer, length};
+    write_all(log, &iov, 1);
+  }
+
+  return collected;
+}
+
+/*
+ * Records go out straight from the rings, so they are only released once
+ * written.
+ */
+static size_t collect_binary(struct lightning_access_log *log)
+{
+  size_t collected = 0;
+
+  for(int first = 0; first < log->count; first += ACCESS_LOG_BATCH_RINGS)
+  {
+    struct iovec iov[ACCESS_LOG_BATCH_RINGS * 2];
+    uint64_t heads[ACCESS_LOG_BATCH_RINGS];
+    int rings = log->count - first < ACCESS_LOG_BATCH_RINGS ? log->count - first : ACCESS_LOG_BATCH_RINGS;
+    int count = 0;
+
+    for(int i = 0; i < rings; i++)
+    {
+      struct lightning_access_ring *ring = log->rings[first + i];
+      uint64_t tail = ring->tail;
+      uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      size_t start = tail & (LIGHTNING_ACCESS_LOG_RECORDS - 1);
+      size_t pending = head - tail;
+      size_t contiguous = LIGHTNING_ACCESS_LOG_RECORDS - start < pending ? LIGHTNING_ACCESS_LOG_RECORDS - start : pending;
+
+      heads[i] = head;
+      collected += pending;
+
+      if(contiguous > 0)
+      {
+        iov[count++] = (struct iovec){&ring->records[start], contiguous * sizeof(struct lightning_access_record)};
+      }
+      if(pending > contiguous)
+      {
+        iov[count++] = (struct iovec){&ring->records[0], (pending - contiguous) * sizeof(struct lightning_access_record)};
+      }
+    }
+
+    if(count > 0)
+    {
+      write_all(log, iov, count);
+    }
+
+    for(int i = 0; i < rings; i++)
+    {
+      __atomic_store_n(&log->rings[first + i]->tail, heads[i], __ATOMIC_RELEASE);
+    }
+  }
+
+  return collected;
+}
+
+static size_t format_json(struct lightning_access_log *log, const struct lightning_access_record *record, char *output)
+{
+  int64_t second = (int64_t)(record->time_ns / 1000000000);
+
+  if(second != log->second)
+  {
+    time_t now = (time_t)second;
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(log->second_text, sizeof(log->second_text), "%Y-%m-%dT%H:%M:%S", &tm);
+    log->second = second;
+  }
+
+  // "1.2.3.4:80" or "[::1]:80".
+  char client[INET6_ADDRSTRLEN + 8] = "";
+  struct in6_addr address;
+  memcpy(&address, record->address, sizeof(address));
+
+  if(IN6_IS_ADDR_V4MAPPED(&address))
+  {
+    inet_ntop(AF_INET, record->address + 12, client, INET6_ADDRSTRLEN);
+    sprintf(client + strlen(client), ":%u", (unsigned)ntohs(record->port));
+  }
+  else if(!IN6_IS_ADDR_UNSPECIFIED(&address))
+  {
+    client[0] = '[';
+    inet_ntop(AF_INET6, &address, client + 1, INET6_ADDRSTRLEN);
+    sprintf(client + strlen(client), "]:%u", (unsigned)ntohs(record->port));
+  }
+
+  char *cursor = output;
+
+  cursor += sprintf(cursor, "{\"time\":\"%s.%06uZ\",\"worker\":%u,\"client\":\"%s\",\"method\":\"%s\",\"path\":\"",
+                    log->second_text, (unsigned)(record->time_ns % 1000000000 / 1000), (unsigned)record->worker,
+                    client, lightning_method_name(record->method));
+
+  size_t path_length = record->path_length < LIGHTNING_ACCESS_LOG_PATH_SIZE ? record->path_length : LIGHTNING_ACCESS_LOG_PATH_SIZE;
+  for(size_t i = 0; i < path_length; i++)
+  {
+    unsigned char c = (unsigned char)record->path[i];
+
+    if(c == '"' || c == '\\')
+    {
+      *cursor++ = '\\';
+      *cursor++ = (char)c;
+    }
+    else if(c < 0x20 || c >= 0x7f)
+    {
+      cursor += sprintf(cursor, "\\u%04x", c);
+    }
+    else
+    {
+      *cursor++ = (char)c;
+    }
+  }
+
+  cursor += sprintf(cursor, "\",\"status\":%u,\"bytes\":%" PRIu64 ",\"duration_ns\":%" PRIu64 ",\"weight\":%u}\n",
+                    (unsigned)record->status, record->bytes, record->duration_ns, (unsigned)record->weight);
+  return (size_t)(cursor - output);
+}
+
+/*
+ * Records that can not be written are lost, the first failure is reported.
+ */
+static void write_all(struct lightning_access_log *log, struct iovec *iov, int count)
+{
+  while(count > 0)
+  {
+    ssize_t written = writev(log->fd, iov, count);
+
+    if(written == -1)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+
+      if(!log->write_failed)
+      {
+        fprintf(stderr, "Warning: can not write the access log (%s), records are lost\n", strerror(errno));
+        log->write_failed = true;
+      }
+      return;
+    }
+
+    while(count > 0 && (size_t)written >= iov->iov_len)
+    {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+
+    if(count > 0)
+    {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+}
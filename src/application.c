@@ -19,15 +19,29 @@
 #define _GNU_SOURCE
 #include <pthread.h>
 #include <sched.h>
+#include <signal.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/sysinfo.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
 #include "lightning/application.h"
+#include "internal/response.h"
+#include "internal/response_cache.h"
+#include "internal/access_log.h"
+#include "internal/body.h"
+#include "internal/handoff.h"
+#include "internal/metrics.h"
+#include "internal/router.h"
+#include "internal/scan.h"
 #include "internal/server.h"
+#include "internal/static.h"
+#include "internal/steering.h"
+#include "internal/topology.h"
 
 #define LIGHTNING_BANNER \
 "░██         ░██████  ░██████  ░██     ░██ ░██████████░███    ░██ ░██████░███    ░██   ░██████ \n"\
@@ -38,26 +52,164 @@
 "░██           ░██   ░██  ░███ ░██     ░██     ░██    ░██   ░████   ░██  ░██   ░████  ░██  ░███\n"\
 "░██████████ ░██████  ░█████░█ ░██     ░██     ░██    ░██    ░███ ░██████░██    ░███   ░█████░█  "
 
+// Room for every counter and the three histograms, with a wide margin.
+#define LIGHTNING_METRICS_TEXT_SIZE 16384
+
 #define LIGHTNING_ERROR(error_message) \
   fprintf(stderr,                      \
           "[Lightning Error]: In <%s> line %d (%s)\n", __FUNCTION__, __LINE__, error_message)
 
 struct lightning_worker
 {
+  struct lightning_application *application;
+  // Created by the worker thread itself, published with an atomic store.
   struct lightning_server *server;
   pthread_t id;
+  // -1 for both when workers are not pinned.
+  int cpu;
+  int node;
+  // One per listener, until the worker takes them over.
+  int listen_fds[LIGHTNING_MAX_LISTENERS];
 };
 
+static void handle_stop_signal(int signal_number);
+static void steer_connections(struct lightning_application *application);
+static void handle_handoff(void *data);
+static void *run_worker(void *data);
+static void serve_metrics(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data);
+static void print_topology(const struct lightning_application *application, const struct lightning_topology *topology);
+static void print_listeners(const struct lightning_config *config);
+static void print_admission(const struct lightning_config *config);
+static void free_cache_rule(struct lightning_cache_rule *rule);
+static int bound_port(int fd);
+
 struct lightning_application
 {
   struct lightning_worker *workers;
+  struct lightning_router *router;
+  struct lightning_response_prefix *prefixes;
+  struct lightning_static_directory *directories;
+  struct lightning_cache_rule *cache_rules;
+  // Created with the first shared cached route.
+  struct lightning_shared_response_cache *shared_responses;
+  // Every default resolved, without the caller's strings.
+  struct lightning_config config;
   int workers_number;
-  int max_connections;
-  unsigned short port;
+  enum lightning_backend backend;
+  size_t max_body_size;
+  size_t body_spill_threshold;
+  bool stopping;
+  // Workers whose server creation finished, successful or not.
+  pthread_mutex_t start_lock;
+  pthread_cond_t start_cond;
+  int started;
+  bool cpu_steering;
+  bool sockets_taken_over;
+  const char *handoff_path;
+  struct lightning_handoff handoff;
+  struct lightning_access_log *access_log;
 };
 
+// The application lightning_ride is running, for the signal handlers.
+static struct lightning_application *riding_application;
+
 struct lightning_application *lightning_new_application(const unsigned short port)
 {
+  struct lightning_config config;
+
+  lightning_config_init(&config);
+  lightning_config_listen(&config, NULL, port);
+  return lightning_new_application_config(&config);
+}
+
+void lightning_config_init(struct lightning_config *config)
+{
+  if(config == NULL)
+  {
+    return;
+  }
+
+  memset(config, 0, sizeof(struct lightning_config));
+  config->pin_workers = true;
+  config->read_buffer_size = LIGHTNING_READ_BUFFER_SIZE;
+  config->epoll_max_events = LIGHTNING_EPOLL_MAX_EVENTS;
+  config->accept_batch = LIGHTNING_ACCEPT_BATCH;
+  config->shed = LIGHTNING_SHED_REJECT;
+  config->response_cache_size = LIGHTNING_RESPONSE_CACHE_SIZE;
+  config->shared_response_cache_size = LIGHTNING_RESPONSE_CACHE_SIZE;
+}
+
+struct lightning_listener *lightning_config_listen(struct lightning_config *config, const char *address, unsigned short port)
+{
+  if(config == NULL || config->listeners_count < 0 || config->listeners_count >= LIGHTNING_MAX_LISTENERS)
+  {
+    return NULL;
+  }
+
+  struct lightning_listener *listener = &config->listeners[config->listeners_count++];
+  memset(listener, 0, sizeof(struct lightning_listener));
+  listener->address = address;
+  listener->port = port;
+  listener->backlog = SOMAXCONN;
+  listener->send_buffer = LIGHTNING_SOCKET_BUFFER_SIZE;
+  listener->receive_buffer = LIGHTNING_SOCKET_BUFFER_SIZE;
+  return listener;
+}
+
+struct lightning_application *lightning_new_application_config(const struct lightning_config *config)
+{
+  if(config == NULL || config->listeners_count < 1 || config->listeners_count > LIGHTNING_MAX_LISTENERS ||
+     config->workers < 0 || config->max_connections < 0 || config->epoll_max_events < 1 ||
+     config->read_buffer_size < LIGHTNING_READ_BUFFER_MIN || config->read_buffer_size > LIGHTNING_READ_BUFFER_MAX ||
+     config->accept_batch < 1 || config->max_active_connections < 0 || config->max_loop_delay_us < 0 ||
+     (config->shed != LIGHTNING_SHED_REJECT && config->shed != LIGHTNING_SHED_BACKLOG))
+  {
+    LIGHTNING_ERROR("invalid configuration");
+    return NULL;
+  }
+
+  // The CPUs the workers are spread over: those we may run on, narrowed
+  // down by config->cpus. Under taskset or a cpuset they are neither all of
+  // them nor numbered from 0.
+  int cpus[LIGHTNING_TOPOLOGY_MAX_CPUS];
+  int cpus_count = 0;
+  bool listed[LIGHTNING_TOPOLOGY_MAX_CPUS];
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+
+  if(config->cpus != NULL && lightning_topology_parse_cpus(config->cpus, listed) == -1)
+  {
+    fprintf(stderr, "Error: \"%s\" is not a CPU list\n", config->cpus);
+    return NULL;
+  }
+
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+  {
+    for(long i = 0; i < sysconf(_SC_NPROCESSORS_CONF) && i < CPU_SETSIZE; i++)
+    {
+      CPU_SET(i, &allowed);
+    }
+  }
+
+  for(int cpu = 0; cpu < CPU_SETSIZE && cpu < LIGHTNING_TOPOLOGY_MAX_CPUS; cpu++)
+  {
+    if(CPU_ISSET(cpu, &allowed) && (config->cpus == NULL || listed[cpu]))
+    {
+      cpus[cpus_count++] = cpu;
+    }
+  }
+
+  if(cpus_count == 0 && config->cpus != NULL)
+  {
+    fprintf(stderr, "Error: none of the CPUs %s can be used\n", config->cpus);
+    return NULL;
+  }
+
+  if(cpus_count == 0)
+  {
+    cpus[cpus_count++] = 0;
+  }
+
   struct lightning_application *application = calloc(1, sizeof(struct lightning_application));
 
   if(application == NULL)
@@ -65,91 +217,863 @@ struct lightning_application *lightning_new_application(const unsigned short por
     return NULL;
   }
 
-  application->port = port;
-  application->workers_number = sysconf(_SC_NPROCESSORS_CONF);
+  // The pointers in the copy are only used until this function returns.
+  application->config = *config;
+  application->config.cpus = NULL;
+  application->backend = LIGHTNING_BACKEND_EPOLL;
+  application->max_body_size = LIGHTNING_MAX_BODY_SIZE;
+  application->body_spill_threshold = LIGHTNING_BODY_SPILL_THRESHOLD;
 
-  if(application->workers_number < 1)
+  const char *backend = getenv("LIGHTNING_BACKEND");
+  if(backend != NULL && strcmp(backend, "io_uring") == 0)
   {
-    application->workers_number = 1;
+    application->backend = LIGHTNING_BACKEND_IO_URING;
   }
+  const char *steering = getenv("LIGHTNING_CPU_STEERING");
+  application->cpu_steering = steering != NULL && strcmp(steering, "1") == 0;
 
+  // One worker per CPU unless told otherwise, more share them in turn.
+  application->workers_number = config->workers > 0 ? config->workers : cpus_count;
   application->workers = calloc(application->workers_number, sizeof(struct lightning_worker));
 
   if(application->workers == NULL)
   {
+    free(application);
     return NULL;
   }
 
-  struct rlimit rl;
-  getrlimit(RLIMIT_NOFILE, &rl);
-  int max_connections = rl.rlim_cur;
+  struct lightning_topology topology;
+  lightning_topology_detect(&topology);
 
   for(int i = 0; i < application->workers_number; i++)
   {
     struct lightning_worker *current_worker = &application->workers[i];
-    current_worker->server = lightning_create_server(application->port, max_connections);
+    int cpu = cpus[i % cpus_count];
 
-    if(current_worker->server == NULL)
+    current_worker->application = application;
+    current_worker->cpu = config->pin_workers ? cpu : -1;
+    current_worker->node = config->pin_workers ? topology.node[cpu] : -1;
+    for(int l = 0; l < LIGHTNING_MAX_LISTENERS; l++)
     {
-      for(int j = 0; j < i; j++)
+      current_worker->listen_fds[l] = -1;
+    }
+  }
+
+  application->router = lightning_router_create();
+
+  if(application->router == NULL)
+  {
+    free(application->workers);
+    free(application);
+    return NULL;
+  }
+
+  if(config->max_connections == 0)
+  {
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    application->config.max_connections = rl.rlim_cur;
+  }
+
+  // Hot restart: the listening sockets of the running generation, either
+  // inherited or asked for over its handoff socket.
+  struct lightning_handoff *handoff = &application->handoff;
+  const char *listen_fds = getenv("LIGHTNING_LISTEN_FDS");
+  application->handoff_path = getenv("LIGHTNING_HANDOFF_SOCKET");
+  lightning_handoff_init(handoff);
+
+  if(listen_fds != NULL && lightning_handoff_inherit(handoff, listen_fds) == -1)
+  {
+    LIGHTNING_ERROR("LIGHTNING_LISTEN_FDS lists a descriptor that is not a listening socket");
+  }
+  else if(listen_fds == NULL && application->handoff_path != NULL &&
+          lightning_handoff_receive(handoff, application->handoff_path, config->listeners[0].port) == -1)
+  {
+    LIGHTNING_ERROR("can not take over the listening sockets, binding new ones");
+  }
+
+  // Only the sockets are created here, in SO_REUSEPORT group order: worker
+  // by worker, one per listener, the order they are handed over in. Each
+  // worker builds its server on its own CPU (run_worker).
+  size_t taken_over = 0;
+
+  for(int i = 0; i < application->workers_number; i++)
+  {
+    struct lightning_worker *current_worker = &application->workers[i];
+
+    for(int l = 0; l < config->listeners_count; l++)
+    {
+      size_t index = (size_t)i * config->listeners_count + l;
+      int fd = -1;
+
+      if(index < handoff->received_count)
       {
-        lightning_destroy_server(application->workers[j].server);
+        fd = handoff->received[index];
+        handoff->received[index] = -1;
+
+        if(bound_port(fd) != config->listeners[l].port)
+        {
+          fprintf(stderr, "Warning: taken over socket %d is not bound to port %u, binding a new one\n",
+                  fd, (unsigned)config->listeners[l].port);
+          close(fd);
+          fd = -1;
+        }
+        else
+        {
+          taken_over++;
+        }
+      }
+
+      current_worker->listen_fds[l] = fd != -1 ? fd : lightning_server_listen(&config->listeners[l]);
+
+      if(current_worker->listen_fds[l] == -1)
+      {
+        for(int j = 0; j <= i; j++)
+        {
+          for(int k = 0; k < config->listeners_count; k++)
+          {
+            if(application->workers[j].listen_fds[k] >= 0)
+            {
+              close(application->workers[j].listen_fds[k]);
+            }
+          }
+        }
+        for(size_t j = index + 1; j < handoff->received_count; j++)
+        {
+          close(handoff->received[j]);
+        }
+        lightning_handoff_close(handoff);
+        lightning_router_destroy(application->router);
+        free(application->workers);
+        free(application);
+        return NULL;
       }
-      free(application->workers);
-      free(application);
-      return NULL;
     }
   }
 
+  for(int l = 0; l < config->listeners_count; l++)
+  {
+    application->config.listeners[l].address = NULL;
+  }
+
+  pthread_mutex_init(&application->start_lock, NULL);
+  pthread_cond_init(&application->start_cond, NULL);
+
+  // Fewer workers or listeners than the previous generation: the extra
+  // sockets leave their SO_REUSEPORT group, connections still in their
+  // queues are lost.
+  for(size_t i = (size_t)application->workers_number * config->listeners_count; i < handoff->received_count; i++)
+  {
+    fprintf(stderr, "Warning: closing taken over listening socket %d, there is no worker for it\n", handoff->received[i]);
+    close(handoff->received[i]);
+  }
+
   fprintf(stdout, "%s\n\n", LIGHTNING_BANNER);
   printf("Threads: %d\n", application->workers_number);
-  printf("Max simultaneous connections: %d\n", max_connections);
+  printf("Max simultaneous connections: %d\n", application->config.max_connections);
+  print_admission(&application->config);
+  printf("Parser scanner: %s\n", lightning_scan_backend());
+  print_topology(application, &topology);
+  print_listeners(config);
+  if(taken_over > 0)
+  {
+    printf("Listening sockets taken over: %zu\n", taken_over);
+  }
+  application->sockets_taken_over = taken_over > 0;
+  handoff->received_count = 0;
 
   return application;
 }
 
+int lightning_route(struct lightning_application *application,
+                    enum http_methods method,
+                    const char *pattern,
+                    lightning_handler handler,
+                    void *user_data)
+{
+  if(application == NULL)
+  {
+    return -1;
+  }
+
+  if(lightning_router_add(application->router, method, pattern, handler, NULL, user_data) == -1)
+  {
+    LIGHTNING_ERROR("invalid or duplicated route");
+    return -1;
+  }
+
+  return 0;
+}
+
+int lightning_route_stream(struct lightning_application *application,
+                           enum http_methods method,
+                           const char *pattern,
+                           lightning_body_handler body_handler,
+                           lightning_handler handler,
+                           void *user_data)
+{
+  if(application == NULL || body_handler == NULL)
+  {
+    return -1;
+  }
+
+  if(lightning_router_add(application->router, method, pattern, handler, body_handler, user_data) == -1)
+  {
+    LIGHTNING_ERROR("invalid or duplicated route");
+    return -1;
+  }
+
+  return 0;
+}
+
+int lightning_route_cached(struct lightning_application *application,
+                           const char *pattern,
+                           lightning_handler handler,
+                           void *user_data,
+                           const struct lightning_cache_policy *policy)
+{
+  if(application == NULL || policy == NULL)
+  {
+    return -1;
+  }
+
+  int vary_count = 0;
+  while(policy->vary != NULL && policy->vary[vary_count] != NULL)
+  {
+    if(vary_count == LIGHTNING_CACHE_VARY_MAX)
+    {
+      LIGHTNING_ERROR("too many Vary headers in the cache policy");
+      return -1;
+    }
+    vary_count++;
+  }
+
+  if(policy->shared && application->shared_responses == NULL)
+  {
+    application->shared_responses = lightning_shared_cache_create(application->workers_number,
+                                                                  application->config.shared_response_cache_size);
+    if(application->shared_responses == NULL)
+    {
+      LIGHTNING_ERROR("can not allocate the shared response cache");
+      return -1;
+    }
+  }
+
+  struct lightning_cache_rule *rule = calloc(1, sizeof(struct lightning_cache_rule));
+  if(rule == NULL)
+  {
+    return -1;
+  }
+
+  rule->ttl_ms = policy->ttl_ms;
+  rule->shared = policy->shared;
+  for(int i = 0; i < vary_count; i++)
+  {
+    rule->vary[i] = strdup(policy->vary[i]);
+    if(rule->vary[i] == NULL)
+    {
+      free_cache_rule(rule);
+      return -1;
+    }
+    rule->vary_count++;
+  }
+
+  if(lightning_router_add_cached(application->router, pattern, handler, user_data, rule) == -1)
+  {
+    LIGHTNING_ERROR("invalid or duplicated route");
+    free_cache_rule(rule);
+    return -1;
+  }
+
+  rule->next = application->cache_rules;
+  application->cache_rules = rule;
+  return 0;
+}
+
+int lightning_set_body_limits(struct lightning_application *application, size_t max_body_size, size_t spill_threshold)
+{
+  if(application == NULL || max_body_size == 0)
+  {
+    return -1;
+  }
+
+  application->max_body_size = max_body_size;
+  application->body_spill_threshold = spill_threshold;
+  return 0;
+}
+
+int lightning_static(struct lightning_application *application, const char *prefix, const char *directory)
+{
+  if(application == NULL || prefix == NULL || directory == NULL || prefix[0] != '/')
+  {
+    return -1;
+  }
+
+  char pattern[LIGHTNING_STATIC_PATH_MAX];
+  size_t length = strlen(prefix);
+
+  while(length > 0 && prefix[length - 1] == '/')
+  {
+    length--;
+  }
+
+  if(length + sizeof("/*path") > sizeof(pattern))
+  {
+    LIGHTNING_ERROR("static route prefix too long");
+    return -1;
+  }
+
+  memcpy(pattern, prefix, length);
+  memcpy(pattern + length, "/*path", sizeof("/*path"));
+
+  struct lightning_static_directory *root = lightning_static_directory_open(directory);
+  if(root == NULL)
+  {
+    fprintf(stderr, "[Lightning Error]: can not open static directory %s\n", directory);
+    return -1;
+  }
+
+  if(lightning_router_add_static(application->router, pattern, root) == -1)
+  {
+    LIGHTNING_ERROR("invalid or duplicated route");
+    lightning_static_directory_close(root);
+    return -1;
+  }
+
+  root->next = application->directories;
+  application->directories = root;
+  return 0;
+}
+
+const struct lightning_response_prefix *lightning_response_prefix(struct lightning_application *application,
+                                                                  int status_code,
+                                                                  const char *content_type,
+                                                                  const char *const headers[])
+{
+  if(application == NULL)
+  {
+    return NULL;
+  }
+
+  struct lightning_response_prefix *prefix = lightning_response_prefix_create(status_code, content_type, headers);
+  if(prefix == NULL)
+  {
+    LIGHTNING_ERROR("invalid response prefix");
+    return NULL;
+  }
+
+  prefix->next = application->prefixes;
+  application->prefixes = prefix;
+  return prefix;
+}
+
+int lightning_set_backend(struct lightning_application *application, enum lightning_backend backend)
+{
+  if(application == NULL || (backend != LIGHTNING_BACKEND_EPOLL && backend != LIGHTNING_BACKEND_IO_URING))
+  {
+    return -1;
+  }
+
+  application->backend = backend;
+  return 0;
+}
+
+int lightning_set_cpu_steering(struct lightning_application *application, int enabled)
+{
+  if(application == NULL)
+  {
+    return -1;
+  }
+
+  application->cpu_steering = enabled != 0;
+  return 0;
+}
+
+int lightning_access_log(struct lightning_application *application,
+                         const char *path,
+                         enum lightning_access_log_format format,
+                         enum lightning_access_log_overflow overflow)
+{
+  if(application == NULL || path == NULL || application->access_log != NULL ||
+     (format != LIGHTNING_ACCESS_LOG_JSON && format != LIGHTNING_ACCESS_LOG_BINARY) ||
+     (overflow != LIGHTNING_ACCESS_LOG_DROP && overflow != LIGHTNING_ACCESS_LOG_SAMPLE))
+  {
+    return -1;
+  }
+
+  application->access_log = lightning_access_log_create(path, format, overflow, application->workers_number);
+
+  if(application->access_log == NULL)
+  {
+    fprintf(stderr, "Warning: can not open the access log %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+int lightning_serve_metrics(struct lightning_application *application, const char *path)
+{
+  if(application == NULL || path == NULL)
+  {
+    return -1;
+  }
+
+  return lightning_route(application, HTTP_GET, path, serve_metrics, application);
+}
+
+/*
+ * Runs on whichever worker got the request and reads the others' counters
+ * while they keep going: each value is exact, the set is not a snapshot.
+ */
+static void serve_metrics(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data)
+{
+  struct lightning_application *application = user_data;
+  const struct lightning_metrics **workers = lightning_request_alloc(request, application->workers_number * sizeof(*workers));
+  char *text = lightning_request_alloc(request, LIGHTNING_METRICS_TEXT_SIZE);
+
+  if(workers == NULL || text == NULL)
+  {
+    lightning_response_status(response, 500);
+    return;
+  }
+
+  for(int i = 0; i < application->workers_number; i++)
+  {
+    const struct lightning_server *server = __atomic_load_n(&application->workers[i].server, __ATOMIC_ACQUIRE);
+    workers[i] = server != NULL ? server->metrics : NULL;
+  }
+
+  struct lightning_arena_stats arena;
+  lightning_arena_usage(application, &arena);
+
+  size_t length = lightning_metrics_render(workers, application->workers_number, &arena, text, LIGHTNING_METRICS_TEXT_SIZE);
+  lightning_response_body(response, "text/plain; version=0.0.4; charset=utf-8", text, length);
+}
+
+void lightning_arena_usage(const struct lightning_application *application, struct lightning_arena_stats *stats)
+{
+  if(application == NULL || stats == NULL)
+  {
+    return;
+  }
+
+  memset(stats, 0, sizeof(struct lightning_arena_stats));
+  stats->block_size = LIGHTNING_ARENA_BLOCK_SIZE;
+
+  for(int i = 0; i < application->workers_number; i++)
+  {
+    const struct lightning_server *server = __atomic_load_n(&application->workers[i].server, __ATOMIC_ACQUIRE);
+    if(server == NULL)
+    {
+      continue;
+    }
+
+    const struct lightning_arena_stats *worker = &server->arena_stats;
+    size_t high_water = __atomic_load_n(&worker->high_water, __ATOMIC_RELAXED);
+
+    if(high_water > stats->high_water)
+    {
+      stats->high_water = high_water;
+    }
+    stats->cycles += __atomic_load_n(&worker->cycles, __ATOMIC_RELAXED);
+    stats->overflows += __atomic_load_n(&worker->overflows, __ATOMIC_RELAXED);
+    stats->large_allocations += __atomic_load_n(&worker->large_allocations, __ATOMIC_RELAXED);
+  }
+}
+
 void lightning_ride(struct lightning_application *application)
 {
   int created_threads = 0;
 
+  if(lightning_router_compile(application->router) == -1)
+  {
+    LIGHTNING_ERROR("can not compile the route table");
+    return;
+  }
+
+  printf("Routes: %zu\n", lightning_router_count(application->router));
+  printf("Backend: %s\n", application->backend == LIGHTNING_BACKEND_IO_URING ? "io_uring" : "epoll");
+
+  steer_connections(application);
+  application->started = 0;
+
+  if(application->access_log != NULL && lightning_access_log_start(application->access_log) == -1)
+  {
+    LIGHTNING_ERROR("can not start the access log thread");
+    return;
+  }
+
+  struct sigaction stop_action;
+  struct sigaction previous_term;
+  struct sigaction previous_int;
+  bool term_installed = false;
+  bool int_installed = false;
+
+  memset(&stop_action, 0, sizeof(stop_action));
+  stop_action.sa_handler = handle_stop_signal;
+  sigemptyset(&stop_action.sa_mask);
+  stop_action.sa_flags = SA_RESTART;
+  riding_application = application;
+
+  // Handlers the program installed itself, or SIG_IGN from a shell running
+  // us in the background, are left alone.
+  if(sigaction(SIGTERM, NULL, &previous_term) == 0 && previous_term.sa_handler == SIG_DFL)
+  {
+    term_installed = sigaction(SIGTERM, &stop_action, NULL) == 0;
+  }
+
+  if(sigaction(SIGINT, NULL, &previous_int) == 0 && previous_int.sa_handler == SIG_DFL)
+  {
+    int_installed = sigaction(SIGINT, &stop_action, NULL) == 0;
+  }
+
+  bool failed = false;
+
   for(int i = 0; i < application->workers_number; i++)
   {
     struct lightning_worker *current_worker = &application->workers[i];
-    if(pthread_create(&current_worker->id, NULL, ride_the_lightning, (void *)current_worker->server) != 0)
+    pthread_attr_t attributes;
+    cpu_set_t cpuset;
+
+    // Pinned before its first instruction, not after: whatever the worker
+    // allocates is first touched on its own NUMA node.
+    CPU_ZERO(&cpuset);
+    pthread_attr_init(&attributes);
+    if(current_worker->cpu >= 0)
+    {
+      CPU_SET(current_worker->cpu, &cpuset);
+      pthread_attr_setaffinity_np(&attributes, sizeof(cpu_set_t), &cpuset);
+    }
+
+    int error = pthread_create(&current_worker->id, &attributes, run_worker, current_worker);
+    pthread_attr_destroy(&attributes);
+
+    if(error == EINVAL)
+    {
+      fprintf(stderr, "Warning: Failed to set CPU affinity for worker %d\n", i);
+      error = pthread_create(&current_worker->id, NULL, run_worker, current_worker);
+    }
+
+    if(error != 0)
+    {
+      LIGHTNING_ERROR("failed to create worker thread");
+      failed = true;
+      break;
+    }
+
+    created_threads++;
+  }
+
+  pthread_mutex_lock(&application->start_lock);
+  while(application->started < created_threads)
+  {
+    pthread_cond_wait(&application->start_cond, &application->start_lock);
+  }
+  pthread_mutex_unlock(&application->start_lock);
+
+  for(int i = 0; i < created_threads; i++)
+  {
+    failed = failed || application->workers[i].server == NULL;
+  }
+
+  if(failed)
+  {
+    for(int j = 0; j < created_threads; j++)
+    {
+      lightning_server_stop(application->workers[j].server);
+    }
+
+    for(int j = 0; j < created_threads; j++)
     {
-      for(int j = 0; j < application->workers_number; j++)
+      pthread_join(application->workers[j].id, NULL);
+    }
+
+    LIGHTNING_ERROR("can not start the workers");
+    created_threads = 0;
+  }
+  else if(__atomic_load_n(&application->stopping, __ATOMIC_ACQUIRE))
+  {
+    // Stopped while the servers did not exist yet.
+    for(int i = 0; i < created_threads; i++)
+    {
+      lightning_server_drain(application->workers[i].server);
+    }
+  }
+
+  if(created_threads > 0)
+  {
+    // Everyone is accepting: the previous generation may drain now, and the
+    // next one can ask us for the sockets.
+    lightning_handoff_acknowledge(&application->handoff);
+
+    if(application->handoff_path != NULL)
+    {
+      int sockets[LIGHTNING_HANDOFF_MAX_SOCKETS];
+      size_t count = 0;
+
+      for(int i = 0; i < application->workers_number; i++)
       {
-        lightning_server_stop(application->workers[j].server);
+        const struct lightning_server *server = application->workers[i].server;
+        for(int l = 0; l < server->listen_count && count < LIGHTNING_HANDOFF_MAX_SOCKETS; l++)
+        {
+          sockets[count++] = server->listen_fds[l];
+        }
       }
 
-      for(int j = 0; j < created_threads; j++)
+      if(lightning_handoff_serve(&application->handoff, application->handoff_path, application->config.listeners[0].port,
+                                 sockets, count, handle_handoff, application) == -1)
       {
-        pthread_join(application->workers[j].id, NULL);
+        LIGHTNING_ERROR("can not serve the listening socket handoff");
       }
+    }
+  }
 
-      LIGHTNING_ERROR("failed to create worker thread");
-      return;
+  for(int i = 0; i < created_threads; i++)
+  {
+    pthread_join(application->workers[i].id, NULL); 
+    printf("Thread[%d] finish.\n", i);
+  }
+
+  // The workers are gone: what they logged last is written now.
+  lightning_access_log_stop(application->access_log);
+
+  if(term_installed)
+  {
+    sigaction(SIGTERM, &previous_term, NULL);
+  }
+
+  if(int_installed)
+  {
+    sigaction(SIGINT, &previous_int, NULL);
+  }
+  riding_application = NULL;
+  lightning_handoff_close(&application->handoff);
+}
+
+void lightning_stop(struct lightning_application *application)
+{
+  if(application == NULL)
+  {
+    return;
+  }
+
+  // A second request does not wait for the connections any more.
+  bool forced = __atomic_exchange_n(&application->stopping, true, __ATOMIC_ACQ_REL);
+  lightning_handoff_interrupt(&application->handoff);
+
+  for(int i = 0; i < application->workers_number; i++)
+  {
+    struct lightning_server *server = __atomic_load_n(&application->workers[i].server, __ATOMIC_ACQUIRE);
+
+    if(forced)
+    {
+      lightning_server_stop(server);
+    }
+    else
+    {
+      lightning_server_drain(server);
+    }
+  }
+}
+
+/*
+ * Worker i is pinned to workers[i].cpu and each of its listeners joined
+ * its SO_REUSEPORT group i-th, so the steering program maps one to the
+ * other.
+ * Sockets taken over keep a program an earlier generation attached: it is
+ * removed when steering is off.
+ */
+static void steer_connections(struct lightning_application *application)
+{
+  const struct lightning_config *config = &application->config;
+
+  if(application->cpu_steering && !config->pin_workers)
+  {
+    fprintf(stderr, "Warning: CPU steering needs pinned workers, connections are hashed\n");
+  }
+
+  if(!application->cpu_steering || !config->pin_workers)
+  {
+    for(int l = 0; l < config->listeners_count && application->sockets_taken_over; l++)
+    {
+      lightning_steering_detach(application->workers[0].listen_fds[l]);
     }
+    return;
+  }
 
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(i, &cpuset);
+  int *sockets = malloc(application->workers_number * sizeof(int));
+  int *cpus = malloc(application->workers_number * sizeof(int));
 
-    if(pthread_setaffinity_np(current_worker->id, sizeof(cpu_set_t), &cpuset) != 0)
+  // One program per SO_REUSEPORT group, that is per listener.
+  for(int l = 0; l < config->listeners_count && sockets != NULL && cpus != NULL; l++)
+  {
+    for(int i = 0; i < application->workers_number; i++)
     {
-      fprintf(stderr, "Warning: Failed to set CPU affinity for worker %d\n", i);
+      sockets[i] = application->workers[i].listen_fds[l];
+      cpus[i] = application->workers[i].cpu;
     }
 
-    created_threads++;
+    if(lightning_steering_attach(sockets, cpus, application->workers_number) == 0)
+    {
+      printf("CPU steering: %d listeners on port %u\n", application->workers_number, (unsigned)config->listeners[l].port);
+    }
+    else
+    {
+      fprintf(stderr, "Warning: CPU steering unavailable (%s), connections are hashed\n", strerror(errno));
+      break;
+    }
+  }
+
+  free(sockets);
+  free(cpus);
+}
+
+/*
+ * Runs on the worker's own CPU: the server, its connection table, pools and
+ * timer wheel are first touched here, so they live on the worker's NUMA node.
+ */
+static void *run_worker(void *data)
+{
+  struct lightning_worker *worker = data;
+  struct lightning_application *application = worker->application;
+  struct lightning_server *server = lightning_create_server(&application->config, worker->listen_fds, application->config.listeners_count);
+
+  for(int l = 0; l < LIGHTNING_MAX_LISTENERS; l++)
+  {
+    worker->listen_fds[l] = -1;
+  }
+
+  if(server != NULL)
+  {
+    lightning_server_set_router(server, application->router);
+    lightning_server_set_backend(server, application->backend);
+    lightning_server_set_body_limits(server, application->max_body_size, application->body_spill_threshold);
+    lightning_server_set_shared_cache(server, application->shared_responses, worker - application->workers);
+    if(application->access_log != NULL)
+    {
+      lightning_server_set_access_log(server, application->access_log->rings[worker - application->workers]);
+    }
+  }
+
+  __atomic_store_n(&worker->server, server, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&application->start_lock);
+  application->started++;
+  pthread_cond_signal(&application->start_cond);
+  pthread_mutex_unlock(&application->start_lock);
+
+  return ride_the_lightning(server);
+}
+
+static void print_topology(const struct lightning_application *application, const struct lightning_topology *topology)
+{
+  const char *separator = " (workers: ";
+  printf("NUMA nodes: %d", topology->nodes);
+
+  for(int node = 0; node < topology->nodes; node++)
+  {
+    int workers = 0;
+    for(int i = 0; i < application->workers_number; i++)
+    {
+      workers += application->workers[i].node == node;
+    }
+
+    if(workers > 0)
+    {
+      printf("%s%d on node %d", separator, workers, node);
+      separator = ", ";
+    }
+  }
+
+  printf("%s\n", application->config.pin_workers ? ")" : " (workers not pinned)");
+}
+
+static void print_listeners(const struct lightning_config *config)
+{
+  printf("Listening on:");
+
+  for(int l = 0; l < config->listeners_count; l++)
+  {
+    const struct lightning_listener *listener = &config->listeners[l];
+    const char *address = listener->address != NULL ? listener->address : "0.0.0.0";
+    bool ipv6 = strchr(address, ':') != NULL;
+
+    printf(ipv6 ? " [%s]:%u" : " %s:%u", address, (unsigned)listener->port);
   }
 
+  printf("\n");
+}
+
+static void print_admission(const struct lightning_config *config)
+{
+  printf("Accept batch: %d", config->accept_batch);
+
+  if(config->max_active_connections > 0 || config->max_loop_delay_us > 0)
+  {
+    printf(", shedding (%s) past", config->shed == LIGHTNING_SHED_REJECT ? "503" : "backlog");
+    if(config->max_active_connections > 0)
+    {
+      printf(" %d connections", config->max_active_connections);
+    }
+    if(config->max_loop_delay_us > 0)
+    {
+      printf("%s %d us of loop delay", config->max_active_connections > 0 ? " or" : "", config->max_loop_delay_us);
+    }
+  }
+
+  printf("\n");
+}
+
+static void free_cache_rule(struct lightning_cache_rule *rule)
+{
+  for(int i = 0; i < rule->vary_count; i++)
+  {
+    free(rule->vary[i]);
+  }
+  free(rule);
+}
+
+// -1 when `fd` is not a bound IPv4 or IPv6 socket.
+static int bound_port(int fd)
+{
+  union lightning_socket_address address;
+  socklen_t length = sizeof(address);
+
+  if(getsockname(fd, &address.any, &length) == -1)
+  {
+    return -1;
+  }
+
+  if(address.any.sa_family == AF_INET)
+  {
+    return ntohs(address.ipv4.sin_port);
+  }
+
+  return address.any.sa_family == AF_INET6 ? ntohs(address.ipv6.sin6_port) : -1;
+}
+
+static void handle_handoff(void *data)
+{
+  struct lightning_application *application = data;
+
+  // Counts as the first stop request, a later one stops at once.
+  __atomic_store_n(&application->stopping, true, __ATOMIC_RELEASE);
+
   for(int i = 0; i < application->workers_number; i++)
   {
-    pthread_join(application->workers[i].id, NULL); 
-    printf("Thread[%d] finish.\n", i);
+    lightning_server_hand_off(application->workers[i].server);
   }
 }
 
+static void handle_stop_signal(int signal_number)
+{
+  (void)signal_number;
+  int saved_errno = errno;
+  lightning_stop(riding_application);
+  errno = saved_errno;
+}
+
 void lightning_destroy(struct lightning_application *application)
 {
   if(application == NULL)
@@ -165,9 +1089,46 @@ void lightning_destroy(struct lightning_application *application)
       {
         lightning_destroy_server(application->workers[i].server);
       }
+      else
+      {
+        for(int l = 0; l < LIGHTNING_MAX_LISTENERS; l++)
+        {
+          if(application->workers[i].listen_fds[l] >= 0)
+          {
+            close(application->workers[i].listen_fds[l]);
+          }
+        }
+      }
     }
     free(application->workers);
   }
 
+  while(application->prefixes != NULL)
+  {
+    struct lightning_response_prefix *next = application->prefixes->next;
+    free(application->prefixes);
+    application->prefixes = next;
+  }
+
+  while(application->directories != NULL)
+  {
+    struct lightning_static_directory *next = application->directories->next;
+    lightning_static_directory_close(application->directories);
+    application->directories = next;
+  }
+
+  while(application->cache_rules != NULL)
+  {
+    struct lightning_cache_rule *next = application->cache_rules->next;
+    free_cache_rule(application->cache_rules);
+    application->cache_rules = next;
+  }
+
+  lightning_shared_cache_destroy(application->shared_responses);
+  lightning_handoff_close(&application->handoff);
+  lightning_access_log_destroy(application->access_log);
+  pthread_mutex_destroy(&application->start_lock);
+  pthread_cond_destroy(&application->start_cond);
+  lightning_router_destroy(application->router);
   free(application);
 }
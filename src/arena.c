@@ -0,0 +1,138 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "internal/arena.h"
+
+struct lightning_arena_block
+{
+  struct lightning_arena_block *next;
+  alignas(max_align_t) char data[];
+};
+
+#define ARENA_BLOCK_PAYLOAD (LIGHTNING_ARENA_BLOCK_SIZE - offsetof(struct lightning_arena_block, data))
+
+static void *arena_alloc_large(struct lightning_arena *arena, size_t size);
+
+void lightning_arena_init(struct lightning_arena *arena, struct lightning_pool *pool, struct lightning_arena_stats *stats)
+{
+  arena->pool = pool;
+  arena->stats = stats;
+  arena->blocks = NULL;
+  arena->large = NULL;
+  arena->cursor = NULL;
+  arena->end = NULL;
+  arena->used = 0;
+}
+
+void *lightning_arena_alloc(struct lightning_arena *arena, size_t size)
+{
+  size_t alignment = alignof(max_align_t);
+
+  if(size == 0 || size > SIZE_MAX - alignment)
+  {
+    return NULL;
+  }
+
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  if(arena->cursor == NULL || (size_t)(arena->end - arena->cursor) < size)
+  {
+    if(size > ARENA_BLOCK_PAYLOAD)
+    {
+      return arena_alloc_large(arena, size);
+    }
+
+    struct lightning_arena_block *block = lightning_pool_acquire(arena->pool);
+    if(block == NULL)
+    {
+      return NULL;
+    }
+
+    // The tail of the previous block is given up: handlers allocate a
+    // handful of small objects, chasing holes is not worth it.
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->cursor = block->data;
+    arena->end = (char *)block + LIGHTNING_ARENA_BLOCK_SIZE;
+  }
+
+  void *memory = arena->cursor;
+  arena->cursor += size;
+  arena->used += size;
+  return memory;
+}
+
+void lightning_arena_reset(struct lightning_arena *arena)
+{
+  if(arena->used == 0)
+  {
+    return;
+  }
+
+  // Only the owning worker writes the statistics; relaxed stores keep the
+  // reads from lightning_arena_usage well defined.
+  struct lightning_arena_stats *stats = arena->stats;
+  __atomic_store_n(&stats->cycles, stats->cycles + 1, __ATOMIC_RELAXED);
+
+  if(arena->used > stats->high_water)
+  {
+    __atomic_store_n(&stats->high_water, arena->used, __ATOMIC_RELAXED);
+  }
+
+  if(arena->blocks != NULL && arena->blocks->next != NULL)
+  {
+    __atomic_store_n(&stats->overflows, stats->overflows + 1, __ATOMIC_RELAXED);
+  }
+
+  while(arena->blocks != NULL)
+  {
+    struct lightning_arena_block *next = arena->blocks->next;
+    lightning_pool_release(arena->pool, arena->blocks);
+    arena->blocks = next;
+  }
+
+  while(arena->large != NULL)
+  {
+    struct lightning_arena_block *next = arena->large->next;
+    free(arena->large);
+    arena->large = next;
+  }
+
+  arena->cursor = NULL;
+  arena->end = NULL;
+  arena->used = 0;
+}
+
+static void *arena_alloc_large(struct lightning_arena *arena, size_t size)
+{
+  struct lightning_arena_block *block = malloc(sizeof(struct lightning_arena_block) + size);
+  if(block == NULL)
+  {
+    return NULL;
+  }
+
+  block->next = arena->large;
+  arena->large = block;
+  arena->used += size;
+  __atomic_store_n(&arena->stats->large_allocations, arena->stats->large_allocations + 1, __ATOMIC_RELAXED);
+  return block->data;
+}
@@ -0,0 +1,168 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "internal/body.h"
+
+static int spill(struct lightning_body_store *store);
+static int write_all(int fd, const char *data, size_t length);
+
+void lightning_body_store_init(struct lightning_body_store *store)
+{
+  store->data = NULL;
+  store->length = 0;
+  store->capacity = 0;
+  store->mapping = NULL;
+  store->fd = -1;
+}
+
+int lightning_body_store_append(struct lightning_body_store *store, const void *data, size_t length, size_t spill_threshold)
+{
+  if(length == 0)
+  {
+    return 0;
+  }
+
+  if(store->fd == -1 && store->length + length > spill_threshold && spill(store) == -1)
+  {
+    return -1;
+  }
+
+  if(store->fd != -1)
+  {
+    if(write_all(store->fd, data, length) == -1)
+    {
+      return -1;
+    }
+    store->length += length;
+    return 0;
+  }
+
+  if(store->length + length > store->capacity)
+  {
+    size_t capacity = store->capacity == 0 ? 4096 : store->capacity;
+    while(capacity < store->length + length)
+    {
+      capacity *= 2;
+    }
+
+    char *grown = realloc(store->data, capacity);
+    if(grown == NULL)
+    {
+      return -1;
+    }
+    store->data = grown;
+    store->capacity = capacity;
+  }
+
+  memcpy(store->data + store->length, data, length);
+  store->length += length;
+  return 0;
+}
+
+const void *lightning_body_store_finish(struct lightning_body_store *store)
+{
+  if(store->fd == -1 || store->length == 0)
+  {
+    return store->data;
+  }
+
+  if(store->mapping == NULL)
+  {
+    void *mapping = mmap(NULL, store->length, PROT_READ, MAP_PRIVATE, store->fd, 0);
+    if(mapping == MAP_FAILED)
+    {
+      return NULL;
+    }
+    store->mapping = mapping;
+  }
+
+  return store->mapping;
+}
+
+void lightning_body_store_release(struct lightning_body_store *store)
+{
+  if(store->mapping != NULL)
+  {
+    munmap(store->mapping, store->length);
+  }
+
+  if(store->fd != -1)
+  {
+    close(store->fd);
+  }
+
+  free(store->data);
+  lightning_body_store_init(store);
+}
+
+static int spill(struct lightning_body_store *store)
+{
+  const char *directory = getenv("TMPDIR");
+  if(directory == NULL || directory[0] == '\0')
+  {
+    directory = "/tmp";
+  }
+
+  // Never linked into the directory: it disappears with its descriptor.
+  int fd = open(directory, O_TMPFILE | O_RDWR | O_EXCL | O_CLOEXEC, 0600);
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  if(write_all(fd, store->data, store->length) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+
+  free(store->data);
+  store->data = NULL;
+  store->capacity = 0;
+  store->fd = fd;
+  return 0;
+}
+
+static int write_all(int fd, const char *data, size_t length)
+{
+  while(length > 0)
+  {
+    ssize_t written = write(fd, data, length);
+    if(written == -1)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      return -1;
+    }
+
+    data += written;
+    length -= written;
+  }
+
+  return 0;
+}
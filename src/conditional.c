@@ -0,0 +1,283 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "lightning/http.h"
+#include "internal/conditional.h"
+#include "internal/date.h"
+
+static bool etag_listed(const char *list, size_t length, const char *etag, size_t etag_length);
+static bool if_range_matches(const struct lightning_http_request *request, const char *etag, size_t etag_length, time_t last_modified);
+static bool parse_number(const char *input, size_t length, size_t *position, uint64_t *value);
+static void skip_spaces(const char *input, size_t length, size_t *position);
+
+uint64_t lightning_etag_hash(uint64_t hash, const void *data, size_t length)
+{
+  const unsigned char *bytes = data;
+
+  for(size_t i = 0; i < length; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211u;
+  }
+
+  return hash;
+}
+
+void lightning_etag_format(char *output, uint64_t hash)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  output[0] = '"';
+  for(int i = 0; i < 16; i++)
+  {
+    output[1 + i] = hex[(hash >> ((15 - i) * 4)) & 0xf];
+  }
+  output[LIGHTNING_ETAG_LENGTH - 1] = '"';
+}
+
+bool lightning_request_not_modified(const struct lightning_http_request *request,
+                                    const char *etag,
+                                    size_t etag_length,
+                                    time_t last_modified)
+{
+  size_t length = 0;
+  const char *value = lightning_request_header(request, "If-None-Match", &length);
+
+  // If-Modified-Since only counts without If-None-Match.
+  if(value != NULL)
+  {
+    return etag != NULL && etag_listed(value, length, etag, etag_length);
+  }
+
+  if(last_modified == -1 || (value = lightning_request_header(request, "If-Modified-Since", &length)) == NULL)
+  {
+    return false;
+  }
+
+  time_t since = lightning_http_date_parse(value, length);
+  return since != -1 && last_modified <= since;
+}
+
+enum lightning_range_result lightning_request_ranges(const struct lightning_http_request *request,
+                                                     uint64_t size,
+                                                     const char *etag,
+                                                     size_t etag_length,
+                                                     time_t last_modified,
+                                                     struct lightning_byte_range *ranges,
+                                                     int *count)
+{
+  static const char unit[] = "bytes=";
+  size_t length = 0;
+  const char *value = lightning_request_header(request, "Range", &length);
+
+  if(value == NULL || length < sizeof(unit) - 1 || strncasecmp(value, unit, sizeof(unit) - 1) != 0 ||
+     !if_range_matches(request, etag, etag_length, last_modified))
+  {
+    return LIGHTNING_RANGE_NONE;
+  }
+
+  size_t position = sizeof(unit) - 1;
+  int specs = 0;
+  int satisfiable = 0;
+
+  while(position < length)
+  {
+    skip_spaces(value, length, &position);
+    if(position < length && value[position] == ',')
+    {
+      position++;
+      continue;
+    }
+    if(position == length)
+    {
+      break;
+    }
+
+    uint64_t first = 0;
+    uint64_t last = UINT64_MAX;
+    bool suffix = value[position] == '-';
+
+    if(suffix)
+    {
+      position++;
+      if(!parse_number(value, length, &position, &last))
+      {
+        return LIGHTNING_RANGE_NONE;
+      }
+    }
+    else
+    {
+      if(!parse_number(value, length, &position, &first) || position == length || value[position] != '-')
+      {
+        return LIGHTNING_RANGE_NONE;
+      }
+      position++;
+      if(position < length && value[position] >= '0' && value[position] <= '9' &&
+         (!parse_number(value, length, &position, &last) || last < first))
+      {
+        return LIGHTNING_RANGE_NONE;
+      }
+    }
+
+    skip_spaces(value, length, &position);
+    if((position < length && value[position] != ',') || ++specs > LIGHTNING_RANGES_MAX)
+    {
+      return LIGHTNING_RANGE_NONE;
+    }
+
+    // "-n" is the last n bytes. Ranges starting past the end are dropped,
+    // those ending past it are cut.
+    if(suffix)
+    {
+      if(last == 0 || size == 0)
+      {
+        continue;
+      }
+      first = last >= size ? 0 : size - last;
+      last = size - 1;
+    }
+    else if(first >= size)
+    {
+      continue;
+    }
+    else if(last >= size)
+    {
+      last = size - 1;
+    }
+
+    ranges[satisfiable].first = first;
+    ranges[satisfiable].length = last - first + 1;
+    satisfiable++;
+  }
+
+  if(specs == 0)
+  {
+    return LIGHTNING_RANGE_NONE;
+  }
+
+  *count = satisfiable;
+  return satisfiable > 0 ? LIGHTNING_RANGE_SATISFIABLE : LIGHTNING_RANGE_UNSATISFIABLE;
+}
+
+/*
+ * Weak comparison: W/"x" and "x" match. A malformed list matches nothing,
+ * so the full response is sent.
+ */
+static bool etag_listed(const char *list, size_t length, const char *etag, size_t etag_length)
+{
+  if(etag_length > 2 && etag[0] == 'W' && etag[1] == '/')
+  {
+    etag += 2;
+    etag_length -= 2;
+  }
+
+  size_t position = 0;
+  while(position < length)
+  {
+    skip_spaces(list, length, &position);
+    if(position < length && list[position] == ',')
+    {
+      position++;
+      continue;
+    }
+    if(position == length)
+    {
+      break;
+    }
+
+    if(list[position] == '*')
+    {
+      return true;
+    }
+
+    if(length - position > 2 && list[position] == 'W' && list[position + 1] == '/')
+    {
+      position += 2;
+    }
+
+    const char *tag = list + position;
+    const char *end = position < length && *tag == '"' ? memchr(tag + 1, '"', length - position - 1) : NULL;
+    if(end == NULL)
+    {
+      return false;
+    }
+
+    size_t tag_length = end + 1 - tag;
+    if(tag_length == etag_length && memcmp(tag, etag, etag_length) == 0)
+    {
+      return true;
+    }
+    position += tag_length;
+  }
+
+  return false;
+}
+
+/*
+ * Without If-Range the range applies. With it, only to the representation
+ * it names: the same strong entity tag, or exactly the same date.
+ */
+static bool if_range_matches(const struct lightning_http_request *request, const char *etag, size_t etag_length, time_t last_modified)
+{
+  size_t length = 0;
+  const char *value = lightning_request_header(request, "If-Range", &length);
+
+  if(value == NULL)
+  {
+    return true;
+  }
+
+  if(length > 0 && value[0] == '"')
+  {
+    return etag != NULL && etag[0] == '"' && length == etag_length && memcmp(value, etag, length) == 0;
+  }
+
+  return last_modified != -1 && lightning_http_date_parse(value, length) == last_modified;
+}
+
+static bool parse_number(const char *input, size_t length, size_t *position, uint64_t *value)
+{
+  size_t start = *position;
+  uint64_t result = 0;
+
+  while(*position < length && input[*position] >= '0' && input[*position] <= '9')
+  {
+    if(result > (UINT64_MAX - 9) / 10)
+    {
+      return false;
+    }
+    result = result * 10 + (uint64_t)(input[*position] - '0');
+    (*position)++;
+  }
+
+  *value = result;
+  return *position > start;
+}
+
+static void skip_spaces(const char *input, size_t length, size_t *position)
+{
+  while(*position < length && (input[*position] == ' ' || input[*position] == '\t'))
+  {
+    (*position)++;
+  }
+}
@@ -16,30 +16,22 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <time.h>
 
 #include "internal/connection.h"
 
 struct lightning_connection *lightning_create_connection(int max_connections)
 {
-  struct lightning_connection *connections = calloc(max_connections, sizeof(struct lightning_connection));
-  if(connections == NULL)
-  {
-    return NULL;
-  }
-
-  for(int i = 0; i < max_connections; i++)
-  {
-    lightning_connection_reset(&connections[i]);
-  }
-
-  return connections;
+  // A zeroed slot is a closed connection (CONN_STATE_CLOSED, no buffers), so
+  // the table is not touched here and only the pages of slots that actually
+  // get used are ever faulted in.
+  return calloc(max_connections, sizeof(struct lightning_connection));
 }
 
-void lightning_connection_init(struct lightning_connection *conn, int fd, struct sockaddr_in *addr)
+void lightning_connection_init(struct lightning_connection *conn, int fd, const union lightning_socket_address *addr)
 {
   if(conn == NULL)
   {
@@ -49,20 +41,56 @@ void lightning_connection_init(struct lightning_connection *conn, int fd, struct
   conn->fd = fd;
   conn->state = CONN_STATE_READING_REQUEST;
 
-  memset(conn->read_buffer, 0, sizeof(conn->read_buffer));
+  conn->read_buffer = NULL;
+  conn->request = NULL;
+  conn->timeout = CONN_TIMEOUT_NONE;
   conn->read_pos = 0;
+  conn->read_start = 0;
   conn->read_total = 0;
 
-  memset(conn->write_buffer, 0, sizeof(conn->write_buffer));
+  conn->response = NULL;
+  conn->write_buffer = NULL;
+  conn->write_used = 0;
   conn->write_total = 0;
   conn->write_pos = 0;
+  conn->output_count = 0;
+  conn->output_index = 0;
+  conn->file = NULL;
+  conn->file_offset = 0;
+  conn->file_remaining = 0;
+  lightning_http_parser_init(&conn->parser, 0);
+  conn->response_pending = false;
+  conn->close_after_response = false;
+  conn->served = false;
+  conn->body_streaming = false;
+  lightning_body_store_init(&conn->body_store);
+  conn->body_target = NULL;
+  conn->producer = NULL;
+  conn->producer_data = NULL;
+  conn->producer_unframed = false;
+  conn->parse_ns = 0;
+  conn->write_started_ns = 0;
 
   if(addr != NULL)
   {
-    memcpy(&conn->client_addr, addr, sizeof(struct sockaddr_in));
+    conn->client_addr = *addr;
   }
 
-  conn->last_activity = time(NULL);
+  conn->uring_inflight = 0;
+  conn->uring_sending = false;
+  conn->uring_closing = false;
+  conn->uring_read_closed = false;
+  conn->uring_receiving = false;
+  conn->uring_recv_paused = false;
+  conn->uring_recv_cancelling = false;
+  conn->uring_held_head = 0;
+  conn->uring_held_tail = 0;
+  conn->uring_held_offset = 0;
+  conn->uring_held_count = 0;
+
+  conn->last_activity = 0;
+  lightning_timer_init(&conn->timer);
+  conn->timeout = CONN_TIMEOUT_NONE;
 }
 
 void lightning_connection_reset(struct lightning_connection *conn)
@@ -74,10 +102,34 @@ void lightning_connection_reset(struct lightning_connection *conn)
 
   conn->fd = -1;
   conn->state = CONN_STATE_CLOSED;
+  conn->read_buffer = NULL;
+  conn->write_buffer = NULL;
+  conn->request = NULL;
+  conn->response = NULL;
+  conn->timeout = CONN_TIMEOUT_NONE;
   conn->read_pos = 0;
+  conn->read_start = 0;
   conn->read_total = 0;
+  conn->write_used = 0;
   conn->write_total = 0;
   conn->write_pos = 0;
+  conn->output_count = 0;
+  conn->output_index = 0;
+  conn->file = NULL;
+  conn->file_offset = 0;
+  conn->file_remaining = 0;
+  lightning_http_parser_init(&conn->parser, 0);
+  conn->response_pending = false;
+  conn->close_after_response = false;
+  conn->served = false;
+  conn->body_streaming = false;
+  lightning_body_store_init(&conn->body_store);
+  conn->body_target = NULL;
+  conn->producer = NULL;
+  conn->producer_data = NULL;
+  conn->producer_unframed = false;
+  conn->parse_ns = 0;
+  conn->write_started_ns = 0;
 }
 
 void lightning_connection_close(struct lightning_connection *conn)
@@ -89,3 +141,183 @@ int lightning_connection_get_fd(struct lightning_connection *conn)
 {
   return conn->fd;
 }
+
+int lightning_connection_acquire_read_buffer(struct lightning_connection *conn, struct lightning_pool *pool)
+{
+  if(conn->read_buffer != NULL)
+  {
+    return 0;
+  }
+
+  struct lightning_read_block *block = lightning_pool_acquire(pool);
+  if(block == NULL)
+  {
+    return -1;
+  }
+
+  conn->request = &block->request;
+  conn->response = &block->response;
+  conn->read_buffer = block->data;
+  return 0;
+}
+
+void lightning_connection_release_read_buffer(struct lightning_connection *conn, struct lightning_pool *pool)
+{
+  if(conn->read_buffer == NULL)
+  {
+    return;
+  }
+
+  lightning_pool_release(pool, (char *)conn->read_buffer - offsetof(struct lightning_read_block, data));
+  conn->read_buffer = NULL;
+  conn->request = NULL;
+  conn->response = NULL;
+}
+
+void lightning_connection_release_idle_read_buffer(struct lightning_connection *conn, struct lightning_pool *pool)
+{
+  if(conn->read_pos == 0 && !conn->response_pending && !conn->body_streaming && conn->producer == NULL)
+  {
+    lightning_connection_release_read_buffer(conn, pool);
+  }
+}
+
+int lightning_connection_acquire_write_buffer(struct lightning_connection *conn, struct lightning_pool *pool)
+{
+  if(conn->write_buffer != NULL)
+  {
+    return 0;
+  }
+
+  conn->write_buffer = lightning_pool_acquire(pool);
+  return conn->write_buffer == NULL ? -1 : 0;
+}
+
+void lightning_connection_release_write_buffer(struct lightning_connection *conn, struct lightning_pool *pool)
+{
+  if(conn->write_buffer == NULL)
+  {
+    return;
+  }
+
+  lightning_pool_release(pool, conn->write_buffer);
+  conn->write_buffer = NULL;
+}
+
+int lightning_connection_output_buffer(struct lightning_connection *conn, size_t length)
+{
+  char *data = conn->write_buffer + conn->write_used;
+
+  // Consecutive responses written to write_buffer go out as one segment.
+  if(conn->output_count > conn->output_index)
+  {
+    struct iovec *last = &conn->output[conn->output_count - 1];
+    if((char *)last->iov_base + last->iov_len == data)
+    {
+      last->iov_len += length;
+      conn->write_used += length;
+      conn->write_total += length;
+      return 0;
+    }
+  }
+
+  if(conn->output_count == LIGHTNING_WRITE_IOV_MAX)
+  {
+    return -1;
+  }
+
+  conn->output[conn->output_count].iov_base = data;
+  conn->output[conn->output_count].iov_len = length;
+  conn->output_count++;
+  conn->write_used += length;
+  conn->write_total += length;
+  return 0;
+}
+
+int lightning_connection_output_external(struct lightning_connection *conn, const void *data, size_t length)
+{
+  if(conn->output_count == LIGHTNING_WRITE_IOV_MAX)
+  {
+    return -1;
+  }
+
+  conn->output[conn->output_count].iov_base = (void *)data;
+  conn->output[conn->output_count].iov_len = length;
+  conn->output_count++;
+  conn->write_total += length;
+  return 0;
+}
+
+size_t lightning_connection_output_sent(struct lightning_connection *conn, size_t sent)
+{
+  conn->write_pos += sent;
+
+  while(sent > 0 && conn->output_index < conn->output_count)
+  {
+    struct iovec *segment = &conn->output[conn->output_index];
+
+    if(sent < segment->iov_len)
+    {
+      segment->iov_base = (char *)segment->iov_base + sent;
+      segment->iov_len -= sent;
+      break;
+    }
+
+    sent -= segment->iov_len;
+    conn->output_index++;
+  }
+
+  if(conn->write_pos < conn->write_total)
+  {
+    return conn->write_total - conn->write_pos;
+  }
+
+  conn->output_count = 0;
+  conn->output_index = 0;
+  conn->write_used = 0;
+  conn->write_total = 0;
+  conn->write_pos = 0;
+  lightning_connection_release_file(conn);
+
+  // A request still being read or a response still being produced may
+  // point into them as well.
+  if(!conn->body_streaming && !conn->response_pending && conn->producer == NULL)
+  {
+    lightning_body_store_release(&conn->body_store);
+    lightning_arena_reset(&conn->arena);
+  }
+  return 0;
+}
+
+int lightning_connection_output_file(struct lightning_connection *conn, struct lightning_static_file *file, off_t offset, size_t length)
+{
+  if(file->data != NULL || length == 0)
+  {
+    if(length > 0 && lightning_connection_output_external(conn, file->data + offset, length) == -1)
+    {
+      return -1;
+    }
+  }
+  else
+  {
+    conn->file_offset = offset;
+    conn->file_remaining = length;
+    conn->write_total += length;
+  }
+
+  conn->file = file;
+  return 0;
+}
+
+void lightning_connection_release_file(struct lightning_connection *conn)
+{
+  if(conn->file == NULL)
+  {
+    return;
+  }
+
+  lightning_static_file_release(conn->file);
+  conn->file = NULL;
+  conn->file_offset = 0;
+  conn->file_remaining = 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <time.h>
+
+#include "internal/date.h"
+
+static const char day_names[7][3] = {
+  {'S', 'u', 'n'}, {'M', 'o', 'n'}, {'T', 'u', 'e'}, {'W', 'e', 'd'},
+  {'T', 'h', 'u'}, {'F', 'r', 'i'}, {'S', 'a', 't'}};
+
+static const char month_names[12][3] = {
+  {'J', 'a', 'n'}, {'F', 'e', 'b'}, {'M', 'a', 'r'}, {'A', 'p', 'r'},
+  {'M', 'a', 'y'}, {'J', 'u', 'n'}, {'J', 'u', 'l'}, {'A', 'u', 'g'},
+  {'S', 'e', 'p'}, {'O', 'c', 't'}, {'N', 'o', 'v'}, {'D', 'e', 'c'}};
+
+static void put_two_digits(char *output, int value);
+static int parse_digits(const char *input, size_t count);
+static void format_date(struct lightning_http_date *date, time_t second);
+
+void lightning_http_date_init(struct lightning_http_date *date, uint64_t now_ms)
+{
+  date->next_update_ms = 0;
+  date->second = -1;
+  lightning_http_date_update(date, now_ms);
+}
+
+void lightning_http_date_update(struct lightning_http_date *date, uint64_t now_ms)
+{
+  if(now_ms < date->next_update_ms)
+  {
+    return;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+  // Monotonic and wall clock are not in phase: wake up again right when the
+  // wall clock second changes.
+  date->next_update_ms = now_ms + 1000 - (uint64_t)now.tv_nsec / 1000000;
+
+  if(now.tv_sec != date->second)
+  {
+    format_date(date, now.tv_sec);
+  }
+}
+
+void lightning_http_date_format(char *output, time_t second)
+{
+  struct tm tm;
+  gmtime_r(&second, &tm);
+
+  char *p = output;
+  memcpy(p, day_names[tm.tm_wday], 3);
+  p += 3;
+  *p++ = ',';
+  *p++ = ' ';
+  put_two_digits(p, tm.tm_mday);
+  p += 2;
+  *p++ = ' ';
+  memcpy(p, month_names[tm.tm_mon], 3);
+  p += 3;
+  *p++ = ' ';
+
+  int year = tm.tm_year + 1900;
+  put_two_digits(p, year / 100);
+  put_two_digits(p + 2, year % 100);
+  p += 4;
+  *p++ = ' ';
+  put_two_digits(p, tm.tm_hour);
+  p[2] = ':';
+  put_two_digits(p + 3, tm.tm_min);
+  p[5] = ':';
+  put_two_digits(p + 6, tm.tm_sec);
+  p += 8;
+  memcpy(p, " GMT", 4);
+}
+
+time_t lightning_http_date_parse(const char *input, size_t length)
+{
+  if(length != LIGHTNING_HTTP_DATE_LENGTH || input[3] != ',' || input[4] != ' ' || input[7] != ' ' ||
+     input[11] != ' ' || input[16] != ' ' || input[19] != ':' || input[22] != ':' || memcmp(input + 25, " GMT", 4) != 0)
+  {
+    return -1;
+  }
+
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_mon = -1;
+  for(int i = 0; i < 12; i++)
+  {
+    if(memcmp(input + 8, month_names[i], 3) == 0)
+    {
+      tm.tm_mon = i;
+    }
+  }
+
+  int day = parse_digits(input + 5, 2);
+  int year = parse_digits(input + 12, 4);
+  tm.tm_hour = parse_digits(input + 17, 2);
+  tm.tm_min = parse_digits(input + 20, 2);
+  tm.tm_sec = parse_digits(input + 23, 2);
+
+  // The day name is redundant and not checked.
+  if(tm.tm_mon == -1 || day < 1 || day > 31 || year < 1970 || tm.tm_hour < 0 || tm.tm_hour > 23 ||
+     tm.tm_min < 0 || tm.tm_min > 59 || tm.tm_sec < 0 || tm.tm_sec > 60)
+  {
+    return -1;
+  }
+
+  tm.tm_mday = day;
+  tm.tm_year = year - 1900;
+  return timegm(&tm);
+}
+
+static void format_date(struct lightning_http_date *date, time_t second)
+{
+  memcpy(date->header, "Date: ", 6);
+  lightning_http_date_format(date->header + 6, second);
+  memcpy(date->header + 6 + LIGHTNING_HTTP_DATE_LENGTH, "\r\n", 3);
+  date->second = second;
+}
+
+static void put_two_digits(char *output, int value)
+{
+  output[0] = '0' + value / 10;
+  output[1] = '0' + value % 10;
+}
+
+// -1 unless `count` decimal digits.
+static int parse_digits(const char *input, size_t count)
+{
+  int value = 0;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    if(input[i] < '0' || input[i] > '9')
+    {
+      return -1;
+    }
+    value = value * 10 + (input[i] - '0');
+  }
+
+  return value;
+}
@@ -0,0 +1,371 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "internal/handoff.h"
+
+#define HANDOFF_MAGIC 0x4c54484fu
+#define HANDOFF_ACK 'A'
+
+struct handoff_message
+{
+  uint32_t magic;
+  uint16_t port;
+  uint16_t count;
+};
+
+union handoff_control
+{
+  struct cmsghdr header;
+  char data[CMSG_SPACE(sizeof(int) * LIGHTNING_HANDOFF_MAX_SOCKETS)];
+};
+
+static int handoff_address(const char *path, struct sockaddr_un *address);
+static void handoff_set_timeout(int fd);
+static bool handoff_is_listening(int fd);
+static bool handoff_send(struct lightning_handoff *handoff, int peer);
+static void *handoff_thread(void *argument);
+
+void lightning_handoff_init(struct lightning_handoff *handoff)
+{
+  memset(handoff, 0, sizeof(struct lightning_handoff));
+  handoff->previous_fd = -1;
+  handoff->listen_fd = -1;
+}
+
+int lightning_handoff_inherit(struct lightning_handoff *handoff, const char *fds)
+{
+  const char *p = fds;
+
+  while(*p != '\0' && handoff->received_count < LIGHTNING_HANDOFF_MAX_SOCKETS)
+  {
+    char *end;
+    long fd = strtol(p, &end, 10);
+
+    if(end == p || fd < 0 || fd > INT32_MAX || (*end != ',' && *end != '\0') || !handoff_is_listening((int)fd))
+    {
+      return -1;
+    }
+
+    fcntl((int)fd, F_SETFD, FD_CLOEXEC);
+    handoff->received[handoff->received_count++] = (int)fd;
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  return (int)handoff->received_count;
+}
+
+int lightning_handoff_receive(struct lightning_handoff *handoff, const char *path, unsigned short port)
+{
+  struct sockaddr_un address;
+  if(handoff_address(path, &address) == -1)
+  {
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  if(connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+  {
+    int error = errno;
+    close(fd);
+    return error == ENOENT || error == ECONNREFUSED ? 0 : -1;
+  }
+
+  handoff_set_timeout(fd);
+
+  struct handoff_message message;
+  struct iovec iov = {&message, sizeof(message)};
+  union handoff_control control;
+  struct msghdr header;
+
+  memset(&header, 0, sizeof(header));
+  header.msg_iov = &iov;
+  header.msg_iovlen = 1;
+  header.msg_control = control.data;
+  header.msg_controllen = sizeof(control.data);
+
+  ssize_t length = recvmsg(fd, &header, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+  size_t count = 0;
+
+  for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg != NULL; cmsg = CMSG_NXTHDR(&header, cmsg))
+  {
+    if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+      count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(handoff->received, CMSG_DATA(cmsg), count * sizeof(int));
+      break;
+    }
+  }
+
+  if(length != (ssize_t)sizeof(message) || message.magic != HANDOFF_MAGIC || message.count != count ||
+     message.port != port || (header.msg_flags & MSG_CTRUNC))
+  {
+    fprintf(stderr, "[Lightning Error]: invalid listening socket handoff from %s\n", path);
+    for(size_t i = 0; i < count; i++)
+    {
+      close(handoff->received[i]);
+    }
+    close(fd);
+    return -1;
+  }
+
+  handoff->received_count = count;
+  handoff->previous_fd = fd;
+  return (int)count;
+}
+
+void lightning_handoff_acknowledge(struct lightning_handoff *handoff)
+{
+  if(handoff->previous_fd == -1)
+  {
+    return;
+  }
+
+  char ack = HANDOFF_ACK;
+  if(send(handoff->previous_fd, &ack, 1, MSG_NOSIGNAL) != 1)
+  {
+    fprintf(stderr, "Warning: the previous process did not get the handoff acknowledgement\n");
+  }
+
+  close(handoff->previous_fd);
+  handoff->previous_fd = -1;
+}
+
+int lightning_handoff_serve(struct lightning_handoff *handoff,
+                            const char *path,
+                            unsigned short port,
+                            const int *sockets,
+                            size_t count,
+                            void (*on_handoff)(void *data),
+                            void *data)
+{
+  struct sockaddr_un address;
+  if(count > LIGHTNING_HANDOFF_MAX_SOCKETS || handoff_address(path, &address) == -1)
+  {
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  // Whatever is there belongs to a generation that is gone or draining.
+  unlink(path);
+
+  if(bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, 4) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Copies, so a worker closing its socket while draining can not make
+  // the thread send a reused descriptor.
+  for(size_t i = 0; i < count; i++)
+  {
+    handoff->sockets[i] = fcntl(sockets[i], F_DUPFD_CLOEXEC, 0);
+    if(handoff->sockets[i] == -1)
+    {
+      for(size_t j = 0; j < i; j++)
+      {
+        close(handoff->sockets[j]);
+      }
+      close(fd);
+      unlink(path);
+      return -1;
+    }
+  }
+
+  memcpy(handoff->path, address.sun_path, sizeof(handoff->path));
+  handoff->sockets_count = count;
+  handoff->listen_fd = fd;
+  handoff->on_handoff = on_handoff;
+  handoff->on_handoff_data = data;
+  handoff->port = port;
+
+  if(pthread_create(&handoff->thread, NULL, handoff_thread, handoff) != 0)
+  {
+    lightning_handoff_close(handoff);
+    return -1;
+  }
+
+  handoff->thread_running = true;
+  return 0;
+}
+
+void lightning_handoff_interrupt(struct lightning_handoff *handoff)
+{
+  if(handoff->listen_fd != -1)
+  {
+    shutdown(handoff->listen_fd, SHUT_RDWR);
+  }
+}
+
+void lightning_handoff_close(struct lightning_handoff *handoff)
+{
+  if(handoff->thread_running)
+  {
+    lightning_handoff_interrupt(handoff);
+    pthread_join(handoff->thread, NULL);
+    handoff->thread_running = false;
+  }
+
+  for(size_t i = 0; i < handoff->sockets_count; i++)
+  {
+    close(handoff->sockets[i]);
+  }
+  handoff->sockets_count = 0;
+
+  if(handoff->listen_fd != -1)
+  {
+    close(handoff->listen_fd);
+    // After a handoff the path is the next generation's.
+    if(!handoff->handed_off)
+    {
+      unlink(handoff->path);
+    }
+    handoff->listen_fd = -1;
+  }
+
+  if(handoff->previous_fd != -1)
+  {
+    close(handoff->previous_fd);
+    handoff->previous_fd = -1;
+  }
+}
+
+static void *handoff_thread(void *argument)
+{
+  struct lightning_handoff *handoff = argument;
+
+  while(1)
+  {
+    int peer = accept4(handoff->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if(peer == -1)
+    {
+      if(errno == EINTR || errno == ECONNABORTED)
+      {
+        continue;
+      }
+      break;
+    }
+
+    bool acknowledged = handoff_send(handoff, peer);
+    close(peer);
+
+    if(acknowledged)
+    {
+      handoff->handed_off = true;
+      printf("Lightning say: listening sockets handed over, draining\n");
+      handoff->on_handoff(handoff->on_handoff_data);
+      break;
+    }
+  }
+
+  // The next generation holds the sockets now, or we are shutting down.
+  for(size_t i = 0; i < handoff->sockets_count; i++)
+  {
+    close(handoff->sockets[i]);
+  }
+  handoff->sockets_count = 0;
+  return NULL;
+}
+
+/*
+ * Sends the sockets and waits for the new process to start accepting on
+ * them. Until then nothing changes here: if it dies on the way up, the next
+ * attempt gets the same sockets.
+ */
+static bool handoff_send(struct lightning_handoff *handoff, int peer)
+{
+  struct handoff_message message = {HANDOFF_MAGIC, handoff->port, (uint16_t)handoff->sockets_count};
+  struct iovec iov = {&message, sizeof(message)};
+  union handoff_control control;
+  struct msghdr header;
+
+  memset(&control, 0, sizeof(control));
+  memset(&header, 0, sizeof(header));
+  header.msg_iov = &iov;
+  header.msg_iovlen = 1;
+  header.msg_control = control.data;
+  header.msg_controllen = CMSG_SPACE(sizeof(int) * handoff->sockets_count);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * handoff->sockets_count);
+  memcpy(CMSG_DATA(cmsg), handoff->sockets, sizeof(int) * handoff->sockets_count);
+
+  if(sendmsg(peer, &header, MSG_NOSIGNAL) != (ssize_t)sizeof(message))
+  {
+    return false;
+  }
+
+  handoff_set_timeout(peer);
+
+  char ack = 0;
+  return recv(peer, &ack, 1, 0) == 1 && ack == HANDOFF_ACK;
+}
+
+static int handoff_address(const char *path, struct sockaddr_un *address)
+{
+  size_t length = strlen(path);
+
+  memset(address, 0, sizeof(struct sockaddr_un));
+  if(length == 0 || length >= sizeof(address->sun_path))
+  {
+    return -1;
+  }
+
+  address->sun_family = AF_UNIX;
+  memcpy(address->sun_path, path, length);
+  return 0;
+}
+
+static void handoff_set_timeout(int fd)
+{
+  struct timeval timeout;
+  timeout.tv_sec = LIGHTNING_HANDOFF_TIMEOUT_MS / 1000;
+  timeout.tv_usec = (LIGHTNING_HANDOFF_TIMEOUT_MS % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static bool handoff_is_listening(int fd)
+{
+  int listening = 0;
+  socklen_t length = sizeof(listening);
+
+  return getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) == 0 && listening;
+}
@@ -0,0 +1,158 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file access_log.h
+ * @brief Asynchronous access log
+ * -      each worker fills fixed size records in its own single-producer
+ * -      ring, without a lock or a system call. one logger thread collects
+ * -      them in batches, formats them and writes them with large writev
+ * -      calls, so a slow disk never shows up in the workers' latency.
+ */
+
+#ifndef LIGHTNING_ACCESS_LOG_H
+#define LIGHTNING_ACCESS_LOG_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lightning/application.h"
+#include "metrics.h"
+
+// Per worker, a power of two: 512 KB of records.
+#define LIGHTNING_ACCESS_LOG_RECORDS 4096
+#define LIGHTNING_ACCESS_LOG_PATH_SIZE 78
+// When sampling, a ring more than half full keeps one request in this many.
+#define LIGHTNING_ACCESS_LOG_SAMPLE_RATE 16
+// How long the logger sleeps when every ring is empty.
+#define LIGHTNING_ACCESS_LOG_INTERVAL_MS 10
+
+/**
+ * One request, also the binary format on disk (host byte order, 128
+ * bytes). Longer paths are cut to LIGHTNING_ACCESS_LOG_PATH_SIZE bytes.
+ */
+struct lightning_access_record
+{
+  // Wall clock when the response was queued.
+  uint64_t time_ns;
+  // Parse and handle, the response is not written yet.
+  uint64_t duration_ns;
+  uint64_t bytes;
+  // IPv6, IPv4-mapped for IPv4 peers, in network byte order. All zeros
+  // when unknown.
+  uint8_t address[16];
+  uint16_t port;
+  uint16_t status;
+  // Requests this record stands for: more than 1 when sampling skipped some.
+  uint16_t weight;
+  uint16_t worker;
+  uint8_t method;
+  uint8_t path_length;
+  char path[LIGHTNING_ACCESS_LOG_PATH_SIZE];
+};
+
+_Static_assert(sizeof(struct lightning_access_record) == 128, "access log records are 128 bytes");
+
+/**
+ * head is written by the worker only, tail by the logger only, each on its
+ * own cache line.
+ */
+struct lightning_access_ring
+{
+  _Alignas(LIGHTNING_CACHE_LINE) uint64_t head;
+  // Requests sampled out since the last record, worker only.
+  uint64_t skipped;
+  bool sample;
+  uint16_t worker;
+  _Alignas(LIGHTNING_CACHE_LINE) uint64_t tail;
+  _Alignas(LIGHTNING_CACHE_LINE) struct lightning_access_record records[LIGHTNING_ACCESS_LOG_RECORDS];
+};
+
+struct lightning_access_log
+{
+  struct lightning_access_ring **rings;
+  int count;
+  int fd;
+  bool close_fd;
+  enum lightning_access_log_format format;
+  pthread_t thread;
+  bool running;
+  bool started;
+  bool write_failed;
+  // Wall clock second last formatted, and its ISO 8601 text.
+  int64_t second;
+  char second_text[24];
+  char *buffer;
+};
+
+/**
+ * Opens `path` for appending ("-" is the standard output) and allocates one
+ * ring per worker. NULL on failure.
+ */
+struct lightning_access_log *lightning_access_log_create(const char *path,
+                                                         enum lightning_access_log_format format,
+                                                         enum lightning_access_log_overflow overflow,
+                                                         int workers);
+
+/**
+ * Starts and stops the logger thread. Stopping writes every record still
+ * in the rings, call it once the workers are gone.
+ */
+int lightning_access_log_start(struct lightning_access_log *log);
+void lightning_access_log_stop(struct lightning_access_log *log);
+void lightning_access_log_destroy(struct lightning_access_log *log);
+
+/**
+ * Next free record of the worker's ring, to be filled and published with
+ * lightning_access_ring_commit. NULL when the request is not logged: the
+ * ring is full (access_log_dropped) or the ring is filling up and the
+ * request is sampled out (access_log_sampled).
+ */
+static inline struct lightning_access_record *lightning_access_ring_reserve(struct lightning_access_ring *ring,
+                                                                            struct lightning_metrics *metrics)
+{
+  uint64_t used = ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if(used >= LIGHTNING_ACCESS_LOG_RECORDS)
+  {
+    lightning_metrics_add(&metrics->access_log_dropped, 1);
+    return NULL;
+  }
+
+  if(ring->sample && used >= LIGHTNING_ACCESS_LOG_RECORDS / 2 && ring->skipped + 1 < LIGHTNING_ACCESS_LOG_SAMPLE_RATE)
+  {
+    ring->skipped++;
+    lightning_metrics_add(&metrics->access_log_sampled, 1);
+    return NULL;
+  }
+
+  struct lightning_access_record *record = &ring->records[ring->head & (LIGHTNING_ACCESS_LOG_RECORDS - 1)];
+  record->weight = (uint16_t)(ring->skipped + 1);
+  record->worker = ring->worker;
+  ring->skipped = 0;
+  return record;
+}
+
+static inline void lightning_access_ring_commit(struct lightning_access_ring *ring)
+{
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+//      LIGHTNING_ACCESS_LOG_H
+#endif
@@ -0,0 +1,65 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file arena.h
+ * @brief Per-connection bump allocator
+ * -      everything a handler allocates for a response lives until that
+ * -      response has been written, then the arena is reset at once.
+ * -      blocks come from a per-worker pool, nothing here is thread safe.
+ */
+
+#ifndef LIGHTNING_ARENA_H
+#define LIGHTNING_ARENA_H
+
+#include <stddef.h>
+
+#include "lightning/application.h"
+#include "pool.h"
+
+#define LIGHTNING_ARENA_BLOCK_SIZE 4096
+
+struct lightning_arena_block;
+
+struct lightning_arena
+{
+  struct lightning_pool *pool;
+  struct lightning_arena_stats *stats;
+  struct lightning_arena_block *blocks;
+  struct lightning_arena_block *large;
+  char *cursor;
+  char *end;
+  size_t used;
+};
+
+void lightning_arena_init(struct lightning_arena *arena, struct lightning_pool *pool, struct lightning_arena_stats *stats);
+
+/**
+ * Returns `size` bytes aligned for any type, NULL when memory runs out.
+ * Requests larger than a block get their own allocation.
+ */
+void *lightning_arena_alloc(struct lightning_arena *arena, size_t size);
+
+/**
+ * Gives every block back to the pool and records the high-water mark. Costs
+ * nothing when the arena was not used, one pool release in the usual case.
+ */
+void lightning_arena_reset(struct lightning_arena *arena);
+
+//      LIGHTNING_ARENA_H
+#endif
@@ -0,0 +1,54 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file body.h
+ * @brief Storage for streamed request bodies
+ * -      bodies grow in memory up to the spill threshold, then move to an
+ * -      unlinked temporary file that is mapped once the body is complete.
+ */
+
+#ifndef LIGHTNING_BODY_H
+#define LIGHTNING_BODY_H
+
+#include <stddef.h>
+
+#define LIGHTNING_MAX_BODY_SIZE (16 * 1024 * 1024)
+#define LIGHTNING_BODY_SPILL_THRESHOLD (64 * 1024)
+
+struct lightning_body_store
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+  void *mapping;
+  int fd;
+};
+
+void lightning_body_store_init(struct lightning_body_store *store);
+int lightning_body_store_append(struct lightning_body_store *store, const void *data, size_t length, size_t spill_threshold);
+
+/**
+ * Makes the whole body addressable and returns it (NULL when empty or on
+ * error). Valid until lightning_body_store_release.
+ */
+const void *lightning_body_store_finish(struct lightning_body_store *store);
+void lightning_body_store_release(struct lightning_body_store *store);
+
+//      LIGHTNING_BODY_H
+#endif
@@ -0,0 +1,98 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file conditional.h
+ * @brief Validators, conditional requests and byte ranges
+ * -      entity tags are hashes computed once when a static file or a
+ * -      cached response enters its cache; If-None-Match and
+ * -      If-Modified-Since turn a GET into a 304, Range into a 206 that
+ * -      points into the body already in memory or on disk.
+ */
+
+#ifndef LIGHTNING_CONDITIONAL_H
+#define LIGHTNING_CONDITIONAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "request.h"
+
+// "0123456789abcdef", quotes included.
+#define LIGHTNING_ETAG_LENGTH 18
+#define LIGHTNING_ETAG_SEED 14695981039346656037u
+// Past this many ranges the whole body is sent instead.
+#define LIGHTNING_RANGES_MAX 6
+
+struct lightning_byte_range
+{
+  uint64_t first;
+  uint64_t length;
+};
+
+enum lightning_range_result
+{
+  // No usable Range header: the whole body, 200.
+  LIGHTNING_RANGE_NONE = 0,
+  LIGHTNING_RANGE_SATISFIABLE,
+  // 416, with Content-Range: bytes */<size>.
+  LIGHTNING_RANGE_UNSATISFIABLE
+};
+
+/**
+ * FNV-1a over `data`, continuing from `hash` (LIGHTNING_ETAG_SEED to
+ * start).
+ */
+uint64_t lightning_etag_hash(uint64_t hash, const void *data, size_t length);
+
+/**
+ * Writes `hash` as a strong entity tag, exactly LIGHTNING_ETAG_LENGTH
+ * characters and no terminator.
+ */
+void lightning_etag_format(char *output, uint64_t hash);
+
+/**
+ * Whether a GET for a representation with these validators is answered
+ * 304 Not Modified: If-None-Match when the request has one (weak
+ * comparison), If-Modified-Since otherwise. `etag` may be NULL and
+ * `last_modified` -1 when there is none.
+ */
+bool lightning_request_not_modified(const struct lightning_http_request *request,
+                                    const char *etag,
+                                    size_t etag_length,
+                                    time_t last_modified);
+
+/**
+ * Reads the Range header against a body of `size` bytes. Satisfiable
+ * ranges are written to `ranges` (LIGHTNING_RANGES_MAX of them) in request
+ * order, `count` says how many. Malformed headers, units other than bytes,
+ * too many ranges and an If-Range that does not match the validators
+ * exactly all give LIGHTNING_RANGE_NONE.
+ */
+enum lightning_range_result lightning_request_ranges(const struct lightning_http_request *request,
+                                                     uint64_t size,
+                                                     const char *etag,
+                                                     size_t etag_length,
+                                                     time_t last_modified,
+                                                     struct lightning_byte_range *ranges,
+                                                     int *count);
+
+//      LIGHTNING_CONDITIONAL_H
+#endif
@@ -20,10 +20,40 @@
 #define LIGHTNING_CONNECTION_H
 
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "arena.h"
+#include "body.h"
+#include "parser.h"
+#include "pool.h"
+#include "request.h"
+#include "response.h"
+#include "static.h"
+#include "timer.h"
+
+struct lightning_route_target;
 
 #define LIGHTNING_MAX_CONNECTIONS 1024
+// Default, lightning_config.read_buffer_size.
 #define LIGHTNING_READ_BUFFER_SIZE 8192
+#define LIGHTNING_READ_BUFFER_MIN 1024
+#define LIGHTNING_READ_BUFFER_MAX (1024 * 1024)
 #define LIGHTNING_WRITE_BUFFER_SIZE 8192
+#define LIGHTNING_WRITE_IOV_MAX 16
+#define LIGHTNING_RESPONSE_COPY_LIMIT 1024
+
+enum lightning_connection_timeout
+{
+  CONN_TIMEOUT_NONE = 0,
+  CONN_TIMEOUT_HEADER,
+  CONN_TIMEOUT_BODY,
+  CONN_TIMEOUT_KEEPALIVE,
+  CONN_TIMEOUT_WRITE
+};
 
 enum lightning_connection_state
 {
@@ -34,25 +64,140 @@ enum lightning_connection_state
   CONN_STATE_CLOSING
 };
 
+/**
+ * Peer of a connection accepted on an IPv4 or IPv6 listener.
+ */
+union lightning_socket_address
+{
+  struct sockaddr any;
+  struct sockaddr_in ipv4;
+  struct sockaddr_in6 ipv6;
+};
+
+/**
+ * Buffers are only attached to a connection while it has bytes in flight.
+ * The request being parsed lives next to the bytes it points into, and the
+ * response being built next to the request.
+ */
+struct lightning_read_block
+{
+  struct lightning_http_request request;
+  struct lightning_http_response response;
+  // The server's read_buffer_size.
+  char data[];
+};
+
 struct lightning_connection
 {
-  struct sockaddr_in client_addr;
-  char read_buffer[LIGHTNING_READ_BUFFER_SIZE];
-  char write_buffer[LIGHTNING_WRITE_BUFFER_SIZE];
+  union lightning_socket_address client_addr;
+  char *read_buffer;
+  char *write_buffer;
+  struct lightning_http_request *request;
+  struct lightning_http_response *response;
   size_t read_pos;
+  size_t read_start;
   size_t read_total;
+  size_t write_used;
   size_t write_total;
   size_t write_pos;
-  time_t last_activity;
+  struct iovec output[LIGHTNING_WRITE_IOV_MAX];
+  unsigned short output_count;
+  unsigned short output_index;
+  struct lightning_static_file *file;
+  off_t file_offset;
+  size_t file_remaining;
+  uint64_t last_activity;
+  struct lightning_timer timer;
+  enum lightning_connection_timeout timeout;
+  // Latency metrics: parser time of the request being read, and when the
+  // output queue stopped being empty (0: it is).
+  uint64_t parse_ns;
+  uint64_t write_started_ns;
   enum lightning_connection_state state;
   int fd;
+  struct lightning_http_parser parser;
+  bool response_head_only;
+  bool response_pending;
+  // Connection: close was sent, the socket closes once it is written.
+  bool close_after_response;
+  // At least one response went out: an empty read buffer is a keep-alive
+  // pause, not a request still on its way.
+  bool served;
+
+  /* Request body streamed through the read buffer instead of waiting in
+   * it, and chunked response still being produced. body_target is the
+   * route the body goes to until its handler runs (NULL: discarded). */
+  bool body_streaming;
+  struct lightning_http_body_reader body_reader;
+  struct lightning_body_store body_store;
+  const struct lightning_route_target *body_target;
+  lightning_chunk_producer producer;
+  void *producer_data;
+  // HTTP/1.0: the producer's data goes out as is, the close ends it.
+  bool producer_unframed;
+
+  // Handler allocations for the responses in the output queue.
+  struct lightning_arena arena;
+
+  /* io_uring backend only: operations in flight and received buffers that
+   * did not fit in read_buffer yet (provided buffer ids + 1, 0 = none).
+   * Past LIGHTNING_URING_HELD_MAX of them the multishot recv is cancelled
+   * until they are consumed and the output drained. After the peer's end
+   * of stream (uring_read_closed) the held input is still answered and the
+   * connection closes once its output is sent. */
+  uint16_t uring_inflight;
+  bool uring_sending;
+  bool uring_closing;
+  bool uring_read_closed;
+  bool uring_receiving;
+  bool uring_recv_paused;
+  bool uring_recv_cancelling;
+  uint32_t uring_held_head;
+  uint32_t uring_held_tail;
+  uint32_t uring_held_offset;
+  uint32_t uring_held_count;
+  struct msghdr uring_message;
 };
 
 struct lightning_connection *lightning_create_connection(int max_connections);
-void lightning_connection_init(struct lightning_connection *conn, int fd, struct sockaddr_in *addr);
+void lightning_connection_init(struct lightning_connection *conn, int fd, const union lightning_socket_address *addr);
 void lightning_connection_reset(struct lightning_connection *conn);
 void lightning_connection_close(struct lightning_connection *conn);
 int lightning_connection_get_fd(struct lightning_connection *conn);
+int lightning_connection_acquire_read_buffer(struct lightning_connection *conn, struct lightning_pool *pool);
+void lightning_connection_release_read_buffer(struct lightning_connection *conn, struct lightning_pool *pool);
+
+/**
+ * Releases the read block of a connection with no input left, unless the
+ * request or response in it are still in use: a response waiting for room,
+ * a producer or a streamed body.
+ */
+void lightning_connection_release_idle_read_buffer(struct lightning_connection *conn, struct lightning_pool *pool);
+int lightning_connection_acquire_write_buffer(struct lightning_connection *conn, struct lightning_pool *pool);
+void lightning_connection_release_write_buffer(struct lightning_connection *conn, struct lightning_pool *pool);
+/*
+ * Output queue: iovecs over write_buffer and over bodies owned by the
+ * handlers, optionally followed by one static file. write_total counts every
+ * byte queued since the queue was last empty, write_pos the ones already
+ * sent.
+ */
+int lightning_connection_output_buffer(struct lightning_connection *conn, size_t length);
+int lightning_connection_output_external(struct lightning_connection *conn, const void *data, size_t length);
+
+/**
+ * Queues `length` bytes of `file` from `offset` after everything else and
+ * takes over the reference the caller holds. Mapped files become an iovec,
+ * the others a file segment for sendfile (file_offset, file_remaining).
+ */
+int lightning_connection_output_file(struct lightning_connection *conn, struct lightning_static_file *file, off_t offset, size_t length);
+void lightning_connection_release_file(struct lightning_connection *conn);
+
+/**
+ * Marks `sent` bytes as written. Once the queue is empty it is reset and
+ * what the responses pointed into (static file, streamed request body,
+ * arena) is released. Returns the number of bytes still queued.
+ */
+size_t lightning_connection_output_sent(struct lightning_connection *conn, size_t sent);
 struct lightning_connection *lightning_connection_get(struct lightning_connection *conn, int index);
 
 //      LIGHTNING_CONNECTION_H
@@ -0,0 +1,65 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file date.h
+ * @brief Cached Date header
+ * -      each worker formats "Date: <IMF-fixdate>\r\n" at most once per
+ * -      second, from the clock its event loop already reads.
+ */
+
+#ifndef LIGHTNING_DATE_H
+#define LIGHTNING_DATE_H
+
+#include <stdint.h>
+#include <time.h>
+
+// "Sun, 06 Nov 1994 08:49:37 GMT"
+#define LIGHTNING_HTTP_DATE_LENGTH 29
+// "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+#define LIGHTNING_DATE_HEADER_LENGTH 37
+
+struct lightning_http_date
+{
+  uint64_t next_update_ms;
+  time_t second;
+  char header[LIGHTNING_DATE_HEADER_LENGTH + 1];
+};
+
+/**
+ * Writes `second` as an IMF-fixdate, exactly LIGHTNING_HTTP_DATE_LENGTH
+ * characters and no terminator.
+ */
+void lightning_http_date_format(char *output, time_t second);
+
+/**
+ * Reads an IMF-fixdate, the format lightning_http_date_format writes.
+ * Returns -1 for anything else, obsolete date formats included.
+ */
+time_t lightning_http_date_parse(const char *input, size_t length);
+
+void lightning_http_date_init(struct lightning_http_date *date, uint64_t now_ms);
+
+/**
+ * Cheap when called every loop iteration: wall time is only read again once
+ * `now_ms` (monotonic) reaches the next second boundary.
+ */
+void lightning_http_date_update(struct lightning_http_date *date, uint64_t now_ms);
+
+//      LIGHTNING_DATE_H
+#endif
@@ -0,0 +1,99 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file handoff.h
+ * @brief Listening socket handoff between two generations of a server
+ * -      the running process serves its listening sockets over a unix
+ * -      socket (SCM_RIGHTS); a new process takes them over, starts
+ * -      accepting and only then tells the old one to drain. The sockets,
+ * -      their accept queues and their SO_REUSEPORT group never change.
+ */
+
+#ifndef LIGHTNING_HANDOFF_H
+#define LIGHTNING_HANDOFF_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/un.h>
+
+#define LIGHTNING_HANDOFF_MAX_SOCKETS 256
+#define LIGHTNING_HANDOFF_TIMEOUT_MS 30000
+
+struct lightning_handoff
+{
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+  // Listening sockets received from the previous process or inherited.
+  int received[LIGHTNING_HANDOFF_MAX_SOCKETS];
+  size_t received_count;
+  // Connection to the previous process, open until it is acknowledged.
+  int previous_fd;
+  // Our own handoff socket, its thread and copies of the sockets it sends.
+  int listen_fd;
+  int sockets[LIGHTNING_HANDOFF_MAX_SOCKETS];
+  size_t sockets_count;
+  unsigned short port;
+  pthread_t thread;
+  bool thread_running;
+  bool handed_off;
+  void (*on_handoff)(void *data);
+  void *on_handoff_data;
+};
+
+void lightning_handoff_init(struct lightning_handoff *handoff);
+
+/**
+ * Takes over the sockets listed in `fds` ("3,4,5"), handed down by whoever
+ * started us. Returns how many were taken, -1 when one is not a listening
+ * socket.
+ */
+int lightning_handoff_inherit(struct lightning_handoff *handoff, const char *fds);
+
+/**
+ * Asks the process serving `path` for its listening sockets. Returns how
+ * many were received, 0 when nobody is serving the path, -1 on error.
+ */
+int lightning_handoff_receive(struct lightning_handoff *handoff, const char *path, unsigned short port);
+
+/**
+ * Tells the previous process we are accepting, so it can start draining.
+ */
+void lightning_handoff_acknowledge(struct lightning_handoff *handoff);
+
+/**
+ * Serves `sockets` on `path` from a thread until the next generation
+ * acknowledges them, then calls `on_handoff`.
+ */
+int lightning_handoff_serve(struct lightning_handoff *handoff,
+                            const char *path,
+                            unsigned short port,
+                            const int *sockets,
+                            size_t count,
+                            void (*on_handoff)(void *data),
+                            void *data);
+
+/**
+ * Wakes the serving thread so it lets go of its socket copies. Only makes a
+ * system call, so it can run in a signal handler.
+ */
+void lightning_handoff_interrupt(struct lightning_handoff *handoff);
+void lightning_handoff_close(struct lightning_handoff *handoff);
+
+//      LIGHTNING_HANDOFF_H
+#endif
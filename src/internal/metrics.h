@@ -0,0 +1,151 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file metrics.h
+ * @brief Per-worker counters and latency histograms
+ * -      each worker owns its block and is the only writer: updates are a
+ * -      relaxed load and store, no locked instruction. readers on other
+ * -      threads load with relaxed atomics and get a slightly stale but
+ * -      never torn value.
+ */
+
+#ifndef LIGHTNING_METRICS_H
+#define LIGHTNING_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lightning/application.h"
+
+#define LIGHTNING_CACHE_LINE 64
+
+/*
+ * Log-linear buckets over nanoseconds, like HdrHistogram: values below 8
+ * are exact, then every power of two is split in 8, so a bucket is at most
+ * 12.5% wide. Everything from 2^36 ns (about 69 s) up lands in the last one.
+ */
+#define LIGHTNING_HISTOGRAM_SUB_BITS 3
+#define LIGHTNING_HISTOGRAM_SUB_COUNT (1 << LIGHTNING_HISTOGRAM_SUB_BITS)
+#define LIGHTNING_HISTOGRAM_MAX_BITS 36
+#define LIGHTNING_HISTOGRAM_BUCKETS ((LIGHTNING_HISTOGRAM_MAX_BITS - LIGHTNING_HISTOGRAM_SUB_BITS + 1) * LIGHTNING_HISTOGRAM_SUB_COUNT)
+
+enum lightning_metrics_phase
+{
+  // Time in the parser until the headers of a request are complete.
+  LIGHTNING_PHASE_PARSE = 0,
+  // Routing, the handler and serializing the response.
+  LIGHTNING_PHASE_HANDLE,
+  // From the first response queued until the output is entirely sent.
+  LIGHTNING_PHASE_WRITE,
+  LIGHTNING_PHASE_COUNT
+};
+
+struct lightning_histogram
+{
+  uint64_t sum_ns;
+  uint64_t buckets[LIGHTNING_HISTOGRAM_BUCKETS];
+};
+
+struct lightning_metrics
+{
+  _Alignas(LIGHTNING_CACHE_LINE) uint64_t requests;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t parse_errors;
+  uint64_t timeouts;
+  uint64_t connections_opened;
+  uint64_t connections_closed;
+  // Writes that left part of the output queued.
+  uint64_t short_writes;
+  uint64_t reads_would_block;
+  uint64_t writes_would_block;
+  uint64_t flushes;
+  uint64_t loop_iterations;
+  uint64_t access_log_dropped;
+  uint64_t access_log_sampled;
+  uint64_t connections_shed;
+  uint64_t overloads;
+  // Requests to cached routes answered without / after calling the handler.
+  uint64_t cache_hits;
+  uint64_t cache_misses;
+  struct lightning_histogram phases[LIGHTNING_PHASE_COUNT];
+};
+
+/**
+ * Aligned on a cache line so two workers never share one. NULL when memory
+ * runs out.
+ */
+struct lightning_metrics *lightning_metrics_create(void);
+void lightning_metrics_destroy(struct lightning_metrics *metrics);
+
+static inline void lightning_metrics_add(uint64_t *counter, uint64_t value)
+{
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static inline size_t lightning_histogram_index(uint64_t value)
+{
+  if(value < LIGHTNING_HISTOGRAM_SUB_COUNT)
+  {
+    return (size_t)value;
+  }
+
+  if(value >> LIGHTNING_HISTOGRAM_MAX_BITS)
+  {
+    value = ((uint64_t)1 << LIGHTNING_HISTOGRAM_MAX_BITS) - 1;
+  }
+
+  unsigned exponent = 63 - (unsigned)__builtin_clzll(value);
+  unsigned shift = exponent - LIGHTNING_HISTOGRAM_SUB_BITS;
+  return (size_t)(shift + 1) * LIGHTNING_HISTOGRAM_SUB_COUNT + ((value >> shift) & (LIGHTNING_HISTOGRAM_SUB_COUNT - 1));
+}
+
+// Largest value counted in bucket `index`.
+static inline uint64_t lightning_histogram_bucket_max(size_t index)
+{
+  if(index < LIGHTNING_HISTOGRAM_SUB_COUNT)
+  {
+    return index;
+  }
+
+  unsigned shift = (unsigned)(index / LIGHTNING_HISTOGRAM_SUB_COUNT) - 1;
+  uint64_t sub = index % LIGHTNING_HISTOGRAM_SUB_COUNT;
+  return ((LIGHTNING_HISTOGRAM_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+static inline void lightning_metrics_record(struct lightning_metrics *metrics, enum lightning_metrics_phase phase, uint64_t ns)
+{
+  struct lightning_histogram *histogram = &metrics->phases[phase];
+  lightning_metrics_add(&histogram->buckets[lightning_histogram_index(ns)], 1);
+  lightning_metrics_add(&histogram->sum_ns, ns);
+}
+
+/**
+ * Renders the sum of `count` workers' metrics in the Prometheus text
+ * format, the arena usage included. Returns the length written, at most
+ * `capacity`; the output is cut at a line boundary when it does not fit.
+ */
+size_t lightning_metrics_render(const struct lightning_metrics *const *workers,
+                                size_t count,
+                                const struct lightning_arena_stats *arena,
+                                char *buffer,
+                                size_t capacity);
+
+//      LIGHTNING_METRICS_H
+#endif
@@ -0,0 +1,113 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file parser.h
+ * @brief Incremental HTTP/1.1 request parser
+ * -      the parser never allocates: it fills a lightning_http_request with
+ * -      slices into the caller's buffer and can be resumed after every recv.
+ */
+
+#ifndef LIGHTNING_PARSER_H
+#define LIGHTNING_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "request.h"
+
+#define LIGHTNING_CHUNK_LINE_MAX 1024
+
+enum lightning_parse_result
+{
+  LIGHTNING_PARSE_INCOMPLETE = 0,
+  LIGHTNING_PARSE_COMPLETE,
+  LIGHTNING_PARSE_ERROR
+};
+
+enum lightning_parser_state
+{
+  PARSER_STATE_REQUEST_LINE = 0,
+  PARSER_STATE_HEADERS,
+  PARSER_STATE_BODY,
+  PARSER_STATE_DONE
+};
+
+struct lightning_http_parser
+{
+  enum lightning_parser_state state;
+  size_t start;
+  size_t line_start;
+  size_t position;
+  size_t colon;
+  size_t end;
+};
+
+enum lightning_body_state
+{
+  BODY_STATE_LENGTH = 0,
+  BODY_STATE_CHUNK_SIZE,
+  BODY_STATE_CHUNK_DATA,
+  BODY_STATE_CHUNK_END,
+  BODY_STATE_TRAILER,
+  BODY_STATE_DONE
+};
+
+/**
+ * Body framing for requests whose body is streamed instead of waiting in
+ * the read buffer: Content-Length or chunked transfer coding.
+ */
+struct lightning_http_body_reader
+{
+  enum lightning_body_state state;
+  uint64_t remaining;
+  uint64_t total;
+};
+
+void lightning_http_parser_init(struct lightning_http_parser *parser, size_t start);
+enum lightning_parse_result lightning_http_parse(struct lightning_http_parser *parser,
+                                                 struct lightning_http_request *request,
+                                                 const char *buffer,
+                                                 size_t length);
+
+/**
+ * True once the headers are parsed and the body can not simply be waited
+ * for: it is chunked or it would not fit in `capacity` bytes of buffer.
+ */
+bool lightning_http_parser_body_streams(const struct lightning_http_parser *parser,
+                                        const struct lightning_http_request *request,
+                                        size_t capacity);
+
+void lightning_http_body_reader_init(struct lightning_http_body_reader *reader, const struct lightning_http_request *request);
+
+/**
+ * Reads framing and payload from `data`. `consumed` input bytes may be
+ * dropped by the caller; `payload` is set to the body bytes found among
+ * them, if any. INCOMPLETE with nothing consumed means the rest of a chunk
+ * line is needed. Returns COMPLETE once the whole body has been read.
+ */
+enum lightning_parse_result lightning_http_body_read(struct lightning_http_body_reader *reader,
+                                                     const char *data,
+                                                     size_t length,
+                                                     size_t *consumed,
+                                                     const char **payload,
+                                                     size_t *payload_length);
+
+//      LIGHTNING_PARSER_H
+#endif
@@ -0,0 +1,49 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file pool.h
+ * @brief Fixed size object pool
+ * -      objects are carved out of slabs and recycled through a free list.
+ * -      a pool belongs to one worker, so nothing here is thread safe.
+ */
+
+#ifndef LIGHTNING_POOL_H
+#define LIGHTNING_POOL_H
+
+#include <stddef.h>
+
+struct lightning_pool_slab;
+
+struct lightning_pool
+{
+  struct lightning_pool_slab *slabs;
+  void *free_list;
+  size_t object_size;
+  size_t objects_per_slab;
+  size_t capacity;
+  size_t in_use;
+};
+
+void lightning_pool_init(struct lightning_pool *pool, size_t object_size, size_t objects_per_slab);
+void *lightning_pool_acquire(struct lightning_pool *pool);
+void lightning_pool_release(struct lightning_pool *pool, void *object);
+void lightning_pool_destroy(struct lightning_pool *pool);
+
+//      LIGHTNING_POOL_H
+#endif
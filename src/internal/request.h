@@ -19,49 +19,84 @@
 #ifndef LIGHTNING_REQUEST_H
 #define LIGHTNING_REQUEST_H
 
-#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-enum http_methods
+#include "lightning/http.h"
+
+struct lightning_arena;
+
+#define LIGHTNING_MAX_HEADERS 32
+#define LIGHTNING_MAX_PARAMS 8
+
+/**
+ * A view into the connection read buffer. Nothing in the request is
+ * copied: every field is an offset/length pair relative to the buffer
+ * the parser was given.
+ */
+struct lightning_http_slice
 {
-  HTTP_GET,
-  HTTP_POST,
-  HTTP_PUT,
-  HTTP_DELETE,
-  HTTP_HEAD,
-  HTTP_OPTIONS,
-  HTTP_PATCH,
-  HTTP_UNKNOWN
+  uint32_t offset;
+  uint32_t length;
 };
 
-struct header
+struct lightning_http_header
 {
-  char *name;
-  char *value;
-  struct header *next;
+  struct lightning_http_slice name;
+  struct lightning_http_slice value;
 };
 
-struct body
+struct lightning_http_param
 {
-  void *data;
-  size_t length;
+  const char *name;
+  size_t name_length;
+  struct lightning_http_slice value;
 };
 
 struct lightning_http_request
 {
+  const char *buffer;
+
   enum http_methods method;
-  char *uri;
-  char *path;
-  char *query_string;
-  char version[10];
-
-  struct header *headers;
-  char *host;
-  char *content_type;
+  struct lightning_http_slice uri;
+  struct lightning_http_slice path;
+  struct lightning_http_slice query_string;
+  struct lightning_http_slice version;
+  int version_minor;
+
+  struct lightning_http_header headers[LIGHTNING_MAX_HEADERS];
+  size_t headers_count;
+  struct lightning_http_slice host;
+  struct lightning_http_slice content_type;
+  struct lightning_http_slice user_agent;
   size_t content_length;
-  char *user_agent;
+  // A Content-Length header was present, even "0".
+  bool content_length_seen;
+  bool keep_alive;
+  bool chunked;
 
-  struct body *body;
+  // Bodies small enough to arrive with the headers stay in the buffer.
+  // Streamed ones are collected elsewhere and body_data points to them.
+  struct lightning_http_slice body;
+  const void *body_data;
+  size_t body_data_length;
+  void *context;
+  struct lightning_arena *arena;
+
+  struct lightning_http_param params[LIGHTNING_MAX_PARAMS];
+  size_t params_count;
 };
 
+static inline const char *lightning_http_slice_data(const char *buffer, struct lightning_http_slice slice)
+{
+  return buffer + slice.offset;
+}
+
+/**
+ * "GET", "POST"... and "UNKNOWN" for HTTP_UNKNOWN or anything out of range.
+ */
+const char *lightning_method_name(enum http_methods method);
+
 //      LIGHTNING_REQUEST_H
 #endif
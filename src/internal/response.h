@@ -19,54 +19,114 @@
 #ifndef LIGHTNING_RESPONSE_H
 #define LIGHTNING_RESPONSE_H
 
-#define _POSIX_C_SOURCE 200809L
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
 
-struct header
+#include "lightning/http.h"
+#include "date.h"
+
+#define LIGHTNING_RESPONSE_MAX_HEADERS 16
+#define LIGHTNING_RESPONSE_HEADER_STORAGE 1024
+
+struct lightning_http_response_header
 {
-  char *name;
-  char *value;
-  struct header *next;
+  const char *name;
+  const char *value;
+  unsigned short name_length;
+  unsigned short value_length;
 };
 
-struct body
+struct lightning_arena;
+struct lightning_static_file;
+
+/**
+ * Part of a body made of several pieces, multipart/byteranges.
+ */
+struct lightning_response_segment
 {
-  void *data;
+  const void *data;
   size_t length;
-  size_t capacity;
 };
 
+/**
+ * Status line, Content-Type and fixed headers rendered once at startup and
+ * copied as one block. Owned by the application, read by every worker.
+ */
+struct lightning_response_prefix
+{
+  struct lightning_response_prefix *next;
+  int status_code;
+  size_t length;
+  char data[];
+};
+
+/**
+ * Lives in the read block next to the request it answers. Headers added
+ * with lightning_response_header() are copied into `storage`, or into the
+ * request arena once it is full; the static variant only keeps the
+ * pointers.
+ */
 struct lightning_http_response
 {
-  char version[10];
   int status_code;
-  char *status_message;
+  const struct lightning_response_prefix *prefix;
+  const char *content_type;
+  const void *body;
+  size_t body_length;
+  struct lightning_static_file *file;
+  // Where the body starts in `file`, for a byte range.
+  off_t file_offset;
+  // Several ranges: the body is these segments, in the mapped file and the
+  // arena, and `file` is only held until they are sent.
+  const struct lightning_response_segment *segments;
+  unsigned short segments_count;
+  lightning_chunk_producer producer;
+  void *producer_data;
+  struct lightning_arena *arena;
+  bool connection_close;
+  // The producer's output goes unframed and the close ends it: HTTP/1.0
+  // has no chunked coding.
+  bool close_delimited;
+  struct lightning_http_response_header headers[LIGHTNING_RESPONSE_MAX_HEADERS];
+  unsigned short headers_count;
+  unsigned short storage_used;
+  char storage[LIGHTNING_RESPONSE_HEADER_STORAGE];
+};
 
-  struct header *headers;
-  char *content_type;
-  size_t content_length;
-  time_t date;
+void lightning_response_init(struct lightning_http_response *response);
+const char *lightning_status_reason(int status_code);
 
-  struct body *body;
-};
+/**
+ * False for 1xx, 204 and 304: no body is sent, nor Content-Length or
+ * Transfer-Encoding.
+ */
+bool lightning_status_has_body(int status_code);
 
-struct header *add_header(struct lightning_http_response *resp, char *name, char *value)
-{
-  struct header *new_header = malloc(sizeof(struct header));
-  if(new_header == NULL)
-  {
-    return NULL;
-  }
+/**
+ * Precomputed "HTTP/1.1 <code> <reason>\r\n" for the known status codes,
+ * NULL for the others.
+ */
+const char *lightning_status_line(int status_code, size_t *length);
 
-  new_header->name = strdup(name);
-  new_header->value = strdup(value);
-  resp->headers->next = new_header;
+/**
+ * Renders a prefix. `headers` holds name, value pairs and ends with NULL.
+ * Returns NULL on allocation failure or when a header is invalid.
+ */
+struct lightning_response_prefix *lightning_response_prefix_create(int status_code,
+                                                                   const char *content_type,
+                                                                   const char *const headers[]);
 
-  return new_header;
-}
+/**
+ * Writes the status line and headers, up to and including the empty line,
+ * into `output`. Returns the number of bytes the head needs; nothing is
+ * written when that exceeds `capacity`. The body is left to the caller so
+ * large ones can be sent from where the handler left them.
+ */
+size_t lightning_response_serialize_head(const struct lightning_http_response *response,
+                                         const struct lightning_http_date *date,
+                                         char *output,
+                                         size_t capacity);
 
 //      LIGHTNING_RESPONSE_H
 #endif
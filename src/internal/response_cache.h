@@ -0,0 +1,250 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file response_cache.h
+ * @brief Cached responses of idempotent GET routes
+ * -      each worker keeps the responses of its cached routes fully
+ * -      serialized, in a byte bounded LRU with a TTL per entry: a hit is
+ * -      one copy into the write buffer, the handler does not run. routes
+ * -      marked shared use one table for every worker instead, read
+ * -      without locks; replaced entries are freed once every worker went
+ * -      through a quiescent state (RCU, QSBR flavour).
+ */
+
+#ifndef LIGHTNING_RESPONSE_CACHE_H
+#define LIGHTNING_RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lightning/application.h"
+#include "conditional.h"
+#include "connection.h"
+#include "date.h"
+#include "metrics.h"
+#include "request.h"
+#include "response.h"
+
+#define LIGHTNING_RESPONSE_CACHE_BUCKETS 1024
+#define LIGHTNING_SHARED_CACHE_SLOTS 4096
+// Expired entries of the shared table looked at per event loop round.
+#define LIGHTNING_SHARED_CACHE_SWEEP 16
+// Path, query and the values of the Vary headers.
+#define LIGHTNING_RESPONSE_CACHE_KEY_MAX 2048
+// A hit is copied into an empty write buffer in one go, its 304 and 206
+// variants too.
+#define LIGHTNING_RESPONSE_CACHE_ENTRY_MAX (LIGHTNING_WRITE_BUFFER_SIZE - 128)
+// Longer entity tags set by a handler are sent but not compared.
+#define LIGHTNING_RESPONSE_CACHE_ETAG_MAX 64
+// Default lightning_config.response_cache_size and shared_response_cache_size.
+#define LIGHTNING_RESPONSE_CACHE_SIZE (4 * 1024 * 1024)
+
+/**
+ * The policy of a cached route, copied from lightning_cache_policy when the
+ * route is registered. Owned by the application.
+ */
+struct lightning_cache_rule
+{
+  struct lightning_cache_rule *next;
+  uint64_t ttl_ms;
+  bool shared;
+  int vary_count;
+  char *vary[LIGHTNING_CACHE_VARY_MAX];
+};
+
+/**
+ * One response as it goes on the wire with Connection: keep-alive; the
+ * Date header is patched in when it is copied out. Immutable once stored,
+ * which is what lets the shared table hand it to several workers. The head
+ * is: status line (status_length), headers with Date at date_offset,
+ * Content-Length at length_offset (entries with an ETag), Connection.
+ */
+struct lightning_cached_response
+{
+  struct lightning_cached_response *hash_next;
+  struct lightning_cached_response *lru_prev;
+  struct lightning_cached_response *lru_next;
+  const struct lightning_cache_rule *rule;
+  uint64_t expires_ms;
+  uint32_t hash;
+  int status_code;
+  size_t status_length;
+  size_t date_offset;
+  size_t length_offset;
+  size_t head_length;
+  size_t body_length;
+  size_t key_length;
+  // Empty for other statuses than 200: no 304 nor 206 then.
+  char etag[LIGHTNING_RESPONSE_CACHE_ETAG_MAX];
+  size_t etag_length;
+  // Accounted against the capacity: the allocation.
+  size_t size;
+  // Key, then head and body.
+  char data[];
+};
+
+struct lightning_response_cache
+{
+  struct lightning_cached_response *buckets[LIGHTNING_RESPONSE_CACHE_BUCKETS];
+  struct lightning_cached_response *lru_head;
+  struct lightning_cached_response *lru_tail;
+  size_t bytes;
+  size_t capacity;
+};
+
+/**
+ * A worker reading the shared table. `state` is odd while the worker is
+ * offline (blocked in its event loop or gone): it holds no entry then.
+ */
+struct lightning_shared_cache_reader
+{
+  _Alignas(LIGHTNING_CACHE_LINE) uint64_t state;
+  // Replaced by this worker and not yet freed: `retired` waits for the
+  // next grace period, `waiting` for the one started at `snapshot`.
+  struct lightning_cached_response *retired;
+  struct lightning_cached_response *waiting;
+  uint64_t *snapshot;
+  size_t sweep;
+};
+
+struct lightning_shared_response_cache
+{
+  struct lightning_cached_response *slots[LIGHTNING_SHARED_CACHE_SLOTS];
+  size_t capacity;
+  size_t bytes;
+  int readers_count;
+  struct lightning_shared_cache_reader readers[];
+};
+
+void lightning_response_cache_init(struct lightning_response_cache *cache, size_t capacity);
+void lightning_response_cache_destroy(struct lightning_response_cache *cache);
+
+/**
+ * Writes the key of `request` for `rule` into `key`, which holds
+ * LIGHTNING_RESPONSE_CACHE_KEY_MAX bytes. Returns false when it does not
+ * fit: the request is not cached.
+ */
+bool lightning_response_cache_key(const struct lightning_cache_rule *rule,
+                                  const struct lightning_http_request *request,
+                                  char *key,
+                                  size_t *length,
+                                  uint32_t *hash);
+
+/**
+ * Returns the fresh entry for the key, NULL on a miss. Expired entries are
+ * dropped on the way.
+ */
+const struct lightning_cached_response *lightning_response_cache_lookup(struct lightning_response_cache *cache,
+                                                                        const struct lightning_cache_rule *rule,
+                                                                        const char *key,
+                                                                        size_t key_length,
+                                                                        uint32_t hash,
+                                                                        uint64_t now_ms);
+
+/**
+ * Takes ownership of `entry`, evicting the least recently used ones to
+ * make room. Entries larger than the capacity are freed at once.
+ */
+void lightning_response_cache_store(struct lightning_response_cache *cache, struct lightning_cached_response *entry);
+
+/**
+ * Serializes the response a handler built. NULL when it can not be cached:
+ * status other than 200, 203, 204, 300, 301, 404 or 410, chunked or file
+ * body, Set-Cookie, larger than LIGHTNING_RESPONSE_CACHE_ENTRY_MAX, or out
+ * of memory. A 200 gets ETag, a hash of its body unless the handler set
+ * one, and Accept-Ranges headers: added to `response` as well.
+ */
+struct lightning_cached_response *lightning_cached_response_create(const struct lightning_cache_rule *rule,
+                                                                   const char *key,
+                                                                   size_t key_length,
+                                                                   uint32_t hash,
+                                                                   struct lightning_http_response *response,
+                                                                   const struct lightning_http_date *date,
+                                                                   uint64_t now_ms);
+
+/**
+ * Copies the response into `output` with the current Date, and
+ * Connection: close when `close` is set. Returns the length it needs;
+ * nothing is written when that exceeds `capacity` or `output` is NULL.
+ */
+size_t lightning_cached_response_write(const struct lightning_cached_response *entry,
+                                       const struct lightning_http_date *date,
+                                       bool close,
+                                       bool head_only,
+                                       char *output,
+                                       size_t capacity);
+
+/**
+ * Same, as a 304 Not Modified: the head without Content-Length.
+ */
+size_t lightning_cached_response_write_not_modified(const struct lightning_cached_response *entry,
+                                                    const struct lightning_http_date *date,
+                                                    bool close,
+                                                    char *output,
+                                                    size_t capacity);
+
+/**
+ * Same, as a 206 Partial Content with `range` of the body.
+ */
+size_t lightning_cached_response_write_range(const struct lightning_cached_response *entry,
+                                             const struct lightning_http_date *date,
+                                             bool close,
+                                             bool head_only,
+                                             const struct lightning_byte_range *range,
+                                             char *output,
+                                             size_t capacity);
+
+struct lightning_shared_response_cache *lightning_shared_cache_create(int readers_count, size_t capacity);
+
+/**
+ * Every reader must be offline for good: the workers are gone.
+ */
+void lightning_shared_cache_destroy(struct lightning_shared_response_cache *shared);
+
+/**
+ * Same as lightning_response_cache_lookup. The entry stays valid until
+ * `reader` goes offline.
+ */
+const struct lightning_cached_response *lightning_shared_cache_lookup(const struct lightning_shared_response_cache *shared,
+                                                                      const struct lightning_cache_rule *rule,
+                                                                      const char *key,
+                                                                      size_t key_length,
+                                                                      uint32_t hash,
+                                                                      uint64_t now_ms);
+
+/**
+ * Publishes `entry` in its slot, or frees it when the table is over its
+ * capacity or another worker just published there. The entry it replaces
+ * is retired by `reader`.
+ */
+void lightning_shared_cache_publish(struct lightning_shared_response_cache *shared, int reader, struct lightning_cached_response *entry);
+
+/**
+ * Quiescent states of `reader`, NULL safe. Offline before the event loop
+ * blocks and once the worker is done: entries it looked up are not used
+ * any more. Online right after the wait, before any lookup. Going offline
+ * also retires a few expired entries and frees those retired before the
+ * last grace period.
+ */
+void lightning_shared_cache_offline(struct lightning_shared_response_cache *shared, int reader, uint64_t now_ms);
+void lightning_shared_cache_online(struct lightning_shared_response_cache *shared, int reader);
+
+//      LIGHTNING_RESPONSE_CACHE_H
+#endif
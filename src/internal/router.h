@@ -0,0 +1,95 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file router.h
+ * @brief Route table
+ * -      routes are inserted into a pointer based radix tree while the
+ * -      application is configured, then lightning_router_compile flattens
+ * -      it into contiguous arrays that every worker reads without locks.
+ */
+
+#ifndef LIGHTNING_ROUTER_H
+#define LIGHTNING_ROUTER_H
+
+#include <stddef.h>
+
+#include "lightning/application.h"
+#include "request.h"
+
+enum lightning_route_result
+{
+  LIGHTNING_ROUTE_FOUND = 0,
+  LIGHTNING_ROUTE_NOT_FOUND,
+  LIGHTNING_ROUTE_METHOD_NOT_ALLOWED,
+  // HTTP_UNKNOWN: no route can have it.
+  LIGHTNING_ROUTE_NOT_IMPLEMENTED
+};
+
+struct lightning_static_directory;
+struct lightning_cache_rule;
+
+/**
+ * `directory` is set for routes added with lightning_router_add_static:
+ * the worker serves those itself and never calls `handler`. `cache` is set
+ * for those added with lightning_router_add_cached.
+ */
+struct lightning_route_target
+{
+  lightning_handler handler;
+  lightning_body_handler body_handler;
+  void *user_data;
+  const struct lightning_static_directory *directory;
+  const struct lightning_cache_rule *cache;
+};
+
+struct lightning_router;
+
+struct lightning_router *lightning_router_create(void);
+int lightning_router_add(struct lightning_router *router,
+                         enum http_methods method,
+                         const char *pattern,
+                         lightning_handler handler,
+                         lightning_body_handler body_handler,
+                         void *user_data);
+int lightning_router_add_static(struct lightning_router *router,
+                                const char *pattern,
+                                const struct lightning_static_directory *directory);
+int lightning_router_add_cached(struct lightning_router *router,
+                                const char *pattern,
+                                lightning_handler handler,
+                                void *user_data,
+                                const struct lightning_cache_rule *cache);
+int lightning_router_compile(struct lightning_router *router);
+size_t lightning_router_count(const struct lightning_router *router);
+
+/**
+ * Looks up `path` (relative to request->buffer) and fills request->params.
+ * On LIGHTNING_ROUTE_METHOD_NOT_ALLOWED, `allowed` (NULL: not wanted) gets
+ * the methods of every route the path matches, bit 1 << method each, HEAD
+ * along with GET.
+ * Only valid after lightning_router_compile.
+ */
+enum lightning_route_result lightning_router_match(const struct lightning_router *router,
+                                                   struct lightning_http_request *request,
+                                                   const struct lightning_route_target **target,
+                                                   unsigned *allowed);
+void lightning_router_destroy(struct lightning_router *router);
+
+//      LIGHTNING_ROUTER_H
+#endif
@@ -0,0 +1,42 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file scan.h
+ * @brief Vectorized delimiter scanning used by the request parser
+ * -      the implementation (AVX2, SSE2 or scalar) is picked once at startup
+ * -      from the features of the running CPU.
+ */
+
+#ifndef LIGHTNING_SCAN_H
+#define LIGHTNING_SCAN_H
+
+#include <stddef.h>
+
+typedef size_t (*lightning_scan_function)(const char *data, size_t length, char first, char second);
+
+/**
+ * Returns the index of the first byte equal to `first` or `second` in
+ * data[0..length), or `length` when there is none.
+ */
+extern lightning_scan_function lightning_scan_any2;
+
+const char *lightning_scan_backend(void);
+
+//      LIGHTNING_SCAN_H
+#endif
@@ -24,23 +24,202 @@
 #ifndef LIGHTNING_SERVER_H
 #define LIGHTNING_SERVER_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 
+#include "lightning/application.h"
+#include "access_log.h"
+#include "arena.h"
+#include "connection.h"
+#include "date.h"
+#include "metrics.h"
+#include "pool.h"
+#include "response_cache.h"
+#include "static.h"
+#include "timer.h"
+
+// Default, lightning_config.epoll_max_events.
 #define LIGHTNING_EPOLL_MAX_EVENTS 64
+// Default, lightning_config.accept_batch.
+#define LIGHTNING_ACCEPT_BATCH 32
+// While shedding, the event loop wakes up this often to check whether the
+// worker recovered.
+#define LIGHTNING_ADMISSION_CHECK_MS 10
 #define LIGHTNING_EPOLL_TIMEOUT_MS -1
+// Default SO_SNDBUF and SO_RCVBUF of the listeners.
+#define LIGHTNING_SOCKET_BUFFER_SIZE (1024 * 1024)
+#define LIGHTNING_POOL_SLAB_OBJECTS 32
+
+#define LIGHTNING_TIMER_TICK_MS 100
+#define LIGHTNING_HEADER_TIMEOUT_MS 10000
+#define LIGHTNING_BODY_TIMEOUT_MS 30000
+#define LIGHTNING_KEEPALIVE_TIMEOUT_MS 15000
+#define LIGHTNING_WRITE_TIMEOUT_MS 30000
+#define LIGHTNING_DRAIN_TIMEOUT_MS 10000
+
+#define LIGHTNING_URING_ENTRIES 1024
+#define LIGHTNING_URING_BUFFER_COUNT 1024
+#define LIGHTNING_URING_BUFFER_SIZE 4096
+// Provided buffers a connection may hold before its recv is stopped.
+#define LIGHTNING_URING_HELD_MAX 8
 
 #define LIGHTNING_ERROR(error_message) \
   fprintf(stderr,                      \
           "[Lightning Error]: In <%s> line %d (%s)\n", __FUNCTION__, __LINE__, error_message)
 
-struct lightning_server;
+struct lightning_router;
+
+/**
+ * One worker: a socket per listener, its event loop and every connection it
+ * accepted. Only the owning thread touches it once lightning_ride started.
+ */
+struct lightning_server
+{
+  struct lightning_connection *connections;
+  const struct lightning_router *router;
+  struct lightning_pool read_pool;
+  struct lightning_pool write_pool;
+  struct lightning_pool arena_pool;
+  struct lightning_arena_stats arena_stats;
+  struct lightning_timer_wheel timers;
+  uint64_t now_ms;
+  struct lightning_http_date date;
+  struct lightning_static_cache files;
+  struct lightning_response_cache responses;
+  // NULL without shared cached routes. shared_reader: this worker's index.
+  struct lightning_shared_response_cache *shared_responses;
+  int shared_reader;
+  // One per listener, -1 once closed.
+  int listen_fds[LIGHTNING_MAX_LISTENERS];
+  int listen_count;
+  int epoll_fd;
+  int wake_fd;
+  int max_connections;
+  int active_connections;
+  size_t read_buffer_size;
+  int epoll_max_events;
+  int accept_batch;
+  // Admission control, see lightning_config. shedding is set past either
+  // limit and cleared under 3/4 of both.
+  int max_active_connections;
+  uint64_t max_loop_delay_ns;
+  enum lightning_shed_mode shed_mode;
+  bool shedding;
+  // Duration of an event loop round, exponentially averaged.
+  uint64_t loop_delay_ns;
+  // epoll: listeners whose last batch stopped short of EAGAIN, one bit each.
+  // Edge-triggered, they get no new event for what is left in their queue.
+  uint32_t accept_pending;
+  enum lightning_backend backend;
+  size_t max_body_size;
+  size_t body_spill_threshold;
+  // Set from other threads (and signal handlers) with atomics, followed by
+  // a write to wake_fd so a worker blocked in its event loop notices.
+  bool running;
+  bool drain_requested;
+  // The listening socket lives on in the next generation: its accept queue
+  // is left to it.
+  bool handed_off;
+  // Owned by the worker: no more accepts, every response says
+  // Connection: close, the loop ends when the last connection is gone or
+  // at drain_deadline_ms.
+  bool draining;
+  uint64_t drain_deadline_ms;
+  // Written by the worker only, read by the metrics route on any worker.
+  struct lightning_metrics *metrics;
+  // NULL when requests are not logged.
+  struct lightning_access_ring *access_log;
+};
+
+/**
+ * Binds a new listening socket with the options of `listener`, member of
+ * the SO_REUSEPORT group of its address.
+ */
+int lightning_server_listen(const struct lightning_listener *listener);
 
-struct lightning_server *lightning_create_server(const unsigned short port, int max_connections);
+/**
+ * Takes ownership of `listen_fds`, bound and listening sockets, closed on
+ * failure too. The sizes come from `config`, with every default resolved.
+ * Called by the worker thread that runs the server, once pinned, so the
+ * pages it touches first come from the worker's NUMA node.
+ */
+struct lightning_server *lightning_create_server(const struct lightning_config *config, const int *listen_fds, int listen_count);
 void *ride_the_lightning(void *args);
 void lightning_destroy_server(struct lightning_server *server);
 void lightning_server_stop(struct lightning_server *server);
 
+/**
+ * Asks the worker to stop gracefully. Safe to call from any thread and from
+ * a signal handler.
+ */
+void lightning_server_drain(struct lightning_server *server);
+
+/**
+ * Drain after the listening socket was handed over to another process:
+ * connections still waiting in the accept queue are left to it.
+ */
+void lightning_server_hand_off(struct lightning_server *server);
+void lightning_server_set_router(struct lightning_server *server, const struct lightning_router *router);
+void lightning_server_set_backend(struct lightning_server *server, enum lightning_backend backend);
+void lightning_server_set_body_limits(struct lightning_server *server, size_t max_body_size, size_t spill_threshold);
+void lightning_server_set_shared_cache(struct lightning_server *server, struct lightning_shared_response_cache *shared, int reader);
+void lightning_server_set_access_log(struct lightning_server *server, struct lightning_access_ring *ring);
+
+/*
+ * Shared by the event backends: everything that does not depend on how
+ * bytes get in and out of the socket.
+ */
+uint64_t lightning_clock_ms(void);
+uint64_t lightning_clock_ns(void);
+struct lightning_connection *lightning_server_open_connection(struct lightning_server *server, int fd, const union lightning_socket_address *addr);
+// Index of the listener whose socket is `fd`, -1 for any other descriptor.
+int lightning_server_listener_index(const struct lightning_server *server, int fd);
+void lightning_server_release_connection(struct lightning_server *server, struct lightning_connection *conn);
+int lightning_server_process_requests(struct lightning_server *server, struct lightning_connection *conn);
+/**
+ * Accounts `sent` bytes of the output queue as written, like
+ * lightning_connection_output_sent, and records the write metrics.
+ */
+size_t lightning_server_output_sent(struct lightning_server *server, struct lightning_connection *conn, size_t sent);
+void lightning_server_update_timer(struct lightning_server *server, struct lightning_connection *conn);
+bool lightning_server_connection_expired(struct lightning_server *server, struct lightning_connection *conn);
+int lightning_server_poll_timeout(struct lightning_server *server);
+void lightning_server_consume_wakeup(struct lightning_server *server);
+
+/**
+ * Admission control. Call with the time the event loop round started (0
+ * when the loop delay is not limited) once the round is over; re-evaluates
+ * whether the worker sheds new connections.
+ */
+void lightning_server_update_admission(struct lightning_server *server, uint64_t round_started_ns);
+
+/**
+ * True while new connections are to be left in the listen backlog.
+ */
+bool lightning_server_accept_paused(const struct lightning_server *server);
+
+/**
+ * Answers a just accepted connection 503 Service Unavailable and closes it.
+ */
+void lightning_server_shed_connection(struct lightning_server *server, int fd);
+bool lightning_server_finished(struct lightning_server *server);
+
+/**
+ * True once a drain was requested and the backend has not started it yet.
+ * The backend then stops accepting, calls lightning_server_start_draining
+ * and closes the connections lightning_server_connection_idle reports.
+ */
+bool lightning_server_drain_pending(struct lightning_server *server);
+void lightning_server_start_draining(struct lightning_server *server);
+bool lightning_server_connection_idle(const struct lightning_connection *conn);
+
+/**
+ * Runs the worker on io_uring. Returns -1 without touching any connection
+ * when the kernel does not support what the backend needs.
+ */
+int lightning_uring_run(struct lightning_server *server);
+
 //      LIGHTNING_SERVER_H
 #endif
@@ -0,0 +1,118 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file static.h
+ * @brief Static file serving
+ * -      every worker keeps its own LRU cache of open files: fd, stat
+ * -      result, pre-rendered headers and, for small files, a private
+ * -      mapping of the contents. no locks, no sharing between workers.
+ */
+
+#ifndef LIGHTNING_STATIC_H
+#define LIGHTNING_STATIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "conditional.h"
+#include "response.h"
+
+#define LIGHTNING_STATIC_CACHE_ENTRIES 256
+#define LIGHTNING_STATIC_MMAP_MAX (256 * 1024)
+#define LIGHTNING_STATIC_REVALIDATE_MS 1000
+#define LIGHTNING_STATIC_PATH_MAX 1024
+
+/**
+ * A directory served under a route prefix. Created while the application
+ * is configured, read only afterwards.
+ */
+struct lightning_static_directory
+{
+  struct lightning_static_directory *next;
+  int fd;
+};
+
+struct lightning_static_file
+{
+  struct lightning_static_file *hash_next;
+  struct lightning_static_file *lru_prev;
+  struct lightning_static_file *lru_next;
+  const struct lightning_static_directory *directory;
+  struct lightning_response_prefix *prefix;
+  const char *content_type;
+  // Computed when the file is opened, from its inode, size and mtime.
+  char etag[LIGHTNING_ETAG_LENGTH];
+  char *data;
+  size_t size;
+  struct timespec modified;
+  ino_t inode;
+  uint64_t checked_ms;
+  uint32_t hash;
+  unsigned references;
+  bool cached;
+  int fd;
+  size_t path_length;
+  char path[];
+};
+
+struct lightning_static_cache
+{
+  struct lightning_static_file *buckets[LIGHTNING_STATIC_CACHE_ENTRIES];
+  struct lightning_static_file *lru_head;
+  struct lightning_static_file *lru_tail;
+  size_t count;
+};
+
+enum lightning_static_result
+{
+  LIGHTNING_STATIC_FOUND = 0,
+  LIGHTNING_STATIC_NOT_FOUND,
+  LIGHTNING_STATIC_ERROR
+};
+
+struct lightning_static_directory *lightning_static_directory_open(const char *path);
+void lightning_static_directory_close(struct lightning_static_directory *directory);
+
+void lightning_static_cache_init(struct lightning_static_cache *cache);
+void lightning_static_cache_destroy(struct lightning_static_cache *cache);
+
+/**
+ * Finds `path` (relative to the directory, not NUL terminated) in the cache
+ * or opens it. On success the file is returned with one reference taken;
+ * drop it with lightning_static_file_release once its bytes are sent.
+ */
+enum lightning_static_result lightning_static_lookup(struct lightning_static_cache *cache,
+                                                     const struct lightning_static_directory *directory,
+                                                     const char *path,
+                                                     size_t path_length,
+                                                     uint64_t now_ms,
+                                                     struct lightning_static_file **file);
+void lightning_static_file_release(struct lightning_static_file *file);
+
+/**
+ * Maps a file that is normally sent with sendfile, for backends that can
+ * only send from memory. Returns -1 when the mapping fails.
+ */
+int lightning_static_file_map(struct lightning_static_file *file);
+
+//      LIGHTNING_STATIC_H
+#endif
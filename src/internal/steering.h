@@ -0,0 +1,53 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file steering.h
+ * @brief CPU-steered accept for the SO_REUSEPORT group
+ * -      a new connection goes to the listener of the worker pinned to the
+ * -      CPU that received its packets, instead of a hash of its addresses.
+ */
+
+#ifndef LIGHTNING_STEERING_H
+#define LIGHTNING_STEERING_H
+
+#include <stddef.h>
+
+/**
+ * Largest group the classic BPF program can map (two instructions per
+ * worker, BPF_MAXINSNS in total).
+ */
+#define LIGHTNING_STEERING_MAX_SOCKETS 2046
+
+/**
+ * `sockets[i]` is the listener of the worker pinned to `cpus[i]`, in the
+ * order the sockets joined their SO_REUSEPORT group. Sets SO_INCOMING_CPU on
+ * each one and attaches to the group a program returning the index of the
+ * socket whose CPU received the packet. Packets from a CPU without a worker
+ * fall back to the kernel's hash. Returns -1 with errno set on failure.
+ */
+int lightning_steering_attach(const int *sockets, const int *cpus, size_t count);
+
+/**
+ * Removes a program a previous generation attached to the group of
+ * `socket_fd`, if any.
+ */
+void lightning_steering_detach(int socket_fd);
+
+//      LIGHTNING_STEERING_H
+#endif
@@ -0,0 +1,76 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file timer.h
+ * @brief Hierarchical timer wheel
+ * -      timers are intrusive list nodes, so scheduling and cancelling are
+ * -      O(1) and never allocate. one wheel per worker, not thread safe.
+ */
+
+#ifndef LIGHTNING_TIMER_H
+#define LIGHTNING_TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LIGHTNING_TIMER_LEVELS 3
+#define LIGHTNING_TIMER_SLOT_BITS 6
+#define LIGHTNING_TIMER_SLOTS (1 << LIGHTNING_TIMER_SLOT_BITS)
+
+struct lightning_timer
+{
+  struct lightning_timer *next;
+  struct lightning_timer *prev;
+  uint64_t expires;
+};
+
+typedef void (*lightning_timer_callback)(struct lightning_timer *timer, void *data);
+
+struct lightning_timer_wheel
+{
+  struct lightning_timer slots[LIGHTNING_TIMER_LEVELS][LIGHTNING_TIMER_SLOTS];
+  uint64_t current;
+  uint64_t tick_ms;
+  size_t count;
+};
+
+void lightning_timer_wheel_init(struct lightning_timer_wheel *wheel, uint64_t now_ms, uint64_t tick_ms);
+void lightning_timer_init(struct lightning_timer *timer);
+bool lightning_timer_pending(const struct lightning_timer *timer);
+void lightning_timer_schedule(struct lightning_timer_wheel *wheel, struct lightning_timer *timer, uint64_t expires_ms);
+void lightning_timer_cancel(struct lightning_timer_wheel *wheel, struct lightning_timer *timer);
+
+/**
+ * Runs the callback of every timer that expired up to `now_ms`. Callbacks
+ * may schedule or cancel any timer, including the one being fired.
+ */
+void lightning_timer_wheel_advance(struct lightning_timer_wheel *wheel,
+                                   uint64_t now_ms,
+                                   lightning_timer_callback callback,
+                                   void *data);
+
+/**
+ * Milliseconds until the wheel needs to be advanced again, or -1 when no
+ * timer is scheduled. Meant to be passed straight to epoll_wait.
+ */
+int lightning_timer_wheel_timeout(const struct lightning_timer_wheel *wheel, uint64_t now_ms);
+
+//      LIGHTNING_TIMER_H
+#endif
@@ -0,0 +1,55 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file topology.h
+ * @brief NUMA layout of the CPUs the workers are pinned to
+ * -      read from sysfs, without libnuma.
+ */
+
+#ifndef LIGHTNING_TOPOLOGY_H
+#define LIGHTNING_TOPOLOGY_H
+
+#include <stdbool.h>
+
+// Same as CPU_SETSIZE: workers are only ever pinned below it.
+#define LIGHTNING_TOPOLOGY_MAX_CPUS 1024
+
+struct lightning_topology
+{
+  int nodes;
+  // NUMA node of each CPU, 0 when the kernel reports none.
+  short node[LIGHTNING_TOPOLOGY_MAX_CPUS];
+};
+
+/**
+ * Fills `topology` from /sys/devices/system/node. A machine (or container)
+ * without that information is one node holding every CPU.
+ */
+void lightning_topology_detect(struct lightning_topology *topology);
+
+/**
+ * Parses a CPU list in the sysfs format ("0-3,8", a trailing newline is
+ * fine) into `cpus`, one flag per CPU. CPUs from
+ * LIGHTNING_TOPOLOGY_MAX_CPUS on are ignored. Returns -1 when the list is
+ * malformed.
+ */
+int lightning_topology_parse_cpus(const char *list, bool cpus[LIGHTNING_TOPOLOGY_MAX_CPUS]);
+
+//      LIGHTNING_TOPOLOGY_H
+#endif
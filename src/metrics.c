@@ -0,0 +1,218 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/metrics.h"
+
+// Exported bucket bounds: powers of two from 128 ns to 2^35 ns (34 s). They
+// fall on internal bucket boundaries, so the cumulative counts are exact.
+#define METRICS_FIRST_BOUND_BITS 7
+#define METRICS_LAST_BOUND_BITS 35
+
+struct metrics_output
+{
+  char *buffer;
+  size_t capacity;
+  size_t length;
+  bool full;
+};
+
+static void emit(struct metrics_output *output, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static void emit_counter(struct metrics_output *output, const char *name, const char *help, uint64_t value);
+static void emit_histogram(struct metrics_output *output, const char *name, const char *help, const uint64_t *buckets, uint64_t sum_ns);
+
+static const struct
+{
+  const char *name;
+  const char *help;
+} lightning_phase_names[LIGHTNING_PHASE_COUNT] = {
+  [LIGHTNING_PHASE_PARSE] = {"lightning_parse_duration_seconds", "Time in the parser until the request headers are complete."},
+  [LIGHTNING_PHASE_HANDLE] = {"lightning_handle_duration_seconds", "Routing, handler and response serialization."},
+  [LIGHTNING_PHASE_WRITE] = {"lightning_write_duration_seconds", "From the first queued response until the output is sent."},
+};
+
+struct lightning_metrics *lightning_metrics_create(void)
+{
+  size_t size = (sizeof(struct lightning_metrics) + LIGHTNING_CACHE_LINE - 1) & ~(size_t)(LIGHTNING_CACHE_LINE - 1);
+  struct lightning_metrics *metrics = aligned_alloc(LIGHTNING_CACHE_LINE, size);
+
+  if(metrics != NULL)
+  {
+    memset(metrics, 0, size);
+  }
+
+  return metrics;
+}
+
+void lightning_metrics_destroy(struct lightning_metrics *metrics)
+{
+  free(metrics);
+}
+
+static uint64_t load(const uint64_t *value)
+{
+  return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+size_t lightning_metrics_render(const struct lightning_metrics *const *workers,
+                                size_t count,
+                                const struct lightning_arena_stats *arena,
+                                char *buffer,
+                                size_t capacity)
+{
+  struct metrics_output output = {.buffer = buffer, .capacity = capacity, .length = 0, .full = false};
+  struct lightning_metrics total;
+  memset(&total, 0, sizeof(total));
+
+  for(size_t i = 0; i < count; i++)
+  {
+    const struct lightning_metrics *worker = workers[i];
+    if(worker == NULL)
+    {
+      continue;
+    }
+
+    total.requests += load(&worker->requests);
+    total.bytes_in += load(&worker->bytes_in);
+    total.bytes_out += load(&worker->bytes_out);
+    total.parse_errors += load(&worker->parse_errors);
+    total.timeouts += load(&worker->timeouts);
+    total.connections_opened += load(&worker->connections_opened);
+    total.connections_closed += load(&worker->connections_closed);
+    total.short_writes += load(&worker->short_writes);
+    total.reads_would_block += load(&worker->reads_would_block);
+    total.writes_would_block += load(&worker->writes_would_block);
+    total.flushes += load(&worker->flushes);
+    total.loop_iterations += load(&worker->loop_iterations);
+    total.access_log_dropped += load(&worker->access_log_dropped);
+    total.access_log_sampled += load(&worker->access_log_sampled);
+    total.connections_shed += load(&worker->connections_shed);
+    total.overloads += load(&worker->overloads);
+    total.cache_hits += load(&worker->cache_hits);
+    total.cache_misses += load(&worker->cache_misses);
+
+    for(int phase = 0; phase < LIGHTNING_PHASE_COUNT; phase++)
+    {
+      total.phases[phase].sum_ns += load(&worker->phases[phase].sum_ns);
+      for(size_t bucket = 0; bucket < LIGHTNING_HISTOGRAM_BUCKETS; bucket++)
+      {
+        total.phases[phase].buckets[bucket] += load(&worker->phases[phase].buckets[bucket]);
+      }
+    }
+  }
+
+  emit_counter(&output, "lightning_requests_total", "Requests handled.", total.requests);
+  emit_counter(&output, "lightning_received_bytes_total", "Bytes read from clients.", total.bytes_in);
+  emit_counter(&output, "lightning_sent_bytes_total", "Bytes written to clients.", total.bytes_out);
+  emit_counter(&output, "lightning_parse_errors_total", "Requests rejected as malformed.", total.parse_errors);
+  emit_counter(&output, "lightning_timeouts_total", "Connections closed by a header, body, keep-alive or write timeout.", total.timeouts);
+  emit_counter(&output, "lightning_connections_total", "Connections accepted.", total.connections_opened);
+  emit_counter(&output, "lightning_short_writes_total", "Writes that left part of the output queued.", total.short_writes);
+  emit_counter(&output, "lightning_read_would_block_total", "Reads that found the socket empty (EAGAIN).", total.reads_would_block);
+  emit_counter(&output, "lightning_write_would_block_total", "Writes that found the socket full (EAGAIN).", total.writes_would_block);
+  emit_counter(&output, "lightning_flushes_total", "Output flushes started.", total.flushes);
+  emit_counter(&output, "lightning_loop_iterations_total", "Event loop iterations.", total.loop_iterations);
+  emit_counter(&output, "lightning_access_log_dropped_total", "Requests not logged, the access log buffer was full.", total.access_log_dropped);
+  emit_counter(&output, "lightning_access_log_sampled_total", "Requests left out of the access log by sampling.", total.access_log_sampled);
+  emit_counter(&output, "lightning_connections_shed_total", "Connections answered 503 and closed by admission control or the connection limit.", total.connections_shed);
+  emit_counter(&output, "lightning_overloads_total", "Times a worker went over its admission limits.", total.overloads);
+  emit_counter(&output, "lightning_response_cache_hits_total", "Requests to cached routes served from the cache.", total.cache_hits);
+  emit_counter(&output, "lightning_response_cache_misses_total", "Requests to cached routes that ran the handler.", total.cache_misses);
+
+  emit(&output, "# HELP lightning_connections_active Connections open.\n");
+  emit(&output, "# TYPE lightning_connections_active gauge\n");
+  emit(&output, "lightning_connections_active %lu\n", (unsigned long)(total.connections_opened - total.connections_closed));
+
+  if(arena != NULL)
+  {
+    emit(&output, "# HELP lightning_arena_high_water_bytes Largest handler allocation cycle on a connection.\n");
+    emit(&output, "# TYPE lightning_arena_high_water_bytes gauge\n");
+    emit(&output, "lightning_arena_high_water_bytes %zu\n", arena->high_water);
+    emit_counter(&output, "lightning_arena_overflows_total", "Allocation cycles that needed more than one arena block.", arena->overflows);
+  }
+
+  for(int phase = 0; phase < LIGHTNING_PHASE_COUNT; phase++)
+  {
+    emit_histogram(&output, lightning_phase_names[phase].name, lightning_phase_names[phase].help,
+                   total.phases[phase].buckets, total.phases[phase].sum_ns);
+  }
+
+  return output.length;
+}
+
+static void emit(struct metrics_output *output, const char *format, ...)
+{
+  if(output->full)
+  {
+    return;
+  }
+
+  va_list arguments;
+  va_start(arguments, format);
+  size_t room = output->capacity - output->length;
+  int length = vsnprintf(output->buffer + output->length, room, format, arguments);
+  va_end(arguments);
+
+  // A line that does not fit is dropped whole, and everything after it.
+  if(length < 0 || (size_t)length >= room)
+  {
+    output->full = true;
+    return;
+  }
+
+  output->length += (size_t)length;
+}
+
+static void emit_counter(struct metrics_output *output, const char *name, const char *help, uint64_t value)
+{
+  emit(output, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", name, help, name, name, (unsigned long)value);
+}
+
+static void emit_histogram(struct metrics_output *output, const char *name, const char *help, const uint64_t *buckets, uint64_t sum_ns)
+{
+  emit(output, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+  uint64_t cumulative = 0;
+  size_t bucket = 0;
+
+  for(int bits = METRICS_FIRST_BOUND_BITS; bits <= METRICS_LAST_BOUND_BITS; bits++)
+  {
+    // 2^bits starts bucket (bits - SUB_BITS + 1) * SUB_COUNT.
+    size_t end = (size_t)(bits - LIGHTNING_HISTOGRAM_SUB_BITS + 1) * LIGHTNING_HISTOGRAM_SUB_COUNT;
+    while(bucket < end)
+    {
+      cumulative += buckets[bucket++];
+    }
+
+    emit(output, "%s_bucket{le=\"%.9g\"} %lu\n", name, (double)((uint64_t)1 << bits) / 1e9, (unsigned long)cumulative);
+  }
+
+  while(bucket < LIGHTNING_HISTOGRAM_BUCKETS)
+  {
+    cumulative += buckets[bucket++];
+  }
+
+  emit(output, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+  emit(output, "%s_sum %.9f\n", name, (double)sum_ns / 1e9);
+  emit(output, "%s_count %lu\n", name, (unsigned long)cumulative);
+}
@@ -0,0 +1,627 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "internal/parser.h"
+#include "internal/scan.h"
+
+static bool parse_request_line(struct lightning_http_request *request,
+                               const char *buffer,
+                               size_t start,
+                               size_t end);
+static bool parse_header_line(struct lightning_http_request *request,
+                              const char *buffer,
+                              size_t start,
+                              size_t colon,
+                              size_t end);
+static enum http_methods parse_method(const char *method, size_t length);
+static bool slice_equals(const char *buffer, struct lightning_http_slice slice, const char *literal, size_t length);
+static bool slice_contains_token(const char *buffer, struct lightning_http_slice slice, const char *token, size_t length);
+
+void lightning_http_parser_init(struct lightning_http_parser *parser, size_t start)
+{
+  parser->state = PARSER_STATE_REQUEST_LINE;
+  parser->start = start;
+  parser->line_start = start;
+  parser->position = start;
+  parser->colon = 0;
+  parser->end = start;
+}
+
+enum lightning_parse_result lightning_http_parse(struct lightning_http_parser *parser,
+                                                 struct lightning_http_request *request,
+                                                 const char *buffer,
+                                                 size_t length)
+{
+  while(parser->state == PARSER_STATE_REQUEST_LINE || parser->state == PARSER_STATE_HEADERS)
+  {
+    if(parser->position >= length)
+    {
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+
+    // Header lines are split in the same pass that looks for their end:
+    // the first hit is either the name/value colon or the newline.
+    if(parser->state == PARSER_STATE_HEADERS && parser->colon == 0)
+    {
+      size_t hit = parser->position + lightning_scan_any2(buffer + parser->position, length - parser->position, ':', '\n');
+
+      if(hit == length)
+      {
+        parser->position = length;
+        return LIGHTNING_PARSE_INCOMPLETE;
+      }
+
+      if(buffer[hit] == ':')
+      {
+        parser->colon = hit;
+        parser->position = hit + 1;
+        continue;
+      }
+
+      parser->position = hit;
+    }
+
+    size_t line_end = parser->position + lightning_scan_any2(buffer + parser->position, length - parser->position, '\n', '\n');
+    if(line_end == length)
+    {
+      parser->position = length;
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+
+    size_t next_line = line_end + 1;
+
+    if(line_end > parser->line_start && buffer[line_end - 1] == '\r')
+    {
+      line_end--;
+    }
+
+    if(parser->state == PARSER_STATE_REQUEST_LINE)
+    {
+      // RFC 9112 2.2: ignore at least one empty line before the request-line.
+      if(line_end == parser->line_start)
+      {
+        parser->start = next_line;
+        parser->line_start = next_line;
+        parser->position = next_line;
+        continue;
+      }
+
+      memset(request, 0, sizeof(struct lightning_http_request));
+      if(!parse_request_line(request, buffer, parser->line_start, line_end))
+      {
+        return LIGHTNING_PARSE_ERROR;
+      }
+      parser->state = PARSER_STATE_HEADERS;
+    }
+    else if(parser->colon == 0)
+    {
+      if(line_end != parser->line_start)
+      {
+        return LIGHTNING_PARSE_ERROR;
+      }
+
+      if(request->chunked && request->content_length_seen)
+      {
+        // Both framings at once is the classic request smuggling vector.
+        return LIGHTNING_PARSE_ERROR;
+      }
+
+      parser->state = request->content_length > 0 || request->chunked ? PARSER_STATE_BODY : PARSER_STATE_DONE;
+      request->body.offset = next_line;
+    }
+    else
+    {
+      if(!parse_header_line(request, buffer, parser->line_start, parser->colon, line_end))
+      {
+        return LIGHTNING_PARSE_ERROR;
+      }
+      parser->colon = 0;
+    }
+
+    parser->line_start = next_line;
+    parser->position = next_line;
+  }
+
+  if(parser->state == PARSER_STATE_BODY)
+  {
+    // Chunked bodies always go through lightning_http_body_read.
+    if(request->chunked || length - request->body.offset < request->content_length)
+    {
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+
+    request->body.length = request->content_length;
+    parser->state = PARSER_STATE_DONE;
+  }
+
+  parser->end = request->body.offset + request->body.length;
+  return LIGHTNING_PARSE_COMPLETE;
+}
+
+bool lightning_http_parser_body_streams(const struct lightning_http_parser *parser,
+                                        const struct lightning_http_request *request,
+                                        size_t capacity)
+{
+  if(parser->state != PARSER_STATE_BODY)
+  {
+    return false;
+  }
+
+  return request->chunked || request->body.offset - parser->start + request->content_length > capacity;
+}
+
+void lightning_http_body_reader_init(struct lightning_http_body_reader *reader, const struct lightning_http_request *request)
+{
+  reader->state = request->chunked ? BODY_STATE_CHUNK_SIZE : BODY_STATE_LENGTH;
+  reader->remaining = request->chunked ? 0 : request->content_length;
+  reader->total = 0;
+}
+
+enum lightning_parse_result lightning_http_body_read(struct lightning_http_body_reader *reader,
+                                                     const char *data,
+                                                     size_t length,
+                                                     size_t *consumed,
+                                                     const char **payload,
+                                                     size_t *payload_length)
+{
+  *consumed = 0;
+  *payload = NULL;
+  *payload_length = 0;
+
+  switch(reader->state)
+  {
+    case BODY_STATE_LENGTH:
+    case BODY_STATE_CHUNK_DATA:
+    {
+      size_t take = length < reader->remaining ? length : (size_t)reader->remaining;
+
+      *payload = data;
+      *payload_length = take;
+      *consumed = take;
+      reader->remaining -= take;
+      reader->total += take;
+
+      if(reader->remaining > 0)
+      {
+        return LIGHTNING_PARSE_INCOMPLETE;
+      }
+
+      if(reader->state == BODY_STATE_LENGTH)
+      {
+        reader->state = BODY_STATE_DONE;
+        return LIGHTNING_PARSE_COMPLETE;
+      }
+
+      reader->state = BODY_STATE_CHUNK_END;
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+
+    case BODY_STATE_CHUNK_END:
+    {
+      if(length == 0)
+      {
+        return LIGHTNING_PARSE_INCOMPLETE;
+      }
+
+      if(data[0] == '\r')
+      {
+        if(length < 2)
+        {
+          return LIGHTNING_PARSE_INCOMPLETE;
+        }
+        if(data[1] != '\n')
+        {
+          return LIGHTNING_PARSE_ERROR;
+        }
+        *consumed = 2;
+      }
+      else if(data[0] == '\n')
+      {
+        *consumed = 1;
+      }
+      else
+      {
+        return LIGHTNING_PARSE_ERROR;
+      }
+
+      reader->state = BODY_STATE_CHUNK_SIZE;
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+
+    case BODY_STATE_CHUNK_SIZE:
+    case BODY_STATE_TRAILER:
+    {
+      const char *newline = memchr(data, '\n', length);
+      if(newline == NULL)
+      {
+        return length >= LIGHTNING_CHUNK_LINE_MAX ? LIGHTNING_PARSE_ERROR : LIGHTNING_PARSE_INCOMPLETE;
+      }
+
+      size_t line_length = newline - data;
+      // Same limit whether the line came in one read or in pieces.
+      if(line_length >= LIGHTNING_CHUNK_LINE_MAX)
+      {
+        return LIGHTNING_PARSE_ERROR;
+      }
+      *consumed = line_length + 1;
+
+      if(line_length > 0 && data[line_length - 1] == '\r')
+      {
+        line_length--;
+      }
+
+      if(reader->state == BODY_STATE_TRAILER)
+      {
+        // Trailer fields are read and ignored up to the empty line.
+        if(line_length == 0)
+        {
+          reader->state = BODY_STATE_DONE;
+          return LIGHTNING_PARSE_COMPLETE;
+        }
+        return LIGHTNING_PARSE_INCOMPLETE;
+      }
+
+      uint64_t size = 0;
+      size_t i = 0;
+      for(; i < line_length; i++)
+      {
+        char c = data[i];
+        int digit;
+
+        if(c >= '0' && c <= '9')
+        {
+          digit = c - '0';
+        }
+        else if(c >= 'a' && c <= 'f')
+        {
+          digit = c - 'a' + 10;
+        }
+        else if(c >= 'A' && c <= 'F')
+        {
+          digit = c - 'A' + 10;
+        }
+        else
+        {
+          break;
+        }
+
+        if(size > (UINT64_MAX >> 4))
+        {
+          return LIGHTNING_PARSE_ERROR;
+        }
+        size = (size << 4) | (uint64_t)digit;
+      }
+
+      // Chunk extensions after ';' are allowed and ignored.
+      if(i == 0 || (i < line_length && data[i] != ';' && data[i] != ' ' && data[i] != '\t'))
+      {
+        return LIGHTNING_PARSE_ERROR;
+      }
+
+      reader->remaining = size;
+      reader->state = size == 0 ? BODY_STATE_TRAILER : BODY_STATE_CHUNK_DATA;
+      return LIGHTNING_PARSE_INCOMPLETE;
+    }
+
+    case BODY_STATE_DONE:
+    default:
+      return LIGHTNING_PARSE_COMPLETE;
+  }
+}
+
+static bool parse_request_line(struct lightning_http_request *request,
+                               const char *buffer,
+                               size_t start,
+                               size_t end)
+{
+  const char *line = buffer + start;
+  size_t length = end - start;
+
+  const char *method_end = memchr(line, ' ', length);
+  if(method_end == NULL || method_end == line)
+  {
+    return false;
+  }
+
+  size_t method_length = method_end - line;
+  request->method = parse_method(line, method_length);
+
+  size_t uri_start = method_length + 1;
+  const char *uri_end = memchr(line + uri_start, ' ', length - uri_start);
+  if(uri_end == NULL || uri_end == line + uri_start)
+  {
+    return false;
+  }
+
+  size_t uri_length = uri_end - (line + uri_start);
+  size_t version_start = uri_start + uri_length + 1;
+  size_t version_length = length - version_start;
+
+  if(version_length != 8 || memcmp(line + version_start, "HTTP/1.", 7) != 0)
+  {
+    return false;
+  }
+
+  char minor = line[version_start + 7];
+  if(minor != '0' && minor != '1')
+  {
+    return false;
+  }
+
+  request->uri.offset = start + uri_start;
+  request->uri.length = uri_length;
+  request->version.offset = start + version_start;
+  request->version.length = version_length;
+  request->version_minor = minor - '0';
+  request->keep_alive = request->version_minor == 1;
+
+  const char *question = memchr(line + uri_start, '?', uri_length);
+  request->path.offset = request->uri.offset;
+
+  if(question == NULL)
+  {
+    request->path.length = uri_length;
+  }
+  else
+  {
+    request->path.length = question - (line + uri_start);
+    request->query_string.offset = request->path.offset + request->path.length + 1;
+    request->query_string.length = uri_length - request->path.length - 1;
+  }
+
+  for(size_t i = 0; i < uri_length; i++)
+  {
+    unsigned char c = line[uri_start + i];
+    if(c <= ' ' || c == 0x7f)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool parse_header_line(struct lightning_http_request *request,
+                              const char *buffer,
+                              size_t start,
+                              size_t colon,
+                              size_t end)
+{
+  // Obsolete line folding (RFC 9112 5.2) is rejected rather than unfolded.
+  if(buffer[start] == ' ' || buffer[start] == '\t')
+  {
+    return false;
+  }
+
+  if(request->headers_count >= LIGHTNING_MAX_HEADERS)
+  {
+    return false;
+  }
+
+  if(colon == start)
+  {
+    return false;
+  }
+
+  size_t name_end = colon;
+  for(size_t i = start; i < name_end; i++)
+  {
+    unsigned char c = buffer[i];
+    if(c <= ' ' || c == 0x7f)
+    {
+      return false;
+    }
+  }
+
+  size_t value_start = name_end + 1;
+  while(value_start < end && (buffer[value_start] == ' ' || buffer[value_start] == '\t'))
+  {
+    value_start++;
+  }
+
+  size_t value_end = end;
+  while(value_end > value_start && (buffer[value_end - 1] == ' ' || buffer[value_end - 1] == '\t'))
+  {
+    value_end--;
+  }
+
+  struct lightning_http_header *header = &request->headers[request->headers_count++];
+  header->name.offset = start;
+  header->name.length = name_end - start;
+  header->value.offset = value_start;
+  header->value.length = value_end - value_start;
+
+  switch(header->name.length)
+  {
+    case 4:
+      if(slice_equals(buffer, header->name, "host", 4))
+      {
+        request->host = header->value;
+      }
+      break;
+
+    case 10:
+      if(slice_equals(buffer, header->name, "user-agent", 10))
+      {
+        request->user_agent = header->value;
+      }
+      else if(slice_equals(buffer, header->name, "connection", 10))
+      {
+        if(slice_contains_token(buffer, header->value, "close", 5))
+        {
+          request->keep_alive = false;
+        }
+        else if(slice_contains_token(buffer, header->value, "keep-alive", 10))
+        {
+          request->keep_alive = true;
+        }
+      }
+      break;
+
+    case 12:
+      if(slice_equals(buffer, header->name, "content-type", 12))
+      {
+        request->content_type = header->value;
+      }
+      break;
+
+    case 14:
+      if(slice_equals(buffer, header->name, "content-length", 14))
+      {
+        if(header->value.length == 0)
+        {
+          return false;
+        }
+
+        size_t content_length = 0;
+        for(size_t i = 0; i < header->value.length; i++)
+        {
+          unsigned char c = buffer[header->value.offset + i];
+          if(c < '0' || c > '9' || content_length > (SIZE_MAX - 9) / 10)
+          {
+            return false;
+          }
+          content_length = content_length * 10 + (c - '0');
+        }
+
+        if(request->content_length_seen && request->content_length != content_length)
+        {
+          return false;
+        }
+
+        request->content_length = content_length;
+        request->content_length_seen = true;
+      }
+      break;
+
+    case 17:
+      // Only "chunked" alone is understood; anything else would leave the
+      // end of the body unknown.
+      if(slice_equals(buffer, header->name, "transfer-encoding", 17))
+      {
+        if(request->chunked || !slice_equals(buffer, header->value, "chunked", 7))
+        {
+          return false;
+        }
+        request->chunked = true;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return true;
+}
+
+static enum http_methods parse_method(const char *method, size_t length)
+{
+  switch(length)
+  {
+    case 3:
+      if(memcmp(method, "GET", 3) == 0)
+      {
+        return HTTP_GET;
+      }
+      if(memcmp(method, "PUT", 3) == 0)
+      {
+        return HTTP_PUT;
+      }
+      break;
+
+    case 4:
+      if(memcmp(method, "POST", 4) == 0)
+      {
+        return HTTP_POST;
+      }
+      if(memcmp(method, "HEAD", 4) == 0)
+      {
+        return HTTP_HEAD;
+      }
+      break;
+
+    case 5:
+      if(memcmp(method, "PATCH", 5) == 0)
+      {
+        return HTTP_PATCH;
+      }
+      break;
+
+    case 6:
+      if(memcmp(method, "DELETE", 6) == 0)
+      {
+        return HTTP_DELETE;
+      }
+      break;
+
+    case 7:
+      if(memcmp(method, "OPTIONS", 7) == 0)
+      {
+        return HTTP_OPTIONS;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  return HTTP_UNKNOWN;
+}
+
+static bool slice_equals(const char *buffer, struct lightning_http_slice slice, const char *literal, size_t length)
+{
+  return slice.length == length && strncasecmp(buffer + slice.offset, literal, length) == 0;
+}
+
+static bool slice_contains_token(const char *buffer, struct lightning_http_slice slice, const char *token, size_t length)
+{
+  const char *value = buffer + slice.offset;
+  size_t i = 0;
+
+  while(i < slice.length)
+  {
+    while(i < slice.length && (value[i] == ' ' || value[i] == '\t' || value[i] == ','))
+    {
+      i++;
+    }
+
+    size_t token_start = i;
+    while(i < slice.length && value[i] != ',')
+    {
+      i++;
+    }
+
+    size_t token_end = i;
+    while(token_end > token_start && (value[token_end - 1] == ' ' || value[token_end - 1] == '\t'))
+    {
+      token_end--;
+    }
+
+    if(token_end - token_start == length && strncasecmp(value + token_start, token, length) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
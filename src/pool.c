@@ -0,0 +1,120 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#include "internal/pool.h"
+
+struct lightning_pool_slab
+{
+  struct lightning_pool_slab *next;
+  alignas(max_align_t) unsigned char objects[];
+};
+
+struct pool_free_object
+{
+  struct pool_free_object *next;
+};
+
+static int pool_grow(struct lightning_pool *pool);
+
+void lightning_pool_init(struct lightning_pool *pool, size_t object_size, size_t objects_per_slab)
+{
+  size_t alignment = alignof(max_align_t);
+
+  if(object_size < sizeof(struct pool_free_object))
+  {
+    object_size = sizeof(struct pool_free_object);
+  }
+
+  pool->slabs = NULL;
+  pool->free_list = NULL;
+  pool->object_size = (object_size + alignment - 1) & ~(alignment - 1);
+  pool->objects_per_slab = objects_per_slab > 0 ? objects_per_slab : 1;
+  pool->capacity = 0;
+  pool->in_use = 0;
+}
+
+void *lightning_pool_acquire(struct lightning_pool *pool)
+{
+  if(pool->free_list == NULL && pool_grow(pool) == -1)
+  {
+    return NULL;
+  }
+
+  struct pool_free_object *object = pool->free_list;
+  pool->free_list = object->next;
+  pool->in_use++;
+
+  return object;
+}
+
+void lightning_pool_release(struct lightning_pool *pool, void *object)
+{
+  if(object == NULL)
+  {
+    return;
+  }
+
+  struct pool_free_object *free_object = object;
+  free_object->next = pool->free_list;
+  pool->free_list = free_object;
+  pool->in_use--;
+}
+
+void lightning_pool_destroy(struct lightning_pool *pool)
+{
+  struct lightning_pool_slab *slab = pool->slabs;
+
+  while(slab != NULL)
+  {
+    struct lightning_pool_slab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+
+  pool->slabs = NULL;
+  pool->free_list = NULL;
+  pool->capacity = 0;
+  pool->in_use = 0;
+}
+
+static int pool_grow(struct lightning_pool *pool)
+{
+  struct lightning_pool_slab *slab = malloc(sizeof(struct lightning_pool_slab) + pool->object_size * pool->objects_per_slab);
+  if(slab == NULL)
+  {
+    return -1;
+  }
+
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+
+  // Thread the new objects in address order so the first connections of a
+  // worker end up next to each other.
+  for(size_t i = pool->objects_per_slab; i > 0; i--)
+  {
+    struct pool_free_object *object = (struct pool_free_object *)(slab->objects + (i - 1) * pool->object_size);
+    object->next = pool->free_list;
+    pool->free_list = object;
+  }
+
+  pool->capacity += pool->objects_per_slab;
+  return 0;
+}
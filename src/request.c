@@ -0,0 +1,154 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "internal/arena.h"
+#include "internal/request.h"
+
+static const char *slice_or_null(const struct lightning_http_request *request,
+                                 struct lightning_http_slice slice,
+                                 size_t *length);
+
+static const char *const method_names[] = {
+  [HTTP_GET] = "GET",
+  [HTTP_POST] = "POST",
+  [HTTP_PUT] = "PUT",
+  [HTTP_DELETE] = "DELETE",
+  [HTTP_HEAD] = "HEAD",
+  [HTTP_OPTIONS] = "OPTIONS",
+  [HTTP_PATCH] = "PATCH",
+  [HTTP_UNKNOWN] = "UNKNOWN",
+};
+
+const char *lightning_method_name(enum http_methods method)
+{
+  return (unsigned)method < HTTP_UNKNOWN ? method_names[method] : method_names[HTTP_UNKNOWN];
+}
+
+enum http_methods lightning_request_method(const struct lightning_http_request *request)
+{
+  return request->method;
+}
+
+const char *lightning_request_path(const struct lightning_http_request *request, size_t *length)
+{
+  return slice_or_null(request, request->path, length);
+}
+
+const char *lightning_request_query(const struct lightning_http_request *request, size_t *length)
+{
+  return slice_or_null(request, request->query_string, length);
+}
+
+const char *lightning_request_header(const struct lightning_http_request *request, const char *name, size_t *length)
+{
+  size_t name_length = strlen(name);
+
+  for(size_t i = 0; i < request->headers_count; i++)
+  {
+    const struct lightning_http_header *header = &request->headers[i];
+    if(header->name.length == name_length &&
+       strncasecmp(request->buffer + header->name.offset, name, name_length) == 0)
+    {
+      return slice_or_null(request, header->value, length);
+    }
+  }
+
+  if(length != NULL)
+  {
+    *length = 0;
+  }
+  return NULL;
+}
+
+const char *lightning_request_param(const struct lightning_http_request *request, const char *name, size_t *length)
+{
+  size_t name_length = strlen(name);
+
+  for(size_t i = 0; i < request->params_count; i++)
+  {
+    const struct lightning_http_param *param = &request->params[i];
+    if(param->name_length == name_length && memcmp(param->name, name, name_length) == 0)
+    {
+      if(length != NULL)
+      {
+        *length = param->value.length;
+      }
+      return request->buffer + param->value.offset;
+    }
+  }
+
+  if(length != NULL)
+  {
+    *length = 0;
+  }
+  return NULL;
+}
+
+const void *lightning_request_body(const struct lightning_http_request *request, size_t *length)
+{
+  if(request->body_data != NULL)
+  {
+    if(length != NULL)
+    {
+      *length = request->body_data_length;
+    }
+    return request->body_data;
+  }
+
+  return slice_or_null(request, request->body, length);
+}
+
+void lightning_request_set_context(struct lightning_http_request *request, void *context)
+{
+  request->context = context;
+}
+
+void *lightning_request_context(const struct lightning_http_request *request)
+{
+  return request->context;
+}
+
+void *lightning_request_alloc(struct lightning_http_request *request, size_t size)
+{
+  if(request->arena == NULL)
+  {
+    return NULL;
+  }
+
+  return lightning_arena_alloc(request->arena, size);
+}
+
+static const char *slice_or_null(const struct lightning_http_request *request,
+                                 struct lightning_http_slice slice,
+                                 size_t *length)
+{
+  if(length != NULL)
+  {
+    *length = slice.length;
+  }
+
+  if(slice.offset == 0 && slice.length == 0)
+  {
+    return NULL;
+  }
+
+  return request->buffer + slice.offset;
+}
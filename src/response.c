@@ -0,0 +1,450 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "internal/arena.h"
+#include "internal/response.h"
+
+#define LIGHTNING_STATUS_CODES(X)                                                                \
+  X(200, "OK") X(201, "Created") X(202, "Accepted") X(204, "No Content")                         \
+  X(206, "Partial Content") X(301, "Moved Permanently") X(302, "Found") X(303, "See Other")      \
+  X(304, "Not Modified") X(307, "Temporary Redirect") X(308, "Permanent Redirect")               \
+  X(400, "Bad Request") X(401, "Unauthorized") X(403, "Forbidden") X(404, "Not Found")           \
+  X(405, "Method Not Allowed") X(408, "Request Timeout") X(409, "Conflict")                      \
+  X(411, "Length Required") X(413, "Content Too Large") X(414, "URI Too Long")                   \
+  X(416, "Range Not Satisfiable") X(429, "Too Many Requests")                                    \
+  X(431, "Request Header Fields Too Large") X(500, "Internal Server Error")                      \
+  X(501, "Not Implemented") X(502, "Bad Gateway") X(503, "Service Unavailable")                  \
+  X(504, "Gateway Timeout")
+
+#define STATUS_REASON_CASE(code, reason) \
+  case code:                             \
+    return reason;
+
+#define STATUS_LINE_CASE(code, reason)                                  \
+  case code:                                                            \
+    *length = sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1;          \
+    return "HTTP/1.1 " #code " " reason "\r\n";
+
+static const char content_type_prefix[] = "Content-Type: ";
+static const char content_length_prefix[] = "Content-Length: ";
+static const char transfer_encoding_chunked[] = "Transfer-Encoding: chunked\r\n";
+static const char connection_keep_alive[] = "Connection: keep-alive\r\n";
+static const char connection_close[] = "Connection: close\r\n";
+
+static bool valid_header(const char *name, size_t name_length, const char *value, size_t value_length);
+static bool reserved_header(const char *name, size_t name_length);
+static int add_header(struct lightning_http_response *response, const char *name, size_t name_length, const char *value, size_t value_length);
+static size_t format_decimal(char *output, size_t value);
+
+void lightning_response_init(struct lightning_http_response *response)
+{
+  response->status_code = 200;
+  response->prefix = NULL;
+  response->content_type = NULL;
+  response->body = NULL;
+  response->body_length = 0;
+  response->file = NULL;
+  response->file_offset = 0;
+  response->segments = NULL;
+  response->segments_count = 0;
+  response->producer = NULL;
+  response->producer_data = NULL;
+  response->arena = NULL;
+  response->connection_close = false;
+  response->close_delimited = false;
+  response->headers_count = 0;
+  response->storage_used = 0;
+}
+
+void lightning_response_status(struct lightning_http_response *response, int status_code)
+{
+  response->status_code = status_code;
+}
+
+void lightning_response_body(struct lightning_http_response *response, const char *content_type, const void *body, size_t length)
+{
+  response->content_type = content_type;
+  response->body = body;
+  response->body_length = length;
+}
+
+void lightning_response_chunked(struct lightning_http_response *response,
+                                const char *content_type,
+                                lightning_chunk_producer producer,
+                                void *user_data)
+{
+  response->content_type = content_type;
+  response->body = NULL;
+  response->body_length = 0;
+  response->producer = producer;
+  response->producer_data = user_data;
+}
+
+int lightning_response_header(struct lightning_http_response *response, const char *name, const char *value)
+{
+  size_t name_length = strlen(name);
+  size_t value_length = strlen(value);
+
+  if(!valid_header(name, name_length, value, value_length))
+  {
+    return -1;
+  }
+
+  char *stored;
+  bool inline_storage = name_length + value_length <= (size_t)(LIGHTNING_RESPONSE_HEADER_STORAGE - response->storage_used);
+
+  if(inline_storage)
+  {
+    stored = response->storage + response->storage_used;
+  }
+  else if(response->arena == NULL || (stored = lightning_arena_alloc(response->arena, name_length + value_length)) == NULL)
+  {
+    return -1;
+  }
+
+  memcpy(stored, name, name_length);
+  memcpy(stored + name_length, value, value_length);
+
+  if(add_header(response, stored, name_length, stored + name_length, value_length) == -1)
+  {
+    return -1;
+  }
+
+  if(inline_storage)
+  {
+    response->storage_used += name_length + value_length;
+  }
+  return 0;
+}
+
+int lightning_response_header_static(struct lightning_http_response *response, const char *name, const char *value)
+{
+  return add_header(response, name, strlen(name), value, strlen(value));
+}
+
+void lightning_response_use_prefix(struct lightning_http_response *response, const struct lightning_response_prefix *prefix)
+{
+  response->prefix = prefix;
+  response->status_code = prefix->status_code;
+}
+
+struct lightning_response_prefix *lightning_response_prefix_create(int status_code,
+                                                                   const char *content_type,
+                                                                   const char *const headers[])
+{
+  char status_buffer[64];
+  size_t status_length;
+  const char *status_line = lightning_status_line(status_code, &status_length);
+
+  if(status_line == NULL)
+  {
+    int written = snprintf(status_buffer, sizeof(status_buffer), "HTTP/1.1 %d %s\r\n",
+                           status_code, lightning_status_reason(status_code));
+    if(written < 0 || (size_t)written >= sizeof(status_buffer))
+    {
+      return NULL;
+    }
+    status_line = status_buffer;
+    status_length = written;
+  }
+
+  size_t length = status_length;
+  if(content_type != NULL)
+  {
+    if(!valid_header("Content-Type", 12, content_type, strlen(content_type)))
+    {
+      return NULL;
+    }
+    length += sizeof(content_type_prefix) - 1 + strlen(content_type) + 2;
+  }
+
+  for(size_t i = 0; headers != NULL && headers[i] != NULL; i += 2)
+  {
+    if(headers[i + 1] == NULL || !valid_header(headers[i], strlen(headers[i]), headers[i + 1], strlen(headers[i + 1])) ||
+       reserved_header(headers[i], strlen(headers[i])))
+    {
+      return NULL;
+    }
+    length += strlen(headers[i]) + 2 + strlen(headers[i + 1]) + 2;
+  }
+
+  // +1 for the terminator sprintf writes after the last header.
+  struct lightning_response_prefix *prefix = malloc(sizeof(struct lightning_response_prefix) + length + 1);
+  if(prefix == NULL)
+  {
+    return NULL;
+  }
+
+  prefix->next = NULL;
+  prefix->status_code = status_code;
+  prefix->length = length;
+
+  char *p = prefix->data;
+  memcpy(p, status_line, status_length);
+  p += status_length;
+
+  if(content_type != NULL)
+  {
+    p += sprintf(p, "%s%s\r\n", content_type_prefix, content_type);
+  }
+
+  for(size_t i = 0; headers != NULL && headers[i] != NULL; i += 2)
+  {
+    p += sprintf(p, "%s: %s\r\n", headers[i], headers[i + 1]);
+  }
+
+  return prefix;
+}
+
+// Anything that could end the header line early would let the value inject
+// headers of its own.
+static bool valid_header(const char *name, size_t name_length, const char *value, size_t value_length)
+{
+  if(name_length == 0)
+  {
+    return false;
+  }
+
+  for(size_t i = 0; i < name_length; i++)
+  {
+    if(name[i] <= ' ' || name[i] == ':' || name[i] == 0x7f)
+    {
+      return false;
+    }
+  }
+
+  for(size_t i = 0; i < value_length; i++)
+  {
+    if(value[i] == '\r' || value[i] == '\n')
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// The message framing is Lightning's: a second Content-Length or a
+// Transfer-Encoding from the handler would contradict the one it writes.
+static bool reserved_header(const char *name, size_t name_length)
+{
+  static const char *const reserved[] = {"Content-Length", "Transfer-Encoding", "Connection"};
+
+  for(size_t i = 0; i < sizeof(reserved) / sizeof(reserved[0]); i++)
+  {
+    if(name_length == strlen(reserved[i]) && strncasecmp(name, reserved[i], name_length) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int add_header(struct lightning_http_response *response, const char *name, size_t name_length, const char *value, size_t value_length)
+{
+  if(response->headers_count == LIGHTNING_RESPONSE_MAX_HEADERS || name_length > UINT16_MAX || value_length > UINT16_MAX ||
+     reserved_header(name, name_length))
+  {
+    return -1;
+  }
+
+  struct lightning_http_response_header *header = &response->headers[response->headers_count++];
+  header->name = name;
+  header->name_length = name_length;
+  header->value = value;
+  header->value_length = value_length;
+  return 0;
+}
+
+bool lightning_status_has_body(int status_code)
+{
+  return status_code >= 200 && status_code != 204 && status_code != 304;
+}
+
+const char *lightning_status_reason(int status_code)
+{
+  switch(status_code)
+  {
+    LIGHTNING_STATUS_CODES(STATUS_REASON_CASE)
+    default: return "Unknown";
+  }
+}
+
+const char *lightning_status_line(int status_code, size_t *length)
+{
+  switch(status_code)
+  {
+    LIGHTNING_STATUS_CODES(STATUS_LINE_CASE)
+    default: return NULL;
+  }
+}
+
+size_t lightning_response_serialize_head(const struct lightning_http_response *response,
+                                         const struct lightning_http_date *date,
+                                         char *output,
+                                         size_t capacity)
+{
+  char status_buffer[64];
+  size_t status_length;
+  const char *status_line;
+  const char *content_type = response->content_type;
+
+  // A prefix already holds the status line and Content-Type.
+  if(response->prefix != NULL)
+  {
+    status_line = response->prefix->data;
+    status_length = response->prefix->length;
+    content_type = NULL;
+  }
+  else
+  {
+    status_line = lightning_status_line(response->status_code, &status_length);
+  }
+
+  if(status_line == NULL)
+  {
+    int written = snprintf(status_buffer, sizeof(status_buffer), "HTTP/1.1 %d %s\r\n",
+                           response->status_code, lightning_status_reason(response->status_code));
+    if(written < 0 || (size_t)written >= sizeof(status_buffer))
+    {
+      return SIZE_MAX;
+    }
+    status_line = status_buffer;
+    status_length = written;
+  }
+
+  char length_digits[24];
+  size_t length_digits_count = format_decimal(length_digits, response->body_length);
+  size_t content_type_length = content_type != NULL ? strlen(content_type) : 0;
+  size_t date_length = date != NULL ? LIGHTNING_DATE_HEADER_LENGTH : 0;
+
+  size_t total = status_length + date_length;
+  if(content_type != NULL)
+  {
+    total += sizeof(content_type_prefix) - 1 + content_type_length + 2;
+  }
+  for(unsigned short i = 0; i < response->headers_count; i++)
+  {
+    total += response->headers[i].name_length + 2 + response->headers[i].value_length + 2;
+  }
+  // 1xx, 204 and 304 have no body and no framing: the Content-Length of
+  // a 304 would have to be the one of the 200 it stands for.
+  bool has_body = lightning_status_has_body(response->status_code);
+  if(has_body && response->producer != NULL)
+  {
+    if(!response->close_delimited)
+    {
+      total += sizeof(transfer_encoding_chunked) - 1;
+    }
+  }
+  else if(has_body)
+  {
+    total += sizeof(content_length_prefix) - 1 + length_digits_count + 2;
+  }
+  const char *connection = response->connection_close ? connection_close : connection_keep_alive;
+  size_t connection_length = response->connection_close ? sizeof(connection_close) - 1 : sizeof(connection_keep_alive) - 1;
+  total += connection_length + 2;
+
+  if(total > capacity)
+  {
+    return total;
+  }
+
+  char *p = output;
+  memcpy(p, status_line, status_length);
+  p += status_length;
+
+  if(date != NULL)
+  {
+    memcpy(p, date->header, LIGHTNING_DATE_HEADER_LENGTH);
+    p += LIGHTNING_DATE_HEADER_LENGTH;
+  }
+
+  if(content_type != NULL)
+  {
+    memcpy(p, content_type_prefix, sizeof(content_type_prefix) - 1);
+    p += sizeof(content_type_prefix) - 1;
+    memcpy(p, content_type, content_type_length);
+    p += content_type_length;
+    *p++ = '\r';
+    *p++ = '\n';
+  }
+
+  for(unsigned short i = 0; i < response->headers_count; i++)
+  {
+    const struct lightning_http_response_header *header = &response->headers[i];
+    memcpy(p, header->name, header->name_length);
+    p += header->name_length;
+    *p++ = ':';
+    *p++ = ' ';
+    memcpy(p, header->value, header->value_length);
+    p += header->value_length;
+    *p++ = '\r';
+    *p++ = '\n';
+  }
+
+  if(has_body && response->producer != NULL)
+  {
+    if(!response->close_delimited)
+    {
+      memcpy(p, transfer_encoding_chunked, sizeof(transfer_encoding_chunked) - 1);
+      p += sizeof(transfer_encoding_chunked) - 1;
+    }
+  }
+  else if(has_body)
+  {
+    memcpy(p, content_length_prefix, sizeof(content_length_prefix) - 1);
+    p += sizeof(content_length_prefix) - 1;
+    memcpy(p, length_digits, length_digits_count);
+    p += length_digits_count;
+    *p++ = '\r';
+    *p++ = '\n';
+  }
+
+  memcpy(p, connection, connection_length);
+  p += connection_length;
+  *p++ = '\r';
+  *p++ = '\n';
+
+  return total;
+}
+
+static size_t format_decimal(char *output, size_t value)
+{
+  char reversed[24];
+  size_t count = 0;
+
+  do
+  {
+    reversed[count++] = '0' + value % 10;
+    value /= 10;
+  } while(value != 0);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    output[i] = reversed[count - 1 - i];
+  }
+
+  return count;
+}
@@ -0,0 +1,743 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "internal/response_cache.h"
+
+// Where the serialized head of every entry ends; the close variant is
+// written instead when the connection closes after the response.
+static const char keep_alive_tail[] = "Connection: keep-alive\r\n\r\n";
+static const char close_tail[] = "Connection: close\r\n\r\n";
+static const char not_modified_line[] = "HTTP/1.1 304 Not Modified\r\n";
+static const char partial_content_line[] = "HTTP/1.1 206 Partial Content\r\n";
+
+static bool status_cacheable(int status_code);
+static int add_validators(struct lightning_http_response *response, char *etag, size_t *etag_length);
+static size_t write_variant(const struct lightning_cached_response *entry,
+                            const struct lightning_http_date *date,
+                            const char *status_line,
+                            size_t status_line_length,
+                            const char *headers,
+                            size_t headers_length,
+                            bool close,
+                            const char *body,
+                            size_t body_length,
+                            char *output,
+                            size_t capacity);
+static bool entry_matches(const struct lightning_cached_response *entry,
+                          const struct lightning_cache_rule *rule,
+                          const char *key,
+                          size_t key_length,
+                          uint32_t hash);
+static void cache_remove(struct lightning_response_cache *cache, struct lightning_cached_response *entry);
+static void lru_unlink(struct lightning_response_cache *cache, struct lightning_cached_response *entry);
+static void lru_push_front(struct lightning_response_cache *cache, struct lightning_cached_response *entry);
+static void shared_retire(struct lightning_shared_response_cache *shared, int reader, struct lightning_cached_response *entry);
+static void shared_sweep(struct lightning_shared_response_cache *shared, int reader, uint64_t now_ms);
+static void shared_reclaim(struct lightning_shared_response_cache *shared, int reader);
+static bool grace_period_over(const struct lightning_shared_response_cache *shared, int reader);
+static void free_entries(struct lightning_cached_response *entry);
+
+void lightning_response_cache_init(struct lightning_response_cache *cache, size_t capacity)
+{
+  memset(cache->buckets, 0, sizeof(cache->buckets));
+  cache->lru_head = NULL;
+  cache->lru_tail = NULL;
+  cache->bytes = 0;
+  cache->capacity = capacity;
+}
+
+void lightning_response_cache_destroy(struct lightning_response_cache *cache)
+{
+  struct lightning_cached_response *entry = cache->lru_head;
+  while(entry != NULL)
+  {
+    struct lightning_cached_response *next = entry->lru_next;
+    free(entry);
+    entry = next;
+  }
+
+  lightning_response_cache_init(cache, cache->capacity);
+}
+
+bool lightning_response_cache_key(const struct lightning_cache_rule *rule,
+                                  const struct lightning_http_request *request,
+                                  char *key,
+                                  size_t *length,
+                                  uint32_t *hash)
+{
+  size_t used = request->uri.length;
+
+  if(used > LIGHTNING_RESPONSE_CACHE_KEY_MAX)
+  {
+    return false;
+  }
+  memcpy(key, lightning_http_slice_data(request->buffer, request->uri), used);
+
+  // Header values never hold a line feed: it separates them, and tells a
+  // missing header from an empty one.
+  for(int i = 0; i < rule->vary_count; i++)
+  {
+    size_t value_length = 0;
+    const char *value = lightning_request_header(request, rule->vary[i], &value_length);
+
+    if(used + 2 + value_length > LIGHTNING_RESPONSE_CACHE_KEY_MAX)
+    {
+      return false;
+    }
+
+    key[used++] = '\n';
+    if(value != NULL)
+    {
+      key[used++] = ':';
+      memcpy(key + used, value, value_length);
+      used += value_length;
+    }
+  }
+
+  // FNV-1a, seeded with the rule so two routes never share entries.
+  uint32_t value = 2166136261u ^ (uint32_t)((uintptr_t)rule >> 4);
+  for(size_t i = 0; i < used; i++)
+  {
+    value ^= (unsigned char)key[i];
+    value *= 16777619u;
+  }
+
+  *length = used;
+  *hash = value;
+  return true;
+}
+
+const struct lightning_cached_response *lightning_response_cache_lookup(struct lightning_response_cache *cache,
+                                                                        const struct lightning_cache_rule *rule,
+                                                                        const char *key,
+                                                                        size_t key_length,
+                                                                        uint32_t hash,
+                                                                        uint64_t now_ms)
+{
+  struct lightning_cached_response *entry = cache->buckets[hash % LIGHTNING_RESPONSE_CACHE_BUCKETS];
+
+  while(entry != NULL && !entry_matches(entry, rule, key, key_length, hash))
+  {
+    entry = entry->hash_next;
+  }
+
+  if(entry == NULL)
+  {
+    return NULL;
+  }
+
+  if(now_ms >= entry->expires_ms)
+  {
+    cache_remove(cache, entry);
+    return NULL;
+  }
+
+  if(cache->lru_head != entry)
+  {
+    lru_unlink(cache, entry);
+    lru_push_front(cache, entry);
+  }
+
+  return entry;
+}
+
+void lightning_response_cache_store(struct lightning_response_cache *cache, struct lightning_cached_response *entry)
+{
+  if(entry->size > cache->capacity)
+  {
+    free(entry);
+    return;
+  }
+
+  struct lightning_cached_response **bucket = &cache->buckets[entry->hash % LIGHTNING_RESPONSE_CACHE_BUCKETS];
+
+  // Only there when the handler ran on a hit that expired meanwhile.
+  for(struct lightning_cached_response *current = *bucket; current != NULL; current = current->hash_next)
+  {
+    if(entry_matches(current, entry->rule, entry->data, entry->key_length, entry->hash))
+    {
+      cache_remove(cache, current);
+      break;
+    }
+  }
+
+  while(cache->bytes + entry->size > cache->capacity)
+  {
+    cache_remove(cache, cache->lru_tail);
+  }
+
+  entry->hash_next = *bucket;
+  *bucket = entry;
+  lru_push_front(cache, entry);
+  cache->bytes += entry->size;
+}
+
+struct lightning_cached_response *lightning_cached_response_create(const struct lightning_cache_rule *rule,
+                                                                   const char *key,
+                                                                   size_t key_length,
+                                                                   uint32_t hash,
+                                                                   struct lightning_http_response *response,
+                                                                   const struct lightning_http_date *date,
+                                                                   uint64_t now_ms)
+{
+  if(!status_cacheable(response->status_code) || response->producer != NULL || response->file != NULL)
+  {
+    return NULL;
+  }
+
+  for(unsigned short i = 0; i < response->headers_count; i++)
+  {
+    const struct lightning_http_response_header *header = &response->headers[i];
+    if(header->name_length == sizeof("Set-Cookie") - 1 && strncasecmp(header->name, "Set-Cookie", header->name_length) == 0)
+    {
+      return NULL;
+    }
+  }
+
+  char etag[LIGHTNING_RESPONSE_CACHE_ETAG_MAX];
+  size_t etag_length = 0;
+  if(response->status_code == 200 && add_validators(response, etag, &etag_length) == -1)
+  {
+    return NULL;
+  }
+
+  // The body of a 204 is not sent, nor kept.
+  size_t body_length = lightning_status_has_body(response->status_code) ? response->body_length : 0;
+
+  // Stored as a keep-alive response whatever this connection does.
+  bool connection_close = response->connection_close;
+  response->connection_close = false;
+
+  struct lightning_cached_response *entry = NULL;
+  size_t head_length = lightning_response_serialize_head(response, date, NULL, 0);
+
+  if(head_length != SIZE_MAX && head_length + body_length <= LIGHTNING_RESPONSE_CACHE_ENTRY_MAX)
+  {
+    size_t size = sizeof(struct lightning_cached_response) + key_length + head_length + body_length;
+    entry = malloc(size);
+
+    if(entry != NULL)
+    {
+      char *head = entry->data + key_length;
+
+      memcpy(entry->data, key, key_length);
+      lightning_response_serialize_head(response, date, head, head_length);
+      if(body_length > 0)
+      {
+        memcpy(head + head_length, response->body, body_length);
+      }
+
+      entry->hash_next = NULL;
+      entry->lru_prev = NULL;
+      entry->lru_next = NULL;
+      entry->rule = rule;
+      entry->expires_ms = now_ms + rule->ttl_ms;
+      entry->hash = hash;
+      entry->status_code = response->status_code;
+      entry->status_length = (const char *)memchr(head, '\n', head_length) + 1 - head;
+      // Right after the status line, or after the prefix when there is
+      // one: looked up rather than worked out.
+      entry->date_offset = (const char *)memmem(head, head_length, date->header, LIGHTNING_DATE_HEADER_LENGTH) - head;
+      entry->head_length = head_length;
+      entry->body_length = body_length;
+      entry->key_length = key_length;
+      memcpy(entry->etag, etag, etag_length);
+      entry->etag_length = etag_length;
+
+      entry->length_offset = 0;
+      if(etag_length > 0)
+      {
+        char digits[24];
+        int digits_length = snprintf(digits, sizeof(digits), "%zu", body_length);
+        entry->length_offset = head_length - (sizeof(keep_alive_tail) - 1) - (sizeof("Content-Length: \r\n") - 1) - digits_length;
+      }
+      entry->size = size;
+    }
+  }
+
+  response->connection_close = connection_close;
+  return entry;
+}
+
+size_t lightning_cached_response_write(const struct lightning_cached_response *entry,
+                                       const struct lightning_http_date *date,
+                                       bool close,
+                                       bool head_only,
+                                       char *output,
+                                       size_t capacity)
+{
+  const char *head = entry->data + entry->key_length;
+  size_t length = close ? entry->head_length - (sizeof(keep_alive_tail) - 1) : entry->head_length;
+  size_t total = length + (close ? sizeof(close_tail) - 1 : 0) + (head_only ? 0 : entry->body_length);
+
+  if(total > capacity || output == NULL)
+  {
+    return total;
+  }
+
+  memcpy(output, head, length);
+  memcpy(output + entry->date_offset, date->header, LIGHTNING_DATE_HEADER_LENGTH);
+
+  if(close)
+  {
+    memcpy(output + length, close_tail, sizeof(close_tail) - 1);
+    length += sizeof(close_tail) - 1;
+  }
+
+  if(!head_only && entry->body_length > 0)
+  {
+    memcpy(output + length, head + entry->head_length, entry->body_length);
+  }
+
+  return total;
+}
+
+size_t lightning_cached_response_write_not_modified(const struct lightning_cached_response *entry,
+                                                    const struct lightning_http_date *date,
+                                                    bool close,
+                                                    char *output,
+                                                    size_t capacity)
+{
+  return write_variant(entry, date, not_modified_line, sizeof(not_modified_line) - 1, NULL, 0, close, NULL, 0, output, capacity);
+}
+
+size_t lightning_cached_response_write_range(const struct lightning_cached_response *entry,
+                                             const struct lightning_http_date *date,
+                                             bool close,
+                                             bool head_only,
+                                             const struct lightning_byte_range *range,
+                                             char *output,
+                                             size_t capacity)
+{
+  char headers[128];
+  int headers_length = snprintf(headers, sizeof(headers), "Content-Range: bytes %llu-%llu/%zu\r\nContent-Length: %llu\r\n",
+                                (unsigned long long)range->first, (unsigned long long)(range->first + range->length - 1),
+                                entry->body_length, (unsigned long long)range->length);
+  const char *body = entry->data + entry->key_length + entry->head_length + range->first;
+
+  return write_variant(entry, date, partial_content_line, sizeof(partial_content_line) - 1, headers, headers_length, close,
+                       body, head_only ? 0 : range->length, output, capacity);
+}
+
+struct lightning_shared_response_cache *lightning_shared_cache_create(int readers_count, size_t capacity)
+{
+  size_t size = sizeof(struct lightning_shared_response_cache) + readers_count * sizeof(struct lightning_shared_cache_reader);
+  size = (size + LIGHTNING_CACHE_LINE - 1) & ~(size_t)(LIGHTNING_CACHE_LINE - 1);
+
+  struct lightning_shared_response_cache *shared = aligned_alloc(LIGHTNING_CACHE_LINE, size);
+  if(shared == NULL)
+  {
+    return NULL;
+  }
+
+  memset(shared, 0, size);
+  shared->capacity = capacity;
+  shared->readers_count = readers_count;
+
+  for(int i = 0; i < readers_count; i++)
+  {
+    shared->readers[i].state = 1;
+    shared->readers[i].snapshot = calloc(readers_count, sizeof(uint64_t));
+
+    if(shared->readers[i].snapshot == NULL)
+    {
+      lightning_shared_cache_destroy(shared);
+      return NULL;
+    }
+  }
+
+  return shared;
+}
+
+void lightning_shared_cache_destroy(struct lightning_shared_response_cache *shared)
+{
+  if(shared == NULL)
+  {
+    return;
+  }
+
+  for(size_t i = 0; i < LIGHTNING_SHARED_CACHE_SLOTS; i++)
+  {
+    free(shared->slots[i]);
+  }
+
+  for(int i = 0; i < shared->readers_count; i++)
+  {
+    free_entries(shared->readers[i].retired);
+    free_entries(shared->readers[i].waiting);
+    free(shared->readers[i].snapshot);
+  }
+
+  free(shared);
+}
+
+const struct lightning_cached_response *lightning_shared_cache_lookup(const struct lightning_shared_response_cache *shared,
+                                                                      const struct lightning_cache_rule *rule,
+                                                                      const char *key,
+                                                                      size_t key_length,
+                                                                      uint32_t hash,
+                                                                      uint64_t now_ms)
+{
+  const struct lightning_cached_response *entry = __atomic_load_n(&shared->slots[hash % LIGHTNING_SHARED_CACHE_SLOTS], __ATOMIC_ACQUIRE);
+
+  if(entry == NULL || now_ms >= entry->expires_ms || !entry_matches(entry, rule, key, key_length, hash))
+  {
+    return NULL;
+  }
+
+  return entry;
+}
+
+void lightning_shared_cache_publish(struct lightning_shared_response_cache *shared, int reader, struct lightning_cached_response *entry)
+{
+  struct lightning_cached_response **slot = &shared->slots[entry->hash % LIGHTNING_SHARED_CACHE_SLOTS];
+  struct lightning_cached_response *old = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  size_t freed = old != NULL ? old->size : 0;
+
+  // Workers publishing at the same time may overshoot the capacity by an
+  // entry each.
+  if(__atomic_load_n(&shared->bytes, __ATOMIC_RELAXED) + entry->size > shared->capacity + freed ||
+     !__atomic_compare_exchange_n(slot, &old, entry, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    free(entry);
+    return;
+  }
+
+  __atomic_add_fetch(&shared->bytes, entry->size, __ATOMIC_RELAXED);
+  if(old != NULL)
+  {
+    shared_retire(shared, reader, old);
+  }
+}
+
+void lightning_shared_cache_offline(struct lightning_shared_response_cache *shared, int reader, uint64_t now_ms)
+{
+  if(shared == NULL)
+  {
+    return;
+  }
+
+  struct lightning_shared_cache_reader *current = &shared->readers[reader];
+  if(current->state & 1)
+  {
+    return;
+  }
+
+  shared_sweep(shared, reader, now_ms);
+  shared_reclaim(shared, reader);
+
+  // Every entry looked up this round is done with before the store.
+  __atomic_store_n(&current->state, current->state + 1, __ATOMIC_RELEASE);
+}
+
+void lightning_shared_cache_online(struct lightning_shared_response_cache *shared, int reader)
+{
+  if(shared == NULL)
+  {
+    return;
+  }
+
+  struct lightning_shared_cache_reader *current = &shared->readers[reader];
+  if((current->state & 1) == 0)
+  {
+    return;
+  }
+
+  // Pairs with the fence in shared_reclaim: either the retiring worker
+  // sees us online, or we see the slot it already emptied.
+  __atomic_store_n(&current->state, current->state + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static bool status_cacheable(int status_code)
+{
+  switch(status_code)
+  {
+    case 200:
+    case 203:
+    case 204:
+    case 300:
+    case 301:
+    case 404:
+    case 410:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+/*
+ * The entity tag the handler set, or a hash of the body and its type. Both
+ * headers go through the response so the miss is answered with them too.
+ */
+static int add_validators(struct lightning_http_response *response, char *etag, size_t *etag_length)
+{
+  for(unsigned short i = 0; i < response->headers_count; i++)
+  {
+    const struct lightning_http_response_header *header = &response->headers[i];
+    if(header->name_length == sizeof("ETag") - 1 && strncasecmp(header->name, "ETag", header->name_length) == 0)
+    {
+      if(header->value_length <= LIGHTNING_RESPONSE_CACHE_ETAG_MAX)
+      {
+        memcpy(etag, header->value, header->value_length);
+        *etag_length = header->value_length;
+      }
+      return lightning_response_header_static(response, "Accept-Ranges", "bytes");
+    }
+  }
+
+  char value[LIGHTNING_ETAG_LENGTH + 1];
+  uint64_t hash = LIGHTNING_ETAG_SEED;
+  if(response->content_type != NULL)
+  {
+    hash = lightning_etag_hash(hash, response->content_type, strlen(response->content_type));
+  }
+  if(response->prefix != NULL)
+  {
+    hash = lightning_etag_hash(hash, response->prefix->data, response->prefix->length);
+  }
+  hash = lightning_etag_hash(hash, response->body, response->body_length);
+  lightning_etag_format(value, hash);
+  value[LIGHTNING_ETAG_LENGTH] = '\0';
+
+  memcpy(etag, value, LIGHTNING_ETAG_LENGTH);
+  *etag_length = LIGHTNING_ETAG_LENGTH;
+
+  if(lightning_response_header(response, "ETag", value) == -1)
+  {
+    return -1;
+  }
+  return lightning_response_header_static(response, "Accept-Ranges", "bytes");
+}
+
+/*
+ * The stored head with another status line and its Content-Length
+ * replaced by `headers`.
+ */
+static size_t write_variant(const struct lightning_cached_response *entry,
+                            const struct lightning_http_date *date,
+                            const char *status_line,
+                            size_t status_line_length,
+                            const char *headers,
+                            size_t headers_length,
+                            bool close,
+                            const char *body,
+                            size_t body_length,
+                            char *output,
+                            size_t capacity)
+{
+  const char *head = entry->data + entry->key_length;
+  size_t middle = entry->length_offset - entry->status_length;
+  const char *tail = close ? close_tail : keep_alive_tail;
+  size_t tail_length = close ? sizeof(close_tail) - 1 : sizeof(keep_alive_tail) - 1;
+  size_t total = status_line_length + middle + headers_length + tail_length + body_length;
+
+  if(total > capacity || output == NULL)
+  {
+    return total;
+  }
+
+  char *p = output;
+  memcpy(p, status_line, status_line_length);
+  p += status_line_length;
+  memcpy(p, head + entry->status_length, middle);
+  memcpy(p + entry->date_offset - entry->status_length, date->header, LIGHTNING_DATE_HEADER_LENGTH);
+  p += middle;
+  if(headers_length > 0)
+  {
+    memcpy(p, headers, headers_length);
+    p += headers_length;
+  }
+  memcpy(p, tail, tail_length);
+  p += tail_length;
+  if(body_length > 0)
+  {
+    memcpy(p, body, body_length);
+  }
+
+  return total;
+}
+
+static bool entry_matches(const struct lightning_cached_response *entry,
+                          const struct lightning_cache_rule *rule,
+                          const char *key,
+                          size_t key_length,
+                          uint32_t hash)
+{
+  return entry->hash == hash && entry->rule == rule && entry->key_length == key_length &&
+         memcmp(entry->data, key, key_length) == 0;
+}
+
+static void cache_remove(struct lightning_response_cache *cache, struct lightning_cached_response *entry)
+{
+  struct lightning_cached_response **link = &cache->buckets[entry->hash % LIGHTNING_RESPONSE_CACHE_BUCKETS];
+  while(*link != entry)
+  {
+    link = &(*link)->hash_next;
+  }
+  *link = entry->hash_next;
+
+  lru_unlink(cache, entry);
+  cache->bytes -= entry->size;
+  free(entry);
+}
+
+static void lru_unlink(struct lightning_response_cache *cache, struct lightning_cached_response *entry)
+{
+  if(entry->lru_prev != NULL)
+  {
+    entry->lru_prev->lru_next = entry->lru_next;
+  }
+  else
+  {
+    cache->lru_head = entry->lru_next;
+  }
+
+  if(entry->lru_next != NULL)
+  {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  }
+  else
+  {
+    cache->lru_tail = entry->lru_prev;
+  }
+
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+static void lru_push_front(struct lightning_response_cache *cache, struct lightning_cached_response *entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+
+  if(cache->lru_head != NULL)
+  {
+    cache->lru_head->lru_prev = entry;
+  }
+  else
+  {
+    cache->lru_tail = entry;
+  }
+
+  cache->lru_head = entry;
+}
+
+/*
+ * The entry is out of its slot: only workers that loaded it before may
+ * still read it. hash_next is free for the retired list, readers of the
+ * shared table never follow it.
+ */
+static void shared_retire(struct lightning_shared_response_cache *shared, int reader, struct lightning_cached_response *entry)
+{
+  struct lightning_shared_cache_reader *current = &shared->readers[reader];
+
+  __atomic_sub_fetch(&shared->bytes, entry->size, __ATOMIC_RELAXED);
+  entry->hash_next = current->retired;
+  current->retired = entry;
+}
+
+/*
+ * Direct mapped, the table only evicts by replacing: expired entries that
+ * nobody replaces are taken out a few slots per round, so they do not hold
+ * on to the capacity.
+ */
+static void shared_sweep(struct lightning_shared_response_cache *shared, int reader, uint64_t now_ms)
+{
+  struct lightning_shared_cache_reader *current = &shared->readers[reader];
+
+  for(int i = 0; i < LIGHTNING_SHARED_CACHE_SWEEP; i++)
+  {
+    struct lightning_cached_response **slot = &shared->slots[current->sweep];
+    struct lightning_cached_response *entry = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+    current->sweep = (current->sweep + 1) % LIGHTNING_SHARED_CACHE_SLOTS;
+    if(entry != NULL && now_ms >= entry->expires_ms &&
+       __atomic_compare_exchange_n(slot, &entry, NULL, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      shared_retire(shared, reader, entry);
+    }
+  }
+}
+
+/*
+ * One grace period at a time: the entries retired since the last one
+ * started wait for every other reader to be seen offline, or to have gone
+ * through a quiescent state since the snapshot. Only then are they freed.
+ */
+static void shared_reclaim(struct lightning_shared_response_cache *shared, int reader)
+{
+  struct lightning_shared_cache_reader *current = &shared->readers[reader];
+
+  if(current->waiting != NULL && grace_period_over(shared, reader))
+  {
+    free_entries(current->waiting);
+    current->waiting = NULL;
+  }
+
+  if(current->waiting != NULL || current->retired == NULL)
+  {
+    return;
+  }
+
+  current->waiting = current->retired;
+  current->retired = NULL;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for(int i = 0; i < shared->readers_count; i++)
+  {
+    current->snapshot[i] = __atomic_load_n(&shared->readers[i].state, __ATOMIC_ACQUIRE);
+  }
+}
+
+static bool grace_period_over(const struct lightning_shared_response_cache *shared, int reader)
+{
+  const struct lightning_shared_cache_reader *current = &shared->readers[reader];
+
+  for(int i = 0; i < shared->readers_count; i++)
+  {
+    if(i == reader || (current->snapshot[i] & 1))
+    {
+      continue;
+    }
+
+    if(__atomic_load_n(&shared->readers[i].state, __ATOMIC_ACQUIRE) == current->snapshot[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void free_entries(struct lightning_cached_response *entry)
+{
+  while(entry != NULL)
+  {
+    struct lightning_cached_response *next = entry->hash_next;
+    free(entry);
+    entry = next;
+  }
+}
@@ -0,0 +1,674 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/router.h"
+
+#define ROUTE_NONE UINT32_MAX
+
+/**
+ * Mutable node used only while routes are being registered.
+ */
+struct route_build_node
+{
+  char *label;
+  size_t label_length;
+  struct route_build_node **children;
+  size_t children_count;
+  struct route_build_node *param_child;
+  struct route_build_node *wildcard_child;
+  char *name;
+  size_t name_length;
+  struct lightning_route_target targets[HTTP_UNKNOWN];
+  bool has_targets;
+};
+
+/**
+ * Compiled node. Static children of a node are stored contiguously and
+ * sorted by the first byte of their label, so a lookup touches one small
+ * array per path component.
+ */
+struct lightning_route_node
+{
+  uint32_t label_offset;
+  uint16_t label_length;
+  uint16_t children_count;
+  uint32_t first_child;
+  uint32_t param_child;
+  uint32_t wildcard_child;
+  uint32_t name_offset;
+  uint32_t name_length;
+  uint32_t targets;
+  unsigned char first;
+};
+
+struct lightning_router
+{
+  struct route_build_node *root;
+  size_t build_nodes;
+  size_t build_label_bytes;
+  size_t routes_count;
+
+  struct lightning_route_node *nodes;
+  size_t nodes_count;
+  struct lightning_route_target *targets;
+  size_t targets_count;
+  char *labels;
+  size_t labels_length;
+};
+
+static struct route_build_node *build_node_create(struct lightning_router *router, const char *label, size_t length);
+static void build_node_destroy(struct route_build_node *node);
+static int build_node_insert(struct lightning_router *router,
+                             struct route_build_node *node,
+                             const char *pattern,
+                             size_t position,
+                             size_t length,
+                             enum http_methods method,
+                             const struct lightning_route_target *target);
+static int build_node_add_child(struct route_build_node *node, struct route_build_node *child);
+static void static_target_handler(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data);
+static int compare_children(const void *left, const void *right);
+static uint32_t match_node(const struct lightning_router *router,
+                           uint32_t index,
+                           const char *path,
+                           size_t position,
+                           size_t length,
+                           size_t path_offset,
+                           struct lightning_http_request *request,
+                           unsigned *allowed);
+static bool node_accepts(const struct lightning_router *router, uint32_t index, enum http_methods method, unsigned *allowed);
+
+struct lightning_router *lightning_router_create(void)
+{
+  struct lightning_router *router = calloc(1, sizeof(struct lightning_router));
+  if(router == NULL)
+  {
+    return NULL;
+  }
+
+  router->root = build_node_create(router, "", 0);
+  if(router->root == NULL)
+  {
+    free(router);
+    return NULL;
+  }
+
+  return router;
+}
+
+int lightning_router_add(struct lightning_router *router,
+                         enum http_methods method,
+                         const char *pattern,
+                         lightning_handler handler,
+                         lightning_body_handler body_handler,
+                         void *user_data)
+{
+  if(router == NULL || router->root == NULL || pattern == NULL || handler == NULL)
+  {
+    return -1;
+  }
+
+  if((int)method < 0 || method >= HTTP_UNKNOWN || pattern[0] != '/')
+  {
+    return -1;
+  }
+
+  struct lightning_route_target target = {handler, body_handler, user_data, NULL, NULL};
+
+  if(build_node_insert(router, router->root, pattern, 0, strlen(pattern), method, &target) == -1)
+  {
+    return -1;
+  }
+
+  router->routes_count++;
+  return 0;
+}
+
+int lightning_router_add_static(struct lightning_router *router,
+                                const char *pattern,
+                                const struct lightning_static_directory *directory)
+{
+  if(router == NULL || router->root == NULL || pattern == NULL || pattern[0] != '/' || directory == NULL)
+  {
+    return -1;
+  }
+
+  // Never called: the worker serves static targets itself. It only marks
+  // the method as taken, so HEAD falls back to it like to any GET route.
+  struct lightning_route_target target = {static_target_handler, NULL, NULL, directory, NULL};
+
+  if(build_node_insert(router, router->root, pattern, 0, strlen(pattern), HTTP_GET, &target) == -1)
+  {
+    return -1;
+  }
+
+  router->routes_count++;
+  return 0;
+}
+
+int lightning_router_add_cached(struct lightning_router *router,
+                                const char *pattern,
+                                lightning_handler handler,
+                                void *user_data,
+                                const struct lightning_cache_rule *cache)
+{
+  if(router == NULL || router->root == NULL || pattern == NULL || pattern[0] != '/' || handler == NULL || cache == NULL)
+  {
+    return -1;
+  }
+
+  struct lightning_route_target target = {handler, NULL, user_data, NULL, cache};
+
+  if(build_node_insert(router, router->root, pattern, 0, strlen(pattern), HTTP_GET, &target) == -1)
+  {
+    return -1;
+  }
+
+  router->routes_count++;
+  return 0;
+}
+
+size_t lightning_router_count(const struct lightning_router *router)
+{
+  return router == NULL ? 0 : router->routes_count;
+}
+
+int lightning_router_compile(struct lightning_router *router)
+{
+  if(router == NULL || router->root == NULL)
+  {
+    return -1;
+  }
+
+  size_t count = router->build_nodes;
+  struct route_build_node **queue = malloc(count * sizeof(struct route_build_node *));
+  router->nodes = calloc(count, sizeof(struct lightning_route_node));
+  router->targets = calloc(count * HTTP_UNKNOWN, sizeof(struct lightning_route_target));
+  router->labels = malloc(router->build_label_bytes + 1);
+
+  if(queue == NULL || router->nodes == NULL || router->targets == NULL || router->labels == NULL)
+  {
+    free(queue);
+    return -1;
+  }
+
+  // Breadth first layout: every node reserves the slots of its children when
+  // it is visited, which keeps siblings next to each other in memory.
+  size_t head = 0;
+  size_t tail = 0;
+  queue[tail++] = router->root;
+
+  while(head < tail)
+  {
+    size_t index = head;
+    struct route_build_node *build = queue[head++];
+    struct lightning_route_node *node = &router->nodes[index];
+
+    node->label_offset = router->labels_length;
+    node->label_length = build->label_length;
+    node->first = build->label_length > 0 ? (unsigned char)build->label[0] : '\0';
+    memcpy(router->labels + router->labels_length, build->label, build->label_length);
+    router->labels_length += build->label_length;
+
+    node->name_offset = router->labels_length;
+    node->name_length = build->name_length;
+    if(build->name_length > 0)
+    {
+      memcpy(router->labels + router->labels_length, build->name, build->name_length);
+      router->labels_length += build->name_length;
+    }
+
+    node->targets = ROUTE_NONE;
+    if(build->has_targets)
+    {
+      node->targets = router->targets_count;
+      memcpy(&router->targets[router->targets_count], build->targets, sizeof(build->targets));
+      router->targets_count += HTTP_UNKNOWN;
+    }
+
+    if(build->children_count > 1)
+    {
+      qsort(build->children, build->children_count, sizeof(struct route_build_node *), compare_children);
+    }
+
+    node->children_count = build->children_count;
+    node->first_child = tail;
+    for(size_t i = 0; i < build->children_count; i++)
+    {
+      queue[tail++] = build->children[i];
+    }
+
+    node->param_child = ROUTE_NONE;
+    if(build->param_child != NULL)
+    {
+      node->param_child = tail;
+      queue[tail++] = build->param_child;
+    }
+
+    node->wildcard_child = ROUTE_NONE;
+    if(build->wildcard_child != NULL)
+    {
+      node->wildcard_child = tail;
+      queue[tail++] = build->wildcard_child;
+    }
+  }
+
+  router->nodes_count = tail;
+  free(queue);
+
+  build_node_destroy(router->root);
+  router->root = NULL;
+
+  return 0;
+}
+
+enum lightning_route_result lightning_router_match(const struct lightning_router *router,
+                                                   struct lightning_http_request *request,
+                                                   const struct lightning_route_target **target,
+                                                   unsigned *allowed)
+{
+  request->params_count = 0;
+
+  if(request->method == HTTP_UNKNOWN)
+  {
+    return LIGHTNING_ROUTE_NOT_IMPLEMENTED;
+  }
+
+  if(router == NULL || router->nodes_count == 0)
+  {
+    return LIGHTNING_ROUTE_NOT_FOUND;
+  }
+
+  const char *path = request->buffer + request->path.offset;
+  unsigned methods = 0;
+  uint32_t index = match_node(router, 0, path, 0, request->path.length, request->path.offset, request, &methods);
+
+  if(index == ROUTE_NONE)
+  {
+    request->params_count = 0;
+    if(methods == 0)
+    {
+      return LIGHTNING_ROUTE_NOT_FOUND;
+    }
+
+    if(allowed != NULL)
+    {
+      *allowed = methods;
+      if(methods & (1u << HTTP_GET))
+      {
+        *allowed |= 1u << HTTP_HEAD;
+      }
+    }
+    return LIGHTNING_ROUTE_METHOD_NOT_ALLOWED;
+  }
+
+  const struct lightning_route_target *targets = &router->targets[router->nodes[index].targets];
+  enum http_methods method = request->method;
+
+  if(targets[method].handler == NULL && method == HTTP_HEAD)
+  {
+    method = HTTP_GET;
+  }
+
+  *target = &targets[method];
+  return LIGHTNING_ROUTE_FOUND;
+}
+
+void lightning_router_destroy(struct lightning_router *router)
+{
+  if(router == NULL)
+  {
+    return;
+  }
+
+  build_node_destroy(router->root);
+  free(router->nodes);
+  free(router->targets);
+  free(router->labels);
+  free(router);
+}
+
+static uint32_t match_node(const struct lightning_router *router,
+                           uint32_t index,
+                           const char *path,
+                           size_t position,
+                           size_t length,
+                           size_t path_offset,
+                           struct lightning_http_request *request,
+                           unsigned *allowed)
+{
+  const struct lightning_route_node *node = &router->nodes[index];
+
+  if(position == length)
+  {
+    if(node_accepts(router, index, request->method, allowed))
+    {
+      return index;
+    }
+  }
+  else
+  {
+    unsigned char c = path[position];
+
+    for(uint32_t i = 0; i < node->children_count; i++)
+    {
+      uint32_t child_index = node->first_child + i;
+      const struct lightning_route_node *child = &router->nodes[child_index];
+
+      if(child->first < c)
+      {
+        continue;
+      }
+
+      if(child->first == c &&
+         length - position >= child->label_length &&
+         memcmp(router->labels + child->label_offset, path + position, child->label_length) == 0)
+      {
+        uint32_t found = match_node(router, child_index, path, position + child->label_length, length, path_offset, request, allowed);
+        if(found != ROUTE_NONE)
+        {
+          return found;
+        }
+      }
+
+      break;
+    }
+
+    if(node->param_child != ROUTE_NONE && c != '/' && request->params_count < LIGHTNING_MAX_PARAMS)
+    {
+      const struct lightning_route_node *param = &router->nodes[node->param_child];
+      const char *slash = memchr(path + position, '/', length - position);
+      size_t end = slash == NULL ? length : (size_t)(slash - path);
+
+      struct lightning_http_param *captured = &request->params[request->params_count++];
+      captured->name = router->labels + param->name_offset;
+      captured->name_length = param->name_length;
+      captured->value.offset = path_offset + position;
+      captured->value.length = end - position;
+
+      uint32_t found = match_node(router, node->param_child, path, end, length, path_offset, request, allowed);
+      if(found != ROUTE_NONE)
+      {
+        return found;
+      }
+
+      request->params_count--;
+    }
+  }
+
+  if(node->wildcard_child != ROUTE_NONE && request->params_count < LIGHTNING_MAX_PARAMS)
+  {
+    const struct lightning_route_node *wildcard = &router->nodes[node->wildcard_child];
+
+    if(node_accepts(router, node->wildcard_child, request->method, allowed))
+    {
+      struct lightning_http_param *captured = &request->params[request->params_count++];
+      captured->name = router->labels + wildcard->name_offset;
+      captured->name_length = wildcard->name_length;
+      captured->value.offset = path_offset + position;
+      captured->value.length = length - position;
+      return node->wildcard_child;
+    }
+  }
+
+  return ROUTE_NONE;
+}
+
+/*
+ * Whether the node has a route for `method`, HEAD falling back to GET.
+ * When it has routes for other methods only, they are added to `allowed`
+ * and the lookup goes on with the param and wildcard alternatives.
+ */
+static bool node_accepts(const struct lightning_router *router, uint32_t index, enum http_methods method, unsigned *allowed)
+{
+  const struct lightning_route_node *node = &router->nodes[index];
+
+  if(node->targets == ROUTE_NONE)
+  {
+    return false;
+  }
+
+  const struct lightning_route_target *targets = &router->targets[node->targets];
+  if(targets[method].handler != NULL || (method == HTTP_HEAD && targets[HTTP_GET].handler != NULL))
+  {
+    return true;
+  }
+
+  for(int i = 0; i < HTTP_UNKNOWN; i++)
+  {
+    if(targets[i].handler != NULL)
+    {
+      *allowed |= 1u << i;
+    }
+  }
+  return false;
+}
+
+static struct route_build_node *build_node_create(struct lightning_router *router, const char *label, size_t length)
+{
+  struct route_build_node *node = calloc(1, sizeof(struct route_build_node));
+  if(node == NULL)
+  {
+    return NULL;
+  }
+
+  node->label = malloc(length + 1);
+  if(node->label == NULL)
+  {
+    free(node);
+    return NULL;
+  }
+
+  memcpy(node->label, label, length);
+  node->label[length] = '\0';
+  node->label_length = length;
+
+  router->build_nodes++;
+  router->build_label_bytes += length;
+
+  return node;
+}
+
+static void build_node_destroy(struct route_build_node *node)
+{
+  if(node == NULL)
+  {
+    return;
+  }
+
+  for(size_t i = 0; i < node->children_count; i++)
+  {
+    build_node_destroy(node->children[i]);
+  }
+
+  build_node_destroy(node->param_child);
+  build_node_destroy(node->wildcard_child);
+  free(node->children);
+  free(node->label);
+  free(node->name);
+  free(node);
+}
+
+static int build_node_insert(struct lightning_router *router,
+                             struct route_build_node *node,
+                             const char *pattern,
+                             size_t position,
+                             size_t length,
+                             enum http_methods method,
+                             const struct lightning_route_target *target)
+{
+  if(position == length)
+  {
+    if(node->targets[method].handler != NULL)
+    {
+      return -1;
+    }
+
+    node->targets[method] = *target;
+    node->has_targets = true;
+    return 0;
+  }
+
+  char c = pattern[position];
+  bool segment_start = position > 0 && pattern[position - 1] == '/';
+
+  if(segment_start && (c == ':' || c == '*'))
+  {
+    size_t name_start = position + 1;
+    size_t name_end = length;
+
+    if(c == ':')
+    {
+      const char *slash = memchr(pattern + name_start, '/', length - name_start);
+      name_end = slash == NULL ? length : (size_t)(slash - pattern);
+
+      if(name_end == name_start)
+      {
+        return -1;
+      }
+    }
+
+    struct route_build_node **slot = c == ':' ? &node->param_child : &node->wildcard_child;
+    size_t name_length = name_end - name_start;
+
+    if(*slot == NULL)
+    {
+      *slot = build_node_create(router, "", 0);
+      if(*slot == NULL)
+      {
+        return -1;
+      }
+
+      (*slot)->name = malloc(name_length + 1);
+      if((*slot)->name == NULL)
+      {
+        return -1;
+      }
+
+      memcpy((*slot)->name, pattern + name_start, name_length);
+      (*slot)->name[name_length] = '\0';
+      (*slot)->name_length = name_length;
+      router->build_label_bytes += name_length;
+    }
+    else if((*slot)->name_length != name_length || memcmp((*slot)->name, pattern + name_start, name_length) != 0)
+    {
+      // Two routes may not give different names to the same parameter.
+      return -1;
+    }
+
+    return build_node_insert(router, *slot, pattern, name_end, length, method, target);
+  }
+
+  // The static run stops right before the next ":param" or "*wildcard".
+  size_t run_end = position;
+  while(run_end < length)
+  {
+    if(run_end > position && pattern[run_end - 1] == '/' && (pattern[run_end] == ':' || pattern[run_end] == '*'))
+    {
+      break;
+    }
+    run_end++;
+  }
+
+  for(size_t i = 0; i < node->children_count; i++)
+  {
+    struct route_build_node *child = node->children[i];
+    if(child->label[0] != c)
+    {
+      continue;
+    }
+
+    size_t common = 0;
+    while(common < child->label_length && position + common < run_end && child->label[common] == pattern[position + common])
+    {
+      common++;
+    }
+
+    if(common < child->label_length)
+    {
+      struct route_build_node *split = build_node_create(router, child->label, common);
+      if(split == NULL)
+      {
+        return -1;
+      }
+
+      size_t rest = child->label_length - common;
+      memmove(child->label, child->label + common, rest + 1);
+      child->label_length = rest;
+      router->build_label_bytes -= common;
+
+      if(build_node_add_child(split, child) == -1)
+      {
+        build_node_destroy(split);
+        return -1;
+      }
+
+      node->children[i] = split;
+      child = split;
+    }
+
+    return build_node_insert(router, child, pattern, position + common, length, method, target);
+  }
+
+  struct route_build_node *child = build_node_create(router, pattern + position, run_end - position);
+  if(child == NULL)
+  {
+    return -1;
+  }
+
+  if(build_node_add_child(node, child) == -1)
+  {
+    build_node_destroy(child);
+    return -1;
+  }
+
+  return build_node_insert(router, child, pattern, run_end, length, method, target);
+}
+
+static int build_node_add_child(struct route_build_node *node, struct route_build_node *child)
+{
+  struct route_build_node **children = realloc(node->children, (node->children_count + 1) * sizeof(struct route_build_node *));
+  if(children == NULL)
+  {
+    return -1;
+  }
+
+  children[node->children_count++] = child;
+  node->children = children;
+  return 0;
+}
+
+static int compare_children(const void *left, const void *right)
+{
+  const struct route_build_node *a = *(const struct route_build_node *const *)left;
+  const struct route_build_node *b = *(const struct route_build_node *const *)right;
+
+  return (unsigned char)a->label[0] - (unsigned char)b->label[0];
+}
+
+static void static_target_handler(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data)
+{
+  (void)request;
+  (void)response;
+  (void)user_data;
+}
@@ -0,0 +1,114 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "internal/scan.h"
+
+static size_t scan_any2_scalar(const char *data, size_t length, char first, char second);
+
+lightning_scan_function lightning_scan_any2 = scan_any2_scalar;
+static const char *scan_backend_name = "scalar";
+
+static size_t scan_any2_scalar(const char *data, size_t length, char first, char second)
+{
+  for(size_t i = 0; i < length; i++)
+  {
+    if(data[i] == first || data[i] == second)
+    {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+#if defined(__x86_64__)
+
+static size_t scan_any2_sse2(const char *data, size_t length, char first, char second)
+{
+  const __m128i first_mask = _mm_set1_epi8(first);
+  const __m128i second_mask = _mm_set1_epi8(second);
+  size_t i = 0;
+
+  for(; i + 16 <= length; i += 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, first_mask), _mm_cmpeq_epi8(chunk, second_mask));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+
+    if(mask != 0)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + scan_any2_scalar(data + i, length - i, first, second);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_any2_avx2(const char *data, size_t length, char first, char second)
+{
+  const __m256i first_mask = _mm256_set1_epi8(first);
+  const __m256i second_mask = _mm256_set1_epi8(second);
+  size_t i = 0;
+
+  for(; i + 32 <= length; i += 32)
+  {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, first_mask), _mm256_cmpeq_epi8(chunk, second_mask));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+
+    if(mask != 0)
+    {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + scan_any2_sse2(data + i, length - i, first, second);
+}
+
+//      __x86_64__
+#endif
+
+__attribute__((constructor))
+static void scan_select_backend(void)
+{
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2"))
+  {
+    lightning_scan_any2 = scan_any2_avx2;
+    scan_backend_name = "avx2";
+    return;
+  }
+
+  lightning_scan_any2 = scan_any2_sse2;
+  scan_backend_name = "sse2";
+#endif
+}
+
+const char *lightning_scan_backend(void)
+{
+  return scan_backend_name;
+}
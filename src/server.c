@@ -24,31 +24,73 @@
 #include <netinet/tcp.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/sysinfo.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "internal/body.h"
+#include "internal/conditional.h"
 #include "internal/connection.h"
+#include "internal/parser.h"
+#include "internal/pool.h"
+#include "internal/response.h"
+#include "internal/router.h"
 #include "internal/server.h"
+#include "internal/static.h"
+#include "internal/timer.h"
 
-void lightning_connection_init(struct lightning_connection *conn, int fd, struct sockaddr_in *addr);
 void lightning_connection_reset(struct lightning_connection *conn);
-static void accept_new_connection(struct lightning_server *server);
+static void accept_connections(struct lightning_server *server, int listener, bool sweep);
+static void accept_pending_connections(struct lightning_server *server);
+static void close_listeners(struct lightning_server *server);
+static void set_listener_option(int fd, int level, int option, int value, const char *name);
 static void close_connection(struct lightning_server *server, int fd);
+static void *ride_the_epoll(struct lightning_server *server);
 static void handle_client_read(struct lightning_server *server, int fd);
 static void handle_client_write(struct lightning_server *server, int fd);
-static int set_socket_nonblocking(int fd);
-static void optimize_socket(int fd);
-static int is_request_complete(struct lightning_connection *conn);
+static int flush_connection(struct lightning_server *server, struct lightning_connection *conn);
+static int process_request(struct lightning_server *server, struct lightning_connection *conn);
+static int queue_response(struct lightning_server *server, struct lightning_connection *conn);
+static int start_body(struct lightning_server *server, struct lightning_connection *conn);
+static int feed_body(struct lightning_server *server, struct lightning_connection *conn);
+static int deliver_body(struct lightning_server *server, struct lightning_connection *conn, const char *data, size_t length);
+static int produce_chunk(struct lightning_server *server, struct lightning_connection *conn);
+static void compact_read_buffer(struct lightning_connection *conn);
+static void add_allow_header(struct lightning_http_response *response, unsigned allowed);
+static void serve_static(struct lightning_server *server, struct lightning_connection *conn, const struct lightning_static_directory *directory);
+static void serve_file_ranges(struct lightning_connection *conn,
+                              struct lightning_static_file *file,
+                              const struct lightning_byte_range *ranges,
+                              int count);
+static void add_file_validators(struct lightning_http_response *response, const struct lightning_static_file *file);
+static const struct lightning_cached_response *lookup_cached(struct lightning_server *server,
+                                                             struct lightning_connection *conn,
+                                                             const struct lightning_cache_rule *rule);
+static int queue_cached(struct lightning_server *server, struct lightning_connection *conn, const struct lightning_cached_response *entry);
+static struct lightning_cached_response *create_cached(struct lightning_server *server,
+                                                       struct lightning_connection *conn,
+                                                       const struct lightning_cache_rule *rule);
+static void store_cached(struct lightning_server *server, struct lightning_cached_response *entry);
+static void handle_connection_timeout(struct lightning_timer *timer, void *data);
+static void start_draining(struct lightning_server *server);
+static void log_access(struct lightning_server *server, struct lightning_connection *conn, uint64_t duration_ns);
+
+// Sent around the worker's cached Date header.
+static const char lightning_default_response_head[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/html; charset=UTF-8\r\n";
 
 static const char lightning_default_response[] =
-    "HTTP/1.1 200 OK\r\n"
-    "Content-Type: text/html; charset=UTF-8\r\n"
     "Content-Length: 80\r\n"
     "Connection: keep-alive\r\n"
     "\r\n"
@@ -57,130 +99,276 @@ static const char lightning_default_response[] =
     "<p>Ride the lightning</p>"
     "</body></html>";
 
+static const char lightning_default_response_close[] =
+    "Content-Length: 80\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "<html><body>"
+    "<h1>Lightning Web Server</h1>"
+    "<p>Ride the lightning</p>"
+    "</body></html>";
+
+static const char lightning_continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+static const char lightning_overloaded_response[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// Chunk framing around the producer's data: "xxxx\r\n" <data> "\r\n".
+#define LIGHTNING_CHUNK_HEADER_LENGTH 6
+#define LIGHTNING_CHUNK_FRAMING (LIGHTNING_CHUNK_HEADER_LENGTH + 2)
+#define LIGHTNING_CHUNK_MIN_ROOM 512
+
+static const size_t lightning_default_response_head_length = sizeof(lightning_default_response_head) - 1;
 static const size_t lightning_default_response_length = sizeof(lightning_default_response) - 1;
+static const size_t lightning_default_response_close_length = sizeof(lightning_default_response_close) - 1;
+// The Content-Length of both default responses.
+static const size_t lightning_default_body_length = 80;
 
-struct lightning_server
-{
-  struct lightning_connection *connections;
-  struct sockaddr_in address;
-  int socket_fd;
-  int epoll_fd;
-  int max_connections;
-  int active_connections;
-  unsigned short port;
-  bool running;
-  unsigned long total_connections_accepted;
-};
 
-struct lightning_server *lightning_create_server(unsigned short port, int max_connections)
+struct lightning_server *lightning_create_server(const struct lightning_config *config, const int *listen_fds, int listen_count)
 {
   struct lightning_server *server = malloc(sizeof(struct lightning_server));
   if(server == NULL)
   {
     LIGHTNING_ERROR("can not allocate struct lightning_server");
+    for(int i = 0; i < listen_count; i++)
+    {
+      close(listen_fds[i]);
+    }
     return NULL;
   }
 
-  server->total_connections_accepted = 0;
-
-  server->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if(server->socket_fd < 0)
+  server->router = NULL;
+  server->backend = LIGHTNING_BACKEND_EPOLL;
+  server->max_body_size = LIGHTNING_MAX_BODY_SIZE;
+  server->body_spill_threshold = LIGHTNING_BODY_SPILL_THRESHOLD;
+  server->access_log = NULL;
+  server->read_buffer_size = config->read_buffer_size;
+  server->epoll_max_events = config->epoll_max_events;
+  server->accept_batch = config->accept_batch;
+  server->max_active_connections = config->max_active_connections;
+  server->max_loop_delay_ns = (uint64_t)config->max_loop_delay_us * 1000;
+  server->shed_mode = config->shed;
+  server->shedding = false;
+  server->loop_delay_ns = 0;
+  server->accept_pending = 0;
+  lightning_pool_init(&server->read_pool, sizeof(struct lightning_read_block) + server->read_buffer_size, LIGHTNING_POOL_SLAB_OBJECTS);
+  lightning_pool_init(&server->write_pool, LIGHTNING_WRITE_BUFFER_SIZE, LIGHTNING_POOL_SLAB_OBJECTS);
+  lightning_pool_init(&server->arena_pool, LIGHTNING_ARENA_BLOCK_SIZE, LIGHTNING_POOL_SLAB_OBJECTS);
+  memset(&server->arena_stats, 0, sizeof(server->arena_stats));
+  server->arena_stats.block_size = LIGHTNING_ARENA_BLOCK_SIZE;
+  server->now_ms = lightning_clock_ms();
+  lightning_http_date_init(&server->date, server->now_ms);
+  lightning_static_cache_init(&server->files);
+  lightning_response_cache_init(&server->responses, config->response_cache_size);
+  server->shared_responses = NULL;
+  server->shared_reader = 0;
+  lightning_timer_wheel_init(&server->timers, server->now_ms, LIGHTNING_TIMER_TICK_MS);
+
+  server->listen_count = listen_count;
+  for(int i = 0; i < listen_count; i++)
   {
-    LIGHTNING_ERROR("can not create a socket");
-    close(server->socket_fd);
-    free(server);
-    return NULL;
+    server->listen_fds[i] = listen_fds[i];
   }
 
-  server->port = port;
-  server->address.sin_family = AF_INET;
-  server->address.sin_addr.s_addr = INADDR_ANY;
-  server->address.sin_port = htons(server->port);
-  memset(server->address.sin_zero, 0, sizeof(server->address.sin_zero));
-
-  setsockopt(server->socket_fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
-
-  if(setsockopt(server->socket_fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) < 0)
+  for(int i = 0; i < listen_count; i++)
   {
-    LIGHTNING_ERROR("can not set the socketopt to SO_REUSEPORT (linux kernel > 3.9 ?)");
-    close(server->socket_fd);
-    free(server);
-    return NULL;
+    int flags = fcntl(server->listen_fds[i], F_GETFL, 0);
+    if(flags == -1 || fcntl(server->listen_fds[i], F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+      close_listeners(server);
+      free(server);
+      return NULL;
+    }
   }
 
-  int sndbuf = 1024 * 1024;
-  int rcvbuf = 1024 * 1024;
-
-  setsockopt(server->socket_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
-  setsockopt(server->socket_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
-  setsockopt(server->socket_fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
-
-  if(bind(server->socket_fd, (struct sockaddr_in *)&server->address, sizeof(struct sockaddr_in)) < 0)
+  server->epoll_fd = epoll_create1(0);
+  if(server->epoll_fd == -1)
   {
-    LIGHTNING_ERROR("can not make bind");
-    close(server->socket_fd);
+    close_listeners(server);
     free(server);
     return NULL;
   }
 
-  if(listen(server->socket_fd, SOMAXCONN) < 0)
+  server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(server->wake_fd == -1)
   {
-    LIGHTNING_ERROR("can not listen");
-    close(server->socket_fd);
+    LIGHTNING_ERROR("can not create the wakeup eventfd");
+    close(server->epoll_fd);
+    close_listeners(server);
     free(server);
     return NULL;
   }
 
-  int flags = fcntl(server->socket_fd, F_GETFL, 0);
-  if(flags == -1 || fcntl(server->socket_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+  server->max_connections = config->max_connections;
+
+  server->connections = lightning_create_connection(server->max_connections);
+  if(server->connections == NULL)
   {
-    close(server->socket_fd);
+    LIGHTNING_ERROR("allocating connections array");
+    close(server->wake_fd);
+    close(server->epoll_fd);
+    close_listeners(server);
     free(server);
     return NULL;
   }
 
-  server->epoll_fd = epoll_create1(0);
-  if(server->epoll_fd == -1)
+  server->metrics = lightning_metrics_create();
+  if(server->metrics == NULL)
   {
-    close(server->socket_fd);
+    LIGHTNING_ERROR("can not allocate the worker metrics");
+    free(server->connections);
+    close(server->wake_fd);
+    close(server->epoll_fd);
+    close_listeners(server);
     free(server);
     return NULL;
   }
 
-  server->max_connections = max_connections;
+  struct epoll_event wake_ev;
+  wake_ev.events = EPOLLIN;
+  wake_ev.data.fd = server->wake_fd;
+  int added = epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &wake_ev);
 
-  server->connections = lightning_create_connection(server->max_connections);
-  if(server->connections == NULL)
+  for(int i = 0; i < listen_count && added == 0; i++)
   {
-    LIGHTNING_ERROR("allocating connections array");
-    close(server->epoll_fd);
-    close(server->socket_fd);
-    free(server);
-    return NULL;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = server->listen_fds[i];
+    added = epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fds[i], &ev);
   }
 
-  struct epoll_event ev;
-  ev.events = EPOLLIN | EPOLLET;
-  ev.data.fd = server->socket_fd;
-
-  if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->socket_fd, &ev) == -1)
+  if(added == -1)
   {
     LIGHTNING_ERROR("epoll_ctl can not add the event");
+    lightning_metrics_destroy(server->metrics);
     free(server->connections);
+    close(server->wake_fd);
     close(server->epoll_fd);
-    close(server->socket_fd);
+    close_listeners(server);
     free(server);
     return NULL;
   }
 
-  // TODO: Load routes
-
   server->active_connections = 0;
   server->running = true;
+  server->drain_requested = false;
+  server->handed_off = false;
+  server->draining = false;
+  server->drain_deadline_ms = 0;
 
   return server;
 }
 
+int lightning_server_listen(const struct lightning_listener *listener)
+{
+  union lightning_socket_address address;
+  socklen_t address_length = sizeof(struct sockaddr_in);
+  const char *name = listener->address != NULL ? listener->address : "0.0.0.0";
+
+  memset(&address, 0, sizeof(address));
+  address.ipv4.sin_family = AF_INET;
+  address.ipv4.sin_port = htons(listener->port);
+
+  if(inet_pton(AF_INET, name, &address.ipv4.sin_addr) != 1)
+  {
+    address.ipv6.sin6_family = AF_INET6;
+    address.ipv6.sin6_port = htons(listener->port);
+    address_length = sizeof(struct sockaddr_in6);
+
+    if(inet_pton(AF_INET6, name, &address.ipv6.sin6_addr) != 1)
+    {
+      fprintf(stderr, "Error: %s is not a numeric IPv4 or IPv6 address\n", name);
+      return -1;
+    }
+  }
+
+  int fd = socket(address.any.sa_family, SOCK_STREAM, 0);
+  if(fd < 0)
+  {
+    LIGHTNING_ERROR("can not create a socket");
+    return -1;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+
+  if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) < 0)
+  {
+    LIGHTNING_ERROR("can not set the socketopt to SO_REUSEPORT (linux kernel > 3.9 ?)");
+    close(fd);
+    return -1;
+  }
+
+  if(address.any.sa_family == AF_INET6)
+  {
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &(int){listener->ipv6_only}, sizeof(int));
+  }
+
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+  set_listener_option(fd, SOL_SOCKET, SO_SNDBUF, listener->send_buffer, "SO_SNDBUF");
+  set_listener_option(fd, SOL_SOCKET, SO_RCVBUF, listener->receive_buffer, "SO_RCVBUF");
+  set_listener_option(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, listener->defer_accept, "TCP_DEFER_ACCEPT");
+  set_listener_option(fd, IPPROTO_TCP, TCP_FASTOPEN, listener->fast_open, "TCP_FASTOPEN");
+  set_listener_option(fd, SOL_SOCKET, SO_BUSY_POLL, listener->busy_poll, "SO_BUSY_POLL");
+
+  if(bind(fd, &address.any, address_length) < 0)
+  {
+    fprintf(stderr, "Error: can not bind %s port %u: %s\n", name, (unsigned)listener->port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  if(listen(fd, listener->backlog > 0 ? listener->backlog : SOMAXCONN) < 0)
+  {
+    LIGHTNING_ERROR("can not listen");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int lightning_server_listener_index(const struct lightning_server *server, int fd)
+{
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    if(server->listen_fds[i] == fd)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+static void close_listeners(struct lightning_server *server)
+{
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    if(server->listen_fds[i] >= 0)
+    {
+      close(server->listen_fds[i]);
+      server->listen_fds[i] = -1;
+    }
+  }
+}
+
+/*
+ * Options left at 0 keep the kernel's default. The others are tuning: a
+ * kernel or a capability that refuses them is not a reason not to serve.
+ */
+static void set_listener_option(int fd, int level, int option, int value, const char *name)
+{
+  if(value > 0 && setsockopt(fd, level, option, &value, sizeof(value)) == -1)
+  {
+    fprintf(stderr, "Warning: can not set %s on a listening socket: %s\n", name, strerror(errno));
+  }
+}
+
 void *ride_the_lightning(void *args)
 {
   struct lightning_server *server = (struct lightning_server *)args;
@@ -190,11 +378,47 @@ void *ride_the_lightning(void *args)
     return NULL;
   }
 
-  struct epoll_event events[LIGHTNING_EPOLL_MAX_EVENTS];
+  if(server->backend == LIGHTNING_BACKEND_IO_URING)
+  {
+    if(lightning_uring_run(server) == 0)
+    {
+      printf("Lightning say: bye... (arena high water %zu bytes)\n", server->arena_stats.high_water);
+      return NULL;
+    }
+
+    fprintf(stderr, "Warning: io_uring is not available, falling back to epoll\n");
+  }
+
+  return ride_the_epoll(server);
+}
+
+static void *ride_the_epoll(struct lightning_server *server)
+{
+  struct epoll_event *events = malloc(server->epoll_max_events * sizeof(struct epoll_event));
+
+  if(events == NULL)
+  {
+    LIGHTNING_ERROR("can not allocate the epoll events");
+    return NULL;
+  }
 
-  while(server->running)
+  while(!lightning_server_finished(server))
   {
-    int fd_counter = epoll_wait(server->epoll_fd, events, LIGHTNING_EPOLL_MAX_EVENTS, LIGHTNING_EPOLL_TIMEOUT_MS);
+    int timeout = lightning_server_poll_timeout(server);
+    if(timeout == -1)
+    {
+      timeout = LIGHTNING_EPOLL_TIMEOUT_MS;
+    }
+
+    lightning_shared_cache_offline(server->shared_responses, server->shared_reader, server->now_ms);
+    int fd_counter = epoll_wait(server->epoll_fd, events, server->epoll_max_events, timeout);
+    lightning_shared_cache_online(server->shared_responses, server->shared_reader);
+    lightning_metrics_add(&server->metrics->loop_iterations, 1);
+
+    // One clock read per loop iteration; everything below uses this value.
+    server->now_ms = lightning_clock_ms();
+    lightning_http_date_update(&server->date, server->now_ms);
+    uint64_t round_started_ns = server->max_loop_delay_ns > 0 ? lightning_clock_ns() : 0;
 
     if(fd_counter == -1)
     {
@@ -206,39 +430,63 @@ void *ride_the_lightning(void *args)
       break;
     }
 
+    lightning_timer_wheel_advance(&server->timers, server->now_ms, handle_connection_timeout, server);
+
     for(int i = 0; i < fd_counter; i++)
     {
       int fd = events[i].data.fd;
       uint32_t events_mask = events[i].events;
+      int listener = lightning_server_listener_index(server, fd);
 
-      if(fd == server->socket_fd)
+      if(fd == server->wake_fd)
       {
-        accept_new_connection(server);
+        lightning_server_consume_wakeup(server);
+      }
+      else if(listener != -1)
+      {
+        // Accepted from once the open connections had their turn.
+        server->accept_pending |= (uint32_t)1 << listener;
       }
       else
       {
-        if(events_mask & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+        // A half-close (EPOLLRDHUP alone) still has requests to answer:
+        // handle_client_read reads up to the end of the stream and closes.
+        if(events_mask & (EPOLLERR | EPOLLHUP))
         {
           close_connection(server, fd);
           continue;
         }
 
-        if(events_mask & EPOLLIN)
+        // Both interests are registered once, edge-triggered: responses are
+        // written as soon as they are produced and EPOLLOUT only matters
+        // after a short write.
+        if((events_mask & EPOLLOUT) && server->connections[fd].write_total > 0)
         {
-          handle_client_read(server, fd);
+          handle_client_write(server, fd);
           continue;
         }
 
-        if(events_mask & EPOLLOUT)
+        if(events_mask & (EPOLLIN | EPOLLRDHUP))
         {
-          handle_client_write(server, fd);
-          continue;
+          handle_client_read(server, fd);
         }
       }
     }
+
+    accept_pending_connections(server);
+    lightning_server_update_admission(server, round_started_ns);
+
+    if(lightning_server_drain_pending(server))
+    {
+      start_draining(server);
+    }
   }
 
-  printf("Lightning say: bye...\n");
+  lightning_shared_cache_offline(server->shared_responses, server->shared_reader, server->now_ms);
+  free(events);
+  printf("Lightning say: bye... (%lu of %lu writes waited for EPOLLOUT, arena high water %zu bytes)\n",
+         (unsigned long)server->metrics->writes_would_block, (unsigned long)server->metrics->flushes,
+         server->arena_stats.high_water);
   return NULL;
 }
 
@@ -249,7 +497,120 @@ void lightning_server_stop(struct lightning_server *server)
     return;
   }
 
-  server->running = false;
+  __atomic_store_n(&server->running, false, __ATOMIC_RELEASE);
+  lightning_server_drain(server);
+}
+
+void lightning_server_drain(struct lightning_server *server)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  uint64_t one = 1;
+  __atomic_store_n(&server->drain_requested, true, __ATOMIC_RELEASE);
+
+  // Only fails when the counter is saturated, which still wakes the loop.
+  ssize_t written = write(server->wake_fd, &one, sizeof(one));
+  (void)written;
+}
+
+void lightning_server_hand_off(struct lightning_server *server)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  __atomic_store_n(&server->handed_off, true, __ATOMIC_RELEASE);
+  lightning_server_drain(server);
+}
+
+/*
+ * Stops taking new connections: whatever already waits in the accept queue
+ * is served, unless the socket was handed over, then the socket is closed so
+ * it leaves the SO_REUSEPORT group.
+ * Idle keep-alive connections are closed right away, the others once their
+ * current response is out.
+ */
+static void start_draining(struct lightning_server *server)
+{
+  bool handed_off = __atomic_load_n(&server->handed_off, __ATOMIC_ACQUIRE);
+
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    if(!handed_off)
+    {
+      accept_connections(server, i, true);
+    }
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, server->listen_fds[i], NULL);
+  }
+  close_listeners(server);
+  server->accept_pending = 0;
+
+  lightning_server_start_draining(server);
+
+  for(int fd = 0; fd < server->max_connections; fd++)
+  {
+    if(lightning_server_connection_idle(&server->connections[fd]))
+    {
+      close_connection(server, fd);
+    }
+  }
+}
+
+void lightning_server_set_backend(struct lightning_server *server, enum lightning_backend backend)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  server->backend = backend;
+}
+
+void lightning_server_set_body_limits(struct lightning_server *server, size_t max_body_size, size_t spill_threshold)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  server->max_body_size = max_body_size;
+  server->body_spill_threshold = spill_threshold;
+}
+
+void lightning_server_set_shared_cache(struct lightning_server *server, struct lightning_shared_response_cache *shared, int reader)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  server->shared_responses = shared;
+  server->shared_reader = reader;
+}
+
+void lightning_server_set_access_log(struct lightning_server *server, struct lightning_access_ring *ring)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  server->access_log = ring;
+}
+
+void lightning_server_set_router(struct lightning_server *server, const struct lightning_router *router)
+{
+  if(server == NULL)
+  {
+    return;
+  }
+
+  server->router = router;
 }
 
 void lightning_destroy_server(struct lightning_server *server)
@@ -264,129 +625,175 @@ void lightning_destroy_server(struct lightning_server *server)
   for(int i = 0; i < server->max_connections; i++)
   {
     struct lightning_connection *conn = &server->connections[i];
-    int current_fd = lightning_connection_get_fd(conn);
-    if(current_fd >= 0)
+    if(conn->state != CONN_STATE_CLOSED)
     {
       lightning_connection_close(conn);
+      lightning_connection_reset(conn);
     }
-    lightning_connection_reset(conn);
   }
 
   free(server->connections);
+  close(server->wake_fd);
+  lightning_static_cache_destroy(&server->files);
+  lightning_response_cache_destroy(&server->responses);
+  lightning_pool_destroy(&server->read_pool);
+  lightning_pool_destroy(&server->write_pool);
+  lightning_pool_destroy(&server->arena_pool);
 
   if(server->epoll_fd >= 0)
   {
     close(server->epoll_fd);
   }
 
-  if(server->socket_fd >= 0)
+  // A handed over socket still listens in the next generation.
+  for(int i = 0; i < server->listen_count && !server->handed_off; i++)
   {
-    shutdown(server->socket_fd, SHUT_RDWR);
-    close(server->socket_fd);
+    if(server->listen_fds[i] >= 0)
+    {
+      shutdown(server->listen_fds[i], SHUT_RDWR);
+    }
   }
+  close_listeners(server);
 
+  lightning_metrics_destroy(server->metrics);
   free(server);
 }
 
-static void accept_new_connection(struct lightning_server *server)
+/*
+ * Accepts a batch of connections from the listener, or everything in its
+ * queue when sweeping it before it is closed. The listener stays pending
+ * while its queue may not be empty: edge-triggered, it gets no new event
+ * for the connections left there.
+ */
+static void accept_connections(struct lightning_server *server, int listener, bool sweep)
 {
-  while(1)
+  int listen_fd = server->listen_fds[listener];
+  uint32_t bit = (uint32_t)1 << listener;
+
+  for(int accepted = 0; sweep || accepted < server->accept_batch; accepted++)
   {
-    struct sockaddr_in client_addr;
+    if(!sweep && lightning_server_accept_paused(server))
+    {
+      return;
+    }
+
+    union lightning_socket_address client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
 
-    int client_fd = accept(server->socket_fd, (struct sockaddr *)&client_addr, &client_addr_len);
+    // Nagle is off on the listening socket, accepted sockets inherit it.
+    int client_fd = accept4(listen_fd, &client_addr.any, &client_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if(client_fd == -1)
     {
-      if(errno == EAGAIN || errno == EWOULDBLOCK)
-      {
-        break;
-      }
-      else
+      if(errno != EAGAIN && errno != EWOULDBLOCK)
       {
         fprintf(stderr, "accept() error: %s\n", strerror(errno));
-        break;
       }
+      server->accept_pending &= ~bit;
+      return;
     }
 
-    if(set_socket_nonblocking(client_fd) == -1)
-    {
-      fprintf(stderr, "Error: Failed to set client socket non-blocking.\n");
-      close(client_fd);
-      continue;
-    }
-
-    optimize_socket(client_fd);
-
-    if(client_fd >= server->max_connections)
-    {
-      char error_buffer[] = "Error.";
-      send(client_fd, error_buffer, sizeof(error_buffer), 0);
-      close(client_fd);
-      continue;
-    }
-
-    static int max_fd_seen = 0;
-    if(client_fd > max_fd_seen)
-    {
-      max_fd_seen = client_fd;
-    }
-
-    struct lightning_connection *conn = &server->connections[client_fd];
-
+    struct lightning_connection *conn = lightning_server_open_connection(server, client_fd, &client_addr);
     if(conn == NULL)
     {
-      return;
+      continue;
     }
 
-    conn->fd = client_fd;
-    conn->state = CONN_STATE_READING_REQUEST;
-
-    memset(conn->read_buffer, 0, sizeof(conn->read_buffer));
-    conn->read_pos = 0;
-    conn->read_total = 0;
-
-    memset(conn->write_buffer, 0, sizeof(conn->write_buffer));
-    conn->write_total = 0;
-    conn->write_pos = 0;
-
-    memcpy(&conn->client_addr, &client_addr, sizeof(struct sockaddr_in));
-
-    conn->last_activity = time(NULL);
-
     struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
     ev.data.fd = client_fd;
 
     if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1)
     {
       fprintf(stderr, "epoll_ctl() failed for client fd %d: %s\n", client_fd, strerror(errno));
       close(client_fd);
-      lightning_connection_reset(conn);
+      lightning_server_release_connection(server, conn);
       continue;
     }
-
-    server->active_connections++;
-    server->total_connections_accepted++;
   }
 }
 
-static int set_socket_nonblocking(int fd)
+static void accept_pending_connections(struct lightning_server *server)
 {
-  int flags = fcntl(fd, F_GETFL, 0);
-  if(flags == -1)
+  for(int i = 0; i < server->listen_count && server->accept_pending != 0; i++)
   {
-    return -1;
+    if((server->accept_pending & ((uint32_t)1 << i)) && server->listen_fds[i] >= 0)
+    {
+      accept_connections(server, i, false);
+    }
   }
-  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-static void optimize_socket(int fd)
+struct lightning_connection *lightning_server_open_connection(struct lightning_server *server, int fd, const union lightning_socket_address *addr)
 {
-  int flag = 1;
-  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
-  setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &flag, sizeof(flag));
-}
+  if(fd >= server->max_connections || (server->shedding && server->shed_mode == LIGHTNING_SHED_REJECT))
+  {
+    lightning_server_shed_connection(server, fd);
+    return NULL;
+  }
+
+  struct lightning_connection *conn = &server->connections[fd];
+
+  lightning_connection_init(conn, fd, addr);
+  lightning_arena_init(&conn->arena, &server->arena_pool, &server->arena_stats);
+  conn->last_activity = server->now_ms;
+  lightning_server_update_timer(server, conn);
+  server->active_connections++;
+  lightning_metrics_add(&server->metrics->connections_opened, 1);
+
+  // Takes effect for the rest of the accept batch already.
+  if(server->max_active_connections > 0 && server->active_connections >= server->max_active_connections && !server->shedding)
+  {
+    server->shedding = true;
+    lightning_metrics_add(&server->metrics->overloads, 1);
+  }
+
+  return conn;
+}
+
+void lightning_server_release_connection(struct lightning_server *server, struct lightning_connection *conn)
+{
+  lightning_timer_cancel(&server->timers, &conn->timer);
+  lightning_connection_release_file(conn);
+
+  // A response waiting for room in write_buffer may still pin a file.
+  if(conn->response_pending && conn->response->file != NULL)
+  {
+    lightning_static_file_release(conn->response->file);
+  }
+
+  // Streaming callbacks that will never see the end of their request.
+  if(conn->body_target != NULL && conn->body_target->body_handler != NULL)
+  {
+    conn->body_target->body_handler(conn->request, NULL, 0, conn->body_target->user_data);
+  }
+
+  if(conn->producer != NULL)
+  {
+    conn->producer(NULL, 0, conn->producer_data);
+  }
+
+  if(conn->response_pending && conn->response->producer != NULL)
+  {
+    conn->response->producer(NULL, 0, conn->response->producer_data);
+  }
+
+  lightning_body_store_release(&conn->body_store);
+  lightning_arena_reset(&conn->arena);
+
+  lightning_connection_release_read_buffer(conn, &server->read_pool);
+  lightning_connection_release_write_buffer(conn, &server->write_pool);
+  lightning_connection_reset(conn);
+  server->active_connections--;
+  lightning_metrics_add(&server->metrics->connections_closed, 1);
+}
+
+void lightning_server_shed_connection(struct lightning_server *server, int fd)
+{
+  // Fresh connection, empty send buffer: it fits or the client is gone.
+  send(fd, lightning_overloaded_response, sizeof(lightning_overloaded_response) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+  close(fd);
+  lightning_metrics_add(&server->metrics->connections_shed, 1);
+}
 
 static void close_connection(struct lightning_server *server, int fd)
 {
@@ -396,24 +803,37 @@ static void close_connection(struct lightning_server *server, int fd)
   }
 
   struct lightning_connection *conn = &server->connections[fd];
-  if(conn->fd == -1)
+  if(conn->state == CONN_STATE_CLOSED)
   {
     return;
   }
 
   epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
   close(fd);
-  lightning_connection_reset(conn);
-  server->active_connections--;
+  lightning_server_release_connection(server, conn);
 }
 
 static void handle_client_read(struct lightning_server *server, int fd)
 {
   struct lightning_connection *conn = &server->connections[fd];
 
+  // Responses still waiting for EPOLLOUT: leave further input in the socket
+  // until they are out, handle_client_write comes back here.
+  if(conn->write_total > 0)
+  {
+    return;
+  }
+
+  if(lightning_connection_acquire_read_buffer(conn, &server->read_pool) == -1)
+  {
+    LIGHTNING_ERROR("can not allocate a read buffer");
+    close_connection(server, fd);
+    return;
+  }
+
   while(1)
   {
-    size_t remaining = LIGHTNING_READ_BUFFER_SIZE - conn->read_pos;
+    size_t remaining = server->read_buffer_size - conn->read_pos;
     if(remaining == 0)
     {
       fprintf(stderr, "Read buffer full for fd %d\n", fd);
@@ -426,38 +846,36 @@ static void handle_client_read(struct lightning_server *server, int fd)
     if(data_length > 0)
     {
       conn->read_pos += data_length;
-      conn->last_activity = time(NULL);
+      conn->last_activity = server->now_ms;
+      lightning_metrics_add(&server->metrics->bytes_in, (uint64_t)data_length);
 
-      if(is_request_complete(conn))
+      if(lightning_server_process_requests(server, conn) == -1)
       {
-        conn->write_total = lightning_default_response_length;
+        close_connection(server, fd);
+        return;
+      }
 
-        if(conn->write_total > LIGHTNING_WRITE_BUFFER_SIZE)
+      if(conn->write_total > 0)
+      {
+        int flushed = flush_connection(server, conn);
+        if(flushed == -1)
         {
-          LIGHTNING_ERROR("response exceeds write buffer size");
           close_connection(server, fd);
           return;
         }
 
-        memcpy(conn->write_buffer, lightning_default_response, lightning_default_response_length);
-
-        conn->write_pos = 0;
-        conn->state = CONN_STATE_WRITING_RESPONSE;
-
-        struct epoll_event ev;
-        ev.events = EPOLLOUT | EPOLLRDHUP | EPOLLET;
-        ev.data.fd = fd;
-
-        if(epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1)
+        if(flushed == 0)
         {
-          fprintf(stderr, "Error: epoll_ctl MOD failed for fd %d: %s\n", fd, strerror(errno));
-          close_connection(server, fd);
+          lightning_server_update_timer(server, conn);
+          return;
         }
-        return;
       }
     }
     else if(data_length == 0)
     {
+      // End of the stream. The complete requests before it were answered
+      // and flushed above (or this runs again from handle_client_write once
+      // they are), an unfinished one is dropped.
       close_connection(server, fd);
       return;
     }
@@ -465,6 +883,7 @@ static void handle_client_read(struct lightning_server *server, int fd)
     {
       if(errno == EAGAIN || errno == EWOULDBLOCK)
       {
+        lightning_metrics_add(&server->metrics->reads_would_block, 1);
         break;
       }
       fprintf(stderr, "Error: recv() error on fd %d: %s\n", fd, strerror(errno));
@@ -472,70 +891,1258 @@ static void handle_client_read(struct lightning_server *server, int fd)
       return;
     }
   }
+
+  // Idle keep-alive connections do not hold on to a buffer.
+  lightning_connection_release_idle_read_buffer(conn, &server->read_pool);
+
+  lightning_server_update_timer(server, conn);
 }
 
 static void handle_client_write(struct lightning_server *server, int fd)
 {
   struct lightning_connection *conn = &server->connections[fd];
 
+  // EPOLLOUT is always armed, most of these edges have nothing to send.
+  if(conn->write_total == 0)
+  {
+    return;
+  }
+
+  int flushed = flush_connection(server, conn);
+  if(flushed == -1)
+  {
+    close_connection(server, fd);
+    return;
+  }
+
+  if(flushed == 0)
+  {
+    return;
+  }
+
+  // Input that arrived while we were blocked did not raise a new edge.
+  handle_client_read(server, fd);
+}
+
+/*
+ * Sends the write buffer right after the responses were produced. Returns 1
+ * once everything is out, 0 when the socket is full and the rest has to wait
+ * for EPOLLOUT, -1 on error or once a Connection: close response is out.
+ */
+static int flush_connection(struct lightning_server *server, struct lightning_connection *conn)
+{
+  conn->state = CONN_STATE_WRITING_RESPONSE;
+  lightning_metrics_add(&server->metrics->flushes, 1);
+
   while(1)
   {
-    size_t remaining = conn->write_total - conn->write_pos;
-    ssize_t n = send(fd, conn->write_buffer + conn->write_pos, remaining, 0);
+    ssize_t n;
+
+    if(conn->output_index < conn->output_count)
+    {
+      struct msghdr message;
+      memset(&message, 0, sizeof(message));
+      message.msg_iov = conn->output + conn->output_index;
+      message.msg_iovlen = conn->output_count - conn->output_index;
+
+      n = sendmsg(conn->fd, &message, MSG_NOSIGNAL);
+    }
+    else
+    {
+      // Only the file segment is left: straight from the page cache.
+      n = sendfile(conn->fd, conn->file->fd, &conn->file_offset, conn->file_remaining);
+      if(n == 0)
+      {
+        fprintf(stderr, "sendfile() on fd %d: file shrank while being sent\n", conn->fd);
+        return -1;
+      }
+
+      if(n > 0)
+      {
+        conn->file_remaining -= n;
+      }
+    }
 
     if(n > 0)
     {
-      conn->write_pos += n;
-      conn->last_activity = time(NULL);
-      if(conn->write_pos >= conn->write_total)
+      conn->last_activity = server->now_ms;
+      if(lightning_server_output_sent(server, conn, n) == 0)
       {
-        conn->read_pos = 0;
-        conn->write_pos = 0;
-        conn->write_total = 0;
-        conn->state = CONN_STATE_READING_REQUEST;
+        // Requests that did not fit in the previous batch of responses are
+        // still waiting in the read buffer.
+        if(lightning_server_process_requests(server, conn) == -1)
+        {
+          return -1;
+        }
 
-        struct epoll_event ev;
-        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
-        ev.data.fd = fd;
+        if(conn->write_total > 0)
+        {
+          continue;
+        }
 
-        if(epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1)
+        if(conn->close_after_response)
         {
-          fprintf(stderr, "Error: epoll_ctl MOD failed for fd %d: %s\n", fd, strerror(errno));
-          close_connection(server, fd);
+          return -1;
         }
-        return;
+
+        lightning_connection_release_write_buffer(conn, &server->write_pool);
+        conn->state = CONN_STATE_READING_REQUEST;
+        return 1;
       }
     }
     else if(n < 0)
     {
       if(errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+        lightning_metrics_add(&server->metrics->writes_would_block, 1);
+        return 0;
+      }
+      if(errno != EPIPE && errno != ECONNRESET)
+      {
+        fprintf(stderr, "send() error on fd %d: %s\n", conn->fd, strerror(errno));
+      }
+      return -1;
+    }
+  }
+}
+
+int lightning_server_process_requests(struct lightning_server *server, struct lightning_connection *conn)
+{
+  uint64_t now_ns = 0;
+
+  if(conn->response_pending && queue_response(server, conn) == -1)
+  {
+    return -1;
+  }
+
+  // A queued file or chunked body goes last: the next response waits until
+  // it is sent. Nothing is read after a Connection: close.
+  while(conn->read_start < conn->read_pos && !conn->response_pending && conn->file == NULL && conn->producer == NULL &&
+        !conn->close_after_response)
+  {
+    if(conn->body_streaming)
+    {
+      int fed = feed_body(server, conn);
+      if(fed == -1)
+      {
+        return -1;
+      }
+
+      if(fed == 0)
       {
         break;
       }
-      fprintf(stderr, "send() error on fd %d: %s\n", fd, strerror(errno));
-      close_connection(server, fd);
-      return;
+      now_ns = lightning_clock_ns();
+    }
+    else
+    {
+      uint64_t parse_started = lightning_clock_ns();
+      enum lightning_parse_result result = lightning_http_parse(&conn->parser, conn->request, conn->read_buffer, conn->read_pos);
+      now_ns = lightning_clock_ns();
+      conn->parse_ns += now_ns - parse_started;
+
+      if(result == LIGHTNING_PARSE_ERROR)
+      {
+        lightning_metrics_add(&server->metrics->parse_errors, 1);
+        return -1;
+      }
+
+      if(result == LIGHTNING_PARSE_INCOMPLETE)
+      {
+        if(!lightning_http_parser_body_streams(&conn->parser, conn->request, server->read_buffer_size))
+        {
+          break;
+        }
+
+        // The body passes through the room left after the headers, so they
+        // are moved to the front first. Earlier responses go out before the
+        // body is read, which keeps 100 Continue in order.
+        if(conn->read_start > 0)
+        {
+          compact_read_buffer(conn);
+          continue;
+        }
+
+        if(conn->write_total > 0)
+        {
+          break;
+        }
+
+        if(start_body(server, conn) == -1)
+        {
+          return -1;
+        }
+        continue;
+      }
+    }
+
+    uint64_t handle_started = now_ns;
+    int status = process_request(server, conn);
+    if(status == -1)
+    {
+      return -1;
+    }
+
+    // Without room for the default response the request is parsed and
+    // handled again later, it counts then.
+    if(status == 0 || conn->response_pending)
+    {
+      now_ns = lightning_clock_ns();
+      lightning_metrics_record(server->metrics, LIGHTNING_PHASE_PARSE, conn->parse_ns);
+      lightning_metrics_record(server->metrics, LIGHTNING_PHASE_HANDLE, now_ns - handle_started);
+      lightning_metrics_add(&server->metrics->requests, 1);
+      if(server->access_log != NULL)
+      {
+        log_access(server, conn, conn->parse_ns + now_ns - handle_started);
+      }
+      conn->parse_ns = 0;
+    }
+
+    if(status == 1)
+    {
+      // No room left in write_buffer: keep the parsed request and answer it
+      // once the queued responses have been flushed.
+      break;
     }
+
+    conn->read_start = conn->parser.end;
+    lightning_http_parser_init(&conn->parser, conn->read_start);
+  }
+
+  if(conn->producer != NULL && produce_chunk(server, conn) == -1)
+  {
+    return -1;
+  }
+
+  // The write phase starts with the first response queued.
+  if(conn->write_total > conn->write_pos && conn->write_started_ns == 0)
+  {
+    conn->write_started_ns = now_ns != 0 ? now_ns : lightning_clock_ns();
+  }
+
+  if(conn->read_start == conn->read_pos)
+  {
+    conn->read_start = 0;
+    conn->read_pos = 0;
+    lightning_http_parser_init(&conn->parser, 0);
+  }
+  else if(conn->read_start > 0)
+  {
+    compact_read_buffer(conn);
   }
+
+  return 0;
+}
+
+static void compact_read_buffer(struct lightning_connection *conn)
+{
+  // Move the partial request to the front. Its slices are offsets into the
+  // old layout, so it is parsed again from the start on the next pass.
+  conn->read_pos -= conn->read_start;
+  memmove(conn->read_buffer, conn->read_buffer + conn->read_start, conn->read_pos);
+  conn->read_start = 0;
+  lightning_http_parser_init(&conn->parser, 0);
 }
 
-static int is_request_complete(struct lightning_connection *conn)
+/*
+ * The headers are in and the body does not fit behind them (or is
+ * chunked): from now on it streams through the rest of the read buffer.
+ * The route is looked up once so the body knows where to go.
+ */
+static int start_body(struct lightning_server *server, struct lightning_connection *conn)
 {
-  if(conn == NULL || conn->read_pos == 0)
+  struct lightning_http_request *request = conn->request;
+  const struct lightning_route_target *target = NULL;
+
+  request->buffer = conn->read_buffer;
+  request->arena = &conn->arena;
+
+  if(request->content_length > server->max_body_size)
   {
-    return 0;
+    return -1;
+  }
+
+  conn->body_target = NULL;
+  if(lightning_router_count(server->router) > 0 &&
+     lightning_router_match(server->router, request, &target, NULL) == LIGHTNING_ROUTE_FOUND &&
+     target->directory == NULL)
+  {
+    conn->body_target = target;
   }
 
-  for(size_t i = 0; i < conn->read_pos - 3; i++)
+  size_t expect_length = 0;
+  const char *expect = lightning_request_header(request, "Expect", &expect_length);
+
+  if(expect != NULL && expect_length == 12 && strncasecmp(expect, "100-continue", 12) == 0)
   {
-    if(conn->read_buffer[i] == '\r' &&
-       conn->read_buffer[i + 1] == '\n' &&
-       conn->read_buffer[i + 2] == '\r' &&
-       conn->read_buffer[i + 3] == '\n')
+    if(lightning_connection_acquire_write_buffer(conn, &server->write_pool) == -1)
     {
-      return 1;
+      LIGHTNING_ERROR("can not allocate a write buffer");
+      return -1;
+    }
+
+    memcpy(conn->write_buffer + conn->write_used, lightning_continue_response, sizeof(lightning_continue_response) - 1);
+    lightning_connection_output_buffer(conn, sizeof(lightning_continue_response) - 1);
+  }
+
+  lightning_http_body_reader_init(&conn->body_reader, request);
+  lightning_body_store_release(&conn->body_store);
+  conn->body_streaming = true;
+  return 0;
+}
+
+/*
+ * Hands the body bytes in the read buffer to their route and drops them, so
+ * a body of any size passes through the same buffer. Returns 1 once the
+ * body is complete, 0 when more input is needed and -1 on error.
+ */
+static int feed_body(struct lightning_server *server, struct lightning_connection *conn)
+{
+  size_t offset = conn->request->body.offset;
+  size_t position = offset;
+  enum lightning_parse_result result = conn->body_reader.state == BODY_STATE_DONE ? LIGHTNING_PARSE_COMPLETE : LIGHTNING_PARSE_INCOMPLETE;
+
+  while(result == LIGHTNING_PARSE_INCOMPLETE && position < conn->read_pos)
+  {
+    const char *payload;
+    size_t payload_length;
+    size_t consumed;
+
+    result = lightning_http_body_read(&conn->body_reader, conn->read_buffer + position, conn->read_pos - position,
+                                      &consumed, &payload, &payload_length);
+
+    if(result == LIGHTNING_PARSE_ERROR)
+    {
+      lightning_metrics_add(&server->metrics->parse_errors, 1);
+      return -1;
     }
+
+    if(payload_length > 0 && deliver_body(server, conn, payload, payload_length) == -1)
+    {
+      return -1;
+    }
+
+    if(consumed == 0)
+    {
+      break;
+    }
+    position += consumed;
+  }
+
+  if(result == LIGHTNING_PARSE_COMPLETE)
+  {
+    // What follows the body is the next pipelined request.
+    conn->request->body.length = 0;
+    conn->parser.end = position;
+    return 1;
+  }
+
+  // Only an unfinished chunk line is kept.
+  memmove(conn->read_buffer + offset, conn->read_buffer + position, conn->read_pos - position);
+  conn->read_pos = offset + (conn->read_pos - position);
+  return 0;
+}
+
+static int deliver_body(struct lightning_server *server, struct lightning_connection *conn, const char *data, size_t length)
+{
+  const struct lightning_route_target *target = conn->body_target;
+
+  if(conn->body_reader.total > server->max_body_size)
+  {
+    return -1;
+  }
+
+  // 404, 405 and static files: nobody reads it, it only has to go.
+  if(target == NULL)
+  {
+    return 0;
+  }
+
+  if(target->body_handler != NULL)
+  {
+    return target->body_handler(conn->request, data, length, target->user_data) == -1 ? -1 : 0;
+  }
+
+  if(lightning_body_store_append(&conn->body_store, data, length, server->body_spill_threshold) == -1)
+  {
+    LIGHTNING_ERROR("can not store the request body");
+    return -1;
   }
 
   return 0;
 }
+
+/*
+ * Frames the next chunk of a chunked response in write_buffer. Waits for
+ * the queue to drain when there is too little room left for a useful chunk.
+ */
+static int produce_chunk(struct lightning_server *server, struct lightning_connection *conn)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  if(lightning_connection_acquire_write_buffer(conn, &server->write_pool) == -1)
+  {
+    LIGHTNING_ERROR("can not allocate a write buffer");
+    return -1;
+  }
+
+  size_t available = LIGHTNING_WRITE_BUFFER_SIZE - conn->write_used;
+  if(available < LIGHTNING_CHUNK_MIN_ROOM || conn->output_count == LIGHTNING_WRITE_IOV_MAX)
+  {
+    return 0;
+  }
+
+  char *output = conn->write_buffer + conn->write_used;
+  size_t header_length = conn->producer_unframed ? 0 : LIGHTNING_CHUNK_HEADER_LENGTH;
+  size_t capacity = conn->producer_unframed ? available : available - LIGHTNING_CHUNK_FRAMING;
+  ssize_t produced = conn->producer(output + header_length, capacity, conn->producer_data);
+
+  if(produced < 0 || (size_t)produced > capacity)
+  {
+    conn->producer = NULL;
+    conn->producer_data = NULL;
+    return -1;
+  }
+
+  if(produced == 0)
+  {
+    conn->producer = NULL;
+    conn->producer_data = NULL;
+    if(conn->producer_unframed)
+    {
+      // close_after_response is set: the close ends the body.
+      return 0;
+    }
+    memcpy(output, "0\r\n\r\n", 5);
+    return lightning_connection_output_buffer(conn, 5);
+  }
+
+  if(conn->producer_unframed)
+  {
+    return lightning_connection_output_buffer(conn, produced);
+  }
+
+  // Fixed width so the size goes in front of data that is already there.
+  for(int i = 3; i >= 0; i--)
+  {
+    output[3 - i] = hex[((size_t)produced >> (i * 4)) & 0xf];
+  }
+  output[4] = '\r';
+  output[5] = '\n';
+  output[LIGHTNING_CHUNK_HEADER_LENGTH + produced] = '\r';
+  output[LIGHTNING_CHUNK_HEADER_LENGTH + produced + 1] = '\n';
+  return lightning_connection_output_buffer(conn, LIGHTNING_CHUNK_FRAMING + produced);
+}
+
+static int process_request(struct lightning_server *server, struct lightning_connection *conn)
+{
+  if(lightning_router_count(server->router) == 0)
+  {
+    size_t length = lightning_default_response_head_length + LIGHTNING_DATE_HEADER_LENGTH + lightning_default_response_length;
+
+    if(conn->write_used + length > LIGHTNING_WRITE_BUFFER_SIZE ||
+       conn->output_count == LIGHTNING_WRITE_IOV_MAX)
+    {
+      return 1;
+    }
+
+    if(lightning_connection_acquire_write_buffer(conn, &server->write_pool) == -1)
+    {
+      LIGHTNING_ERROR("can not allocate a write buffer");
+      return -1;
+    }
+
+    conn->state = CONN_STATE_PROCESSING;
+    conn->served = true;
+    conn->body_streaming = false;
+    conn->close_after_response = !conn->request->keep_alive || server->draining;
+    char *output = conn->write_buffer + conn->write_used;
+    memcpy(output, lightning_default_response_head, lightning_default_response_head_length);
+    output += lightning_default_response_head_length;
+    memcpy(output, server->date.header, LIGHTNING_DATE_HEADER_LENGTH);
+    output += LIGHTNING_DATE_HEADER_LENGTH;
+
+    if(conn->close_after_response)
+    {
+      memcpy(output, lightning_default_response_close, lightning_default_response_close_length);
+      length += lightning_default_response_close_length - lightning_default_response_length;
+    }
+    else
+    {
+      memcpy(output, lightning_default_response, lightning_default_response_length);
+    }
+    return lightning_connection_output_buffer(conn, length);
+  }
+
+  struct lightning_http_request *request = conn->request;
+  struct lightning_http_response *response = conn->response;
+  const struct lightning_route_target *target = NULL;
+
+  request->buffer = conn->read_buffer;
+  request->arena = &conn->arena;
+  lightning_response_init(response);
+  response->arena = &conn->arena;
+  conn->close_after_response = !request->keep_alive || server->draining;
+  response->connection_close = conn->close_after_response;
+  conn->response_head_only = request->method == HTTP_HEAD;
+
+  unsigned allowed = 0;
+
+  switch(lightning_router_match(server->router, request, &target, &allowed))
+  {
+    case LIGHTNING_ROUTE_FOUND:
+      conn->state = CONN_STATE_PROCESSING;
+      if(target->directory != NULL)
+      {
+        serve_static(server, conn, target->directory);
+        break;
+      }
+
+      // Requests with a body always reach the handler, and are not stored.
+      if(target->cache != NULL && request->content_length == 0 && !request->chunked)
+      {
+        const struct lightning_cached_response *cached = lookup_cached(server, conn, target->cache);
+        if(cached != NULL)
+        {
+          return queue_cached(server, conn, cached);
+        }
+
+        target->handler(request, response, target->user_data);
+        // Answered from the new entry, before the cache may free it, so
+        // validators and ranges apply to the miss too; the plain response
+        // is still there without room.
+        struct lightning_cached_response *entry = create_cached(server, conn, target->cache);
+        if(entry != NULL)
+        {
+          int status = queue_cached(server, conn, entry);
+          store_cached(server, entry);
+          if(status != 1)
+          {
+            return status;
+          }
+        }
+        break;
+      }
+
+      if(conn->body_streaming)
+      {
+        request->body_data = lightning_body_store_finish(&conn->body_store);
+        request->body_data_length = conn->body_store.length;
+        conn->body_target = NULL;
+
+        if(request->body_data == NULL && conn->body_store.length > 0)
+        {
+          LIGHTNING_ERROR("can not map the request body");
+          return -1;
+        }
+      }
+      else if(target->body_handler != NULL && request->body.length > 0 &&
+              target->body_handler(request, request->buffer + request->body.offset, request->body.length, target->user_data) == -1)
+      {
+        return -1;
+      }
+
+      target->handler(request, response, target->user_data);
+      break;
+
+    case LIGHTNING_ROUTE_METHOD_NOT_ALLOWED:
+      lightning_response_status(response, 405);
+      add_allow_header(response, allowed);
+      break;
+
+    case LIGHTNING_ROUTE_NOT_IMPLEMENTED:
+      lightning_response_status(response, 501);
+      break;
+
+    case LIGHTNING_ROUTE_NOT_FOUND:
+    default:
+      lightning_response_status(response, 404);
+      break;
+  }
+
+  // A collected body stays until the response that may point into it is
+  // sent (lightning_connection_output_sent).
+  conn->body_streaming = false;
+  return queue_response(server, conn);
+}
+
+/*
+ * The head always goes into write_buffer. Small bodies are copied after it
+ * so pipelined responses leave in one segment; larger ones are sent straight
+ * from the handler's memory.
+ */
+static int queue_response(struct lightning_server *server, struct lightning_connection *conn)
+{
+  if(lightning_connection_acquire_write_buffer(conn, &server->write_pool) == -1)
+  {
+    LIGHTNING_ERROR("can not allocate a write buffer");
+    return -1;
+  }
+
+  conn->served = true;
+  struct lightning_http_response *response = conn->response;
+
+  // HTTP/1.0 has no chunked coding: the producer's output goes as is and
+  // the close marks its end.
+  if(response->producer != NULL && conn->request->version_minor == 0)
+  {
+    response->close_delimited = true;
+    response->connection_close = true;
+    conn->close_after_response = true;
+  }
+  size_t available = LIGHTNING_WRITE_BUFFER_SIZE - conn->write_used;
+  size_t head_length = available;
+
+  // A response takes two segments, head (+ copied body) and body, or one
+  // more than its multipart segments.
+  unsigned segments = 2 + response->segments_count;
+  if(conn->output_count + segments <= LIGHTNING_WRITE_IOV_MAX)
+  {
+    head_length = lightning_response_serialize_head(response, &server->date, conn->write_buffer + conn->write_used, available);
+  }
+
+  if(conn->output_count + segments > LIGHTNING_WRITE_IOV_MAX || head_length > available)
+  {
+    if(conn->write_total > 0)
+    {
+      // Serialized again once the queued responses are flushed.
+      conn->response_pending = true;
+      return 0;
+    }
+
+    LIGHTNING_ERROR("response head exceeds write buffer size");
+    return -1;
+  }
+
+  // Statuses without a body drop it like a HEAD response.
+  bool head_only = conn->response_head_only || !lightning_status_has_body(response->status_code);
+  size_t body_length = head_only ? 0 : response->body_length;
+
+  if(response->producer != NULL)
+  {
+    lightning_connection_output_buffer(conn, head_length);
+
+    if(head_only)
+    {
+      response->producer(NULL, 0, response->producer_data);
+    }
+    else
+    {
+      conn->producer = response->producer;
+      conn->producer_data = response->producer_data;
+      conn->producer_unframed = response->close_delimited;
+    }
+  }
+  else if(response->file != NULL)
+  {
+    lightning_connection_output_buffer(conn, head_length);
+
+    if(head_only)
+    {
+      lightning_static_file_release(response->file);
+    }
+    else if(response->segments != NULL)
+    {
+      for(unsigned short i = 0; i < response->segments_count; i++)
+      {
+        lightning_connection_output_external(conn, response->segments[i].data, response->segments[i].length);
+      }
+      // Keeps the mapping the segments point into until they are sent.
+      lightning_connection_output_file(conn, response->file, 0, 0);
+    }
+    else
+    {
+      lightning_connection_output_file(conn, response->file, response->file_offset, body_length);
+    }
+  }
+  else if(body_length <= LIGHTNING_RESPONSE_COPY_LIMIT && head_length + body_length <= available)
+  {
+    if(body_length > 0)
+    {
+      memcpy(conn->write_buffer + conn->write_used + head_length, response->body, body_length);
+    }
+    lightning_connection_output_buffer(conn, head_length + body_length);
+  }
+  else
+  {
+    lightning_connection_output_buffer(conn, head_length);
+    lightning_connection_output_external(conn, response->body, body_length);
+  }
+
+  conn->response_pending = false;
+  return 0;
+}
+
+// Required with a 405 (RFC 9110, 15.5.6).
+static void add_allow_header(struct lightning_http_response *response, unsigned allowed)
+{
+  char value[64];
+  size_t length = 0;
+
+  value[0] = '\0';
+  for(int method = 0; method < HTTP_UNKNOWN; method++)
+  {
+    if(allowed & (1u << method))
+    {
+      length += snprintf(value + length, sizeof(value) - length, "%s%s", length > 0 ? ", " : "", lightning_method_name(method));
+    }
+  }
+
+  lightning_response_header(response, "Allow", value);
+}
+
+static void serve_static(struct lightning_server *server, struct lightning_connection *conn, const struct lightning_static_directory *directory)
+{
+  struct lightning_http_response *response = conn->response;
+  struct lightning_static_file *file;
+  size_t length = 0;
+  const char *path = lightning_request_param(conn->request, "path", &length);
+
+  switch(lightning_static_lookup(&server->files, directory, path, length, server->now_ms, &file))
+  {
+    case LIGHTNING_STATIC_FOUND:
+      break;
+
+    case LIGHTNING_STATIC_NOT_FOUND:
+      lightning_response_status(response, 404);
+      return;
+
+    case LIGHTNING_STATIC_ERROR:
+    default:
+      lightning_response_status(response, 500);
+      return;
+  }
+
+  struct lightning_byte_range ranges[LIGHTNING_RANGES_MAX];
+  int count = 0;
+  char content_range[64];
+
+  if(lightning_request_not_modified(conn->request, file->etag, LIGHTNING_ETAG_LENGTH, file->modified.tv_sec))
+  {
+    lightning_response_status(response, 304);
+    add_file_validators(response, file);
+    lightning_static_file_release(file);
+    return;
+  }
+
+  switch(lightning_request_ranges(conn->request, file->size, file->etag, LIGHTNING_ETAG_LENGTH, file->modified.tv_sec, ranges, &count))
+  {
+    case LIGHTNING_RANGE_SATISFIABLE:
+      serve_file_ranges(conn, file, ranges, count);
+      break;
+
+    case LIGHTNING_RANGE_UNSATISFIABLE:
+      snprintf(content_range, sizeof(content_range), "bytes */%zu", file->size);
+      lightning_response_status(response, 416);
+      lightning_response_header(response, "Content-Range", content_range);
+      lightning_static_file_release(file);
+      break;
+
+    case LIGHTNING_RANGE_NONE:
+    default:
+      lightning_response_use_prefix(response, file->prefix);
+      response->body_length = file->size;
+      response->file = file;
+      break;
+  }
+}
+
+/*
+ * One range is sent by offset, from the mapping or with sendfile. Several
+ * make a multipart/byteranges body: the part headers are written to the
+ * arena and the parts point into the mapped file, nothing is copied.
+ */
+static void serve_file_ranges(struct lightning_connection *conn,
+                              struct lightning_static_file *file,
+                              const struct lightning_byte_range *ranges,
+                              int count)
+{
+  struct lightning_http_response *response = conn->response;
+  char content_range[64];
+
+  lightning_response_status(response, 206);
+  add_file_validators(response, file);
+
+  if(count == 1)
+  {
+    snprintf(content_range, sizeof(content_range), "bytes %llu-%llu/%zu", (unsigned long long)ranges[0].first,
+             (unsigned long long)(ranges[0].first + ranges[0].length - 1), file->size);
+    lightning_response_header(response, "Content-Range", content_range);
+    response->content_type = file->content_type;
+    response->body_length = ranges[0].length;
+    response->file = file;
+    response->file_offset = ranges[0].first;
+    return;
+  }
+
+  // The part headers, the closing delimiter and the content type.
+  size_t part_header_max = 160 + strlen(file->content_type);
+  size_t text_size = count * part_header_max + 128;
+  struct lightning_response_segment *segments = lightning_arena_alloc(&conn->arena, (2 * count + 1) * sizeof(*segments));
+  char *text = lightning_arena_alloc(&conn->arena, text_size);
+
+  if(segments == NULL || text == NULL || lightning_static_file_map(file) == -1)
+  {
+    lightning_static_file_release(file);
+    lightning_response_init(response);
+    response->arena = &conn->arena;
+    response->connection_close = conn->close_after_response;
+    lightning_response_status(response, 500);
+    return;
+  }
+
+  char boundary[24];
+  snprintf(boundary, sizeof(boundary), "%016llx", (unsigned long long)(lightning_clock_ns() * 0x9e3779b97f4a7c15ull));
+
+  size_t used = 0;
+  size_t body_length = 0;
+  for(int i = 0; i < count; i++)
+  {
+    int written = snprintf(text + used, part_header_max, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %llu-%llu/%zu\r\n\r\n",
+                           boundary, file->content_type, (unsigned long long)ranges[i].first,
+                           (unsigned long long)(ranges[i].first + ranges[i].length - 1), file->size);
+    segments[2 * i].data = text + used;
+    segments[2 * i].length = written;
+    segments[2 * i + 1].data = file->data + ranges[i].first;
+    segments[2 * i + 1].length = ranges[i].length;
+    used += written;
+    body_length += written + ranges[i].length;
+  }
+
+  int written = snprintf(text + used, text_size - used, "\r\n--%s--\r\n", boundary);
+  segments[2 * count].data = text + used;
+  segments[2 * count].length = written;
+  body_length += written;
+  used += written + 1;
+
+  snprintf(text + used, text_size - used, "multipart/byteranges; boundary=%s", boundary);
+  response->content_type = text + used;
+  response->body_length = body_length;
+  response->segments = segments;
+  response->segments_count = 2 * count + 1;
+  response->file = file;
+}
+
+static void add_file_validators(struct lightning_http_response *response, const struct lightning_static_file *file)
+{
+  char etag[LIGHTNING_ETAG_LENGTH + 1];
+  char last_modified[LIGHTNING_HTTP_DATE_LENGTH + 1];
+
+  memcpy(etag, file->etag, LIGHTNING_ETAG_LENGTH);
+  etag[LIGHTNING_ETAG_LENGTH] = '\0';
+  lightning_http_date_format(last_modified, file->modified.tv_sec);
+  last_modified[LIGHTNING_HTTP_DATE_LENGTH] = '\0';
+
+  lightning_response_header(response, "ETag", etag);
+  lightning_response_header(response, "Last-Modified", last_modified);
+}
+
+static const struct lightning_cached_response *lookup_cached(struct lightning_server *server,
+                                                             struct lightning_connection *conn,
+                                                             const struct lightning_cache_rule *rule)
+{
+  char key[LIGHTNING_RESPONSE_CACHE_KEY_MAX];
+  size_t key_length;
+  uint32_t hash;
+  const struct lightning_cached_response *entry = NULL;
+
+  if(!lightning_response_cache_key(rule, conn->request, key, &key_length, &hash))
+  {
+    return NULL;
+  }
+
+  if(rule->shared)
+  {
+    entry = lightning_shared_cache_lookup(server->shared_responses, rule, key, key_length, hash, server->now_ms);
+  }
+  else
+  {
+    entry = lightning_response_cache_lookup(&server->responses, rule, key, key_length, hash, server->now_ms);
+  }
+
+  lightning_metrics_add(entry != NULL ? &server->metrics->cache_hits : &server->metrics->cache_misses, 1);
+  return entry;
+}
+
+/*
+ * Same contract as process_request. Entries, and their 304 and 206
+ * variants, fit in an empty write buffer, so without room the response
+ * waits for the queued ones to be flushed. Several ranges get the whole
+ * entity.
+ */
+static int queue_cached(struct lightning_server *server, struct lightning_connection *conn, const struct lightning_cached_response *entry)
+{
+  struct lightning_http_response *response = conn->response;
+  struct lightning_byte_range ranges[LIGHTNING_RANGES_MAX];
+  int ranges_count = 0;
+  bool not_modified = false;
+  enum lightning_range_result ranged = LIGHTNING_RANGE_NONE;
+
+  if(entry->etag_length > 0)
+  {
+    not_modified = lightning_request_not_modified(conn->request, entry->etag, entry->etag_length, -1);
+    if(!not_modified)
+    {
+      ranged = lightning_request_ranges(conn->request, entry->body_length, entry->etag, entry->etag_length, -1, ranges, &ranges_count);
+    }
+  }
+
+  if(ranged == LIGHTNING_RANGE_UNSATISFIABLE)
+  {
+    char content_range[64];
+    snprintf(content_range, sizeof(content_range), "bytes */%zu", entry->body_length);
+
+    lightning_response_init(response);
+    response->arena = &conn->arena;
+    response->connection_close = conn->close_after_response;
+    lightning_response_status(response, 416);
+    lightning_response_header(response, "Content-Range", content_range);
+    return queue_response(server, conn);
+  }
+
+  bool partial = ranged == LIGHTNING_RANGE_SATISFIABLE && ranges_count == 1;
+  bool close = conn->close_after_response;
+  bool head_only = conn->response_head_only;
+  size_t length;
+
+  if(not_modified)
+  {
+    length = lightning_cached_response_write_not_modified(entry, &server->date, close, NULL, 0);
+  }
+  else if(partial)
+  {
+    length = lightning_cached_response_write_range(entry, &server->date, close, head_only, &ranges[0], NULL, 0);
+  }
+  else
+  {
+    length = lightning_cached_response_write(entry, &server->date, close, head_only, NULL, 0);
+  }
+
+  if(conn->write_used + length > LIGHTNING_WRITE_BUFFER_SIZE || conn->output_count == LIGHTNING_WRITE_IOV_MAX)
+  {
+    return 1;
+  }
+
+  if(lightning_connection_acquire_write_buffer(conn, &server->write_pool) == -1)
+  {
+    LIGHTNING_ERROR("can not allocate a write buffer");
+    return -1;
+  }
+
+  char *output = conn->write_buffer + conn->write_used;
+  size_t capacity = LIGHTNING_WRITE_BUFFER_SIZE - conn->write_used;
+
+  // What the access log reads.
+  response->status_code = entry->status_code;
+  response->body_length = entry->body_length;
+  conn->served = true;
+
+  if(not_modified)
+  {
+    response->status_code = 304;
+    response->body_length = 0;
+    length = lightning_cached_response_write_not_modified(entry, &server->date, close, output, capacity);
+  }
+  else if(partial)
+  {
+    response->status_code = 206;
+    response->body_length = ranges[0].length;
+    length = lightning_cached_response_write_range(entry, &server->date, close, head_only, &ranges[0], output, capacity);
+  }
+  else
+  {
+    length = lightning_cached_response_write(entry, &server->date, close, head_only, output, capacity);
+  }
+
+  return lightning_connection_output_buffer(conn, length);
+}
+
+static struct lightning_cached_response *create_cached(struct lightning_server *server,
+                                                       struct lightning_connection *conn,
+                                                       const struct lightning_cache_rule *rule)
+{
+  char key[LIGHTNING_RESPONSE_CACHE_KEY_MAX];
+  size_t key_length;
+  uint32_t hash;
+
+  if(!lightning_response_cache_key(rule, conn->request, key, &key_length, &hash))
+  {
+    return NULL;
+  }
+
+  return lightning_cached_response_create(rule, key, key_length, hash, conn->response, &server->date, server->now_ms);
+}
+
+// Takes ownership of `entry`.
+static void store_cached(struct lightning_server *server, struct lightning_cached_response *entry)
+{
+  if(entry->rule->shared)
+  {
+    lightning_shared_cache_publish(server->shared_responses, server->shared_reader, entry);
+  }
+  else
+  {
+    lightning_response_cache_store(&server->responses, entry);
+  }
+}
+
+uint64_t lightning_clock_ms(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// Precise (vDSO) clock for the latency histograms.
+uint64_t lightning_clock_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * Only copies the request into the worker's ring, the logger thread does
+ * the rest. Called once the response is queued.
+ */
+static void log_access(struct lightning_server *server, struct lightning_connection *conn, uint64_t duration_ns)
+{
+  struct lightning_access_record *record = lightning_access_ring_reserve(server->access_log, server->metrics);
+
+  if(record == NULL)
+  {
+    return;
+  }
+
+  const struct lightning_http_request *request = conn->request;
+  size_t path_length = request->path.length < LIGHTNING_ACCESS_LOG_PATH_SIZE ? request->path.length : LIGHTNING_ACCESS_LOG_PATH_SIZE;
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  record->time_ns = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+  record->duration_ns = duration_ns;
+  if(conn->client_addr.any.sa_family == AF_INET6)
+  {
+    memcpy(record->address, &conn->client_addr.ipv6.sin6_addr, sizeof(record->address));
+    record->port = conn->client_addr.ipv6.sin6_port;
+  }
+  else if(conn->client_addr.any.sa_family == AF_INET)
+  {
+    static const uint8_t ipv4_mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    memcpy(record->address, ipv4_mapped, sizeof(ipv4_mapped));
+    memcpy(record->address + 12, &conn->client_addr.ipv4.sin_addr, 4);
+    record->port = conn->client_addr.ipv4.sin_port;
+  }
+  else
+  {
+    memset(record->address, 0, sizeof(record->address));
+    record->port = 0;
+  }
+  record->method = (uint8_t)request->method;
+  record->path_length = (uint8_t)path_length;
+  memcpy(record->path, lightning_http_slice_data(conn->read_buffer, request->path), path_length);
+
+  // Without routes the request got the default response.
+  if(lightning_router_count(server->router) == 0)
+  {
+    record->status = 200;
+    record->bytes = lightning_default_body_length;
+  }
+  else
+  {
+    record->status = (uint16_t)conn->response->status_code;
+    record->bytes = conn->response_head_only || conn->response->producer != NULL ? 0 : conn->response->body_length;
+  }
+
+  lightning_access_ring_commit(server->access_log);
+}
+
+size_t lightning_server_output_sent(struct lightning_server *server, struct lightning_connection *conn, size_t sent)
+{
+  size_t remaining = lightning_connection_output_sent(conn, sent);
+  lightning_metrics_add(&server->metrics->bytes_out, sent);
+
+  if(remaining > 0)
+  {
+    lightning_metrics_add(&server->metrics->short_writes, 1);
+  }
+  else if(conn->write_started_ns != 0)
+  {
+    lightning_metrics_record(server->metrics, LIGHTNING_PHASE_WRITE, lightning_clock_ns() - conn->write_started_ns);
+    conn->write_started_ns = 0;
+  }
+
+  return remaining;
+}
+
+void lightning_server_update_timer(struct lightning_server *server, struct lightning_connection *conn)
+{
+  enum lightning_connection_timeout timeout;
+  uint64_t duration;
+
+  if(conn->write_total > 0)
+  {
+    timeout = CONN_TIMEOUT_WRITE;
+    duration = LIGHTNING_WRITE_TIMEOUT_MS;
+  }
+  else if(conn->served && conn->read_pos == 0)
+  {
+    // Between requests. Until the first response the connection is on the
+    // header timeout, from the moment it was accepted.
+    timeout = CONN_TIMEOUT_KEEPALIVE;
+    duration = LIGHTNING_KEEPALIVE_TIMEOUT_MS;
+  }
+  else if(conn->parser.state == PARSER_STATE_BODY)
+  {
+    timeout = CONN_TIMEOUT_BODY;
+    duration = LIGHTNING_BODY_TIMEOUT_MS;
+  }
+  else
+  {
+    timeout = CONN_TIMEOUT_HEADER;
+    duration = LIGHTNING_HEADER_TIMEOUT_MS;
+  }
+
+  // Header and keep-alive deadlines count from the moment the phase started.
+  // Body and write deadlines are idle timeouts: progress only touches
+  // last_activity and the timer re-checks it when it fires.
+  if(timeout == conn->timeout && lightning_timer_pending(&conn->timer))
+  {
+    return;
+  }
+
+  conn->timeout = timeout;
+  lightning_timer_schedule(&server->timers, &conn->timer, server->now_ms + duration);
+}
+
+bool lightning_server_connection_expired(struct lightning_server *server, struct lightning_connection *conn)
+{
+  if(conn->timeout == CONN_TIMEOUT_BODY || conn->timeout == CONN_TIMEOUT_WRITE)
+  {
+    uint64_t duration = conn->timeout == CONN_TIMEOUT_BODY ? LIGHTNING_BODY_TIMEOUT_MS : LIGHTNING_WRITE_TIMEOUT_MS;
+    uint64_t deadline = conn->last_activity + duration;
+
+    if(deadline > server->now_ms)
+    {
+      lightning_timer_schedule(&server->timers, &conn->timer, deadline);
+      return false;
+    }
+  }
+
+  lightning_metrics_add(&server->metrics->timeouts, 1);
+  return true;
+}
+
+int lightning_server_poll_timeout(struct lightning_server *server)
+{
+  int timeout = lightning_timer_wheel_timeout(&server->timers, server->now_ms);
+
+  if(server->draining)
+  {
+    uint64_t left = server->drain_deadline_ms > server->now_ms ? server->drain_deadline_ms - server->now_ms : 0;
+    if(timeout == -1 || (uint64_t)timeout > left)
+    {
+      timeout = (int)left;
+    }
+  }
+
+  if(server->accept_pending != 0 && !lightning_server_accept_paused(server))
+  {
+    return 0;
+  }
+
+  // Recovery is only noticed by a round of the loop.
+  if(server->shedding && (timeout == -1 || timeout > LIGHTNING_ADMISSION_CHECK_MS))
+  {
+    timeout = LIGHTNING_ADMISSION_CHECK_MS;
+  }
+
+  return timeout;
+}
+
+void lightning_server_update_admission(struct lightning_server *server, uint64_t round_started_ns)
+{
+  if(round_started_ns != 0)
+  {
+    uint64_t round_ns = lightning_clock_ns() - round_started_ns;
+    server->loop_delay_ns = server->loop_delay_ns - server->loop_delay_ns / 8 + round_ns / 8;
+  }
+
+  int max_active = server->max_active_connections;
+  uint64_t max_delay = server->max_loop_delay_ns;
+
+  if(!server->shedding)
+  {
+    if((max_active > 0 && server->active_connections >= max_active) || (max_delay > 0 && server->loop_delay_ns >= max_delay))
+    {
+      server->shedding = true;
+      lightning_metrics_add(&server->metrics->overloads, 1);
+    }
+  }
+  else if((max_active == 0 || server->active_connections <= max_active - max_active / 4) &&
+          (max_delay == 0 || server->loop_delay_ns <= max_delay - max_delay / 4))
+  {
+    server->shedding = false;
+  }
+}
+
+bool lightning_server_accept_paused(const struct lightning_server *server)
+{
+  return server->shedding && server->shed_mode == LIGHTNING_SHED_BACKLOG;
+}
+
+void lightning_server_consume_wakeup(struct lightning_server *server)
+{
+  uint64_t value;
+  ssize_t length = read(server->wake_fd, &value, sizeof(value));
+  (void)length;
+}
+
+bool lightning_server_finished(struct lightning_server *server)
+{
+  if(!__atomic_load_n(&server->running, __ATOMIC_ACQUIRE))
+  {
+    return true;
+  }
+
+  // Connections still open at the deadline are closed by
+  // lightning_destroy_server. The listening sockets may outlive the accept
+  // queue sweep (io_uring closes each one once its accept is cancelled).
+  bool listening = false;
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    listening = listening || server->listen_fds[i] >= 0;
+  }
+
+  return server->draining && ((!listening && server->active_connections == 0) ||
+                              server->now_ms >= server->drain_deadline_ms);
+}
+
+bool lightning_server_drain_pending(struct lightning_server *server)
+{
+  return !server->draining && __atomic_load_n(&server->drain_requested, __ATOMIC_ACQUIRE);
+}
+
+void lightning_server_start_draining(struct lightning_server *server)
+{
+  server->draining = true;
+  server->drain_deadline_ms = server->now_ms + LIGHTNING_DRAIN_TIMEOUT_MS;
+  printf("Lightning say: draining %d connections\n", server->active_connections);
+}
+
+bool lightning_server_connection_idle(const struct lightning_connection *conn)
+{
+  return conn->state != CONN_STATE_CLOSED && conn->served && conn->read_pos == 0 && conn->write_total == 0 &&
+         !conn->response_pending && !conn->body_streaming && conn->producer == NULL;
+}
+
+static void handle_connection_timeout(struct lightning_timer *timer, void *data)
+{
+  struct lightning_server *server = data;
+  struct lightning_connection *conn = (struct lightning_connection *)((char *)timer - offsetof(struct lightning_connection, timer));
+
+  if(lightning_server_connection_expired(server, conn))
+  {
+    close_connection(server, conn->fd);
+  }
+}
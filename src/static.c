@@ -0,0 +1,569 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "internal/date.h"
+#include "internal/static.h"
+
+struct mime_type
+{
+  const char *extension;
+  const char *type;
+};
+
+static const struct mime_type mime_types[] = {
+  {"html", "text/html; charset=utf-8"},
+  {"htm", "text/html; charset=utf-8"},
+  {"css", "text/css; charset=utf-8"},
+  {"js", "text/javascript; charset=utf-8"},
+  {"mjs", "text/javascript; charset=utf-8"},
+  {"json", "application/json"},
+  {"map", "application/json"},
+  {"txt", "text/plain; charset=utf-8"},
+  {"xml", "application/xml"},
+  {"svg", "image/svg+xml"},
+  {"png", "image/png"},
+  {"jpg", "image/jpeg"},
+  {"jpeg", "image/jpeg"},
+  {"gif", "image/gif"},
+  {"webp", "image/webp"},
+  {"avif", "image/avif"},
+  {"ico", "image/x-icon"},
+  {"woff", "font/woff"},
+  {"woff2", "font/woff2"},
+  {"ttf", "font/ttf"},
+  {"wasm", "application/wasm"},
+  {"pdf", "application/pdf"},
+  {"mp4", "video/mp4"},
+  {"webm", "video/webm"},
+};
+
+static const char default_mime_type[] = "application/octet-stream";
+
+static size_t build_relative_path(char *output, const char *path, size_t length);
+static uint32_t hash_path(const struct lightning_static_directory *directory, const char *path, size_t length);
+static const char *mime_type_of(const char *path, size_t length);
+static int open_beneath(int directory_fd, const char *path, int flags);
+static struct lightning_static_file *open_file(const struct lightning_static_directory *directory,
+                                               const char *path,
+                                               size_t length,
+                                               enum lightning_static_result *result);
+static void cache_insert(struct lightning_static_cache *cache, struct lightning_static_file *file);
+static void cache_remove(struct lightning_static_cache *cache, struct lightning_static_file *file);
+static void lru_unlink(struct lightning_static_cache *cache, struct lightning_static_file *file);
+static void lru_push_front(struct lightning_static_cache *cache, struct lightning_static_file *file);
+static void free_file(struct lightning_static_file *file);
+
+struct lightning_static_directory *lightning_static_directory_open(const char *path)
+{
+  struct lightning_static_directory *directory = malloc(sizeof(struct lightning_static_directory));
+  if(directory == NULL)
+  {
+    return NULL;
+  }
+
+  directory->next = NULL;
+  directory->fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if(directory->fd == -1)
+  {
+    free(directory);
+    return NULL;
+  }
+
+  return directory;
+}
+
+void lightning_static_directory_close(struct lightning_static_directory *directory)
+{
+  if(directory == NULL)
+  {
+    return;
+  }
+
+  close(directory->fd);
+  free(directory);
+}
+
+void lightning_static_cache_init(struct lightning_static_cache *cache)
+{
+  memset(cache->buckets, 0, sizeof(cache->buckets));
+  cache->lru_head = NULL;
+  cache->lru_tail = NULL;
+  cache->count = 0;
+}
+
+void lightning_static_cache_destroy(struct lightning_static_cache *cache)
+{
+  // Connections are gone by now, references they held do not matter.
+  struct lightning_static_file *file = cache->lru_head;
+  while(file != NULL)
+  {
+    struct lightning_static_file *next = file->lru_next;
+    free_file(file);
+    file = next;
+  }
+
+  lightning_static_cache_init(cache);
+}
+
+enum lightning_static_result lightning_static_lookup(struct lightning_static_cache *cache,
+                                                     const struct lightning_static_directory *directory,
+                                                     const char *path,
+                                                     size_t path_length,
+                                                     uint64_t now_ms,
+                                                     struct lightning_static_file **result)
+{
+  char relative[LIGHTNING_STATIC_PATH_MAX];
+  size_t length = build_relative_path(relative, path, path_length);
+
+  if(length == 0)
+  {
+    return LIGHTNING_STATIC_NOT_FOUND;
+  }
+
+  uint32_t hash = hash_path(directory, relative, length);
+  struct lightning_static_file *file = cache->buckets[hash % LIGHTNING_STATIC_CACHE_ENTRIES];
+
+  while(file != NULL)
+  {
+    if(file->hash == hash && file->directory == directory && file->path_length == length &&
+       memcmp(file->path, relative, length) == 0)
+    {
+      break;
+    }
+    file = file->hash_next;
+  }
+
+  if(file != NULL && now_ms - file->checked_ms >= LIGHTNING_STATIC_REVALIDATE_MS)
+  {
+    // Resolved like open_file does: a link swapped in since the file was
+    // opened is not followed out of the directory to stat its target.
+    struct stat st;
+    int fd = open_beneath(directory->fd, relative, O_PATH);
+    bool unchanged = fd != -1 && fstat(fd, &st) == 0 && st.st_ino == file->inode &&
+                     (size_t)st.st_size == file->size &&
+                     st.st_mtim.tv_sec == file->modified.tv_sec && st.st_mtim.tv_nsec == file->modified.tv_nsec;
+    if(fd != -1)
+    {
+      close(fd);
+    }
+
+    if(unchanged)
+    {
+      file->checked_ms = now_ms;
+    }
+    else
+    {
+      cache_remove(cache, file);
+      file = NULL;
+    }
+  }
+
+  if(file == NULL)
+  {
+    enum lightning_static_result status;
+    file = open_file(directory, relative, length, &status);
+    if(file == NULL)
+    {
+      return status;
+    }
+
+    file->hash = hash;
+    file->checked_ms = now_ms;
+    cache_insert(cache, file);
+  }
+  else if(cache->lru_head != file)
+  {
+    lru_unlink(cache, file);
+    lru_push_front(cache, file);
+  }
+
+  file->references++;
+  *result = file;
+  return LIGHTNING_STATIC_FOUND;
+}
+
+void lightning_static_file_release(struct lightning_static_file *file)
+{
+  file->references--;
+
+  if(file->references == 0 && !file->cached)
+  {
+    free_file(file);
+  }
+}
+
+int lightning_static_file_map(struct lightning_static_file *file)
+{
+  if(file->data != NULL || file->size == 0)
+  {
+    return 0;
+  }
+
+  void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+  if(data == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  file->data = data;
+  return 0;
+}
+
+/*
+ * Turns the captured path into one relative to the directory. Hidden files
+ * and ".." are refused, directories resolve to their index.html. Returns 0
+ * when the path is not acceptable.
+ */
+static size_t build_relative_path(char *output, const char *path, size_t length)
+{
+  static const char index_file[] = "index.html";
+
+  if(length + sizeof(index_file) > LIGHTNING_STATIC_PATH_MAX)
+  {
+    return 0;
+  }
+
+  size_t segment_start = 0;
+  for(size_t i = 0; i <= length; i++)
+  {
+    if(i < length && path[i] == '\0')
+    {
+      return 0;
+    }
+
+    if(i == length || path[i] == '/')
+    {
+      if(i > segment_start && path[segment_start] == '.')
+      {
+        return 0;
+      }
+      segment_start = i + 1;
+    }
+  }
+
+  size_t start = 0;
+  while(start < length && path[start] == '/')
+  {
+    start++;
+  }
+
+  size_t output_length = length - start;
+  if(output_length > 0)
+  {
+    memcpy(output, path + start, output_length);
+  }
+
+  if(output_length == 0 || output[output_length - 1] == '/')
+  {
+    memcpy(output + output_length, index_file, sizeof(index_file) - 1);
+    output_length += sizeof(index_file) - 1;
+  }
+
+  output[output_length] = '\0';
+  return output_length;
+}
+
+static uint32_t hash_path(const struct lightning_static_directory *directory, const char *path, size_t length)
+{
+  // FNV-1a, seeded with the directory so two roots never share entries.
+  uint32_t hash = 2166136261u ^ (uint32_t)((uintptr_t)directory >> 4);
+
+  for(size_t i = 0; i < length; i++)
+  {
+    hash ^= (unsigned char)path[i];
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static const char *mime_type_of(const char *path, size_t length)
+{
+  size_t dot = length;
+  while(dot > 0 && path[dot - 1] != '.' && path[dot - 1] != '/')
+  {
+    dot--;
+  }
+
+  if(dot == 0 || path[dot - 1] != '.')
+  {
+    return default_mime_type;
+  }
+
+  const char *extension = path + dot;
+  for(size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++)
+  {
+    if(strcasecmp(extension, mime_types[i].extension) == 0)
+    {
+      return mime_types[i].type;
+    }
+  }
+
+  return default_mime_type;
+}
+
+/*
+ * Symbolic links may point anywhere the process can read: they are only
+ * followed while they stay below the directory. Kernels before 5.6 have no
+ * openat2, every component is opened without following links there.
+ */
+static int open_beneath(int directory_fd, const char *path, int flags)
+{
+  struct open_how how;
+  memset(&how, 0, sizeof(how));
+  how.flags = flags | O_CLOEXEC;
+  how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+
+  int fd = syscall(__NR_openat2, directory_fd, path, &how, sizeof(how));
+  if(fd != -1 || errno != ENOSYS)
+  {
+    return fd;
+  }
+
+  char component[LIGHTNING_STATIC_PATH_MAX];
+  int parent = directory_fd;
+
+  while(1)
+  {
+    const char *slash = strchr(path, '/');
+    if(slash == NULL)
+    {
+      fd = openat(parent, path, flags | O_CLOEXEC | O_NOFOLLOW);
+      break;
+    }
+
+    memcpy(component, path, slash - path);
+    component[slash - path] = '\0';
+    fd = openat(parent, component, O_PATH | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    if(fd == -1)
+    {
+      break;
+    }
+
+    if(parent != directory_fd)
+    {
+      close(parent);
+    }
+    parent = fd;
+    path = slash + 1;
+  }
+
+  if(parent != directory_fd)
+  {
+    int saved = errno;
+    close(parent);
+    errno = saved;
+  }
+  return fd;
+}
+
+static struct lightning_static_file *open_file(const struct lightning_static_directory *directory,
+                                               const char *path,
+                                               size_t length,
+                                               enum lightning_static_result *result)
+{
+  *result = LIGHTNING_STATIC_ERROR;
+
+  int fd = open_beneath(directory->fd, path, O_RDONLY | O_NOCTTY);
+  if(fd == -1)
+  {
+    if(errno == ENOENT || errno == ENOTDIR || errno == EACCES || errno == ELOOP || errno == ENAMETOOLONG || errno == EXDEV)
+    {
+      *result = LIGHTNING_STATIC_NOT_FOUND;
+    }
+    return NULL;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) == -1)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  if(!S_ISREG(st.st_mode))
+  {
+    close(fd);
+    *result = LIGHTNING_STATIC_NOT_FOUND;
+    return NULL;
+  }
+
+  struct lightning_static_file *file = malloc(sizeof(struct lightning_static_file) + length + 1);
+  if(file == NULL)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  char last_modified[LIGHTNING_HTTP_DATE_LENGTH + 1];
+  lightning_http_date_format(last_modified, st.st_mtime);
+  last_modified[LIGHTNING_HTTP_DATE_LENGTH] = '\0';
+
+  // Strong: a new inode, size or modification time is a new tag, and the
+  // file is reopened as soon as one of them changes.
+  uint64_t hash = LIGHTNING_ETAG_SEED;
+  hash = lightning_etag_hash(hash, &st.st_ino, sizeof(st.st_ino));
+  hash = lightning_etag_hash(hash, &st.st_size, sizeof(st.st_size));
+  hash = lightning_etag_hash(hash, &st.st_mtim, sizeof(st.st_mtim));
+  lightning_etag_format(file->etag, hash);
+
+  char etag[LIGHTNING_ETAG_LENGTH + 1];
+  memcpy(etag, file->etag, LIGHTNING_ETAG_LENGTH);
+  etag[LIGHTNING_ETAG_LENGTH] = '\0';
+
+  file->content_type = mime_type_of(path, length);
+  const char *const headers[] = {"Last-Modified", last_modified, "ETag", etag, "Accept-Ranges", "bytes", NULL};
+  file->prefix = lightning_response_prefix_create(200, file->content_type, headers);
+  if(file->prefix == NULL)
+  {
+    close(fd);
+    free(file);
+    return NULL;
+  }
+
+  file->hash_next = NULL;
+  file->lru_prev = NULL;
+  file->lru_next = NULL;
+  file->directory = directory;
+  file->data = NULL;
+  file->size = st.st_size;
+  file->modified = st.st_mtim;
+  file->inode = st.st_ino;
+  file->references = 0;
+  file->cached = false;
+  file->fd = fd;
+  file->path_length = length;
+  memcpy(file->path, path, length + 1);
+
+  // Small files are kept mapped and sent from memory; the rest go out with
+  // sendfile and keep their descriptor open instead.
+  if(file->size > 0 && file->size <= LIGHTNING_STATIC_MMAP_MAX && lightning_static_file_map(file) == 0)
+  {
+    close(file->fd);
+    file->fd = -1;
+  }
+
+  *result = LIGHTNING_STATIC_FOUND;
+  return file;
+}
+
+static void cache_insert(struct lightning_static_cache *cache, struct lightning_static_file *file)
+{
+  if(cache->count == LIGHTNING_STATIC_CACHE_ENTRIES)
+  {
+    cache_remove(cache, cache->lru_tail);
+  }
+
+  struct lightning_static_file **bucket = &cache->buckets[file->hash % LIGHTNING_STATIC_CACHE_ENTRIES];
+  file->hash_next = *bucket;
+  *bucket = file;
+  file->cached = true;
+
+  lru_push_front(cache, file);
+  cache->count++;
+}
+
+static void cache_remove(struct lightning_static_cache *cache, struct lightning_static_file *file)
+{
+  struct lightning_static_file **link = &cache->buckets[file->hash % LIGHTNING_STATIC_CACHE_ENTRIES];
+  while(*link != file)
+  {
+    link = &(*link)->hash_next;
+  }
+  *link = file->hash_next;
+
+  lru_unlink(cache, file);
+  cache->count--;
+  file->cached = false;
+
+  // Still being sent: the last lightning_static_file_release frees it.
+  if(file->references == 0)
+  {
+    free_file(file);
+  }
+}
+
+static void lru_unlink(struct lightning_static_cache *cache, struct lightning_static_file *file)
+{
+  if(file->lru_prev != NULL)
+  {
+    file->lru_prev->lru_next = file->lru_next;
+  }
+  else
+  {
+    cache->lru_head = file->lru_next;
+  }
+
+  if(file->lru_next != NULL)
+  {
+    file->lru_next->lru_prev = file->lru_prev;
+  }
+  else
+  {
+    cache->lru_tail = file->lru_prev;
+  }
+
+  file->lru_prev = NULL;
+  file->lru_next = NULL;
+}
+
+static void lru_push_front(struct lightning_static_cache *cache, struct lightning_static_file *file)
+{
+  file->lru_prev = NULL;
+  file->lru_next = cache->lru_head;
+
+  if(cache->lru_head != NULL)
+  {
+    cache->lru_head->lru_prev = file;
+  }
+  else
+  {
+    cache->lru_tail = file;
+  }
+
+  cache->lru_head = file;
+}
+
+static void free_file(struct lightning_static_file *file)
+{
+  if(file->data != NULL)
+  {
+    munmap(file->data, file->size);
+  }
+
+  if(file->fd >= 0)
+  {
+    close(file->fd);
+  }
+
+  free(file->prefix);
+  free(file);
+}
@@ -0,0 +1,84 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include "internal/steering.h"
+
+int lightning_steering_attach(const int *sockets, const int *cpus, size_t count)
+{
+  if(count == 0 || count > LIGHTNING_STEERING_MAX_SOCKETS)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for(size_t i = 0; i < count; i++)
+  {
+    if(setsockopt(sockets[i], SOL_SOCKET, SO_INCOMING_CPU, &cpus[i], sizeof(cpus[i])) == -1)
+    {
+      return -1;
+    }
+  }
+
+  // A = cpu; one "if A == cpus[i] return i" per socket; anything else is out
+  // of range, which the kernel answers with its usual hash.
+  size_t length = 2 * count + 2;
+  struct sock_filter *code = malloc(length * sizeof(struct sock_filter));
+  if(code == NULL)
+  {
+    return -1;
+  }
+
+  size_t n = 0;
+  code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+
+  for(size_t i = 0; i < count; i++)
+  {
+    code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)cpus[i], 0, 1);
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (unsigned)i);
+  }
+
+  code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (unsigned)count);
+
+  struct sock_fprog program = {.len = (unsigned short)n, .filter = code};
+
+  // The program belongs to the group: attaching it through one socket is
+  // enough and replaces whatever was there.
+  int result = setsockopt(sockets[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program));
+
+  int saved_errno = errno;
+  free(code);
+  errno = saved_errno;
+
+  return result;
+}
+
+void lightning_steering_detach(int socket_fd)
+{
+#ifdef SO_DETACH_REUSEPORT_BPF
+  int unused = 0;
+  setsockopt(socket_fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &unused, sizeof(unused));
+#else
+  (void)socket_fd;
+#endif
+}
@@ -0,0 +1,244 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+
+#include "internal/timer.h"
+
+#define SLOT_MASK ((uint64_t)LIGHTNING_TIMER_SLOTS - 1)
+
+static void list_init(struct lightning_timer *head);
+static void list_append(struct lightning_timer *head, struct lightning_timer *timer);
+static void list_unlink(struct lightning_timer *timer);
+static void wheel_place(struct lightning_timer_wheel *wheel, struct lightning_timer *timer);
+static void wheel_cascade(struct lightning_timer_wheel *wheel, int level);
+
+void lightning_timer_wheel_init(struct lightning_timer_wheel *wheel, uint64_t now_ms, uint64_t tick_ms)
+{
+  for(int level = 0; level < LIGHTNING_TIMER_LEVELS; level++)
+  {
+    for(int slot = 0; slot < LIGHTNING_TIMER_SLOTS; slot++)
+    {
+      list_init(&wheel->slots[level][slot]);
+    }
+  }
+
+  wheel->tick_ms = tick_ms > 0 ? tick_ms : 1;
+  wheel->current = now_ms / wheel->tick_ms;
+  wheel->count = 0;
+}
+
+void lightning_timer_init(struct lightning_timer *timer)
+{
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->expires = 0;
+}
+
+bool lightning_timer_pending(const struct lightning_timer *timer)
+{
+  return timer->next != NULL;
+}
+
+void lightning_timer_schedule(struct lightning_timer_wheel *wheel, struct lightning_timer *timer, uint64_t expires_ms)
+{
+  if(lightning_timer_pending(timer))
+  {
+    list_unlink(timer);
+    wheel->count--;
+  }
+
+  // Round up so a timer never fires before its deadline.
+  timer->expires = (expires_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+  if(timer->expires <= wheel->current)
+  {
+    timer->expires = wheel->current + 1;
+  }
+
+  wheel_place(wheel, timer);
+  wheel->count++;
+}
+
+void lightning_timer_cancel(struct lightning_timer_wheel *wheel, struct lightning_timer *timer)
+{
+  if(!lightning_timer_pending(timer))
+  {
+    return;
+  }
+
+  list_unlink(timer);
+  wheel->count--;
+}
+
+void lightning_timer_wheel_advance(struct lightning_timer_wheel *wheel,
+                                   uint64_t now_ms,
+                                   lightning_timer_callback callback,
+                                   void *data)
+{
+  uint64_t target = now_ms / wheel->tick_ms;
+
+  if(wheel->count == 0)
+  {
+    wheel->current = target;
+    return;
+  }
+
+  while(wheel->current < target)
+  {
+    wheel->current++;
+
+    if((wheel->current & SLOT_MASK) == 0)
+    {
+      if(((wheel->current >> LIGHTNING_TIMER_SLOT_BITS) & SLOT_MASK) == 0)
+      {
+        wheel_cascade(wheel, 2);
+      }
+      wheel_cascade(wheel, 1);
+    }
+
+    struct lightning_timer expired;
+    struct lightning_timer *slot = &wheel->slots[0][wheel->current & SLOT_MASK];
+
+    if(slot->next == slot)
+    {
+      continue;
+    }
+
+    // Detach the whole slot first: callbacks are free to reschedule timers
+    // into the slot we are walking.
+    expired.next = slot->next;
+    expired.prev = slot->prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    list_init(slot);
+
+    while(expired.next != &expired)
+    {
+      struct lightning_timer *timer = expired.next;
+      list_unlink(timer);
+      wheel->count--;
+      callback(timer, data);
+    }
+  }
+}
+
+int lightning_timer_wheel_timeout(const struct lightning_timer_wheel *wheel, uint64_t now_ms)
+{
+  if(wheel->count == 0)
+  {
+    return -1;
+  }
+
+  uint64_t ticks = LIGHTNING_TIMER_SLOTS - (wheel->current & SLOT_MASK);
+
+  for(uint64_t i = 1; i < LIGHTNING_TIMER_SLOTS; i++)
+  {
+    uint64_t tick = wheel->current + i;
+    const struct lightning_timer *slot = &wheel->slots[0][tick & SLOT_MASK];
+
+    if(slot->next != slot)
+    {
+      ticks = i;
+      break;
+    }
+
+    if((tick & SLOT_MASK) == 0)
+    {
+      // Higher levels cascade here, wake up and let them.
+      ticks = i;
+      break;
+    }
+  }
+
+  uint64_t deadline = (wheel->current + ticks) * wheel->tick_ms;
+  if(deadline <= now_ms)
+  {
+    return 0;
+  }
+
+  uint64_t timeout = deadline - now_ms;
+  return timeout > INT_MAX ? INT_MAX : (int)timeout;
+}
+
+static void list_init(struct lightning_timer *head)
+{
+  head->next = head;
+  head->prev = head;
+}
+
+static void list_append(struct lightning_timer *head, struct lightning_timer *timer)
+{
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void list_unlink(struct lightning_timer *timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+static void wheel_place(struct lightning_timer_wheel *wheel, struct lightning_timer *timer)
+{
+  uint64_t delta = timer->expires - wheel->current;
+  uint64_t max_delta = ((uint64_t)1 << (LIGHTNING_TIMER_SLOT_BITS * LIGHTNING_TIMER_LEVELS)) - 1;
+
+  if(delta > max_delta)
+  {
+    timer->expires = wheel->current + max_delta;
+    delta = max_delta;
+  }
+
+  int level = 0;
+  while(level < LIGHTNING_TIMER_LEVELS - 1 && delta >= ((uint64_t)1 << (LIGHTNING_TIMER_SLOT_BITS * (level + 1))))
+  {
+    level++;
+  }
+
+  uint64_t slot = (timer->expires >> (LIGHTNING_TIMER_SLOT_BITS * level)) & SLOT_MASK;
+  list_append(&wheel->slots[level][slot], timer);
+}
+
+static void wheel_cascade(struct lightning_timer_wheel *wheel, int level)
+{
+  uint64_t index = (wheel->current >> (LIGHTNING_TIMER_SLOT_BITS * level)) & SLOT_MASK;
+  struct lightning_timer *slot = &wheel->slots[level][index];
+  struct lightning_timer pending;
+
+  if(slot->next == slot)
+  {
+    return;
+  }
+
+  pending.next = slot->next;
+  pending.prev = slot->prev;
+  pending.next->prev = &pending;
+  pending.prev->next = &pending;
+  list_init(slot);
+
+  while(pending.next != &pending)
+  {
+    struct lightning_timer *timer = pending.next;
+    list_unlink(timer);
+    wheel_place(wheel, timer);
+  }
+}
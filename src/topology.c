@@ -0,0 +1,136 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/topology.h"
+
+static void mark_cpus(struct lightning_topology *topology, const char *list, int node);
+
+void lightning_topology_detect(struct lightning_topology *topology)
+{
+  memset(topology, 0, sizeof(struct lightning_topology));
+  topology->nodes = 1;
+
+  DIR *directory = opendir("/sys/devices/system/node");
+  if(directory == NULL)
+  {
+    return;
+  }
+
+  int highest = 0;
+  struct dirent *entry;
+
+  while((entry = readdir(directory)) != NULL)
+  {
+    char *end;
+    if(strncmp(entry->d_name, "node", 4) != 0 || entry->d_name[4] < '0' || entry->d_name[4] > '9')
+    {
+      continue;
+    }
+
+    long node = strtol(entry->d_name + 4, &end, 10);
+    if(*end != '\0' || node >= 32768)
+    {
+      continue;
+    }
+
+    char path[64 + sizeof(entry->d_name)];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+
+    FILE *file = fopen(path, "re");
+    if(file == NULL)
+    {
+      continue;
+    }
+
+    char list[4096];
+    if(fgets(list, sizeof(list), file) != NULL)
+    {
+      mark_cpus(topology, list, (int)node);
+      if(node > highest)
+      {
+        highest = (int)node;
+      }
+    }
+    fclose(file);
+  }
+
+  closedir(directory);
+  topology->nodes = highest + 1;
+}
+
+// CPUs of one node, "0-3,8-11\n".
+static void mark_cpus(struct lightning_topology *topology, const char *list, int node)
+{
+  bool cpus[LIGHTNING_TOPOLOGY_MAX_CPUS];
+
+  lightning_topology_parse_cpus(list, cpus);
+  for(int cpu = 0; cpu < LIGHTNING_TOPOLOGY_MAX_CPUS; cpu++)
+  {
+    if(cpus[cpu])
+    {
+      topology->node[cpu] = (short)node;
+    }
+  }
+}
+
+// Ranges and single CPUs, comma separated.
+int lightning_topology_parse_cpus(const char *list, bool cpus[LIGHTNING_TOPOLOGY_MAX_CPUS])
+{
+  const char *cursor = list;
+
+  memset(cpus, 0, LIGHTNING_TOPOLOGY_MAX_CPUS * sizeof(bool));
+
+  while(*cursor >= '0' && *cursor <= '9')
+  {
+    char *end;
+    long first = strtol(cursor, &end, 10);
+    long last = first;
+
+    if(*end == '-')
+    {
+      if(end[1] < '0' || end[1] > '9')
+      {
+        return -1;
+      }
+      last = strtol(end + 1, &end, 10);
+    }
+
+    for(long cpu = first; cpu <= last && cpu < LIGHTNING_TOPOLOGY_MAX_CPUS; cpu++)
+    {
+      cpus[cpu] = true;
+    }
+
+    cursor = end;
+    if(*cursor == ',')
+    {
+      cursor++;
+      if(*cursor < '0' || *cursor > '9')
+      {
+        return -1;
+      }
+    }
+  }
+
+  return *cursor == '\0' || *cursor == '\n' ? 0 : -1;
+}
@@ -0,0 +1,1112 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * io_uring event backend. It talks to the kernel through the raw syscalls
+ * so there is no liburing dependency:
+ * - one multishot accept per listening socket, cancelled when it used up
+ *   its batch for the round or the worker sheds into the backlog, armed
+ *   again after;
+ * - one multishot recv per connection, filling buffers from a provided
+ *   buffer ring shared by all connections of the worker;
+ * - sends are queued as SQEs and submitted together with the wait for the
+ *   next completions, so a loop iteration costs a single io_uring_enter.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "internal/connection.h"
+#include "internal/server.h"
+#include "internal/static.h"
+#include "internal/timer.h"
+
+#define URING_BUFFER_GROUP 0
+
+enum uring_operation
+{
+  URING_OP_ACCEPT = 1,
+  URING_OP_RECV,
+  URING_OP_SEND,
+  URING_OP_CANCEL,
+  URING_OP_WAKE
+};
+
+struct lightning_uring
+{
+  int fd;
+
+  void *sq_ring;
+  size_t sq_ring_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_array;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned sq_local_tail;
+  unsigned sq_pending;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  void *cq_ring;
+  size_t cq_ring_size;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  struct io_uring_buf_ring *buffer_ring;
+  size_t buffer_ring_size;
+  char *buffers;
+  uint32_t *buffer_length;
+  uint32_t *buffer_next;
+  uint16_t buffer_tail;
+  unsigned buffers_available;
+};
+
+struct uring_worker
+{
+  struct lightning_server *server;
+  struct lightning_uring ring;
+  uint64_t wake_value;
+  int *starved;
+  size_t starved_count;
+  size_t starved_capacity;
+  // Per listener: its multishot accept is armed (until the completion
+  // without IORING_CQE_F_MORE), a cancellation is on its way, connections
+  // it accepted in this round of the loop.
+  bool accept_armed[LIGHTNING_MAX_LISTENERS];
+  bool accept_cancelling[LIGHTNING_MAX_LISTENERS];
+  int accepted[LIGHTNING_MAX_LISTENERS];
+};
+
+static int uring_setup(struct lightning_uring *ring);
+static void uring_teardown(struct lightning_uring *ring);
+static struct io_uring_sqe *uring_get_sqe(struct lightning_uring *ring);
+static int uring_enter(struct lightning_uring *ring, unsigned wait_nr, int timeout_ms);
+static void uring_recycle_buffer(struct lightning_uring *ring, uint16_t bid);
+static void uring_arm_accept(struct uring_worker *worker, int listener);
+static int uring_cancel_accept(struct uring_worker *worker, int listener);
+static void uring_update_accepts(struct uring_worker *worker);
+static void uring_arm_wake(struct uring_worker *worker);
+static void uring_start_draining(struct uring_worker *worker);
+static void uring_close_listener(struct uring_worker *worker, int listener);
+static void uring_arm_recv(struct uring_worker *worker, struct lightning_connection *conn);
+static void uring_update_recv(struct uring_worker *worker, struct lightning_connection *conn);
+static void uring_arm_send(struct uring_worker *worker, struct lightning_connection *conn);
+static void uring_handle_accept(struct uring_worker *worker, struct io_uring_cqe *cqe);
+static void uring_handle_recv(struct uring_worker *worker, struct io_uring_cqe *cqe);
+static void uring_handle_send(struct uring_worker *worker, struct io_uring_cqe *cqe);
+static int uring_consume(struct uring_worker *worker, struct lightning_connection *conn);
+static void uring_close_connection(struct uring_worker *worker, struct lightning_connection *conn);
+static void uring_finish_close(struct uring_worker *worker, struct lightning_connection *conn);
+static void uring_handle_timeout(struct lightning_timer *timer, void *data);
+
+static inline uint64_t uring_user_data(enum uring_operation operation, int fd)
+{
+  return ((uint64_t)operation << 32) | (uint32_t)fd;
+}
+
+int lightning_uring_run(struct lightning_server *server)
+{
+  struct uring_worker worker;
+  memset(&worker, 0, sizeof(worker));
+  worker.server = server;
+
+  if(uring_setup(&worker.ring) == -1)
+  {
+    return -1;
+  }
+
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    uring_arm_accept(&worker, i);
+  }
+  uring_arm_wake(&worker);
+
+  while(!lightning_server_finished(server))
+  {
+    int timeout = lightning_server_poll_timeout(server);
+
+    lightning_shared_cache_offline(server->shared_responses, server->shared_reader, server->now_ms);
+    if(uring_enter(&worker.ring, 1, timeout) == -1)
+    {
+      fprintf(stderr, "io_uring_enter() error: %s\n", strerror(errno));
+      break;
+    }
+    lightning_shared_cache_online(server->shared_responses, server->shared_reader);
+    lightning_metrics_add(&server->metrics->loop_iterations, 1);
+
+    server->now_ms = lightning_clock_ms();
+    lightning_http_date_update(&server->date, server->now_ms);
+    uint64_t round_started_ns = server->max_loop_delay_ns > 0 ? lightning_clock_ns() : 0;
+
+    struct lightning_uring *ring = &worker.ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while(head != tail)
+    {
+      struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+
+      switch((enum uring_operation)(cqe->user_data >> 32))
+      {
+        case URING_OP_ACCEPT:
+          uring_handle_accept(&worker, cqe);
+          break;
+
+        case URING_OP_RECV:
+          uring_handle_recv(&worker, cqe);
+          break;
+
+        case URING_OP_SEND:
+          uring_handle_send(&worker, cqe);
+          break;
+
+        case URING_OP_WAKE:
+          if(cqe->res > 0)
+          {
+            uring_arm_wake(&worker);
+          }
+          break;
+
+        case URING_OP_CANCEL:
+        default:
+          break;
+      }
+
+      head++;
+      if(head == tail)
+      {
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+      }
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    // Connections whose multishot recv ran out of provided buffers are
+    // re-armed once buffers have been handed back to the kernel.
+    while(worker.starved_count > 0 && ring->buffers_available > 0)
+    {
+      int fd = worker.starved[--worker.starved_count];
+      struct lightning_connection *conn = &server->connections[fd];
+
+      if(conn->state != CONN_STATE_CLOSED)
+      {
+        uring_update_recv(&worker, conn);
+      }
+    }
+
+    lightning_timer_wheel_advance(&server->timers, server->now_ms, uring_handle_timeout, &worker);
+    lightning_server_update_admission(server, round_started_ns);
+    uring_update_accepts(&worker);
+
+    if(lightning_server_drain_pending(server))
+    {
+      uring_start_draining(&worker);
+    }
+  }
+
+  lightning_shared_cache_offline(server->shared_responses, server->shared_reader, server->now_ms);
+  uring_teardown(&worker.ring);
+  free(worker.starved);
+  return 0;
+}
+
+static int uring_setup(struct lightning_uring *ring)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+
+  int fd = syscall(__NR_io_uring_setup, LIGHTNING_URING_ENTRIES, &params);
+  if(fd < 0 && errno == EINVAL)
+  {
+    // Kernels before 6.1 do not know the task run flags.
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, LIGHTNING_URING_ENTRIES, &params);
+  }
+
+  if(fd < 0)
+  {
+    return -1;
+  }
+
+  if(!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+  {
+    close(fd);
+    return -1;
+  }
+
+  ring->fd = fd;
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  if(params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if(ring->cq_ring_size > ring->sq_ring_size)
+    {
+      ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if(ring->sq_ring == MAP_FAILED)
+  {
+    close(fd);
+    return -1;
+  }
+
+  if(params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    ring->cq_ring = ring->sq_ring;
+  }
+  else
+  {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if(ring->cq_ring == MAP_FAILED)
+    {
+      munmap(ring->sq_ring, ring->sq_ring_size);
+      close(fd);
+      return -1;
+    }
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(ring->sqes == MAP_FAILED)
+  {
+    ring->sqes = NULL;
+    ring->buffer_ring = NULL;
+    uring_teardown(ring);
+    return -1;
+  }
+
+  char *sq = ring->sq_ring;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_entries = params.sq_entries;
+  ring->sq_local_tail = *ring->sq_tail;
+  ring->sq_pending = 0;
+
+  char *cq = ring->cq_ring;
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  // Provided buffer ring (kernel 5.19+).
+  ring->buffer_ring_size = LIGHTNING_URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+  ring->buffer_ring = mmap(NULL, ring->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ring->buffers = malloc((size_t)LIGHTNING_URING_BUFFER_COUNT * LIGHTNING_URING_BUFFER_SIZE);
+  ring->buffer_length = calloc(LIGHTNING_URING_BUFFER_COUNT, sizeof(uint32_t));
+  ring->buffer_next = calloc(LIGHTNING_URING_BUFFER_COUNT, sizeof(uint32_t));
+
+  if(ring->buffer_ring == MAP_FAILED)
+  {
+    ring->buffer_ring = NULL;
+  }
+
+  if(ring->buffer_ring == NULL || ring->buffers == NULL || ring->buffer_length == NULL || ring->buffer_next == NULL)
+  {
+    uring_teardown(ring);
+    return -1;
+  }
+
+  struct io_uring_buf_reg registration;
+  memset(&registration, 0, sizeof(registration));
+  registration.ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring;
+  registration.ring_entries = LIGHTNING_URING_BUFFER_COUNT;
+  registration.bgid = URING_BUFFER_GROUP;
+
+  if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+  {
+    uring_teardown(ring);
+    return -1;
+  }
+
+  ring->buffer_tail = 0;
+  ring->buffers_available = 0;
+  for(uint16_t bid = 0; bid < LIGHTNING_URING_BUFFER_COUNT; bid++)
+  {
+    uring_recycle_buffer(ring, bid);
+  }
+
+  return 0;
+}
+
+static void uring_teardown(struct lightning_uring *ring)
+{
+  if(ring->sqes != NULL)
+  {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+
+  if(ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+  {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+
+  if(ring->sq_ring != NULL)
+  {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+
+  // Closing the ring cancels whatever is still in flight.
+  close(ring->fd);
+
+  if(ring->buffer_ring != NULL)
+  {
+    munmap(ring->buffer_ring, ring->buffer_ring_size);
+  }
+
+  free(ring->buffers);
+  free(ring->buffer_length);
+  free(ring->buffer_next);
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct lightning_uring *ring)
+{
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+  if(ring->sq_local_tail - head >= ring->sq_entries)
+  {
+    // Submission queue full: flush it without waiting for completions.
+    if(uring_enter(ring, 0, -1) == -1)
+    {
+      return NULL;
+    }
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if(ring->sq_local_tail - head >= ring->sq_entries)
+    {
+      return NULL;
+    }
+  }
+
+  unsigned index = ring->sq_local_tail & ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+
+  ring->sq_array[index] = index;
+  ring->sq_local_tail++;
+  ring->sq_pending++;
+
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  return sqe;
+}
+
+static int uring_enter(struct lightning_uring *ring, unsigned wait_nr, int timeout_ms)
+{
+  __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  void *argp = NULL;
+  size_t argsz = 0;
+
+  if(wait_nr > 0 && timeout_ms >= 0)
+  {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+
+    flags |= IORING_ENTER_EXT_ARG;
+    argp = &arg;
+    argsz = sizeof(arg);
+  }
+
+  while(1)
+  {
+    int submitted = syscall(__NR_io_uring_enter, ring->fd, ring->sq_pending, wait_nr, flags, argp, argsz);
+
+    if(submitted >= 0)
+    {
+      ring->sq_pending -= (unsigned)submitted > ring->sq_pending ? ring->sq_pending : (unsigned)submitted;
+      return 0;
+    }
+
+    if(errno == ETIME || errno == EINTR)
+    {
+      return 0;
+    }
+
+    if(errno == EBUSY || errno == EAGAIN)
+    {
+      // Completion queue is backed up: reap what is there first.
+      if(wait_nr > 0)
+      {
+        return 0;
+      }
+      continue;
+    }
+
+    return -1;
+  }
+}
+
+static void uring_recycle_buffer(struct lightning_uring *ring, uint16_t bid)
+{
+  struct io_uring_buf *buffer = &ring->buffer_ring->bufs[ring->buffer_tail & (LIGHTNING_URING_BUFFER_COUNT - 1)];
+
+  buffer->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)bid * LIGHTNING_URING_BUFFER_SIZE);
+  buffer->len = LIGHTNING_URING_BUFFER_SIZE;
+  buffer->bid = bid;
+
+  ring->buffer_tail++;
+  __atomic_store_n(&ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+  ring->buffers_available++;
+}
+
+// Accepts are told apart by the index of their listener.
+static void uring_arm_accept(struct uring_worker *worker, int listener)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe == NULL)
+  {
+    LIGHTNING_ERROR("io_uring submission queue is full");
+    return;
+  }
+
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = worker->server->listen_fds[listener];
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = uring_user_data(URING_OP_ACCEPT, listener);
+  worker->accept_armed[listener] = true;
+  worker->accept_cancelling[listener] = false;
+}
+
+// -1 when the submission queue is full.
+static int uring_cancel_accept(struct uring_worker *worker, int listener)
+{
+  if(!worker->accept_armed[listener] || worker->accept_cancelling[listener])
+  {
+    return 0;
+  }
+
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe == NULL)
+  {
+    return -1;
+  }
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = uring_user_data(URING_OP_ACCEPT, listener);
+  sqe->user_data = uring_user_data(URING_OP_CANCEL, listener);
+  worker->accept_cancelling[listener] = true;
+  return 0;
+}
+
+/*
+ * Once a round of the loop is over. A listener that used up its accept
+ * batch was cancelled and is armed again; while the worker sheds into the
+ * backlog every accept is cancelled, so new connections queue up there.
+ */
+static void uring_update_accepts(struct uring_worker *worker)
+{
+  struct lightning_server *server = worker->server;
+
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    worker->accepted[i] = 0;
+
+    if(server->draining || server->listen_fds[i] == -1)
+    {
+      continue;
+    }
+
+    if(lightning_server_accept_paused(server))
+    {
+      uring_cancel_accept(worker, i);
+    }
+    else if(!worker->accept_armed[i])
+    {
+      uring_arm_accept(worker, i);
+    }
+  }
+}
+
+// The eventfd counter is read back into wake_value, which only matters in
+// that the read completes.
+static void uring_arm_wake(struct uring_worker *worker)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe == NULL)
+  {
+    LIGHTNING_ERROR("io_uring submission queue is full");
+    return;
+  }
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = worker->server->wake_fd;
+  sqe->addr = (uint64_t)(uintptr_t)&worker->wake_value;
+  sqe->len = sizeof(worker->wake_value);
+  sqe->user_data = uring_user_data(URING_OP_WAKE, worker->server->wake_fd);
+}
+
+/*
+ * Same as the epoll backend: leave the SO_REUSEPORT groups, close idle
+ * connections. A multishot accept holds its socket until its cancellation
+ * completes, so each socket is closed when its last completion arrives.
+ */
+static void uring_start_draining(struct uring_worker *worker)
+{
+  struct lightning_server *server = worker->server;
+
+  // A listener without an armed accept gets no last completion to close
+  // it on.
+  for(int i = 0; i < server->listen_count; i++)
+  {
+    if(!worker->accept_armed[i] || uring_cancel_accept(worker, i) == -1)
+    {
+      uring_close_listener(worker, i);
+    }
+  }
+
+  lightning_server_start_draining(server);
+
+  for(int fd = 0; fd < server->max_connections; fd++)
+  {
+    struct lightning_connection *conn = &server->connections[fd];
+    if(lightning_server_connection_idle(conn) && !conn->uring_closing)
+    {
+      uring_close_connection(worker, conn);
+    }
+  }
+}
+
+/*
+ * Serves what is left in the accept queue and closes the listening socket.
+ * Accepts wait for the socket with exclusive wakeups: one our cancelled
+ * accept consumed would otherwise strand its connection, even when the next
+ * generation shares the queue after a handoff.
+ */
+static void uring_close_listener(struct uring_worker *worker, int listener)
+{
+  struct lightning_server *server = worker->server;
+  int listen_fd = server->listen_fds[listener];
+
+  if(listen_fd == -1)
+  {
+    return;
+  }
+
+  while(1)
+  {
+    union lightning_socket_address client_addr;
+    socklen_t client_addr_length = sizeof(client_addr);
+
+    int fd = accept4(listen_fd, &client_addr.any, &client_addr_length, SOCK_CLOEXEC);
+    if(fd == -1)
+    {
+      break;
+    }
+
+    struct lightning_connection *conn = lightning_server_open_connection(server, fd, &client_addr);
+    if(conn != NULL)
+    {
+      uring_arm_recv(worker, conn);
+    }
+  }
+
+  close(listen_fd);
+  server->listen_fds[listener] = -1;
+}
+
+static void uring_arm_recv(struct uring_worker *worker, struct lightning_connection *conn)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe == NULL)
+  {
+    uring_close_connection(worker, conn);
+    return;
+  }
+
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = conn->fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = uring_user_data(URING_OP_RECV, conn->fd);
+  conn->uring_inflight++;
+  conn->uring_receiving = true;
+}
+
+/*
+ * A connection waiting on its own output would otherwise keep taking
+ * provided buffers from the ring every connection of the worker shares:
+ * like the epoll loop leaves input in the socket, its recv is cancelled
+ * past LIGHTNING_URING_HELD_MAX held buffers, and armed again once they
+ * are consumed and the responses sent.
+ */
+static void uring_update_recv(struct uring_worker *worker, struct lightning_connection *conn)
+{
+  if(conn->uring_closing || conn->uring_read_closed)
+  {
+    return;
+  }
+
+  if(conn->uring_held_count >= LIGHTNING_URING_HELD_MAX)
+  {
+    conn->uring_recv_paused = true;
+  }
+  else if(conn->uring_recv_paused && conn->uring_held_count == 0 && conn->write_total == 0)
+  {
+    conn->uring_recv_paused = false;
+  }
+
+  if(!conn->uring_recv_paused)
+  {
+    if(!conn->uring_receiving)
+    {
+      uring_arm_recv(worker, conn);
+    }
+    return;
+  }
+
+  if(!conn->uring_receiving || conn->uring_recv_cancelling)
+  {
+    return;
+  }
+
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe == NULL)
+  {
+    uring_close_connection(worker, conn);
+    return;
+  }
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = uring_user_data(URING_OP_RECV, conn->fd);
+  sqe->user_data = uring_user_data(URING_OP_CANCEL, conn->fd);
+  conn->uring_recv_cancelling = true;
+}
+
+static void uring_arm_send(struct uring_worker *worker, struct lightning_connection *conn)
+{
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe == NULL)
+  {
+    uring_close_connection(worker, conn);
+    return;
+  }
+
+  // There is no sendfile here: a file segment is mapped and sent from
+  // memory like any other body.
+  if(conn->output_index == conn->output_count && conn->file_remaining > 0)
+  {
+    if(lightning_static_file_map(conn->file) == -1)
+    {
+      uring_close_connection(worker, conn);
+      return;
+    }
+
+    conn->output[0].iov_base = conn->file->data + conn->file_offset;
+    conn->output[0].iov_len = conn->file_remaining;
+    conn->output_index = 0;
+    conn->output_count = 1;
+    conn->file_remaining = 0;
+  }
+
+  // Responses queued while this send is in flight only append segments,
+  // so the iovecs it points to stay put until it completes.
+  memset(&conn->uring_message, 0, sizeof(conn->uring_message));
+  conn->uring_message.msg_iov = conn->output + conn->output_index;
+  conn->uring_message.msg_iovlen = conn->output_count - conn->output_index;
+
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = conn->fd;
+  sqe->addr = (uint64_t)(uintptr_t)&conn->uring_message;
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = uring_user_data(URING_OP_SEND, conn->fd);
+
+  conn->uring_inflight++;
+  conn->uring_sending = true;
+  conn->state = CONN_STATE_WRITING_RESPONSE;
+  lightning_metrics_add(&worker->server->metrics->flushes, 1);
+}
+
+static void uring_handle_accept(struct uring_worker *worker, struct io_uring_cqe *cqe)
+{
+  struct lightning_server *server = worker->server;
+  int listener = (int)(uint32_t)cqe->user_data;
+  bool last = !(cqe->flags & IORING_CQE_F_MORE);
+
+  if(last)
+  {
+    worker->accept_armed[listener] = false;
+    worker->accept_cancelling[listener] = false;
+  }
+
+  if(last && !server->draining && !lightning_server_accept_paused(server) &&
+     worker->accepted[listener] < server->accept_batch && server->listen_fds[listener] != -1)
+  {
+    uring_arm_accept(worker, listener);
+  }
+
+  if(cqe->res >= 0)
+  {
+    // Multishot accept can not report the peer address, it is only asked
+    // for when the access log needs it.
+    union lightning_socket_address client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    if(server->access_log != NULL)
+    {
+      socklen_t client_addr_len = sizeof(client_addr);
+      getpeername(cqe->res, &client_addr.any, &client_addr_len);
+    }
+
+    struct lightning_connection *conn = lightning_server_open_connection(server, cqe->res, &client_addr);
+    if(conn != NULL)
+    {
+      uring_arm_recv(worker, conn);
+    }
+
+    // The rest of the queue waits for the next round.
+    if(++worker->accepted[listener] >= server->accept_batch && !last)
+    {
+      uring_cancel_accept(worker, listener);
+    }
+  }
+  else if(cqe->res != -ECANCELED)
+  {
+    fprintf(stderr, "accept() error: %s\n", strerror(-cqe->res));
+  }
+
+  if(last && server->draining)
+  {
+    uring_close_listener(worker, listener);
+  }
+}
+
+static void uring_handle_recv(struct uring_worker *worker, struct io_uring_cqe *cqe)
+{
+  struct lightning_server *server = worker->server;
+  struct lightning_uring *ring = &worker->ring;
+  int fd = (int)(uint32_t)cqe->user_data;
+  struct lightning_connection *conn = &server->connections[fd];
+  bool more = cqe->flags & IORING_CQE_F_MORE;
+
+  if(!more)
+  {
+    conn->uring_inflight--;
+    conn->uring_receiving = false;
+    conn->uring_recv_cancelling = false;
+  }
+
+  if(cqe->flags & IORING_CQE_F_BUFFER)
+  {
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    ring->buffers_available--;
+
+    if(conn->uring_closing || cqe->res <= 0)
+    {
+      uring_recycle_buffer(ring, bid);
+    }
+    else
+    {
+      ring->buffer_length[bid] = cqe->res;
+      ring->buffer_next[bid] = 0;
+
+      if(conn->uring_held_tail != 0)
+      {
+        ring->buffer_next[conn->uring_held_tail - 1] = bid + 1;
+      }
+      else
+      {
+        conn->uring_held_head = bid + 1;
+        conn->uring_held_offset = 0;
+      }
+      conn->uring_held_tail = bid + 1;
+      conn->uring_held_count++;
+    }
+  }
+
+  if(conn->uring_closing)
+  {
+    if(conn->uring_inflight == 0)
+    {
+      uring_finish_close(worker, conn);
+    }
+    return;
+  }
+
+  if(cqe->res == -ENOBUFS)
+  {
+    if(worker->starved_count == worker->starved_capacity)
+    {
+      size_t capacity = worker->starved_capacity == 0 ? 64 : worker->starved_capacity * 2;
+      int *starved = realloc(worker->starved, capacity * sizeof(int));
+      if(starved == NULL)
+      {
+        uring_close_connection(worker, conn);
+        return;
+      }
+      worker->starved = starved;
+      worker->starved_capacity = capacity;
+    }
+
+    worker->starved[worker->starved_count++] = fd;
+    return;
+  }
+
+  // Stopped by uring_update_recv.
+  if(cqe->res == -ECANCELED)
+  {
+    uring_update_recv(worker, conn);
+    return;
+  }
+
+  if(cqe->res < 0)
+  {
+    if(cqe->res != -ECONNRESET)
+    {
+      fprintf(stderr, "Error: recv() error on fd %d: %s\n", fd, strerror(-cqe->res));
+    }
+    uring_close_connection(worker, conn);
+    return;
+  }
+
+  if(cqe->res == 0)
+  {
+    // End of stream: the held requests are still answered, uring_consume
+    // closes once the output is sent.
+    conn->uring_read_closed = true;
+  }
+  else
+  {
+    conn->last_activity = server->now_ms;
+    lightning_metrics_add(&server->metrics->bytes_in, (uint64_t)cqe->res);
+  }
+
+  if(uring_consume(worker, conn) == -1)
+  {
+    uring_close_connection(worker, conn);
+  }
+}
+
+static void uring_handle_send(struct uring_worker *worker, struct io_uring_cqe *cqe)
+{
+  struct lightning_server *server = worker->server;
+  int fd = (int)(uint32_t)cqe->user_data;
+  struct lightning_connection *conn = &server->connections[fd];
+
+  conn->uring_inflight--;
+  conn->uring_sending = false;
+
+  if(conn->uring_closing)
+  {
+    if(conn->uring_inflight == 0)
+    {
+      uring_finish_close(worker, conn);
+    }
+    return;
+  }
+
+  if(cqe->res < 0)
+  {
+    if(cqe->res != -EPIPE && cqe->res != -ECONNRESET)
+    {
+      fprintf(stderr, "send() error on fd %d: %s\n", fd, strerror(-cqe->res));
+    }
+    uring_close_connection(worker, conn);
+    return;
+  }
+
+  conn->last_activity = server->now_ms;
+
+  if(lightning_server_output_sent(server, conn, cqe->res) > 0)
+  {
+    uring_arm_send(worker, conn);
+    return;
+  }
+
+  if(uring_consume(worker, conn) == -1)
+  {
+    uring_close_connection(worker, conn);
+  }
+}
+
+static int uring_consume(struct uring_worker *worker, struct lightning_connection *conn)
+{
+  struct lightning_server *server = worker->server;
+  struct lightning_uring *ring = &worker->ring;
+
+  while(1)
+  {
+    while(conn->uring_held_head != 0 && conn->read_pos < server->read_buffer_size)
+    {
+      if(lightning_connection_acquire_read_buffer(conn, &server->read_pool) == -1)
+      {
+        LIGHTNING_ERROR("can not allocate a read buffer");
+        return -1;
+      }
+
+      uint16_t bid = conn->uring_held_head - 1;
+      size_t available = ring->buffer_length[bid] - conn->uring_held_offset;
+      size_t space = server->read_buffer_size - conn->read_pos;
+      size_t length = available < space ? available : space;
+      const char *data = ring->buffers + (size_t)bid * LIGHTNING_URING_BUFFER_SIZE + conn->uring_held_offset;
+
+      memcpy(conn->read_buffer + conn->read_pos, data, length);
+      conn->read_pos += length;
+      conn->uring_held_offset += length;
+
+      if(conn->uring_held_offset == ring->buffer_length[bid])
+      {
+        conn->uring_held_head = ring->buffer_next[bid];
+        conn->uring_held_offset = 0;
+        if(conn->uring_held_head == 0)
+        {
+          conn->uring_held_tail = 0;
+        }
+        conn->uring_held_count--;
+        uring_recycle_buffer(ring, bid);
+      }
+    }
+
+    if(lightning_server_process_requests(server, conn) == -1)
+    {
+      return -1;
+    }
+
+    if(conn->uring_held_head == 0 || conn->read_pos < server->read_buffer_size)
+    {
+      if(conn->uring_held_head == 0)
+      {
+        break;
+      }
+      continue;
+    }
+
+    // read_buffer is full. Waiting on our own responses is fine: the rest
+    // is consumed when the send completes. Otherwise the request is larger
+    // than the buffer.
+    if(conn->write_total > 0 || conn->response_pending || conn->close_after_response)
+    {
+      break;
+    }
+
+    fprintf(stderr, "Read buffer full for fd %d\n", conn->fd);
+    return -1;
+  }
+
+  if(conn->write_total > 0)
+  {
+    if(!conn->uring_sending)
+    {
+      uring_arm_send(worker, conn);
+    }
+  }
+  else if(conn->close_after_response || conn->uring_read_closed)
+  {
+    // The Connection: close response is out, or the peer is done sending
+    // and everything it sent has been answered.
+    return -1;
+  }
+  else
+  {
+    lightning_connection_release_write_buffer(conn, &server->write_pool);
+    conn->state = CONN_STATE_READING_REQUEST;
+  }
+
+  lightning_connection_release_idle_read_buffer(conn, &server->read_pool);
+
+  uring_update_recv(worker, conn);
+  lightning_server_update_timer(server, conn);
+  return 0;
+}
+
+static void uring_close_connection(struct uring_worker *worker, struct lightning_connection *conn)
+{
+  if(conn->uring_closing || conn->state == CONN_STATE_CLOSED)
+  {
+    return;
+  }
+
+  conn->uring_closing = true;
+  lightning_timer_cancel(&worker->server->timers, &conn->timer);
+
+  while(conn->uring_held_head != 0)
+  {
+    uint16_t bid = conn->uring_held_head - 1;
+    conn->uring_held_head = worker->ring.buffer_next[bid];
+    uring_recycle_buffer(&worker->ring, bid);
+  }
+  conn->uring_held_tail = 0;
+  conn->uring_held_count = 0;
+
+  if(conn->uring_inflight == 0)
+  {
+    uring_finish_close(worker, conn);
+    return;
+  }
+
+  // The fd stays open until every operation on it has completed, so its
+  // number can not be reused while stale completions are still coming.
+  shutdown(conn->fd, SHUT_RDWR);
+
+  struct io_uring_sqe *sqe = uring_get_sqe(&worker->ring);
+  if(sqe != NULL)
+  {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = uring_user_data(URING_OP_RECV, conn->fd);
+    sqe->user_data = uring_user_data(URING_OP_CANCEL, conn->fd);
+  }
+}
+
+static void uring_finish_close(struct uring_worker *worker, struct lightning_connection *conn)
+{
+  close(conn->fd);
+  lightning_server_release_connection(worker->server, conn);
+}
+
+static void uring_handle_timeout(struct lightning_timer *timer, void *data)
+{
+  struct uring_worker *worker = data;
+  struct lightning_connection *conn = (struct lightning_connection *)((char *)timer - offsetof(struct lightning_connection, timer));
+
+  if(lightning_server_connection_expired(worker->server, conn))
+  {
+    uring_close_connection(worker, conn);
+  }
+}
@@ -0,0 +1,294 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Request parser expected results, run by `make test`. Every input goes
+ * through parse_driver_run like a connection would feed it, whole and
+ * revealed a few bytes at a time: both must give the same answer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_driver.h"
+
+#define TEST_CAPACITY 4096
+#define TEST_MAX_REQUESTS 8
+
+struct parsed
+{
+  size_t count;
+  enum http_methods methods[TEST_MAX_REQUESTS];
+  char paths[TEST_MAX_REQUESTS][64];
+  uint64_t bodies[TEST_MAX_REQUESTS];
+  size_t hosts[TEST_MAX_REQUESTS];
+};
+
+static int failures;
+
+static void record(const struct lightning_http_request *request,
+                   const char *buffer,
+                   size_t start,
+                   size_t end,
+                   uint64_t body_length,
+                   void *user_data);
+static enum lightning_parse_result parse(const char *input, size_t step, struct parsed *parsed);
+static void expect(const char *name, const char *input, enum lightning_parse_result result, size_t requests);
+static void expect_request(const char *name, const char *input, size_t index, enum http_methods method, const char *path, uint64_t body);
+static void test_split_reads(void);
+static void test_pipelined(void);
+static void test_oversized_headers(void);
+static void test_chunk_sizes(void);
+static void test_framing_conflicts(void);
+
+int main(void)
+{
+  test_split_reads();
+  test_pipelined();
+  test_oversized_headers();
+  test_chunk_sizes();
+  test_framing_conflicts();
+
+  if(failures > 0)
+  {
+    fprintf(stderr, "test_parser: %d failed\n", failures);
+    return 1;
+  }
+
+  printf("test_parser: ok\n");
+  return 0;
+}
+
+static void record(const struct lightning_http_request *request,
+                   const char *buffer,
+                   size_t start,
+                   size_t end,
+                   uint64_t body_length,
+                   void *user_data)
+{
+  (void)start;
+  (void)end;
+  struct parsed *parsed = user_data;
+
+  if(parsed->count == TEST_MAX_REQUESTS)
+  {
+    return;
+  }
+
+  size_t length = request->path.length < 63 ? request->path.length : 63;
+  memcpy(parsed->paths[parsed->count], buffer + request->path.offset, length);
+  parsed->paths[parsed->count][length] = '\0';
+  parsed->methods[parsed->count] = request->method;
+  parsed->bodies[parsed->count] = body_length;
+  parsed->hosts[parsed->count] = request->host.length;
+  parsed->count++;
+}
+
+static enum lightning_parse_result parse(const char *input, size_t step, struct parsed *parsed)
+{
+  size_t length = strlen(input);
+  size_t requests;
+
+  memset(parsed, 0, sizeof(*parsed));
+
+  // Exact size, so a read past the end trips ASan.
+  char *buffer = malloc(length > 0 ? length : 1);
+  if(buffer == NULL)
+  {
+    abort();
+  }
+  memcpy(buffer, input, length);
+
+  enum lightning_parse_result result = parse_driver_run(buffer, length, step, TEST_CAPACITY, record, parsed, &requests);
+  free(buffer);
+
+  if(requests != parsed->count)
+  {
+    fprintf(stderr, "FAIL: callback saw %zu requests, driver counted %zu\n", parsed->count, requests);
+    failures++;
+  }
+  return result;
+}
+
+/*
+ * Whole, then one and seven bytes per read.
+ */
+static void expect(const char *name, const char *input, enum lightning_parse_result result, size_t requests)
+{
+  static const size_t steps[] = {SIZE_MAX, 1, 7};
+
+  for(size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+  {
+    struct parsed parsed;
+    enum lightning_parse_result got = parse(input, steps[i], &parsed);
+
+    if(got != result || parsed.count != requests)
+    {
+      fprintf(stderr, "FAIL: %s (step %zu): result %d with %zu requests, expected %d with %zu\n",
+              name, steps[i] == SIZE_MAX ? 0 : steps[i], got, parsed.count, result, requests);
+      failures++;
+    }
+  }
+}
+
+static void expect_request(const char *name, const char *input, size_t index, enum http_methods method, const char *path, uint64_t body)
+{
+  struct parsed whole;
+  struct parsed split;
+
+  parse(input, SIZE_MAX, &whole);
+  parse(input, 1, &split);
+
+  if(whole.count <= index || whole.methods[index] != method || strcmp(whole.paths[index], path) != 0 ||
+     whole.bodies[index] != body)
+  {
+    fprintf(stderr, "FAIL: %s: request %zu is not %s with a %llu byte body\n", name, index, path, (unsigned long long)body);
+    failures++;
+    return;
+  }
+
+  if(split.count <= index || split.methods[index] != whole.methods[index] ||
+     strcmp(split.paths[index], whole.paths[index]) != 0 || split.bodies[index] != whole.bodies[index] ||
+     split.hosts[index] != whole.hosts[index])
+  {
+    fprintf(stderr, "FAIL: %s: request %zu differs when read one byte at a time\n", name, index);
+    failures++;
+  }
+}
+
+static void test_split_reads(void)
+{
+  static const char get[] = "GET /users/42?x=1 HTTP/1.1\r\nHost: example.com\r\nAccept: */*\r\n\r\n";
+  static const char post[] = "POST /upload HTTP/1.1\r\nHost: a\r\nContent-Length: 11\r\n\r\nhello world";
+  static const char chunked[] = "POST /c HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                "5\r\nhello\r\n6;name=value\r\n world\r\n0\r\nTrailer: x\r\n\r\n";
+  static const char bare_lf[] = "GET /lf HTTP/1.1\nHost: a\n\n";
+
+  expect("split get", get, LIGHTNING_PARSE_COMPLETE, 1);
+  expect_request("split get", get, 0, HTTP_GET, "/users/42", 0);
+  expect("split post", post, LIGHTNING_PARSE_COMPLETE, 1);
+  expect_request("split post", post, 0, HTTP_POST, "/upload", 11);
+  expect("split chunked", chunked, LIGHTNING_PARSE_COMPLETE, 1);
+  expect_request("split chunked", chunked, 0, HTTP_POST, "/c", 11);
+  expect("split bare lf", bare_lf, LIGHTNING_PARSE_COMPLETE, 1);
+
+  expect("headers cut short", "GET / HTTP/1.1\r\nHost: a\r\n", LIGHTNING_PARSE_INCOMPLETE, 0);
+  expect("body cut short", "POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\nabc", LIGHTNING_PARSE_INCOMPLETE, 0);
+  expect("chunk cut short", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nab", LIGHTNING_PARSE_INCOMPLETE, 0);
+}
+
+static void test_pipelined(void)
+{
+  static const char three[] = "GET /a HTTP/1.1\r\nHost: a\r\n\r\n"
+                              "POST /b HTTP/1.1\r\nContent-Length: 3\r\n\r\nxyz"
+                              "GET /c HTTP/1.1\r\n\r\n";
+  static const char with_chunked[] = "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n"
+                                     "GET /b HTTP/1.1\r\n\r\n";
+
+  expect("pipelined", three, LIGHTNING_PARSE_COMPLETE, 3);
+  expect_request("pipelined", three, 0, HTTP_GET, "/a", 0);
+  expect_request("pipelined", three, 1, HTTP_POST, "/b", 3);
+  expect_request("pipelined", three, 2, HTTP_GET, "/c", 0);
+  expect("pipelined after chunked", with_chunked, LIGHTNING_PARSE_COMPLETE, 2);
+  expect_request("pipelined after chunked", with_chunked, 1, HTTP_GET, "/b", 0);
+  expect("pipelined partial", "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\nGET /c HT", LIGHTNING_PARSE_INCOMPLETE, 2);
+  expect("pipelined then garbage", "GET /a HTTP/1.1\r\n\r\nNOT A REQUEST\r\n\r\n", LIGHTNING_PARSE_ERROR, 1);
+}
+
+static void test_oversized_headers(void)
+{
+  char input[16384];
+  size_t used = (size_t)snprintf(input, sizeof(input), "GET / HTTP/1.1\r\n");
+
+  for(int i = 0; i < LIGHTNING_MAX_HEADERS; i++)
+  {
+    used += (size_t)snprintf(input + used, sizeof(input) - used, "X-Header-%d: %d\r\n", i, i);
+  }
+  snprintf(input + used, sizeof(input) - used, "\r\n");
+  expect("header count at the limit", input, LIGHTNING_PARSE_COMPLETE, 1);
+
+  snprintf(input + used, sizeof(input) - used, "X-One-More: 1\r\n\r\n");
+  expect("header count over the limit", input, LIGHTNING_PARSE_ERROR, 0);
+
+  // Long lines are the read buffer's business: the parser takes them whole.
+  used = (size_t)snprintf(input, sizeof(input), "GET / HTTP/1.1\r\nHost: ");
+  memset(input + used, 'h', 8192);
+  used += 8192;
+  snprintf(input + used, sizeof(input) - used, "\r\n\r\n");
+  expect("long header value", input, LIGHTNING_PARSE_COMPLETE, 1);
+
+  struct parsed parsed;
+  parse(input, 7, &parsed);
+  if(parsed.count != 1 || parsed.hosts[0] != 8192)
+  {
+    fprintf(stderr, "FAIL: long header value: Host is not 8192 bytes\n");
+    failures++;
+  }
+
+  expect("header without colon", "GET / HTTP/1.1\r\nNoColon\r\n\r\n", LIGHTNING_PARSE_ERROR, 0);
+}
+
+static void test_chunk_sizes(void)
+{
+  static const char head[] = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  static const char *const bad[] = {
+      "zz\r\nab\r\n0\r\n\r\n",
+      "\r\n0\r\n\r\n",
+      "-1\r\n0\r\n\r\n",
+      "5x\r\nhello\r\n0\r\n\r\n",
+      "10000000000000000\r\n0\r\n\r\n",
+      "3\r\nabcd\r\n0\r\n\r\n",
+  };
+  char input[2048];
+
+  for(size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+  {
+    snprintf(input, sizeof(input), "%s%s", head, bad[i]);
+    expect("bad chunk size", input, LIGHTNING_PARSE_ERROR, 0);
+  }
+
+  // A size line may not go on for LIGHTNING_CHUNK_LINE_MAX bytes.
+  size_t used = (size_t)snprintf(input, sizeof(input), "%s1;", head);
+  memset(input + used, 'e', LIGHTNING_CHUNK_LINE_MAX);
+  used += LIGHTNING_CHUNK_LINE_MAX;
+  snprintf(input + used, sizeof(input) - used, "\r\na\r\n0\r\n\r\n");
+  expect("chunk line too long", input, LIGHTNING_PARSE_ERROR, 0);
+
+  snprintf(input, sizeof(input), "%sA\r\n0123456789\r\n0\r\n\r\n", head);
+  expect("upper case chunk size", input, LIGHTNING_PARSE_COMPLETE, 1);
+  expect_request("upper case chunk size", input, 0, HTTP_POST, "/", 10);
+}
+
+static void test_framing_conflicts(void)
+{
+  expect("zero length and chunked",
+         "POST / HTTP/1.1\r\nContent-Length: 0\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", LIGHTNING_PARSE_ERROR, 0);
+  expect("chunked and length",
+         "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n0\r\n\r\n", LIGHTNING_PARSE_ERROR, 0);
+  expect("two different lengths",
+         "POST / HTTP/1.1\r\nContent-Length: 0\r\nContent-Length: 3\r\n\r\nabc", LIGHTNING_PARSE_ERROR, 0);
+  expect("two transfer encodings",
+         "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", LIGHTNING_PARSE_ERROR, 0);
+  expect("unknown transfer coding", "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", LIGHTNING_PARSE_ERROR, 0);
+  expect("signed length", "POST / HTTP/1.1\r\nContent-Length: +3\r\n\r\nabc", LIGHTNING_PARSE_ERROR, 0);
+  expect("empty length", "POST / HTTP/1.1\r\nContent-Length:\r\n\r\n", LIGHTNING_PARSE_ERROR, 0);
+
+  expect("same length twice", "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc", LIGHTNING_PARSE_COMPLETE, 1);
+  expect("zero length", "POST / HTTP/1.1\r\nContent-Length: 0\r\n\r\n", LIGHTNING_PARSE_COMPLETE, 1);
+}
@@ -0,0 +1,228 @@
+/**
+ * Lightning - Web Framework.
+ * Copyright (C) 2025  Pablo Vitorino Panciera (tstwroot) <tstwroot@protonmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Router expected results, run by `make test`: static, param and wildcard
+ * precedence, falling back between them on a method mismatch, the Allow set
+ * of a 405 and unknown methods.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/router.h"
+
+static int failures;
+
+static void handler(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data);
+static void add(struct lightning_router *router, enum http_methods method, const char *pattern, const char *name);
+static enum lightning_route_result match(const struct lightning_router *router,
+                                         enum http_methods method,
+                                         const char *path,
+                                         struct lightning_http_request *request,
+                                         const char **name,
+                                         unsigned *allowed);
+static void expect_found(const struct lightning_router *router,
+                         enum http_methods method,
+                         const char *path,
+                         const char *name,
+                         const char *param,
+                         const char *value);
+static void expect_result(const struct lightning_router *router,
+                          enum http_methods method,
+                          const char *path,
+                          enum lightning_route_result result,
+                          unsigned allowed);
+
+int main(void)
+{
+  struct lightning_router *router = lightning_router_create();
+  if(router == NULL)
+  {
+    fprintf(stderr, "test_router: can not create the router\n");
+    return 1;
+  }
+
+  add(router, HTTP_GET, "/users/me", "get-me");
+  add(router, HTTP_GET, "/users/:id", "get-user");
+  add(router, HTTP_DELETE, "/users/me", "delete-me");
+  add(router, HTTP_PUT, "/users/:id/avatar", "put-avatar");
+  add(router, HTTP_GET, "/files/:name", "get-file");
+  add(router, HTTP_GET, "/files/*path", "get-path");
+  add(router, HTTP_GET, "/accounts/:id", "get-account");
+  add(router, HTTP_DELETE, "/accounts/me", "delete-account");
+  add(router, HTTP_POST, "/assets/upload", "post-upload");
+  add(router, HTTP_GET, "/assets/*path", "get-asset");
+  add(router, HTTP_HEAD, "/head", "head");
+  add(router, HTTP_GET, "/head", "get-head");
+
+  if(lightning_router_add(router, HTTP_GET, "/users/me", handler, NULL, "again") != -1)
+  {
+    fprintf(stderr, "FAIL: a route registered twice is accepted\n");
+    failures++;
+  }
+
+  if(lightning_router_compile(router) == -1)
+  {
+    fprintf(stderr, "test_router: can not compile the router\n");
+    return 1;
+  }
+
+  // Static before param before wildcard.
+  expect_found(router, HTTP_GET, "/users/me", "get-me", NULL, NULL);
+  expect_found(router, HTTP_GET, "/users/42", "get-user", "id", "42");
+  expect_found(router, HTTP_PUT, "/users/42/avatar", "put-avatar", "id", "42");
+  expect_found(router, HTTP_GET, "/files/a.txt", "get-file", "name", "a.txt");
+  expect_found(router, HTTP_GET, "/files/a/b.txt", "get-path", "path", "a/b.txt");
+
+  // The static node lacks the method: the param, then the wildcard sibling.
+  expect_found(router, HTTP_DELETE, "/users/me", "delete-me", NULL, NULL);
+  expect_found(router, HTTP_GET, "/accounts/me", "get-account", "id", "me");
+  expect_found(router, HTTP_DELETE, "/accounts/me", "delete-account", NULL, NULL);
+  expect_found(router, HTTP_PUT, "/users/me/avatar", "put-avatar", "id", "me");
+  expect_found(router, HTTP_GET, "/assets/upload", "get-asset", "path", "upload");
+  expect_found(router, HTTP_POST, "/assets/upload", "post-upload", NULL, NULL);
+
+  // HEAD falls back to GET, unless it has its own route.
+  expect_found(router, HTTP_HEAD, "/users/42", "get-user", "id", "42");
+  expect_found(router, HTTP_HEAD, "/head", "head", NULL, NULL);
+
+  // 405 carries the methods of every route the path matches.
+  expect_result(router, HTTP_POST, "/users/me", LIGHTNING_ROUTE_METHOD_NOT_ALLOWED,
+                1u << HTTP_GET | 1u << HTTP_HEAD | 1u << HTTP_DELETE);
+  expect_result(router, HTTP_PUT, "/accounts/me", LIGHTNING_ROUTE_METHOD_NOT_ALLOWED,
+                1u << HTTP_GET | 1u << HTTP_HEAD | 1u << HTTP_DELETE);
+  expect_result(router, HTTP_DELETE, "/users/42", LIGHTNING_ROUTE_METHOD_NOT_ALLOWED, 1u << HTTP_GET | 1u << HTTP_HEAD);
+  expect_result(router, HTTP_PUT, "/assets/upload", LIGHTNING_ROUTE_METHOD_NOT_ALLOWED,
+                1u << HTTP_GET | 1u << HTTP_HEAD | 1u << HTTP_POST);
+  expect_result(router, HTTP_GET, "/users/42/avatar", LIGHTNING_ROUTE_METHOD_NOT_ALLOWED, 1u << HTTP_PUT);
+
+  expect_result(router, HTTP_GET, "/nothing", LIGHTNING_ROUTE_NOT_FOUND, 0);
+  expect_result(router, HTTP_GET, "/users/42/other", LIGHTNING_ROUTE_NOT_FOUND, 0);
+  expect_result(router, HTTP_GET, "/users/", LIGHTNING_ROUTE_NOT_FOUND, 0);
+
+  // A method the parser does not know is 501 whatever the path.
+  expect_result(router, HTTP_UNKNOWN, "/users/me", LIGHTNING_ROUTE_NOT_IMPLEMENTED, 0);
+  expect_result(router, HTTP_UNKNOWN, "/nothing", LIGHTNING_ROUTE_NOT_IMPLEMENTED, 0);
+
+  lightning_router_destroy(router);
+
+  if(failures > 0)
+  {
+    fprintf(stderr, "test_router: %d failed\n", failures);
+    return 1;
+  }
+
+  printf("test_router: ok\n");
+  return 0;
+}
+
+static void handler(struct lightning_http_request *request, struct lightning_http_response *response, void *user_data)
+{
+  (void)request;
+  (void)response;
+  (void)user_data;
+}
+
+static void add(struct lightning_router *router, enum http_methods method, const char *pattern, const char *name)
+{
+  if(lightning_router_add(router, method, pattern, handler, NULL, (void *)name) == -1)
+  {
+    fprintf(stderr, "FAIL: can not add %s\n", pattern);
+    failures++;
+  }
+}
+
+static enum lightning_route_result match(const struct lightning_router *router,
+                                         enum http_methods method,
+                                         const char *path,
+                                         struct lightning_http_request *request,
+                                         const char **name,
+                                         unsigned *allowed)
+{
+  const struct lightning_route_target *target = NULL;
+
+  memset(request, 0, sizeof(*request));
+  request->buffer = path;
+  request->method = method;
+  request->path.offset = 0;
+  request->path.length = strlen(path);
+
+  *allowed = 0;
+  enum lightning_route_result result = lightning_router_match(router, request, &target, allowed);
+  *name = result == LIGHTNING_ROUTE_FOUND ? target->user_data : NULL;
+  return result;
+}
+
+static void expect_found(const struct lightning_router *router,
+                         enum http_methods method,
+                         const char *path,
+                         const char *name,
+                         const char *param,
+                         const char *value)
+{
+  struct lightning_http_request request;
+  const char *found;
+  unsigned allowed;
+
+  if(match(router, method, path, &request, &found, &allowed) != LIGHTNING_ROUTE_FOUND || strcmp(found, name) != 0)
+  {
+    fprintf(stderr, "FAIL: %s %s does not reach %s\n", lightning_method_name(method), path, name);
+    failures++;
+    return;
+  }
+
+  if(param == NULL)
+  {
+    if(request.params_count != 0)
+    {
+      fprintf(stderr, "FAIL: %s %s captured %zu parameters\n", lightning_method_name(method), path, request.params_count);
+      failures++;
+    }
+    return;
+  }
+
+  const struct lightning_http_param *captured = &request.params[0];
+  if(request.params_count != 1 || captured->name_length != strlen(param) ||
+     memcmp(captured->name, param, captured->name_length) != 0 || captured->value.length != strlen(value) ||
+     memcmp(path + captured->value.offset, value, captured->value.length) != 0)
+  {
+    fprintf(stderr, "FAIL: %s %s does not capture %s=%s\n", lightning_method_name(method), path, param, value);
+    failures++;
+  }
+}
+
+static void expect_result(const struct lightning_router *router,
+                          enum http_methods method,
+                          const char *path,
+                          enum lightning_route_result result,
+                          unsigned allowed)
+{
+  struct lightning_http_request request;
+  const char *found;
+  unsigned got_allowed;
+  enum lightning_route_result got = match(router, method, path, &request, &found, &got_allowed);
+
+  if(got != result || (result == LIGHTNING_ROUTE_METHOD_NOT_ALLOWED && got_allowed != allowed))
+  {
+    fprintf(stderr, "FAIL: %s %s: result %d allowed %#x, expected %d allowed %#x\n",
+            lightning_method_name(method), path, got, got_allowed, result, allowed);
+    failures++;
+  }
+}